@@ -0,0 +1,66 @@
+// Includes
+#include "CAccessUnitAssembler.h"
+#include "H264.h"
+
+CAccessUnitAssembler::CAccessUnitAssembler()
+	: m_callbacks( 0 )
+	, m_accessUnits( 0 )
+{
+}
+
+CAccessUnitAssembler::~CAccessUnitAssembler()
+{
+}
+
+void CAccessUnitAssembler::Reset()
+{
+	m_hasVcl = true;
+}
+
+bool CAccessUnitAssembler::StartsAccessUnit( const uint8_t *dataIn, size_t sizeIn )
+{
+	const uint8_t *end 		= dataIn + sizeIn;
+	const uint8_t *cursor 	= dataIn;
+	h264::TNalUnit nal;
+	bool startsAccessUnit 	= false;
+	
+	m_callbacks++;
+	
+	while( h264::NextNalUnit( cursor, end, nal ) )
+	{
+		if( nal.m_size == 0 )
+		{
+			continue;
+		}
+		
+		uint8_t type = nal.GetType();
+		
+		if( nal.IsVCL() )
+		{
+			// The first slice of the next picture, with no AUD or parameter sets ahead of it
+			if( m_hasVcl && h264::IsFirstSliceOfPicture( nal ) )
+			{
+				startsAccessUnit = true;
+			}
+			
+			m_hasVcl = true;
+		}
+		else if( type == h264::NAL_AUD || type == h264::NAL_SEI || type == h264::NAL_SPS || type == h264::NAL_PPS || ( type >= 14 && type <= 18 ) )
+		{
+			// These can only come ahead of the first slice of an access unit (7.4.1.2.3)
+			if( m_hasVcl )
+			{
+				startsAccessUnit = true;
+			}
+			
+			m_hasVcl = false;
+		}
+	}
+	
+	if( startsAccessUnit )
+	{
+		m_accessUnits++;
+	}
+	
+	return startsAccessUnit;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+// Tracks access unit boundaries across video callbacks. With maxnal set the camera delivers a frame as several NALs,
+// one per callback, and only the callback that starts a new access unit should count as a frame and wake the muxer.
+// Waking it there costs no latency: the H264 parser can't finish a frame before the next one starts anyway.
+// Only used from the video callback thread, apart from the counters.
+class CAccessUnitAssembler
+{
+public:
+	// Attributes
+	std::atomic<uint64_t> 		m_callbacks;
+	std::atomic<uint64_t> 		m_accessUnits;
+	
+	// Methods
+	CAccessUnitAssembler();
+	virtual ~CAccessUnitAssembler();
+	
+	// True if the buffer contains the first NAL of a new access unit
+	bool StartsAccessUnit( const uint8_t *dataIn, size_t sizeIn );
+	
+	// Call when the stream restarts, so the next buffer starts a new access unit
+	void Reset();
+
+private:
+	// Attributes
+	bool 						m_hasVcl		= true;		// The current access unit has a slice already
+};
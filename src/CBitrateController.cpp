@@ -0,0 +1,139 @@
+// Includes
+#include "CBitrateController.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	// Counters restart when the muxer does. A counter going backwards is not a loss.
+	uint64_t Delta( uint64_t currentIn, uint64_t lastIn )
+	{
+		return ( currentIn > lastIn ) ? ( currentIn - lastIn ) : 0;
+	}
+}
+
+CBitrateController::CBitrateController( const TBitrateControlConfig &configIn, uint32_t bitrate_bpsIn, uint32_t framerateIn )
+	: m_config( configIn )
+	, m_bitrate_bps( std::min( std::max( bitrate_bpsIn, configIn.m_minBitrate_bps ), configIn.m_maxBitrate_bps ) )
+	, m_framerate( framerateIn )
+	, m_maxFramerate( framerateIn )
+	, m_lastChange( TClock::now() )
+	, m_lastCongestion( TClock::now() )
+{
+	if( m_config.m_minBitrate_bps == 0 || m_config.m_minBitrate_bps > m_config.m_maxBitrate_bps )
+	{
+		throw std::runtime_error( "Bitrate bounds must be non-zero, minimum first" );
+	}
+	
+	if( m_config.m_lowBufferFill > m_config.m_highBufferFill || m_config.m_lowLatency_us > m_config.m_highLatency_us )
+	{
+		throw std::runtime_error( "Low congestion marks must not be above the high ones" );
+	}
+}
+
+bool CBitrateController::Update( const TCongestionSignals &signalsIn, TClock::time_point nowIn )
+{
+	if( !m_hasSignals )
+	{
+		// Nothing to take deltas from yet
+		m_lastSignals 	= signalsIn;
+		m_hasSignals 	= true;
+		return false;
+	}
+	
+	bool isLosing = ( Delta( signalsIn.m_framesFailed, m_lastSignals.m_framesFailed ) != 0 )
+					|| ( Delta( signalsIn.m_framesDropped, m_lastSignals.m_framesDropped ) != 0 )
+					|| ( Delta( signalsIn.m_deliveryDrops, m_lastSignals.m_deliveryDrops ) != 0 );
+	
+	bool isBackedUp = ( signalsIn.m_bufferFill > m_config.m_highBufferFill ) || ( signalsIn.m_latency_us > m_config.m_highLatency_us );
+	bool isDrained 	= ( signalsIn.m_bufferFill < m_config.m_lowBufferFill ) && ( signalsIn.m_latency_us < m_config.m_lowLatency_us );
+	
+	m_lastSignals 		= signalsIn;
+	m_congestedSamples 	= isBackedUp ? ( m_congestedSamples + 1 ) : 0;
+	
+	// A single full sample may just be an IDR passing through. Losses are never noise.
+	if( isLosing || m_congestedSamples >= k_congestedSamples )
+	{
+		m_state 			= ECongestionState::CONGESTED;
+		m_lastCongestion 	= nowIn;
+		
+		// Give the last change time to show up in the signals before backing off further
+		if( nowIn - m_lastChange >= k_decreaseInterval && Decrease() )
+		{
+			m_lastChange = nowIn;
+			return true;
+		}
+		
+		return false;
+	}
+	
+	if( !isDrained )
+	{
+		m_state = ECongestionState::HOLDING;
+		return false;
+	}
+	
+	m_state = ECongestionState::CLEAR;
+	
+	if( nowIn - m_lastCongestion >= k_recoveryDelay && nowIn - m_lastChange >= k_increaseInterval && Increase() )
+	{
+		m_lastChange = nowIn;
+		return true;
+	}
+	
+	return false;
+}
+
+bool CBitrateController::Decrease()
+{
+	if( m_bitrate_bps > m_config.m_minBitrate_bps )
+	{
+		m_bitrate_bps = std::max( m_config.m_minBitrate_bps, (uint32_t)( m_bitrate_bps * k_decreaseFactor ) );
+		m_decreases++;
+		return true;
+	}
+	
+	if( m_config.m_minFramerate != 0 && m_framerate > m_config.m_minFramerate )
+	{
+		m_framerate = std::max( m_config.m_minFramerate, m_framerate * 2 / 3 );
+		m_decreases++;
+		return true;
+	}
+	
+	return false;
+}
+
+bool CBitrateController::Increase()
+{
+	// Smooth motion back before picture quality
+	if( m_framerate < m_maxFramerate )
+	{
+		m_framerate = std::min( m_maxFramerate, m_framerate + std::max( 1u, m_maxFramerate / 4 ) );
+		m_increases++;
+		return true;
+	}
+	
+	if( m_bitrate_bps < m_config.m_maxBitrate_bps )
+	{
+		uint32_t step = std::max( 1u, ( m_config.m_maxBitrate_bps - m_config.m_minBitrate_bps ) / k_increaseSteps );
+		
+		m_bitrate_bps = std::min( m_config.m_maxBitrate_bps, m_bitrate_bps + step );
+		m_increases++;
+		return true;
+	}
+	
+	return false;
+}
+
+const char* CBitrateController::ToString( ECongestionState stateIn )
+{
+	switch( stateIn )
+	{
+		case ECongestionState::CLEAR: 		return "clear";
+		case ECongestionState::HOLDING: 	return "holding";
+		case ECongestionState::CONGESTED: 	return "congested";
+	}
+	
+	return "unknown";
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <chrono>
+
+struct TBitrateControlConfig
+{
+	uint32_t 		m_minBitrate_bps		= 500000;
+	uint32_t 		m_maxBitrate_bps		= 8000000;
+	uint32_t 		m_minFramerate			= 0;			// Framerate is only lowered once the bitrate is at its floor. 0 never touches it.
+	
+	// Occupancy bands. Above the high marks is congestion, below the low marks is clear, in between holds.
+	float 			m_highBufferFill		= 0.25f;		// Of the muxer's input buffer
+	float 			m_lowBufferFill			= 0.05f;
+	uint32_t 		m_highLatency_us		= 150000;		// Capture to muxer output
+	uint32_t 		m_lowLatency_us			= 50000;
+};
+
+// One sample of a channel's congestion signals. The counters are cumulative, the controller works on their deltas.
+struct TCongestionSignals
+{
+	float 			m_bufferFill			= 0.0f;
+	uint32_t 		m_latency_us			= 0;
+	uint64_t 		m_framesFailed			= 0;			// WritePacket couldn't hand the frame to ZMQ
+	uint64_t 		m_framesDropped			= 0;			// Never got through the muxer at all (buffer overflow included)
+	uint64_t 		m_deliveryDrops			= 0;			// Dropped by outputs for backed up subscribers, not while they wait to start
+};
+
+enum class ECongestionState
+{
+	CLEAR,
+	HOLDING,
+	CONGESTED
+};
+
+// Closed-loop bitrate control for one channel. Any loss backs the bitrate off multiplicatively at once, occupancy above the
+// high marks does so once it persists for k_congestedSamples. Only after k_recoveryDelay without congestion does it creep
+// back up, additively. Changes are rate limited, since the camera takes a while to settle on a new bitrate and the signals
+// lag behind it. With the bitrate at its floor and a minimum framerate configured, framerate is traded away next, and is
+// the first thing given back.
+//
+// Not thread safe: driven from the channel's owner thread.
+class CBitrateController
+{
+public:
+	typedef std::chrono::steady_clock TClock;
+	
+	// Attributes
+	uint64_t 			m_decreases		= 0;
+	uint64_t 			m_increases		= 0;
+	
+	// Methods
+	// Starts from the camera's current settings. Its framerate is also the ceiling for the framerate given back.
+	CBitrateController( const TBitrateControlConfig &configIn, uint32_t bitrate_bpsIn, uint32_t framerateIn );
+	
+	// Call a few times a second. True if the bitrate or framerate changed and should be applied to the camera.
+	bool Update( const TCongestionSignals &signalsIn, TClock::time_point nowIn );
+	
+	uint32_t GetBitrate() const { return m_bitrate_bps; }
+	uint32_t GetFramerate() const { return m_framerate; }
+	ECongestionState GetState() const { return m_state; }
+	
+	static const char* ToString( ECongestionState stateIn );
+
+private:
+	// Attributes
+	TBitrateControlConfig 	m_config;
+	uint32_t 				m_bitrate_bps;
+	uint32_t 				m_framerate;
+	uint32_t 				m_maxFramerate;
+	
+	ECongestionState 		m_state				= ECongestionState::HOLDING;
+	TCongestionSignals 		m_lastSignals;
+	bool 					m_hasSignals		= false;
+	uint32_t 				m_congestedSamples	= 0;
+	
+	TClock::time_point 		m_lastChange;
+	TClock::time_point 		m_lastCongestion;
+	
+	const uint32_t 					k_congestedSamples		= 2;
+	const float 					k_decreaseFactor		= 0.7f;
+	const uint32_t 					k_increaseSteps			= 20;			// Additive step is 1/20th of the range
+	const std::chrono::seconds 		k_decreaseInterval		= std::chrono::seconds( 1 );
+	const std::chrono::seconds 		k_increaseInterval		= std::chrono::seconds( 4 );
+	const std::chrono::seconds 		k_recoveryDelay			= std::chrono::seconds( 10 );
+	
+	// Methods
+	bool Decrease();
+	bool Increase();
+};
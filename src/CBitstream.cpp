@@ -0,0 +1,123 @@
+// Includes
+#include "CBitstream.h"
+
+#include <stdexcept>
+
+CBitReader::CBitReader( const uint8_t *dataIn, size_t sizeIn )
+	: m_pData( dataIn )
+	, m_sizeBits( sizeIn * 8 )
+{
+}
+
+uint32_t CBitReader::ReadBit()
+{
+	if( m_position >= m_sizeBits )
+	{
+		throw std::runtime_error( "Bitstream overrun" );
+	}
+	
+	uint32_t bit = ( m_pData[ m_position >> 3 ] >> ( 7 - ( m_position & 7 ) ) ) & 1;
+	m_position++;
+	
+	return bit;
+}
+
+uint32_t CBitReader::ReadBits( uint32_t countIn )
+{
+	uint32_t value = 0;
+	
+	for( uint32_t i = 0; i < countIn; ++i )
+	{
+		value = ( value << 1 ) | ReadBit();
+	}
+	
+	return value;
+}
+
+uint32_t CBitReader::ReadUE()
+{
+	uint32_t leadingZeros = 0;
+	
+	while( ReadBit() == 0 )
+	{
+		if( ++leadingZeros > 31 )
+		{
+			throw std::runtime_error( "Invalid exp-Golomb code" );
+		}
+	}
+	
+	return (uint32_t)( ( 1ull << leadingZeros ) - 1 + ReadBits( leadingZeros ) );
+}
+
+int32_t CBitReader::ReadSE()
+{
+	uint32_t codeNum = ReadUE();
+	
+	// 1, 2, 3, 4... maps to 1, -1, 2, -2...
+	return ( codeNum & 1 ) ? (int32_t)( ( codeNum + 1 ) / 2 ) : -(int32_t)( codeNum / 2 );
+}
+
+size_t CBitReader::GetBitsLeft() const
+{
+	return m_sizeBits - m_position;
+}
+
+CBitWriter::CBitWriter( std::vector<uint8_t> &dataOut )
+	: m_data( dataOut )
+{
+}
+
+void CBitWriter::WriteBit( uint32_t bitIn )
+{
+	if( m_bitsInLastByte == 8 )
+	{
+		m_data.push_back( 0 );
+		m_bitsInLastByte = 0;
+	}
+	
+	if( bitIn )
+	{
+		m_data.back() |= ( 0x80 >> m_bitsInLastByte );
+	}
+	
+	m_bitsInLastByte++;
+}
+
+void CBitWriter::WriteBits( uint32_t valueIn, uint32_t countIn )
+{
+	for( uint32_t i = countIn; i > 0; --i )
+	{
+		WriteBit( ( valueIn >> ( i - 1 ) ) & 1 );
+	}
+}
+
+void CBitWriter::WriteUE( uint32_t valueIn )
+{
+	uint64_t codeNum 	= (uint64_t)valueIn + 1;
+	uint32_t bits 		= 0;
+	
+	while( ( codeNum >> bits ) > 1 )
+	{
+		bits++;
+	}
+	
+	// bits zeros, then codeNum in bits + 1 bits
+	WriteBits( 0, bits );
+	WriteBit( 1 );
+	WriteBits( (uint32_t)codeNum, bits );
+}
+
+void CBitWriter::WriteSE( int32_t valueIn )
+{
+	WriteUE( ( valueIn > 0 ) ? (uint32_t)( 2 * (int64_t)valueIn - 1 ) : (uint32_t)( -2 * (int64_t)valueIn ) );
+}
+
+void CBitWriter::WriteTrailingBits()
+{
+	WriteBit( 1 );
+	
+	while( m_bitsInLastByte != 8 )
+	{
+		WriteBit( 0 );
+	}
+}
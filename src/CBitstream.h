@@ -0,0 +1,49 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// MSB-first bit reader over RBSP data (emulation prevention bytes already removed).
+// Reading past the end throws std::runtime_error.
+class CBitReader
+{
+public:
+	// Methods
+	CBitReader( const uint8_t *dataIn, size_t sizeIn );
+	
+	uint32_t ReadBit();
+	uint32_t ReadBits( uint32_t countIn );		// Up to 32 bits
+	uint32_t ReadUE();							// Unsigned exp-Golomb
+	int32_t ReadSE();							// Signed exp-Golomb
+	
+	size_t GetBitsLeft() const;
+
+private:
+	// Attributes
+	const uint8_t 		*m_pData;
+	size_t 				m_sizeBits;
+	size_t 				m_position		= 0;
+};
+
+// MSB-first bit writer producing RBSP data. Escape the result before putting it in a NAL.
+class CBitWriter
+{
+public:
+	// Methods
+	CBitWriter( std::vector<uint8_t> &dataOut );
+	
+	void WriteBit( uint32_t bitIn );
+	void WriteBits( uint32_t valueIn, uint32_t countIn );	// Up to 32 bits
+	void WriteUE( uint32_t valueIn );
+	void WriteSE( int32_t valueIn );
+	
+	// rbsp_trailing_bits: a stop bit, then zeros to the next byte boundary
+	void WriteTrailingBits();
+
+private:
+	// Attributes
+	std::vector<uint8_t> 	&m_data;
+	uint32_t 				m_bitsInLastByte	= 8;
+};
@@ -0,0 +1,175 @@
+// Includes
+#include "CBitstreamAnalyzer.h"
+#include "CBitstream.h"
+
+#include <algorithm>
+#include <exception>
+
+CBitstreamAnalyzer::CBitstreamAnalyzer()
+	: m_nalsChecked( 0 )
+	, m_framingErrors( 0 )
+	, m_forbiddenBitErrors( 0 )
+	, m_sliceHeaderErrors( 0 )
+	, m_frameNumGaps( 0 )
+	, m_keyframesRequested( 0 )
+{
+}
+
+CBitstreamAnalyzer::~CBitstreamAnalyzer()
+{
+}
+
+bool CBitstreamAnalyzer::Analyze( const uint8_t *dataIn, size_t sizeIn )
+{
+	bool isCorrupt = false;
+	
+	// Every callback buffer should start exactly on a 3 or 4 byte start code
+	const uint8_t *startCode = h264::FindStartCode( dataIn, dataIn + std::min<size_t>( sizeIn, 4 ) );
+	
+	if( startCode != dataIn && !( startCode == dataIn + 1 && dataIn[ 0 ] == 0 ) )
+	{
+		m_framingErrors++;
+		isCorrupt = true;
+	}
+	
+	const uint8_t *end 		= dataIn + sizeIn;
+	const uint8_t *cursor 	= dataIn;
+	h264::TNalUnit nal;
+	
+	while( h264::NextNalUnit( cursor, end, nal ) )
+	{
+		m_nalsChecked++;
+		
+		if( nal.m_size == 0 )
+		{
+			m_framingErrors++;
+			isCorrupt = true;
+			continue;
+		}
+		
+		if( nal.m_pData[ 0 ] & 0x80 )
+		{
+			m_forbiddenBitErrors++;
+			isCorrupt = true;
+			continue;
+		}
+		
+		if( nal.GetType() == h264::NAL_SPS )
+		{
+			m_hasSps = h264::ParseSps( nal.m_pData, nal.m_size, m_sps );
+			
+			if( !m_hasSps )
+			{
+				m_sliceHeaderErrors++;
+				isCorrupt = true;
+			}
+		}
+		else if( nal.IsVCL() )
+		{
+			if( !CheckSlice( nal ) )
+			{
+				isCorrupt = true;
+			}
+		}
+	}
+	
+	if( !isCorrupt )
+	{
+		return false;
+	}
+	
+	auto now = std::chrono::steady_clock::now();
+	
+	if( now - m_lastKeyframeRequest < k_minRequestInterval )
+	{
+		return false;
+	}
+	
+	m_lastKeyframeRequest = now;
+	m_keyframesRequested++;
+	
+	// Pick up frame_num tracking again from the next reference picture
+	m_prevRefFrameNum = -1;
+	
+	return true;
+}
+
+bool CBitstreamAnalyzer::CheckSlice( const h264::TNalUnit &nalIn )
+{
+	// Types 2-4 are data partitions, which the camera doesn't produce
+	if( !m_hasSps || ( nalIn.GetType() != h264::NAL_SLICE && nalIn.GetType() != h264::NAL_IDR_SLICE ) )
+	{
+		return true;
+	}
+	
+	// The fields we need are all in the first few bytes of the header
+	h264::RemoveEmulationPrevention( nalIn.m_pData + 1, std::min( nalIn.m_size - 1, k_maxSliceHeaderBytes ), m_sliceHeader );
+	
+	uint32_t firstMb 	= 0;
+	uint32_t sliceType 	= 0;
+	uint32_t ppsId 		= 0;
+	uint32_t frameNum 	= 0;
+	
+	try
+	{
+		CBitReader reader( m_sliceHeader.data(), m_sliceHeader.size() );
+		
+		firstMb 	= reader.ReadUE();
+		sliceType 	= reader.ReadUE();
+		ppsId 		= reader.ReadUE();
+		
+		if( m_sps.m_separateColourPlane )
+		{
+			// colour_plane_id
+			reader.ReadBits( 2 );
+		}
+		
+		frameNum = reader.ReadBits( m_sps.m_log2MaxFrameNum );
+	}
+	catch( const std::exception &e )
+	{
+		m_sliceHeaderErrors++;
+		return false;
+	}
+	
+	bool isHeaderValid = ( firstMb < m_sps.GetPicSizeInMbs() && sliceType <= 9 && ppsId <= 255 );
+	
+	if( nalIn.GetType() == h264::NAL_IDR_SLICE )
+	{
+		// IDRs are I or SI slices (slice_type 2, 4, 7 or 9) with frame_num 0
+		isHeaderValid = isHeaderValid && ( frameNum == 0 ) && ( sliceType % 5 == 2 || sliceType % 5 == 4 );
+	}
+	
+	if( !isHeaderValid )
+	{
+		m_sliceHeaderErrors++;
+		return false;
+	}
+	
+	// frame_num only moves at the first slice of a picture
+	if( firstMb != 0 )
+	{
+		return true;
+	}
+	
+	bool isValid = true;
+	
+	if( nalIn.GetType() != h264::NAL_IDR_SLICE && m_prevRefFrameNum >= 0 && !m_sps.m_gapsInFrameNumAllowed )
+	{
+		// Pictures after a reference picture carry its frame_num + 1 (or the same, for a second field or non-reference picture)
+		uint32_t maxFrameNum = 1u << m_sps.m_log2MaxFrameNum;
+		
+		if( frameNum != (uint32_t)m_prevRefFrameNum && frameNum != ( (uint32_t)m_prevRefFrameNum + 1 ) % maxFrameNum )
+		{
+			m_frameNumGaps++;
+			isValid = false;
+		}
+	}
+	
+	if( nalIn.GetRefIdc() != 0 )
+	{
+		m_prevRefFrameNum = frameNum;
+	}
+	
+	return isValid;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+#include "H264.h"
+
+// Cheap per-NAL sanity checks on the camera's H264 output, looking for damage from USB transfer errors.
+// Only NAL headers, SPS and slice headers are parsed. Only used from the video callback thread, apart from the counters.
+class CBitstreamAnalyzer
+{
+public:
+	// Attributes
+	std::atomic<uint64_t> 		m_nalsChecked;
+	std::atomic<uint64_t> 		m_framingErrors;			// Buffer not starting with a start code, or empty NALs
+	std::atomic<uint64_t> 		m_forbiddenBitErrors;
+	std::atomic<uint64_t> 		m_sliceHeaderErrors;
+	std::atomic<uint64_t> 		m_frameNumGaps;
+	std::atomic<uint64_t> 		m_keyframesRequested;
+	
+	// Methods
+	CBitstreamAnalyzer();
+	virtual ~CBitstreamAnalyzer();
+	
+	// Returns true if the buffer looks corrupt and it has been long enough since the last keyframe request to make another
+	bool Analyze( const uint8_t *dataIn, size_t sizeIn );
+
+private:
+	// Attributes
+	h264::TSpsInfo 				m_sps;
+	bool 						m_hasSps				= false;
+	
+	// frame_num of the last reference picture, -1 until an IDR has been seen
+	int64_t 					m_prevRefFrameNum		= -1;
+	
+	std::vector<uint8_t> 		m_sliceHeader;
+	
+	std::chrono::steady_clock::time_point 	m_lastKeyframeRequest;
+	
+	const size_t 								k_maxSliceHeaderBytes	= 32;
+	const std::chrono::milliseconds 			k_minRequestInterval	= std::chrono::milliseconds( 1000 );
+	
+	// Methods
+	bool CheckSlice( const h264::TNalUnit &nalIn );
+};
@@ -1,69 +1,199 @@
 #include "CCameraRegistrar.h"
 
+#include <algorithm>
+
 using namespace std;
 using namespace CpperoMQ;
 
 using json = nlohmann::json;
 
+namespace
+{
+	const char *k_registrationEndpoint = "ipc:///tmp/geomux_registration.ipc";
+}
+
 CCameraRegistrar::CCameraRegistrar( CpperoMQ::Context *contextIn )
 	: m_pContext( contextIn )
 	, m_req( m_pContext->createRequestSocket() )
+	, m_killThread( false )
 {
-	m_req.connect( "ipc:///tmp/geomux_registration.ipc" );
+	// Don't let unanswered requests hold up context termination
+	m_req.setLinger( 0 );
+	m_req.connect( k_registrationEndpoint );
+	
+	// Start the registration thread. The socket is only used from this thread from now on.
+	m_thread = std::thread( &CCameraRegistrar::ThreadLoop, this );
 }
 
 CCameraRegistrar::~CCameraRegistrar()
-{ 
-}
-
-bool CCameraRegistrar::SendRequest( const nlohmann::json &requestIn )
 {
-	// Send a registration request
-	m_req.send( OutgoingMessage( requestIn.dump().c_str() ) );
-
-	IncomingMessage reply;
-	
-	// Wait for reply (blocks)
-	m_req.receive( reply );
-	
-	// Parse reply
-	json response = json::parse( string( reply.charData(), reply.size() ) );
-	
-	if( response[ "response" ] != 1 )
 	{
-		return false;
+		// Under the lock, or the thread could check its predicate just before this and then miss the notify
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_killThread = true;
 	}
 	
-	return true;
+	try
+	{
+		// Wake the thread so it can make a final attempt at any pending requests and exit
+		m_requestCondition.notify_one();
+		m_thread.join();
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error cleaning up CCameraRegistrar: " << e.what() << endl;
+	}
 }
 
-bool CCameraRegistrar::RegisterCamera( const std::string &cameraNameIn )
+void CCameraRegistrar::RegisterCamera( const std::string &cameraNameIn, TRegistrationCallback callbackIn )
 {
-	json reg = 	{ 
+	json reg = 	{
 					{ "type", "camera_registration" },
-					{ "camera", cameraNameIn } 
+					{ "camera", cameraNameIn }
 				};
 	
-	return SendRequest( reg );
+	QueueRequest( reg, callbackIn );
 }
 
-bool CCameraRegistrar::RegisterChannel( const std::string &cameraNameIn, uint32_t channelNumIn )
+void CCameraRegistrar::RegisterChannel( const std::string &cameraNameIn, uint32_t channelNumIn, TRegistrationCallback callbackIn )
 {
-	json reg = 	{ 
+	json reg = 	{
 					{ "type", "channel_registration" },
 					{ "camera", cameraNameIn },
 					{ "channel", channelNumIn }
 				};
 	
-	return SendRequest( reg );
+	QueueRequest( reg, callbackIn );
 }
 
-bool CCameraRegistrar::UnregisterCamera( const std::string &cameraNameIn )
+void CCameraRegistrar::UnregisterCamera( const std::string &cameraNameIn )
 {
-	json unreg = 	{ 
+	json unreg = 	{
 						{ "type", "camera_unregistration" },
 						{ "camera", cameraNameIn }
 					};
 	
-	return SendRequest( unreg );
-}
\ No newline at end of file
+	QueueRequest( unreg, nullptr );
+}
+
+void CCameraRegistrar::QueueRequest( const nlohmann::json &requestIn, TRegistrationCallback callbackIn )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_requests.push_back( TRegistrationRequest{ requestIn, callbackIn } );
+	}
+	
+	m_requestCondition.notify_one();
+}
+
+void CCameraRegistrar::ThreadLoop()
+{
+	std::chrono::milliseconds retryDelay = k_minRetryDelay;
+	
+	while( true )
+	{
+		TRegistrationRequest request;
+		
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			
+			// Wait for work
+			m_requestCondition.wait( lock, [this](){ return m_killThread || !m_requests.empty(); } );
+			
+			if( m_requests.empty() )
+			{
+				// Killed with nothing left to send
+				return;
+			}
+			
+			request = m_requests.front();
+		}
+		
+		ERegistrationResult result = SendRequest( request.m_request, ( m_killThread ? k_shutdownTimeout : k_replyTimeout ) );
+		
+		if( result == ERegistrationResult::TIMED_OUT && !m_killThread )
+		{
+			cerr << "No reply from registration server. Retrying in " << retryDelay.count() << "ms" << endl;
+			
+			// Back off before retrying the same request. Shutdown cuts the wait short.
+			{
+				std::unique_lock<std::mutex> lock( m_mutex );
+				m_requestCondition.wait_for( lock, retryDelay, [this](){ return (bool)m_killThread; } );
+			}
+			
+			retryDelay = std::min( retryDelay * 2, k_maxRetryDelay );
+			continue;
+		}
+		
+		// Request completed (or was abandoned during shutdown)
+		retryDelay = k_minRetryDelay;
+		
+		{
+			std::lock_guard<std::mutex> lock( m_mutex );
+			m_requests.pop_front();
+		}
+		
+		if( request.m_callback )
+		{
+			try
+			{
+				request.m_callback( result == ERegistrationResult::ACCEPTED );
+			}
+			catch( const std::exception &e )
+			{
+				cerr << "Error in registration callback: " << e.what() << endl;
+			}
+		}
+	}
+}
+
+void CCameraRegistrar::ResetSocket()
+{
+	// A REQ socket that never got its reply is stuck in the send state, so replace it (lazy pirate pattern)
+	m_req = m_pContext->createRequestSocket();
+	m_req.setLinger( 0 );
+	m_req.connect( k_registrationEndpoint );
+}
+
+ERegistrationResult CCameraRegistrar::SendRequest( const nlohmann::json &requestIn, std::chrono::milliseconds timeoutIn )
+{
+	try
+	{
+		// Send a registration request
+		if( !m_req.send( OutgoingMessage( requestIn.dump().c_str() ) ) )
+		{
+			ResetSocket();
+			return ERegistrationResult::TIMED_OUT;
+		}
+		
+		// Wait for reply, up to the deadline
+		zmq_pollitem_t items[] = { { static_cast<void*>( m_req ), 0, ZMQ_POLLIN, 0 } };
+		
+		if( zmq_poll( items, 1, timeoutIn.count() ) <= 0 || !( items[ 0 ].revents & ZMQ_POLLIN ) )
+		{
+			ResetSocket();
+			return ERegistrationResult::TIMED_OUT;
+		}
+		
+		IncomingMessage reply;
+		m_req.receive( reply );
+		
+		// Parse reply
+		json response = json::parse( string( reply.charData(), reply.size() ) );
+		
+		if( response[ "response" ] != 1 )
+		{
+			return ERegistrationResult::DENIED;
+		}
+		
+		return ERegistrationResult::ACCEPTED;
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error sending registration request: " << e.what() << endl;
+		
+		// Start from a clean socket for the next request
+		ResetSocket();
+		return ERegistrationResult::DENIED;
+	}
+}
@@ -4,6 +4,30 @@
 #include <CpperoMQ/All.hpp>
 #include <json.hpp>
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+
+// Typedefs
+typedef std::function<void( bool acceptedIn )> TRegistrationCallback;
+
+enum class ERegistrationResult
+{
+	ACCEPTED,
+	DENIED,
+	TIMED_OUT
+};
+
+struct TRegistrationRequest
+{
+	nlohmann::json 			m_request;
+	TRegistrationCallback 	m_callback;
+};
+
 class CCameraRegistrar
 {
 public:
@@ -11,15 +35,33 @@ public:
 	CCameraRegistrar( CpperoMQ::Context *contextIn );
 	virtual ~CCameraRegistrar();
 	
-	bool RegisterCamera( const std::string &cameraNameIn );
-	bool RegisterChannel( const std::string &cameraNameIn, uint32_t channelNumIn );
-	
-	bool UnregisterCamera( const std::string &cameraNameIn );
+	// Requests are queued and sent from the registrar thread, so these never block the caller.
+	// Callbacks are invoked from the registrar thread once cockpit replies (or the request is abandoned at shutdown).
+	void RegisterCamera( const std::string &cameraNameIn, TRegistrationCallback callbackIn = nullptr );
+	void RegisterChannel( const std::string &cameraNameIn, uint32_t channelNumIn, TRegistrationCallback callbackIn = nullptr );
 	
+	void UnregisterCamera( const std::string &cameraNameIn );
+
 private:
-	// Attributes	
-	CpperoMQ::Context 			*m_pContext;
-	CpperoMQ::RequestSocket 	m_req;
+	// Attributes
+	CpperoMQ::Context 					*m_pContext;
+	CpperoMQ::RequestSocket 			m_req;
+	
+	std::thread 						m_thread;
+	std::mutex 							m_mutex;
+	std::condition_variable 			m_requestCondition;
+	std::deque<TRegistrationRequest> 	m_requests;
+	std::atomic<bool> 					m_killThread;
+	
+	const std::chrono::milliseconds 	k_replyTimeout		= std::chrono::milliseconds( 2500 );
+	const std::chrono::milliseconds 	k_shutdownTimeout	= std::chrono::milliseconds( 500 );
+	const std::chrono::milliseconds 	k_minRetryDelay		= std::chrono::milliseconds( 250 );
+	const std::chrono::milliseconds 	k_maxRetryDelay		= std::chrono::milliseconds( 8000 );
+	
+	// Methods
+	void QueueRequest( const nlohmann::json &requestIn, TRegistrationCallback callbackIn );
+	void ThreadLoop();
+	void ResetSocket();
 	
-	bool SendRequest( const nlohmann::json &requestIn );
-};
\ No newline at end of file
+	ERegistrationResult SendRequest( const nlohmann::json &requestIn, std::chrono::milliseconds timeoutIn );
+};
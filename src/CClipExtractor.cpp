@@ -0,0 +1,222 @@
+// Includes
+#include "CClipExtractor.h"
+#include "CKeyframeIndex.h"
+#include "Mp4Box.h"
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const size_t CClipExtractor::k_copyChunkSize;
+
+void CClipExtractor::Extract( const std::string &segmentPathIn, double start_sIn, double end_sIn, const std::string &outputPathIn )
+{
+	if( end_sIn <= start_sIn )
+	{
+		throw std::runtime_error( "Clip end must be after its start" );
+	}
+	
+	CKeyframeIndex index;
+	index.Load( CKeyframeIndex::GetIndexPath( segmentPathIn ) );
+	
+	if( index.GetEntries().empty() )
+	{
+		throw std::runtime_error( "No keyframes indexed for " + segmentPathIn );
+	}
+	
+	const int64_t base_us 	= index.GetEntries().front().m_timestamp_us;
+	const int64_t start_us 	= base_us + (int64_t)( start_sIn * 1000000.0 );
+	const int64_t end_us 	= base_us + (int64_t)( end_sIn * 1000000.0 );
+	
+	// Start at the keyframe at or before the start time, and stop at the first keyframe after the end time
+	TKeyframeEntry first;
+	TKeyframeEntry next;
+	
+	if( !index.Lookup( start_us, first ) )
+	{
+		first = index.GetEntries().front();
+	}
+	
+	int fd = open( segmentPathIn.c_str(), O_RDONLY | O_CLOEXEC );
+	
+	if( fd < 0 )
+	{
+		throw std::runtime_error( "Failed to open " + segmentPathIn + ": " + strerror( errno ) );
+	}
+	
+	try
+	{
+		struct stat info;
+		
+		if( fstat( fd, &info ) != 0 )
+		{
+			throw std::runtime_error( "Failed to stat " + segmentPathIn + ": " + strerror( errno ) );
+		}
+		
+		uint64_t endOffset = index.LookupNext( end_us, next ) ? next.m_offset : (uint64_t)info.st_size;
+		
+		if( first.m_offset >= endOffset || endOffset > (uint64_t)info.st_size )
+		{
+			throw std::runtime_error( "Index does not match " + segmentPathIn );
+		}
+		
+		// One pass over the init segment and then the clip's byte range
+		posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+		
+		std::vector<uint8_t> init( index.GetInitSegmentSize() );
+		ReadAt( fd, init.data(), init.size(), 0 );
+		
+		// Only the box headers are read to find the clip's extent. A fragment is complete once its mdat is; anything past
+		// that (a partial fragment, preallocated space) is left out. The range can start with telemetry emsg boxes, so the
+		// first moof is read in full for its decode time.
+		uint64_t completeEnd 	= first.m_offset;
+		uint64_t offset 		= first.m_offset;
+		uint64_t mediaTime 		= 0;
+		bool hasMediaTime 		= false;
+		mp4::TBox box;
+		
+		while( ReadBoxHeader( fd, offset, endOffset, box ) && box.m_type != 0 )
+		{
+			if( !hasMediaTime && box.m_type == mp4::FourCC( 'm', 'o', 'o', 'f' ) )
+			{
+				std::vector<uint8_t> moof( box.m_size );
+				ReadAt( fd, moof.data(), moof.size(), box.m_offset );
+				
+				if( !mp4::GetBaseMediaDecodeTime( moof.data(), moof.size(), mediaTime ) )
+				{
+					throw std::runtime_error( "Corrupt fragment at offset " + std::to_string( box.m_offset ) + " in " + segmentPathIn );
+				}
+				
+				hasMediaTime = true;
+			}
+			
+			offset = box.GetEnd();
+			
+			if( hasMediaTime && box.m_type == mp4::FourCC( 'm', 'd', 'a', 't' ) )
+			{
+				completeEnd = offset;
+			}
+		}
+		
+		if( completeEnd == first.m_offset )
+		{
+			throw std::runtime_error( "No complete fragments in range in " + segmentPathIn );
+		}
+		
+		// The fragments keep their original decode times, so shift presentation back to zero with an edit list
+		std::vector<uint8_t> clipInit = mp4::RebuildInitWithEditList( init.data(), init.size(), mediaTime );
+		
+		std::ofstream file( outputPathIn, std::ios::binary | std::ios::trunc );
+		
+		if( !file )
+		{
+			throw std::runtime_error( "Failed to open " + outputPathIn );
+		}
+		
+		file.write( (const char*)clipInit.data(), clipInit.size() );
+		
+		// Copied through a fixed buffer, so memory stays flat however long the clip is
+		std::vector<uint8_t> chunk( std::min<uint64_t>( k_copyChunkSize, completeEnd - first.m_offset ) );
+		
+		for( offset = first.m_offset; offset < completeEnd && file; offset += chunk.size() )
+		{
+			chunk.resize( std::min<uint64_t>( chunk.size(), completeEnd - offset ) );
+			ReadAt( fd, chunk.data(), chunk.size(), offset );
+			file.write( (const char*)chunk.data(), chunk.size() );
+		}
+		
+		file.close();
+		
+		if( !file )
+		{
+			throw std::runtime_error( "Failed to write " + outputPathIn );
+		}
+		
+		close( fd );
+	}
+	catch( ... )
+	{
+		close( fd );
+		throw;
+	}
+}
+
+void CClipExtractor::ReadAt( int fdIn, uint8_t *dataOut, size_t sizeIn, uint64_t offsetIn )
+{
+	while( sizeIn > 0 )
+	{
+		ssize_t ret = pread( fdIn, dataOut, sizeIn, offsetIn );
+		
+		if( ret < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			
+			throw std::runtime_error( "Read failed: " + std::string( strerror( errno ) ) );
+		}
+		else if( ret == 0 )
+		{
+			throw std::runtime_error( "Unexpected end of file" );
+		}
+		
+		dataOut 	+= ret;
+		sizeIn 		-= ret;
+		offsetIn 	+= ret;
+	}
+}
+
+bool CClipExtractor::ReadBoxHeader( int fdIn, uint64_t offsetIn, uint64_t endIn, mp4::TBox &boxOut )
+{
+	uint8_t header[ 16 ];
+	
+	if( offsetIn + 8 > endIn )
+	{
+		return false;
+	}
+	
+	ReadAt( fdIn, header, 8, offsetIn );
+	
+	uint64_t size 		= mp4::ReadU32( header );
+	uint32_t headerSize = 8;
+	
+	if( size == 1 )
+	{
+		// 64-bit largesize follows the type
+		if( offsetIn + 16 > endIn )
+		{
+			return false;
+		}
+		
+		ReadAt( fdIn, header + 8, 8, offsetIn + 8 );
+		
+		size 		= mp4::ReadU64( header + 8 );
+		headerSize 	= 16;
+	}
+	else if( size == 0 )
+	{
+		// Box extends to the end of the range
+		size = endIn - offsetIn;
+	}
+	
+	if( size < headerSize || offsetIn + size > endIn )
+	{
+		return false;
+	}
+	
+	boxOut.m_type 		= mp4::ReadU32( header + 4 );
+	boxOut.m_offset 	= offsetIn;
+	boxOut.m_size 		= size;
+	boxOut.m_headerSize = headerSize;
+	
+	return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Mp4Box.h"
+
+// Cuts a time range out of a recorded segment by copying whole fragments, without decoding or encoding.
+// The keyframe index locates the GOPs enclosing the range, so the cost scales with the clip length,
+// and the fragments are streamed from the segment to the output rather than held in memory.
+class CClipExtractor
+{
+public:
+	// Methods
+	// Times are in seconds, relative to the first keyframe of the segment
+	static void Extract( const std::string &segmentPathIn, double start_sIn, double end_sIn, const std::string &outputPathIn );
+
+private:
+	// Attributes
+	static const size_t k_copyChunkSize = 1024 * 1024;
+	
+	// Methods
+	static void ReadAt( int fdIn, uint8_t *dataOut, size_t sizeIn, uint64_t offsetIn );
+	
+	// Parses the header of the box at offsetIn without reading its payload. False if it doesn't fit before endIn.
+	static bool ReadBoxHeader( int fdIn, uint64_t offsetIn, uint64_t endIn, mp4::TBox &boxOut );
+};
@@ -0,0 +1,152 @@
+// Includes
+#include "CDtlsContext.h"
+
+#include <stdexcept>
+#include <cstdio>
+
+#include <openssl/err.h>
+#include <openssl/ec.h>
+#include <openssl/x509.h>
+#include <openssl/rand.h>
+
+namespace
+{
+	std::string GetOpenSslError()
+	{
+		char error[ 256 ];
+		ERR_error_string_n( ERR_get_error(), error, sizeof( error ) );
+		return std::string( error );
+	}
+	
+	// The browser's certificate is self-signed too. It gets checked against the offer's fingerprint after the handshake.
+	int AcceptAnyCertificate( int preverifyIn, X509_STORE_CTX *storeIn )
+	{
+		return 1;
+	}
+}
+
+CDtlsContext::CDtlsContext()
+	: m_pContext( nullptr )
+	, m_pKey( nullptr )
+	, m_pCertificate( nullptr )
+{
+	try
+	{
+		CreateIdentity();
+		
+		m_pContext = SSL_CTX_new( DTLS_server_method() );
+		
+		if( m_pContext == nullptr )
+		{
+			throw std::runtime_error( "Failed to create DTLS context: " + GetOpenSslError() );
+		}
+		
+		SSL_CTX_set_min_proto_version( m_pContext, DTLS1_2_VERSION );
+		
+		if( SSL_CTX_use_certificate( m_pContext, m_pCertificate ) != 1 || SSL_CTX_use_PrivateKey( m_pContext, m_pKey ) != 1 )
+		{
+			throw std::runtime_error( "Failed to load DTLS certificate: " + GetOpenSslError() );
+		}
+		
+		// Unlike everything else in OpenSSL, 0 is success
+		if( SSL_CTX_set_tlsext_use_srtp( m_pContext, "SRTP_AES128_CM_SHA1_80" ) != 0 )
+		{
+			throw std::runtime_error( "Failed to enable DTLS-SRTP: " + GetOpenSslError() );
+		}
+		
+		SSL_CTX_set_verify( m_pContext, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, AcceptAnyCertificate );
+		
+		// Handshake messages are fragmented to the MTU we set, never what the kernel reports
+		SSL_CTX_set_options( m_pContext, SSL_OP_NO_QUERY_MTU );
+	}
+	catch( const std::exception & )
+	{
+		Cleanup();
+		throw;
+	}
+}
+
+CDtlsContext::~CDtlsContext()
+{
+	Cleanup();
+}
+
+std::string CDtlsContext::GetFingerprint( X509 *certificateIn )
+{
+	unsigned char digest[ EVP_MAX_MD_SIZE ];
+	unsigned int digestSize = 0;
+	
+	if( X509_digest( certificateIn, EVP_sha256(), digest, &digestSize ) != 1 )
+	{
+		return "";
+	}
+	
+	std::string fingerprint;
+	
+	for( unsigned int i = 0; i < digestSize; ++i )
+	{
+		char hex[ 4 ];
+		snprintf( hex, sizeof( hex ), ( i == 0 ) ? "%02X" : ":%02X", digest[ i ] );
+		fingerprint += hex;
+	}
+	
+	return fingerprint;
+}
+
+void CDtlsContext::CreateIdentity()
+{
+	// EVP_PKEY_CTX keygen works the same on OpenSSL 1.1 and 3
+	EVP_PKEY_CTX *keyContext = EVP_PKEY_CTX_new_id( EVP_PKEY_EC, nullptr );
+	
+	bool generated = keyContext != nullptr
+					&& EVP_PKEY_keygen_init( keyContext ) == 1
+					&& EVP_PKEY_CTX_set_ec_paramgen_curve_nid( keyContext, NID_X9_62_prime256v1 ) == 1
+					&& EVP_PKEY_keygen( keyContext, &m_pKey ) == 1;
+	
+	EVP_PKEY_CTX_free( keyContext );
+	
+	if( !generated )
+	{
+		throw std::runtime_error( "Failed to generate DTLS key: " + GetOpenSslError() );
+	}
+	
+	m_pCertificate = X509_new();
+	
+	if( m_pCertificate == nullptr )
+	{
+		throw std::runtime_error( "Failed to create DTLS certificate" );
+	}
+	
+	uint32_t serial = 0;
+	RAND_bytes( (unsigned char*)&serial, sizeof( serial ) );
+	
+	X509_set_version( m_pCertificate, 2 );
+	ASN1_INTEGER_set( X509_get_serialNumber( m_pCertificate ), serial & 0x7FFFFFFF );
+	
+	// A day of slack for cameras whose clock hasn't been set yet
+	X509_gmtime_adj( X509_getm_notBefore( m_pCertificate ), -24L * 60 * 60 );
+	X509_gmtime_adj( X509_getm_notAfter( m_pCertificate ), k_certificateLifetime_s );
+	
+	X509_NAME *name = X509_get_subject_name( m_pCertificate );
+	X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, (const unsigned char*)"geomuxpp", -1, -1, 0 );
+	
+	if( X509_set_issuer_name( m_pCertificate, name ) != 1
+		|| X509_set_pubkey( m_pCertificate, m_pKey ) != 1
+		|| X509_sign( m_pCertificate, m_pKey, EVP_sha256() ) == 0 )
+	{
+		throw std::runtime_error( "Failed to sign DTLS certificate: " + GetOpenSslError() );
+	}
+	
+	m_fingerprint = GetFingerprint( m_pCertificate );
+}
+
+void CDtlsContext::Cleanup()
+{
+	SSL_CTX_free( m_pContext );
+	X509_free( m_pCertificate );
+	EVP_PKEY_free( m_pKey );
+	
+	m_pContext 		= nullptr;
+	m_pCertificate 	= nullptr;
+	m_pKey 			= nullptr;
+}
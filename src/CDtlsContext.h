@@ -0,0 +1,36 @@
+#pragma once
+
+// Includes
+#include <string>
+
+#include <openssl/ssl.h>
+
+// The server's DTLS identity, shared by every WebRTC session: a throwaway self-signed ECDSA P-256 certificate made at
+// startup. Browsers don't check it against a CA, they check its fingerprint against the one in our SDP answer.
+class CDtlsContext
+{
+public:
+	// Methods
+	CDtlsContext();
+	virtual ~CDtlsContext();
+	
+	SSL_CTX* Get() const { return m_pContext; }
+	
+	// SHA-256 fingerprint of our certificate, as it goes in a=fingerprint ("AB:CD:...")
+	const std::string& GetFingerprint() const { return m_fingerprint; }
+	
+	static std::string GetFingerprint( X509 *certificateIn );
+
+private:
+	// Attributes
+	SSL_CTX 		*m_pContext;
+	EVP_PKEY 		*m_pKey;
+	X509 			*m_pCertificate;
+	std::string 	m_fingerprint;
+	
+	const long 		k_certificateLifetime_s	= 30L * 24 * 60 * 60;
+	
+	// Methods
+	void CreateIdentity();
+	void Cleanup();
+};
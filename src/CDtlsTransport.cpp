@@ -0,0 +1,215 @@
+// Includes
+#include "CDtlsTransport.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+
+#include <openssl/err.h>
+#include <openssl/srtp.h>
+
+using namespace std;
+
+namespace
+{
+	const char 		k_exporterLabel[] 	= "EXTRACTOR-dtls_srtp";
+}
+
+CDtlsTransport::CDtlsTransport( CDtlsContext &contextIn )
+	: m_pSsl( SSL_new( contextIn.Get() ) )
+	, m_pReadBio( nullptr )
+	, m_state( EState::HANDSHAKING )
+{
+	if( m_pSsl == nullptr )
+	{
+		throw std::runtime_error( "Failed to create DTLS session" );
+	}
+	
+	// Datagrams come in through a memory BIO. Each write goes out as its own datagram, which a memory BIO can't do.
+	m_pReadBio 			= BIO_new( BIO_s_mem() );
+	BIO *writeBio 		= BIO_new( GetWriteMethod() );
+	
+	if( m_pReadBio == nullptr || writeBio == nullptr )
+	{
+		BIO_free( m_pReadBio );
+		BIO_free( writeBio );
+		SSL_free( m_pSsl );
+		
+		throw std::runtime_error( "Failed to create DTLS BIOs" );
+	}
+	
+	BIO_set_mem_eof_return( m_pReadBio, -1 );
+	BIO_set_data( writeBio, this );
+	BIO_set_init( writeBio, 1 );
+	
+	SSL_set_bio( m_pSsl, m_pReadBio, writeBio );
+	SSL_set_mtu( m_pSsl, k_mtu );
+	SSL_set_accept_state( m_pSsl );
+}
+
+CDtlsTransport::~CDtlsTransport()
+{
+	// Frees both BIOs
+	SSL_free( m_pSsl );
+}
+
+void CDtlsTransport::HandleDatagram( const uint8_t *dataIn, size_t sizeIn )
+{
+	if( m_state == EState::CLOSED || m_state == EState::FAILED )
+	{
+		return;
+	}
+	
+	BIO_write( m_pReadBio, dataIn, (int)sizeIn );
+	
+	if( m_state == EState::HANDSHAKING )
+	{
+		Handshake();
+		return;
+	}
+	
+	// After the handshake only alerts are expected, and the browser's retransmitted Finished if ours was lost
+	uint8_t buffer[ 2048 ];
+	int bytesRead = SSL_read( m_pSsl, buffer, sizeof( buffer ) );
+	
+	if( bytesRead <= 0 )
+	{
+		int error = SSL_get_error( m_pSsl, bytesRead );
+		
+		if( error == SSL_ERROR_ZERO_RETURN )
+		{
+			m_state = EState::CLOSED;
+		}
+		else if( error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE )
+		{
+			m_state = EState::FAILED;
+		}
+	}
+	
+	ERR_clear_error();
+}
+
+void CDtlsTransport::HandleTimeout()
+{
+	if( m_state == EState::HANDSHAKING && DTLSv1_handle_timeout( m_pSsl ) < 0 )
+	{
+		// Out of retransmissions
+		m_state = EState::FAILED;
+		ERR_clear_error();
+	}
+}
+
+void CDtlsTransport::Close()
+{
+	if( m_state == EState::CONNECTED )
+	{
+		SSL_shutdown( m_pSsl );
+		ERR_clear_error();
+	}
+	
+	m_state = EState::CLOSED;
+}
+
+std::string CDtlsTransport::GetPeerFingerprint() const
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	X509 *certificate = SSL_get1_peer_certificate( m_pSsl );
+#else
+	X509 *certificate = SSL_get_peer_certificate( m_pSsl );
+#endif
+	
+	if( certificate == nullptr )
+	{
+		return "";
+	}
+	
+	std::string fingerprint = CDtlsContext::GetFingerprint( certificate );
+	X509_free( certificate );
+	
+	return fingerprint;
+}
+
+bool CDtlsTransport::ExportSrtpKeys( TSrtpKeys &keysOut ) const
+{
+	SRTP_PROTECTION_PROFILE *profile = SSL_get_selected_srtp_profile( m_pSsl );
+	
+	if( m_state != EState::CONNECTED || profile == nullptr || profile->id != SRTP_AES128_CM_SHA1_80 )
+	{
+		return false;
+	}
+	
+	// client key | server key | client salt | server salt. We are the server.
+	const size_t k_keySize 	= CSrtpContext::k_masterKeySize;
+	const size_t k_saltSize = CSrtpContext::k_masterSaltSize;
+	uint8_t material[ 2 * ( k_keySize + k_saltSize ) ];
+	
+	if( SSL_export_keying_material( m_pSsl, material, sizeof( material ), k_exporterLabel, strlen( k_exporterLabel ), nullptr, 0, 0 ) != 1 )
+	{
+		ERR_clear_error();
+		return false;
+	}
+	
+	memcpy( keysOut.m_remoteKey, material, k_keySize );
+	memcpy( keysOut.m_localKey, material + k_keySize, k_keySize );
+	memcpy( keysOut.m_remoteSalt, material + 2 * k_keySize, k_saltSize );
+	memcpy( keysOut.m_localSalt, material + 2 * k_keySize + k_saltSize, k_saltSize );
+	
+	OPENSSL_cleanse( material, sizeof( material ) );
+	return true;
+}
+
+void CDtlsTransport::Handshake()
+{
+	int result = SSL_do_handshake( m_pSsl );
+	
+	if( result == 1 )
+	{
+		m_state = EState::CONNECTED;
+		return;
+	}
+	
+	int error = SSL_get_error( m_pSsl, result );
+	
+	if( error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE )
+	{
+		char reason[ 256 ];
+		ERR_error_string_n( ERR_get_error(), reason, sizeof( reason ) );
+		cerr << "DTLS handshake failed: " << reason << endl;
+		
+		m_state = EState::FAILED;
+	}
+	
+	ERR_clear_error();
+}
+
+BIO_METHOD* CDtlsTransport::GetWriteMethod()
+{
+	static BIO_METHOD *method = []()
+	{
+		BIO_METHOD *writeMethod = BIO_meth_new( BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "geomuxpp datagram" );
+		
+		if( writeMethod != nullptr )
+		{
+			BIO_meth_set_write( writeMethod, BioWrite );
+			BIO_meth_set_ctrl( writeMethod, BioControl );
+		}
+		
+		return writeMethod;
+	}();
+	
+	return method;
+}
+
+int CDtlsTransport::BioWrite( BIO *bioIn, const char *dataIn, int sizeIn )
+{
+	CDtlsTransport *transport = (CDtlsTransport*)BIO_get_data( bioIn );
+	
+	transport->m_outgoing.emplace_back( (const uint8_t*)dataIn, (const uint8_t*)dataIn + sizeIn );
+	return sizeIn;
+}
+
+long CDtlsTransport::BioControl( BIO *bioIn, int commandIn, long argumentIn, void *pointerIn )
+{
+	// Flushing always succeeds. Nothing is ever left pending, and the MTU is fixed, so everything else is 0.
+	return ( commandIn == BIO_CTRL_FLUSH ) ? 1 : 0;
+}
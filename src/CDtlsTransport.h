@@ -0,0 +1,72 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+#include "CDtlsContext.h"
+#include "CSrtpContext.h"
+
+// SRTP master keys from a finished handshake (RFC 5764), from our side's point of view
+struct TSrtpKeys
+{
+	uint8_t 	m_localKey[ CSrtpContext::k_masterKeySize ];
+	uint8_t 	m_localSalt[ CSrtpContext::k_masterSaltSize ];
+	uint8_t 	m_remoteKey[ CSrtpContext::k_masterKeySize ];
+	uint8_t 	m_remoteSalt[ CSrtpContext::k_masterSaltSize ];
+};
+
+// The server end of one DTLS association, only used to agree SRTP keys. Holds no socket: received datagrams are fed
+// in, and everything it wants to send collects in GetOutgoing() for the caller to put on the wire.
+class CDtlsTransport
+{
+public:
+	enum class EState
+	{
+		HANDSHAKING,
+		CONNECTED,
+		CLOSED,
+		FAILED
+	};
+	
+	// Methods
+	explicit CDtlsTransport( CDtlsContext &contextIn );
+	virtual ~CDtlsTransport();
+	
+	void HandleDatagram( const uint8_t *dataIn, size_t sizeIn );
+	
+	// Resends our last flight if the browser hasn't answered in time. Call regularly while handshaking.
+	void HandleTimeout();
+	
+	// Sends close_notify
+	void Close();
+	
+	EState GetState() const { return m_state; }
+	
+	// Datagrams to send, in order. The caller clears it.
+	std::vector<std::vector<uint8_t>>& GetOutgoing() { return m_outgoing; }
+	
+	// Only valid once connected
+	std::string GetPeerFingerprint() const;
+	bool ExportSrtpKeys( TSrtpKeys &keysOut ) const;
+
+private:
+	// Attributes
+	SSL 								*m_pSsl;
+	BIO 								*m_pReadBio;
+	EState 								m_state;
+	std::vector<std::vector<uint8_t>> 	m_outgoing;
+	
+	// Browsers' own DTLS MTU, well under any path MTU
+	const long 							k_mtu	= 1200;
+	
+	// Methods
+	void Handshake();
+	static BIO_METHOD* GetWriteMethod();
+	static int BioWrite( BIO *bioIn, const char *dataIn, int sizeIn );
+	static long BioControl( BIO *bioIn, int commandIn, long argumentIn, void *pointerIn );
+};
@@ -0,0 +1,377 @@
+// Includes
+#include "CFaststartWorker.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <cstdio>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+extern "C" 
+{ 
+	// FFmpeg
+	#include <libavformat/avformat.h>
+}
+
+using namespace std;
+
+namespace
+{
+	// linux/ioprio.h isn't exported by glibc
+	const int k_ioprioWhoProcess 	= 1;
+	const int k_ioprioClassIdle 	= 3;
+	const int k_ioprioClassShift 	= 13;
+	
+	const int k_niceness 			= 19;
+}
+
+CFaststartWorker::CFaststartWorker( std::function<bool()> isUnderPressureIn )
+	: m_segmentsConverted( 0 )
+	, m_segmentsFailed( 0 )
+	, m_isUnderPressure( isUnderPressureIn )
+	, m_killThread( false )
+	, m_cancelCurrent( false )
+{
+	m_thread = std::thread( &CFaststartWorker::ThreadLoop, this );
+}
+
+CFaststartWorker::~CFaststartWorker()
+{
+	try
+	{
+		Stop();
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error cleaning up CFaststartWorker: " << e.what() << endl;
+	}
+}
+
+std::string CFaststartWorker::GetOutputPath( const std::string &segmentPathIn )
+{
+	const std::string extension( ".mp4" );
+	
+	if( segmentPathIn.size() > extension.size() && segmentPathIn.compare( segmentPathIn.size() - extension.size(), extension.size(), extension ) == 0 )
+	{
+		return segmentPathIn.substr( 0, segmentPathIn.size() - extension.size() ) + ".faststart.mp4";
+	}
+	
+	return segmentPathIn + ".faststart.mp4";
+}
+
+void CFaststartWorker::Queue( const std::string &segmentPathIn )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		
+		if( m_killThread )
+		{
+			return;
+		}
+		
+		m_queue.push_back( segmentPathIn );
+	}
+	
+	m_wakeCondition.notify_one();
+}
+
+void CFaststartWorker::CancelAll()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		
+		m_queue.clear();
+		m_cancelCurrent = true;
+	}
+	
+	m_wakeCondition.notify_one();
+}
+
+void CFaststartWorker::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		
+		m_queue.clear();
+		m_killThread = true;
+	}
+	
+	m_wakeCondition.notify_one();
+	
+	if( m_thread.joinable() )
+	{
+		m_thread.join();
+	}
+}
+
+void CFaststartWorker::ThreadLoop()
+{
+	LowerPriority();
+	
+	while( true )
+	{
+		std::string segmentPath;
+		
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			
+			m_wakeCondition.wait( lock, [this](){ return m_killThread || !m_queue.empty(); } );
+			
+			if( m_killThread )
+			{
+				return;
+			}
+			
+			segmentPath = m_queue.front();
+			m_queue.pop_front();
+			m_cancelCurrent = false;
+		}
+		
+		const std::string outputPath( GetOutputPath( segmentPath ) );
+		
+		// Live video comes first. Don't even start while a channel is under pressure.
+		if( !WaitForIdle() )
+		{
+			continue;
+		}
+		
+		cout << "Converting " << segmentPath << " to faststart MP4" << endl;
+		
+		if( Convert( segmentPath, outputPath ) )
+		{
+			m_segmentsConverted++;
+			cout << "Wrote faststart MP4: " << outputPath << endl;
+		}
+		else if( !IsCancelled() )
+		{
+			m_segmentsFailed++;
+		}
+	}
+}
+
+void CFaststartWorker::LowerPriority()
+{
+	// Both only apply to this thread
+	pid_t tid = syscall( SYS_gettid );
+	
+	if( setpriority( PRIO_PROCESS, tid, k_niceness ) != 0 )
+	{
+		cerr << "Failed to lower faststart worker CPU priority" << endl;
+	}
+	
+	if( syscall( SYS_ioprio_set, k_ioprioWhoProcess, tid, k_ioprioClassIdle << k_ioprioClassShift ) != 0 )
+	{
+		cerr << "Failed to lower faststart worker I/O priority" << endl;
+	}
+}
+
+bool CFaststartWorker::Convert( const std::string &segmentPathIn, const std::string &outputPathIn )
+{
+	// Write to a temporary name, so a partial file is never mistaken for a finished one
+	const std::string tempPath( outputPathIn + ".part" );
+	
+	AVFormatContext *input 	= nullptr;
+	AVFormatContext *output = nullptr;
+	bool completed 			= false;
+	
+	try
+	{
+		if( !( input = avformat_alloc_context() ) )
+		{
+			throw std::runtime_error( "Failed to allocate input context" );
+		}
+		
+		input->interrupt_callback.callback 	= &InterruptCallback;
+		input->interrupt_callback.opaque 	= this;
+		
+		if( avformat_open_input( &input, segmentPathIn.c_str(), NULL, NULL ) < 0 )
+		{
+			throw std::runtime_error( "Could not open input" );
+		}
+		
+		if( avformat_find_stream_info( input, NULL ) < 0 )
+		{
+			throw std::runtime_error( "Unable to find stream info" );
+		}
+		
+		OpenOutput( input, &output, tempPath );
+		
+		AVPacket packet;
+		
+		auto throttleStartTime 	= std::chrono::steady_clock::now();
+		auto lastPressureCheck 	= throttleStartTime;
+		uint64_t throttleBytes 	= 0;
+		
+		while( av_read_frame( input, &packet ) >= 0 )
+		{
+			AVStream *inStream 	= input->streams[ packet.stream_index ];
+			AVStream *outStream = output->streams[ packet.stream_index ];
+			
+			av_packet_rescale_ts( &packet, inStream->time_base, outStream->time_base );
+			packet.pos = -1;
+			
+			throttleBytes += packet.size;
+			
+			int ret = av_interleaved_write_frame( output, &packet );
+			av_packet_unref( &packet );
+			
+			if( ret < 0 )
+			{
+				throw std::runtime_error( "Error writing packet" );
+			}
+			
+			if( IsCancelled() )
+			{
+				break;
+			}
+			
+			// Hold back to the rate limit
+			auto now = std::chrono::steady_clock::now();
+			auto due = throttleStartTime + std::chrono::microseconds( throttleBytes * 1000000 / k_maxRate_Bps );
+			
+			if( due > now && !Sleep( std::chrono::duration_cast<std::chrono::microseconds>( due - now ) ) )
+			{
+				break;
+			}
+			
+			if( now - lastPressureCheck > k_pressureCheckInterval )
+			{
+				if( !WaitForIdle() )
+				{
+					break;
+				}
+				
+				// Don't try to catch up on the time spent paused
+				throttleStartTime 	= std::chrono::steady_clock::now();
+				lastPressureCheck 	= throttleStartTime;
+				throttleBytes 		= 0;
+			}
+		}
+		
+		if( !IsCancelled() )
+		{
+			// The faststart pass moves the moov to the front here
+			if( av_write_trailer( output ) < 0 )
+			{
+				throw std::runtime_error( "Error writing trailer" );
+			}
+			
+			completed = true;
+		}
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Failed to convert " << segmentPathIn << ": " << e.what() << endl;
+	}
+	
+	avformat_close_input( &input );
+	
+	if( output )
+	{
+		avio_closep( &output->pb );
+		avformat_free_context( output );
+	}
+	
+	if( completed && rename( tempPath.c_str(), outputPathIn.c_str() ) != 0 )
+	{
+		cerr << "Failed to rename " << tempPath << endl;
+		completed = false;
+	}
+	
+	if( !completed )
+	{
+		unlink( tempPath.c_str() );
+	}
+	
+	return completed;
+}
+
+void CFaststartWorker::OpenOutput( AVFormatContext *inputIn, AVFormatContext **outputOut, const std::string &pathIn )
+{
+	avformat_alloc_output_context2( outputOut, NULL, "mp4", pathIn.c_str() );
+	
+	AVFormatContext *output = *outputOut;
+	
+	if( !output )
+	{
+		throw std::runtime_error( "Could not create output context" );
+	}
+	
+	output->interrupt_callback.callback = &InterruptCallback;
+	output->interrupt_callback.opaque 	= this;
+	
+	// Stream copy, same as the live muxer
+	for( size_t i = 0; i < inputIn->nb_streams; ++i )
+	{
+		AVStream *inStream 	= inputIn->streams[ i ];
+		AVStream *outStream = avformat_new_stream( output, NULL );
+		
+		if( !outStream )
+		{
+			throw std::runtime_error( "Failed allocating output stream" );
+		}
+		
+		if( avcodec_copy_context( outStream->codec, inStream->codec ) < 0 )
+		{
+			throw std::runtime_error( "Failed to copy codec context" );
+		}
+		
+		// Let the muxer pick the tag for its container
+		outStream->codec->codec_tag = 0;
+		outStream->time_base 		= inStream->time_base;
+		
+		if( output->oformat->flags & AVFMT_GLOBALHEADER )
+		{
+			outStream->codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+		}
+	}
+	
+	if( avio_open2( &output->pb, pathIn.c_str(), AVIO_FLAG_WRITE, &output->interrupt_callback, NULL ) < 0 )
+	{
+		throw std::runtime_error( "Could not open " + pathIn );
+	}
+	
+	AVDictionary *options = NULL;
+	av_dict_set( &options, "movflags", "faststart", 0 );
+	
+	int ret = avformat_write_header( output, &options );
+	av_dict_free( &options );
+	
+	if( ret < 0 )
+	{
+		throw std::runtime_error( "Error writing header" );
+	}
+}
+
+bool CFaststartWorker::WaitForIdle()
+{
+	while( m_isUnderPressure && m_isUnderPressure() )
+	{
+		if( !Sleep( k_pressureBackoff ) )
+		{
+			return false;
+		}
+	}
+	
+	return !IsCancelled();
+}
+
+bool CFaststartWorker::Sleep( std::chrono::microseconds durationIn )
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+	
+	return !m_wakeCondition.wait_for( lock, durationIn, [this](){ return IsCancelled(); } );
+}
+
+bool CFaststartWorker::IsCancelled()
+{
+	return m_killThread || m_cancelCurrent;
+}
+
+int CFaststartWorker::InterruptCallback( void *workerIn )
+{
+	// Lets libavformat abandon blocking I/O on cancel
+	return ( (CFaststartWorker*)workerIn )->IsCancelled() ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+
+struct AVFormatContext;
+
+// Rewrites closed recording segments into progressive MP4 with the moov up front, for review workstations.
+// Runs one segment at a time on a niced, idle I/O priority thread, throttled, and pauses while the
+// supplied pressure check reports a live channel is struggling. The fragmented original is left in place.
+class CFaststartWorker
+{
+public:
+	// Attributes
+	std::atomic<uint64_t> 	m_segmentsConverted;
+	std::atomic<uint64_t> 	m_segmentsFailed;
+	
+	// Methods
+	CFaststartWorker( std::function<bool()> isUnderPressureIn );
+	virtual ~CFaststartWorker();
+	
+	static std::string GetOutputPath( const std::string &segmentPathIn );
+	
+	void Queue( const std::string &segmentPathIn );
+	
+	// Drops queued segments and abandons the one in progress
+	void CancelAll();
+	
+	// Cancels everything and joins the thread. Segments queued afterwards are ignored.
+	void Stop();
+
+private:
+	// Attributes
+	std::function<bool()> 			m_isUnderPressure;
+	
+	std::thread 					m_thread;
+	std::mutex 						m_mutex;
+	std::condition_variable 		m_wakeCondition;
+	std::deque<std::string> 		m_queue;
+	std::atomic<bool> 				m_killThread;
+	std::atomic<bool> 				m_cancelCurrent;
+	
+	const uint64_t 					k_maxRate_Bps				= 8 * 1024 * 1024;
+	const std::chrono::seconds 		k_pressureCheckInterval		= std::chrono::seconds( 1 );
+	const std::chrono::seconds 		k_pressureBackoff			= std::chrono::seconds( 5 );
+	
+	// Methods
+	void ThreadLoop();
+	void LowerPriority();
+	
+	bool Convert( const std::string &segmentPathIn, const std::string &outputPathIn );
+	void OpenOutput( AVFormatContext *inputIn, AVFormatContext **outputOut, const std::string &pathIn );
+	
+	bool WaitForIdle();
+	bool Sleep( std::chrono::microseconds durationIn );
+	bool IsCancelled();
+	
+	static int InterruptCallback( void *workerIn );
+};
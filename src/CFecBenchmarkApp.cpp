@@ -0,0 +1,333 @@
+// Includes
+#include "CFecBenchmarkApp.h"
+#include "CFecEncoder.h"
+#include "CFecDecoder.h"
+#include "CTsPacketizer.h"
+#include "CAccessUnitAssembler.h"
+#include "H264.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <memory>
+
+using namespace std;
+
+namespace
+{
+	// Same datagram size as CTsMulticastOutput
+	const size_t k_datagramSize = 7 * CTsPacketizer::k_packetSize;
+}
+
+CFecBenchmarkApp::CFecBenchmarkApp( int argCountIn, char* argsIn[], const std::string &inputPathIn )
+	: CApp( argCountIn, argsIn )
+	, m_inputPath( inputPathIn )
+{
+}
+
+CFecBenchmarkApp::~CFecBenchmarkApp()
+{
+}
+
+void CFecBenchmarkApp::Run()
+{
+	LoadCapture();
+	
+	cout << m_inputPath << ": " << m_frameCount << " frames in " << m_datagrams.size() << " datagrams. XorInto uses: " << fec::GetKernels().back().m_name << endl;
+	
+	BenchmarkKernels();
+	BenchmarkEncoder();
+	
+	const std::vector<TScheme> schemes =
+	{
+		{ "none", 0, 0, false },
+		{ "1D 10x10", 10, 10, false },
+		{ "2D 10x10", 10, 10, true },
+		{ "2D 5x5", 5, 5, true }
+	};
+	
+	const std::vector<TChannel> channels =
+	{
+		{ 0.001, 1.0 },
+		{ 0.01, 4.0 },
+		{ 0.02, 8.0 },
+		{ 0.05, 12.0 }
+	};
+	
+	cout << endl << "Loss simulation (Gilbert-Elliott bursts, at least " << k_minSimulatedPackets << " packets per run)" << endl;
+	cout << std::left << std::setw( 10 ) << "scheme" << std::right << std::setw( 10 ) << "overhead" << std::setw( 8 ) << "loss"
+		<< std::setw( 8 ) << "burst" << std::setw( 12 ) << "lost" << std::setw( 12 ) << "after FEC" << std::setw( 14 ) << "frames intact" << endl;
+	
+	for( const TChannel &channel : channels )
+	{
+		for( const TScheme &scheme : schemes )
+		{
+			// Same seed for every run, so the schemes face comparable loss patterns
+			std::mt19937 random( 1 );
+			SimulateLoss( scheme, channel, random );
+		}
+	}
+}
+
+void CFecBenchmarkApp::LoadCapture()
+{
+	std::ifstream input( m_inputPath, std::ios::binary | std::ios::ate );
+	
+	if( !input )
+	{
+		throw std::runtime_error( "Failed to open " + m_inputPath );
+	}
+	
+	std::vector<uint8_t> data( input.tellg() );
+	input.seekg( 0 );
+	
+	if( !input.read( (char*)data.data(), data.size() ) )
+	{
+		throw std::runtime_error( "Failed to read " + m_inputPath );
+	}
+	
+	// One NAL per callback, as the camera delivers them with maxnal set
+	CTsPacketizer packetizer;
+	CAccessUnitAssembler assembler;
+	std::vector<uint8_t> packets;
+	
+	const uint8_t *end 		= data.data() + data.size();
+	const uint8_t *cursor 	= h264::FindStartCode( data.data(), end );
+	h264::TNalUnit nal;
+	
+	while( h264::NextNalUnit( cursor, end, nal ) )
+	{
+		TBufferSegment segment;
+		segment.m_pData 	= nal.m_pStartCode;
+		segment.m_size 		= ( nal.m_pData + nal.m_size ) - nal.m_pStartCode;
+		
+		bool isFrameStart = assembler.StartsAccessUnit( segment.m_pData, segment.m_size );
+		
+		if( isFrameStart )
+		{
+			m_frameCount++;
+		}
+		
+		packets.clear();
+		packetizer.Packetize( &segment, 1, isFrameStart, packets );
+		
+		for( size_t offset = 0; offset < packets.size(); offset += k_datagramSize )
+		{
+			TDatagram datagram;
+			datagram.m_frame = m_frameCount - 1;
+			datagram.m_payload.assign( packets.begin() + offset, packets.begin() + std::min( packets.size(), offset + k_datagramSize ) );
+			
+			m_datagrams.push_back( std::move( datagram ) );
+		}
+	}
+	
+	if( m_datagrams.empty() )
+	{
+		throw std::runtime_error( "No H264 found in " + m_inputPath );
+	}
+}
+
+void CFecBenchmarkApp::BenchmarkKernels()
+{
+	const std::vector<fec::TKernel> &kernels = fec::GetKernels();
+	
+	cout << endl << "XOR kernels" << endl;
+	
+	// The byte loop is the reference the others must agree with
+	std::vector<uint8_t> expected( k_datagramSize, 0 );
+	
+	for( const TDatagram &datagram : m_datagrams )
+	{
+		kernels.front().m_xor( expected.data(), datagram.m_payload.data(), datagram.m_payload.size() );
+	}
+	
+	bool allAgree = true;
+	
+	for( const fec::TKernel &kernel : kernels )
+	{
+		std::vector<uint8_t> parity;
+		size_t bytes 	= 0;
+		
+		auto start 		= std::chrono::steady_clock::now();
+		auto elapsed 	= std::chrono::steady_clock::duration::zero();
+		
+		do
+		{
+			parity.assign( k_datagramSize, 0 );
+			
+			for( const TDatagram &datagram : m_datagrams )
+			{
+				kernel.m_xor( parity.data(), datagram.m_payload.data(), datagram.m_payload.size() );
+				bytes += datagram.m_payload.size();
+			}
+			
+			elapsed = std::chrono::steady_clock::now() - start;
+		}
+		while( elapsed < k_minDuration );
+		
+		double elapsed_s 	= std::chrono::duration_cast<std::chrono::microseconds>( elapsed ).count() / 1000000.0;
+		bool agrees 		= ( parity == expected );
+		
+		allAgree = allAgree && agrees;
+		
+		cout << std::left << std::setw( 10 ) << kernel.m_name << std::right
+			<< std::fixed << std::setprecision( 1 ) << std::setw( 10 ) << ( bytes / elapsed_s / 1000000.0 ) << " MB/sec"
+			<< ( agrees ? "" : "  MISMATCH" ) << endl;
+	}
+	
+	if( !allAgree )
+	{
+		throw std::runtime_error( "XOR kernels disagree" );
+	}
+}
+
+void CFecBenchmarkApp::BenchmarkEncoder()
+{
+	CFecEncoder encoder( 10, 10, true );
+	std::vector<TFecPacket> fecPackets;
+	
+	uint16_t sequence 	= 0;
+	size_t bytes 		= 0;
+	
+	auto start 		= std::chrono::steady_clock::now();
+	auto elapsed 	= std::chrono::steady_clock::duration::zero();
+	
+	do
+	{
+		for( const TDatagram &datagram : m_datagrams )
+		{
+			fecPackets.clear();
+			encoder.Add( sequence++, 0, datagram.m_payload.data(), datagram.m_payload.size(), fecPackets );
+			bytes += datagram.m_payload.size();
+		}
+		
+		elapsed = std::chrono::steady_clock::now() - start;
+	}
+	while( elapsed < k_minDuration );
+	
+	double elapsed_s = std::chrono::duration_cast<std::chrono::microseconds>( elapsed ).count() / 1000000.0;
+	
+	cout << endl << "2D 10x10 encoder: " << std::fixed << std::setprecision( 1 ) << ( bytes * 8 / elapsed_s / 1000000.0 ) << " Mbit/sec of media" << endl;
+}
+
+void CFecBenchmarkApp::SimulateLoss( const TScheme &schemeIn, const TChannel &channelIn, std::mt19937 &randomIn )
+{
+	// Two state channel: every packet sent in the bad state is lost. The mean burst length sets how long it stays there.
+	const double badToGood 	= 1.0 / channelIn.m_meanBurst;
+	const double goodToBad 	= channelIn.m_lossRate * badToGood / ( 1.0 - channelIn.m_lossRate );
+	
+	std::uniform_real_distribution<double> uniform( 0.0, 1.0 );
+	bool isBad = false;
+	
+	auto isLost = [&]()
+	{
+		isBad = isBad ? ( uniform( randomIn ) >= badToGood ) : ( uniform( randomIn ) < goodToBad );
+		return isBad;
+	};
+	
+	std::unique_ptr<CFecEncoder> encoder;
+	
+	if( schemeIn.m_columns != 0 )
+	{
+		encoder = util::make_unique<CFecEncoder>( schemeIn.m_columns, schemeIn.m_rows, schemeIn.m_rowFec );
+	}
+	
+	CFecDecoder decoder;
+	std::vector<TFecPacket> fecPackets;
+	std::vector<TRecoveredPacket> recovered;
+	
+	const size_t passes = ( k_minSimulatedPackets + m_datagrams.size() - 1 ) / m_datagrams.size();
+	const size_t total 	= passes * m_datagrams.size();
+	
+	std::vector<bool> isDelivered( total, false );
+	size_t lost 		= 0;
+	size_t fecSent 		= 0;
+	
+	for( size_t index = 0; index < total; ++index )
+	{
+		const TDatagram &datagram 	= m_datagrams[ index % m_datagrams.size() ];
+		const uint16_t sequence 	= (uint16_t)index;
+		const uint32_t timestamp 	= (uint32_t)( datagram.m_frame * 3000 );
+		
+		if( isLost() )
+		{
+			lost++;
+		}
+		else
+		{
+			isDelivered[ index ] = true;
+			decoder.AddMedia( sequence, timestamp, datagram.m_payload.data(), datagram.m_payload.size() );
+		}
+		
+		if( !encoder )
+		{
+			continue;
+		}
+		
+		fecPackets.clear();
+		encoder->Add( sequence, timestamp, datagram.m_payload.data(), datagram.m_payload.size(), fecPackets );
+		
+		for( const TFecPacket &fecPacket : fecPackets )
+		{
+			fecSent++;
+			
+			if( isLost() )
+			{
+				continue;
+			}
+			
+			recovered.clear();
+			decoder.AddFec( fecPacket.m_data.data(), fecPacket.m_data.size(), recovered );
+			
+			for( const TRecoveredPacket &packet : recovered )
+			{
+				size_t recoveredIndex = index - (uint16_t)( sequence - packet.m_sequence );
+				
+				if( packet.m_payload != m_datagrams[ recoveredIndex % m_datagrams.size() ].m_payload )
+				{
+					throw std::runtime_error( "Recovered packet " + std::to_string( recoveredIndex ) + " doesn't match what was sent" );
+				}
+				
+				isDelivered[ recoveredIndex ] = true;
+			}
+		}
+	}
+	
+	size_t lostAfterFec 	= 0;
+	size_t framesIntact 	= 0;
+	size_t frames 			= 0;
+	bool isFrameIntact 		= true;
+	
+	for( size_t index = 0; index < total; ++index )
+	{
+		const TDatagram &datagram = m_datagrams[ index % m_datagrams.size() ];
+		
+		if( index > 0 && datagram.m_frame != m_datagrams[ ( index - 1 ) % m_datagrams.size() ].m_frame )
+		{
+			frames++;
+			framesIntact += isFrameIntact ? 1 : 0;
+			isFrameIntact = true;
+		}
+		
+		if( !isDelivered[ index ] )
+		{
+			lostAfterFec++;
+			isFrameIntact = false;
+		}
+	}
+	
+	frames++;
+	framesIntact += isFrameIntact ? 1 : 0;
+	
+	cout << std::left << std::setw( 10 ) << schemeIn.m_name << std::right << std::fixed
+		<< std::setprecision( 1 ) << std::setw( 9 ) << ( 100.0 * fecSent / total ) << "%"
+		<< std::setw( 7 ) << ( 100.0 * channelIn.m_lossRate ) << "%"
+		<< std::setprecision( 0 ) << std::setw( 8 ) << channelIn.m_meanBurst
+		<< std::setprecision( 3 ) << std::setw( 11 ) << ( 100.0 * lost / total ) << "%"
+		<< std::setw( 11 ) << ( 100.0 * lostAfterFec / total ) << "%"
+		<< std::setprecision( 2 ) << std::setw( 13 ) << ( 100.0 * framesIntact / frames ) << "%" << endl;
+	
+	cout.unsetf( std::ios::floatfield );
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+
+#include "CApp.h"
+#include "Fec.h"
+
+// Measures the FEC layer on a raw H264 (Annex-B) capture, packetized exactly as the multicast output would send it:
+// XOR kernel and encoder throughput, then how many packets and whole frames survive a bursty lossy link
+// (Gilbert-Elliott model) with no FEC, column-only FEC and row+column FEC.
+class CFecBenchmarkApp : public CApp
+{
+public:
+	// Methods
+	CFecBenchmarkApp( int argCountIn, char* argsIn[], const std::string &inputPathIn );
+	virtual ~CFecBenchmarkApp();
+	
+	virtual void Run();
+
+private:
+	struct TDatagram
+	{
+		size_t 					m_frame;
+		std::vector<uint8_t> 	m_payload;
+	};
+	
+	struct TScheme
+	{
+		const char 		*m_name;
+		uint8_t 		m_columns;		// 0 for no FEC
+		uint8_t 		m_rows;
+		bool 			m_rowFec;
+	};
+	
+	struct TChannel
+	{
+		double 			m_lossRate;
+		double 			m_meanBurst;	// Packets
+	};
+	
+	// Attributes
+	std::string 				m_inputPath;
+	std::vector<TDatagram> 		m_datagrams;
+	size_t 						m_frameCount		= 0;
+	
+	const std::chrono::milliseconds k_minDuration 			= std::chrono::milliseconds( 1000 );
+	const size_t 					k_minSimulatedPackets 	= 200000;
+	
+	// Methods
+	void LoadCapture();
+	void BenchmarkKernels();
+	void BenchmarkEncoder();
+	void SimulateLoss( const TScheme &schemeIn, const TChannel &channelIn, std::mt19937 &randomIn );
+};
@@ -0,0 +1,164 @@
+// Includes
+#include "CFecDecoder.h"
+
+#include <algorithm>
+
+using namespace std;
+
+CFecDecoder::CFecDecoder()
+{
+}
+
+CFecDecoder::~CFecDecoder()
+{
+}
+
+void CFecDecoder::AddMedia( uint16_t sequenceIn, uint32_t timestampIn, const uint8_t *payloadIn, size_t sizeIn )
+{
+	Store( sequenceIn, timestampIn, payloadIn, sizeIn );
+	
+	// Not from Store(), which also runs while AddFec() walks the FEC packets
+	if( ++m_sinceLastPrune >= k_pruneInterval )
+	{
+		Prune();
+	}
+}
+
+void CFecDecoder::Store( uint16_t sequenceIn, uint32_t timestampIn, const uint8_t *payloadIn, size_t sizeIn )
+{
+	TMedia &media = m_media[ sequenceIn ];
+	media.m_timestamp = timestampIn;
+	media.m_payload.assign( payloadIn, payloadIn + sizeIn );
+	
+	if( (int16_t)( sequenceIn - m_newestSequence ) > 0 || m_media.size() == 1 )
+	{
+		m_newestSequence = sequenceIn;
+	}
+}
+
+void CFecDecoder::AddFec( const uint8_t *packetIn, size_t sizeIn, std::vector<TRecoveredPacket> &packetsOut )
+{
+	TStoredFec fec;
+	
+	if( sizeIn < fec::k_rtpHeaderSize || !fec::ReadFecHeader( packetIn + fec::k_rtpHeaderSize, sizeIn - fec::k_rtpHeaderSize, fec.m_header ) )
+	{
+		m_fecPacketsInvalid++;
+		return;
+	}
+	
+	fec.m_payload.assign( packetIn + fec::k_rtpHeaderSize + fec::k_fecHeaderSize, packetIn + sizeIn );
+	m_fec.push_back( std::move( fec ) );
+	
+	// Each recovery may complete another group, so go round until nothing changes
+	bool progress = true;
+	
+	while( progress )
+	{
+		progress = false;
+		
+		for( auto it = m_fec.begin(); it != m_fec.end(); )
+		{
+			bool isSpent = false;
+			
+			if( TryRecover( *it, isSpent, packetsOut ) )
+			{
+				progress = true;
+			}
+			
+			it = isSpent ? m_fec.erase( it ) : it + 1;
+		}
+	}
+}
+
+bool CFecDecoder::TryRecover( const TStoredFec &fecIn, bool &isSpentOut, std::vector<TRecoveredPacket> &packetsOut )
+{
+	const fec::TFecHeader &header = fecIn.m_header;
+	
+	uint16_t missing 		= 0;
+	size_t missingCount 	= 0;
+	
+	for( uint16_t i = 0; i < header.m_count && missingCount < 2; ++i )
+	{
+		uint16_t sequence = header.m_snBase + i * header.m_offset;
+		
+		if( m_media.find( sequence ) == m_media.end() )
+		{
+			missing = sequence;
+			missingCount++;
+		}
+	}
+	
+	// Nothing to do, or nothing this packet can do on its own yet
+	isSpentOut = ( missingCount == 0 );
+	
+	if( missingCount != 1 )
+	{
+		return false;
+	}
+	
+	TRecoveredPacket recovered;
+	recovered.m_sequence 	= missing;
+	recovered.m_payload 	= fecIn.m_payload;
+	
+	uint16_t length 		= header.m_lengthRecovery;
+	uint32_t timestamp 		= header.m_tsRecovery;
+	
+	for( uint16_t i = 0; i < header.m_count; ++i )
+	{
+		uint16_t sequence = header.m_snBase + i * header.m_offset;
+		
+		if( sequence == missing )
+		{
+			continue;
+		}
+		
+		const TMedia &media = m_media[ sequence ];
+		
+		if( media.m_payload.size() > recovered.m_payload.size() )
+		{
+			// Longer than the FEC payload, so the FEC packet can't belong to this media
+			m_fecPacketsInvalid++;
+			isSpentOut = true;
+			return false;
+		}
+		
+		fec::XorInto( recovered.m_payload.data(), media.m_payload.data(), media.m_payload.size() );
+		
+		length 		^= (uint16_t)media.m_payload.size();
+		timestamp 	^= media.m_timestamp;
+	}
+	
+	if( length > recovered.m_payload.size() )
+	{
+		m_fecPacketsInvalid++;
+		isSpentOut = true;
+		return false;
+	}
+	
+	recovered.m_payload.resize( length );
+	recovered.m_timestamp = timestamp;
+	
+	Store( recovered.m_sequence, recovered.m_timestamp, recovered.m_payload.data(), recovered.m_payload.size() );
+	packetsOut.push_back( std::move( recovered ) );
+	
+	m_packetsRecovered++;
+	isSpentOut = true;
+	
+	return true;
+}
+
+void CFecDecoder::Prune()
+{
+	m_sinceLastPrune = 0;
+	
+	for( auto it = m_media.begin(); it != m_media.end(); )
+	{
+		it = ( (uint16_t)( m_newestSequence - it->first ) > k_historyPackets ) ? m_media.erase( it ) : std::next( it );
+	}
+	
+	// Groups that still can't be completed are lost for good
+	m_fec.erase( std::remove_if( m_fec.begin(), m_fec.end(), [this]( const TStoredFec &fecIn )
+	{
+		return (uint16_t)( m_newestSequence - fecIn.m_header.m_snBase ) > k_historyPackets;
+	} ), m_fec.end() );
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+#include "Fec.h"
+
+struct TRecoveredPacket
+{
+	uint16_t 				m_sequence		= 0;
+	uint32_t 				m_timestamp		= 0;
+	std::vector<uint8_t> 	m_payload;
+};
+
+// Receiver side reference decoder for CFecEncoder's SMPTE 2022-1 streams. Keeps a window of recent media and FEC
+// packets and rebuilds any packet that is the only one missing from a column or row. Recovering one packet can
+// complete another group, so it repeats until nothing changes, which is what lets 2D FEC fix bursts longer than L.
+// Written for clarity over speed: it's for the benchmark and for viewers to copy, not for the camera.
+class CFecDecoder
+{
+public:
+	// Attributes
+	uint64_t 	m_packetsRecovered		= 0;
+	uint64_t 	m_fecPacketsInvalid		= 0;
+	
+	// Methods
+	CFecDecoder();
+	virtual ~CFecDecoder();
+	
+	// A received media packet's RTP payload
+	void AddMedia( uint16_t sequenceIn, uint32_t timestampIn, const uint8_t *payloadIn, size_t sizeIn );
+	
+	// A received FEC packet, RTP header included, from either FEC port. Packets it rebuilds are appended to packetsOut.
+	void AddFec( const uint8_t *packetIn, size_t sizeIn, std::vector<TRecoveredPacket> &packetsOut );
+
+private:
+	struct TMedia
+	{
+		uint32_t 				m_timestamp;
+		std::vector<uint8_t> 	m_payload;
+	};
+	
+	struct TStoredFec
+	{
+		fec::TFecHeader 		m_header;
+		std::vector<uint8_t> 	m_payload;
+	};
+	
+	// Attributes
+	std::unordered_map<uint16_t, TMedia> 	m_media;
+	std::deque<TStoredFec> 					m_fec;
+	uint16_t 								m_newestSequence	= 0;
+	size_t 									m_sinceLastPrune	= 0;
+	
+	// Comfortably more than the largest matrix, so a late column packet still finds its media
+	const uint16_t 							k_historyPackets	= 1000;
+	const size_t 							k_pruneInterval		= 256;
+	
+	// Methods
+	void Store( uint16_t sequenceIn, uint32_t timestampIn, const uint8_t *payloadIn, size_t sizeIn );
+	bool TryRecover( const TStoredFec &fecIn, bool &isSpentOut, std::vector<TRecoveredPacket> &packetsOut );
+	void Prune();
+};
@@ -0,0 +1,136 @@
+// Includes
+#include "CFecEncoder.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+CFecEncoder::CFecEncoder( uint8_t columnsIn, uint8_t rowsIn, bool rowFecIn )
+	: m_columns( columnsIn )
+	, m_rows( rowsIn )
+	, m_rowFec( rowFecIn )
+{
+	if( m_columns == 0 || m_columns > fec::k_maxColumns || m_rows == 0 || m_rows > fec::k_maxRows || (size_t)m_columns * m_rows > fec::k_maxMatrixSize )
+	{
+		throw std::runtime_error( "Invalid FEC matrix: " + std::to_string( m_columns ) + "x" + std::to_string( m_rows )
+			+ ". Columns and rows must be 1-20, and at most 100 packets in total." );
+	}
+	
+	std::random_device random;
+	m_columnSequence 	= (uint16_t)random();
+	m_rowSequence 		= (uint16_t)random();
+	m_ssrc 				= random();
+	
+	m_columnAccumulators.resize( m_columns );
+	
+	for( TAccumulator &accumulator : m_columnAccumulators )
+	{
+		accumulator.m_payload.resize( fec::k_maxPayloadSize, 0 );
+		accumulator.m_header.m_isRow 	= false;
+		accumulator.m_header.m_offset 	= m_columns;
+		accumulator.m_header.m_count 	= m_rows;
+	}
+	
+	m_rowAccumulator.m_payload.resize( fec::k_maxPayloadSize, 0 );
+	m_rowAccumulator.m_header.m_isRow 	= true;
+	m_rowAccumulator.m_header.m_offset 	= 1;
+	m_rowAccumulator.m_header.m_count 	= m_columns;
+}
+
+CFecEncoder::~CFecEncoder()
+{
+}
+
+void CFecEncoder::Reset()
+{
+	for( TAccumulator &accumulator : m_columnAccumulators )
+	{
+		Clear( accumulator );
+	}
+	
+	Clear( m_rowAccumulator );
+	
+	m_position = 0;
+}
+
+double CFecEncoder::GetOverhead() const
+{
+	return ( 1.0 / m_rows ) + ( m_rowFec ? 1.0 / m_columns : 0.0 );
+}
+
+void CFecEncoder::Add( uint16_t sequenceIn, uint32_t timestampIn, const uint8_t *payloadIn, size_t sizeIn, std::vector<TFecPacket> &packetsOut )
+{
+	if( sizeIn > fec::k_maxPayloadSize )
+	{
+		throw std::runtime_error( "Packet too large to protect: " + std::to_string( sizeIn ) + " bytes" );
+	}
+	
+	const size_t column = m_position % m_columns;
+	const size_t row 	= m_position / m_columns;
+	
+	Accumulate( m_columnAccumulators[ column ], sequenceIn, timestampIn, payloadIn, sizeIn );
+	
+	if( m_rowFec )
+	{
+		Accumulate( m_rowAccumulator, sequenceIn, timestampIn, payloadIn, sizeIn );
+		
+		if( column + 1 == m_columns )
+		{
+			Emit( m_rowAccumulator, m_rowSequence, timestampIn, packetsOut );
+		}
+	}
+	
+	if( row + 1 == m_rows )
+	{
+		Emit( m_columnAccumulators[ column ], m_columnSequence, timestampIn, packetsOut );
+	}
+	
+	m_position = ( m_position + 1 ) % ( (size_t)m_columns * m_rows );
+}
+
+void CFecEncoder::Accumulate( TAccumulator &accumulatorIn, uint16_t sequenceIn, uint32_t timestampIn, const uint8_t *payloadIn, size_t sizeIn )
+{
+	fec::TFecHeader &header = accumulatorIn.m_header;
+	
+	if( accumulatorIn.m_packets++ == 0 )
+	{
+		header.m_snBase = sequenceIn;
+	}
+	
+	// Shorter payloads count as zero padded to the longest
+	fec::XorInto( accumulatorIn.m_payload.data(), payloadIn, sizeIn );
+	
+	accumulatorIn.m_size 	= std::max( accumulatorIn.m_size, sizeIn );
+	header.m_lengthRecovery ^= (uint16_t)sizeIn;
+	header.m_ptRecovery 	^= fec::k_mediaPayloadType;
+	header.m_tsRecovery 	^= timestampIn;
+}
+
+void CFecEncoder::Emit( TAccumulator &accumulatorIn, uint16_t &sequenceIn, uint32_t timestampIn, std::vector<TFecPacket> &packetsOut )
+{
+	packetsOut.emplace_back();
+	TFecPacket &packet = packetsOut.back();
+	
+	packet.m_isRow = accumulatorIn.m_header.m_isRow;
+	packet.m_data.resize( fec::k_rtpHeaderSize + fec::k_fecHeaderSize + accumulatorIn.m_size );
+	
+	fec::WriteRtpHeader( packet.m_data.data(), fec::k_fecPayloadType, sequenceIn++, timestampIn, m_ssrc );
+	fec::WriteFecHeader( packet.m_data.data() + fec::k_rtpHeaderSize, accumulatorIn.m_header );
+	memcpy( packet.m_data.data() + fec::k_rtpHeaderSize + fec::k_fecHeaderSize, accumulatorIn.m_payload.data(), accumulatorIn.m_size );
+	
+	Clear( accumulatorIn );
+}
+
+void CFecEncoder::Clear( TAccumulator &accumulatorIn )
+{
+	memset( accumulatorIn.m_payload.data(), 0, accumulatorIn.m_size );
+	
+	accumulatorIn.m_size 						= 0;
+	accumulatorIn.m_packets 					= 0;
+	accumulatorIn.m_header.m_lengthRecovery 	= 0;
+	accumulatorIn.m_header.m_ptRecovery 		= 0;
+	accumulatorIn.m_header.m_tsRecovery 		= 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "Fec.h"
+
+// A complete FEC packet, RTP header included, ready to send on the column (port + 2) or row (port + 4) FEC port
+struct TFecPacket
+{
+	bool 					m_isRow		= false;
+	std::vector<uint8_t> 	m_data;
+};
+
+// Builds SMPTE 2022-1 column and row XOR packets over a contiguous run of RTP media packets.
+// Each FEC packet is emitted as soon as the last packet it protects has been added, so a column's
+// parity trails its last packet by at most one row.
+class CFecEncoder
+{
+public:
+	// Methods
+	// columnsIn = L, rowsIn = D. Row FEC is optional (1D vs 2D FEC).
+	CFecEncoder( uint8_t columnsIn, uint8_t rowsIn, bool rowFecIn );
+	virtual ~CFecEncoder();
+	
+	// Protects one media packet's RTP payload. FEC packets it completes are appended to packetsOut.
+	void Add( uint16_t sequenceIn, uint32_t timestampIn, const uint8_t *payloadIn, size_t sizeIn, std::vector<TFecPacket> &packetsOut );
+	
+	// Starts a new matrix, e.g. when the media sequence numbers jump
+	void Reset();
+	
+	// FEC packets per media packet, for reporting
+	double GetOverhead() const;
+
+private:
+	struct TAccumulator
+	{
+		fec::TFecHeader 		m_header;
+		std::vector<uint8_t> 	m_payload;					// Always k_maxPayloadSize, zero past m_size
+		size_t 					m_size			= 0;
+		size_t 					m_packets		= 0;
+	};
+	
+	// Attributes
+	uint8_t 					m_columns;
+	uint8_t 					m_rows;
+	bool 						m_rowFec;
+	
+	std::vector<TAccumulator> 	m_columnAccumulators;
+	TAccumulator 				m_rowAccumulator;
+	size_t 						m_position		= 0;		// Index of the next media packet in the matrix
+	
+	uint16_t 					m_columnSequence;
+	uint16_t 					m_rowSequence;
+	uint32_t 					m_ssrc;
+	
+	// Methods
+	void Accumulate( TAccumulator &accumulatorIn, uint16_t sequenceIn, uint32_t timestampIn, const uint8_t *payloadIn, size_t sizeIn );
+	void Emit( TAccumulator &accumulatorIn, uint16_t &sequenceIn, uint32_t timestampIn, std::vector<TFecPacket> &packetsOut );
+	void Clear( TAccumulator &accumulatorIn );
+};
@@ -0,0 +1,389 @@
+// Includes
+#include "CFragmentRouter.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+using namespace std;
+using namespace CpperoMQ;
+
+CFragmentRouter::CFragmentRouter( CpperoMQ::Context *contextIn, const std::string &endpointIn )
+	: m_subscriberCount( 0 )
+	, m_fragmentsSent( 0 )
+	, m_fragmentsDropped( 0 )
+	, m_fragmentsPassedOver( 0 )
+	, m_router( contextIn->createRouterSocket() )
+	, m_killThread( false )
+{
+	// Unroutable sends fail instead of vanishing, and a full subscriber fails right away instead of blocking the others
+	int mandatory 		= 1;
+	int timeout 		= 0;
+	int highWaterMark 	= k_sendHighWaterMark;
+	
+	zmq_setsockopt( static_cast<void*>( m_router ), ZMQ_ROUTER_MANDATORY, &mandatory, sizeof( mandatory ) );
+	zmq_setsockopt( static_cast<void*>( m_router ), ZMQ_SNDTIMEO, &timeout, sizeof( timeout ) );
+	zmq_setsockopt( static_cast<void*>( m_router ), ZMQ_SNDHWM, &highWaterMark, sizeof( highWaterMark ) );
+	
+	m_router.setLinger( 0 );
+	m_router.bind( endpointIn.c_str() );
+	
+	m_wakeFd = eventfd( 0, EFD_NONBLOCK );
+	
+	if( m_wakeFd < 0 )
+	{
+		throw std::runtime_error( "Failed to create fragment router eventfd" );
+	}
+	
+	// The socket belongs to the router thread from here on
+	m_thread = std::thread( &CFragmentRouter::ThreadLoop, this );
+}
+
+CFragmentRouter::~CFragmentRouter()
+{
+	m_killThread = true;
+	
+	uint64_t wake = 1;
+	if( write( m_wakeFd, &wake, sizeof( wake ) ) < 0 )
+	{
+		cerr << "Failed to wake fragment router thread" << endl;
+	}
+	
+	if( m_thread.joinable() )
+	{
+		m_thread.join();
+	}
+	
+	close( m_wakeFd );
+}
+
+std::vector<TSubscriberStats> CFragmentRouter::GetSubscriberStats()
+{
+	std::lock_guard<std::mutex> lock( m_subscriberMutex );
+	std::vector<TSubscriberStats> stats;
+	
+	for( const TSubscriber &subscriber : m_subscribers )
+	{
+		stats.push_back( subscriber.m_stats );
+	}
+	
+	return stats;
+}
+
+void CFragmentRouter::OnInitSegment( const TFragmentPtr &initSegmentIn )
+{
+	OnFragment( initSegmentIn );
+}
+
+void CFragmentRouter::OnFragment( const TFragmentPtr &fragmentIn )
+{
+	// Called from the muxer thread: only a pointer is queued, the router thread does the rest
+	{
+		std::lock_guard<std::mutex> lock( m_pendingMutex );
+		m_pending.push_back( fragmentIn );
+	}
+	
+	uint64_t wake = 1;
+	if( write( m_wakeFd, &wake, sizeof( wake ) ) < 0 )
+	{
+		// Counter is saturated, the router thread is already due to wake up
+	}
+}
+
+void CFragmentRouter::ThreadLoop()
+{
+	bool hasBacklog = false;
+	
+	while( !m_killThread )
+	{
+		zmq_pollitem_t items[] =
+		{
+			{ static_cast<void*>( m_router ), 0, ZMQ_POLLIN, 0 },
+			{ nullptr, m_wakeFd, ZMQ_POLLIN, 0 }
+		};
+		
+		if( zmq_poll( items, 2, hasBacklog ? k_retryInterval_ms : k_pollTimeout_ms ) < 0 )
+		{
+			if( zmq_errno() != EINTR )
+			{
+				cerr << "Fragment router poll failed: " << zmq_strerror( zmq_errno() ) << endl;
+			}
+			
+			continue;
+		}
+		
+		if( items[ 1 ].revents & ZMQ_POLLIN )
+		{
+			uint64_t count;
+			if( read( m_wakeFd, &count, sizeof( count ) ) < 0 )
+			{
+				// Nothing to clear
+			}
+		}
+		
+		std::lock_guard<std::mutex> lock( m_subscriberMutex );
+		
+		try
+		{
+			if( items[ 0 ].revents & ZMQ_POLLIN )
+			{
+				ReceiveRequests();
+			}
+			
+			DistributePending();
+			
+			hasBacklog = false;
+			
+			for( TSubscriber &subscriber : m_subscribers )
+			{
+				Flush( subscriber );
+				hasBacklog |= !subscriber.m_queue.empty();
+			}
+		}
+		catch( const std::exception &e )
+		{
+			cerr << "Fragment router error: " << e.what() << endl;
+		}
+		
+		m_subscribers.erase( std::remove_if( m_subscribers.begin(), m_subscribers.end(), []( const TSubscriber &subscriberIn ){ return subscriberIn.m_isGone; } ), m_subscribers.end() );
+		m_subscriberCount = (uint32_t)m_subscribers.size();
+	}
+}
+
+void CFragmentRouter::ReceiveRequests()
+{
+	while( true )
+	{
+		zmq_pollitem_t item = { static_cast<void*>( m_router ), 0, ZMQ_POLLIN, 0 };
+		
+		if( zmq_poll( &item, 1, 0 ) <= 0 || !( item.revents & ZMQ_POLLIN ) )
+		{
+			return;
+		}
+		
+		// Identity frame from ROUTER, then whatever the DEALER sent
+		std::vector<std::string> frames;
+		bool more = true;
+		
+		while( more )
+		{
+			IncomingMessage frame;
+			
+			if( !frame.receive( m_router, more ) )
+			{
+				return;
+			}
+			
+			frames.push_back( std::string( frame.charData(), frame.size() ) );
+		}
+		
+		if( frames.size() < 2 )
+		{
+			continue;
+		}
+		
+		TSubscriber *existing = FindSubscriber( frames[ 0 ] );
+		
+		if( frames[ 1 ] == "subscribe" )
+		{
+			if( existing != nullptr )
+			{
+				continue;
+			}
+			
+			if( m_subscribers.size() >= k_maxSubscribers )
+			{
+				cerr << "Fragment router is full, ignoring subscriber" << endl;
+				continue;
+			}
+			
+			TSubscriber subscriber;
+			subscriber.m_identity 		= frames[ 0 ];
+			subscriber.m_stats.m_name 	= ( frames.size() > 2 && !frames[ 2 ].empty() ) ? frames[ 2 ] : "subscriber" + std::to_string( m_subscribersSeen );
+			
+			m_subscribersSeen++;
+			
+			// Late joiners get the current init segment right away, and media from the next keyframe
+			if( m_pInitSegment )
+			{
+				Enqueue( subscriber, m_pInitSegment );
+			}
+			
+			m_subscribers.push_back( std::move( subscriber ) );
+		}
+		else if( frames[ 1 ] == "unsubscribe" && existing != nullptr )
+		{
+			existing->m_isGone = true;
+		}
+	}
+}
+
+void CFragmentRouter::DistributePending()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_pendingMutex );
+		m_draining.swap( m_pending );
+	}
+	
+	for( const TFragmentPtr &fragment : m_draining )
+	{
+		if( fragment->m_isInit )
+		{
+			m_pInitSegment = fragment;
+		}
+		
+		for( TSubscriber &subscriber : m_subscribers )
+		{
+			Enqueue( subscriber, fragment );
+		}
+	}
+	
+	m_draining.clear();
+}
+
+void CFragmentRouter::Enqueue( TSubscriber &subscriberIn, const TFragmentPtr &fragmentIn )
+{
+	if( fragmentIn->m_isInit )
+	{
+		// The muxer restarted: start over with the new init segment at the next keyframe
+		subscriberIn.m_queue.push_back( fragmentIn );
+		subscriberIn.m_stats.m_queuedBytes += fragmentIn->m_data.size();
+		subscriberIn.m_waitingForKeyframe 	= true;
+		subscriberIn.m_isCatchingUp 		= false;
+		return;
+	}
+	
+	if( subscriberIn.m_waitingForKeyframe )
+	{
+		if( !fragmentIn->m_isKeyframe )
+		{
+			// Still paying for a skip is a loss. Waiting to start is not.
+			if( subscriberIn.m_isCatchingUp )
+			{
+				Drop( subscriberIn );
+			}
+			else
+			{
+				PassOver( subscriberIn );
+			}
+			
+			return;
+		}
+		
+		subscriberIn.m_waitingForKeyframe 	= false;
+		subscriberIn.m_isCatchingUp 		= false;
+	}
+	
+	subscriberIn.m_queue.push_back( fragmentIn );
+	subscriberIn.m_stats.m_queuedBytes += fragmentIn->m_data.size();
+	
+	// Lag is measured on the mux clock, from the oldest media still queued to this fragment
+	auto oldest = std::find_if( subscriberIn.m_queue.begin(), subscriberIn.m_queue.end(), []( const TFragmentPtr &queuedIn ){ return !queuedIn->m_isInit; } );
+	
+	if( ( fragmentIn->m_timestamp_us - (*oldest)->m_timestamp_us ) > k_maxLag_us || subscriberIn.m_stats.m_queuedBytes > k_maxQueuedBytes )
+	{
+		SkipToKeyframe( subscriberIn );
+	}
+}
+
+void CFragmentRouter::SkipToKeyframe( TSubscriber &subscriberIn )
+{
+	std::deque<TFragmentPtr> &queue = subscriberIn.m_queue;
+	
+	// Resume at the newest queued keyframe, unless that is the oldest fragment too. Then nothing queued helps, wait for the next one.
+	auto newestKeyframe = std::find_if( queue.rbegin(), queue.rend(), []( const TFragmentPtr &queuedIn ){ return queuedIn->m_isKeyframe && !queuedIn->m_isInit; } );
+	auto oldest 		= std::find_if( queue.begin(), queue.end(), []( const TFragmentPtr &queuedIn ){ return !queuedIn->m_isInit; } );
+	
+	bool isUseful 	= ( newestKeyframe != queue.rend() ) && ( *newestKeyframe != *oldest );
+	size_t keepFrom = isUseful ? (size_t)( queue.rend() - newestKeyframe - 1 ) : queue.size();
+	
+	// Init segments are kept: they are tiny, and what follows them needs them
+	std::deque<TFragmentPtr> kept;
+	
+	for( size_t i = 0; i < queue.size(); ++i )
+	{
+		if( i >= keepFrom || queue[ i ]->m_isInit )
+		{
+			kept.push_back( queue[ i ] );
+		}
+		else
+		{
+			subscriberIn.m_stats.m_queuedBytes -= queue[ i ]->m_data.size();
+			Drop( subscriberIn );
+		}
+	}
+	
+	queue.swap( kept );
+	
+	subscriberIn.m_waitingForKeyframe 	= !isUseful;
+	subscriberIn.m_isCatchingUp 		= !isUseful;
+	subscriberIn.m_stats.m_skips++;
+}
+
+void CFragmentRouter::Flush( TSubscriber &subscriberIn )
+{
+	while( !subscriberIn.m_queue.empty() && !subscriberIn.m_isGone )
+	{
+		const TFragmentPtr &fragment = subscriberIn.m_queue.front();
+		
+		try
+		{
+			// The identity frame is where ZMQ checks the subscriber's pipe. Once it is accepted, the rest of the message is too.
+			OutgoingMessage identity( subscriberIn.m_identity.size(), subscriberIn.m_identity.data() );
+			
+			if( !identity.send( m_router, true ) )
+			{
+				return;
+			}
+			
+			OutgoingMessage topic( fragment->m_isInit ? "i" : "v" );
+			OutgoingMessage payload( fragment->m_data.size(), fragment->m_data.data() );
+			
+			topic.send( m_router, true );
+			payload.send( m_router, false );
+		}
+		catch( const std::exception & )
+		{
+			// Unroutable: the subscriber disconnected without saying so
+			subscriberIn.m_isGone = true;
+			return;
+		}
+		
+		subscriberIn.m_stats.m_queuedBytes -= fragment->m_data.size();
+		subscriberIn.m_stats.m_fragmentsSent++;
+		m_fragmentsSent++;
+		
+		subscriberIn.m_queue.pop_front();
+	}
+}
+
+void CFragmentRouter::Drop( TSubscriber &subscriberIn )
+{
+	subscriberIn.m_stats.m_fragmentsDropped++;
+	m_fragmentsDropped++;
+}
+
+void CFragmentRouter::PassOver( TSubscriber &subscriberIn )
+{
+	// Expected after every subscribe and init segment. It says nothing about the subscriber keeping up, so it isn't a drop.
+	subscriberIn.m_stats.m_fragmentsPassedOver++;
+	m_fragmentsPassedOver++;
+}
+
+CFragmentRouter::TSubscriber* CFragmentRouter::FindSubscriber( const std::string &identityIn )
+{
+	for( TSubscriber &subscriber : m_subscribers )
+	{
+		if( subscriber.m_identity == identityIn )
+		{
+			return &subscriber;
+		}
+	}
+	
+	return nullptr;
+}
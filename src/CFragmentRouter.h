@@ -0,0 +1,101 @@
+#pragma once
+
+// Includes
+#include <CpperoMQ/All.hpp>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "CFragmentSink.h"
+
+struct TSubscriberStats
+{
+	std::string 	m_name;
+	uint64_t 		m_fragmentsSent		= 0;
+	uint64_t 		m_fragmentsDropped	= 0;		// Lost to falling behind
+	uint64_t 		m_fragmentsPassedOver	= 0;	// Waiting for a keyframe to start at, after subscribing or a new init segment
+	uint64_t 		m_skips				= 0;		// Times the subscriber fell behind and was moved on to a keyframe
+	size_t 			m_queuedBytes		= 0;
+};
+
+// Delivers muxed fragments over a ZMQ ROUTER socket, with a bounded queue per subscriber. The PUB socket drops whatever
+// hits a slow subscriber's high water mark, mid-GOP included, and that viewer shows corruption until the next IDR.
+//
+// A subscriber connects a DEALER and sends "subscribe", optionally followed by a name frame for the health report. It then
+// gets the same two part messages as the PUB socket: "i" + init segment, followed by "v" + fragment from the next keyframe on.
+// "unsubscribe" or disconnecting ends it.
+//
+// A subscriber that falls more than k_maxLag_us (or k_maxQueuedBytes) behind skips whole fragments up to the newest keyframe
+// it has queued, or waits for the next one. Slow subscribers get fewer frames instead of broken ones, and never hold up the others.
+class CFragmentRouter : public CFragmentSink
+{
+public:
+	// Attributes
+	std::atomic<uint32_t> 		m_subscriberCount;
+	std::atomic<uint64_t> 		m_fragmentsSent;
+	std::atomic<uint64_t> 		m_fragmentsDropped;
+	std::atomic<uint64_t> 		m_fragmentsPassedOver;
+	
+	// Methods
+	CFragmentRouter( CpperoMQ::Context *contextIn, const std::string &endpointIn );
+	virtual ~CFragmentRouter();
+	
+	std::vector<TSubscriberStats> GetSubscriberStats();
+	
+	// CFragmentSink
+	virtual void OnInitSegment( const TFragmentPtr &initSegmentIn );
+	virtual void OnFragment( const TFragmentPtr &fragmentIn );
+
+private:
+	struct TSubscriber
+	{
+		std::string 				m_identity;
+		TSubscriberStats 			m_stats;
+		std::deque<TFragmentPtr> 	m_queue;
+		bool 						m_waitingForKeyframe	= true;
+		bool 						m_isCatchingUp			= false;	// Waiting because it fell behind, not to start
+		bool 						m_isGone				= false;
+	};
+	
+	// Attributes
+	CpperoMQ::RouterSocket 			m_router;
+	int 							m_wakeFd				= -1;
+	uint64_t 						m_subscribersSeen		= 0;
+	
+	// Filled by the muxer thread, drained by the router thread
+	std::mutex 						m_pendingMutex;
+	std::vector<TFragmentPtr> 		m_pending;
+	std::vector<TFragmentPtr> 		m_draining;
+	
+	// Router thread only, apart from GetSubscriberStats()
+	std::mutex 						m_subscriberMutex;
+	std::vector<TSubscriber> 		m_subscribers;
+	TFragmentPtr 					m_pInitSegment;
+	
+	std::thread 					m_thread;
+	std::atomic<bool> 				m_killThread;
+	
+	const size_t 					k_maxSubscribers		= 16;
+	const int64_t 					k_maxLag_us				= 1000000;
+	const size_t 					k_maxQueuedBytes		= 8 * 1024 * 1024;
+	const int 						k_sendHighWaterMark		= 4;		// Messages held by ZMQ per subscriber, beyond our own queue
+	const long 						k_pollTimeout_ms		= 100;
+	const long 						k_retryInterval_ms		= 5;		// While a subscriber has a backlog. ROUTER has no per-peer POLLOUT.
+	
+	// Methods
+	void ThreadLoop();
+	void ReceiveRequests();
+	void DistributePending();
+	
+	void Enqueue( TSubscriber &subscriberIn, const TFragmentPtr &fragmentIn );
+	void SkipToKeyframe( TSubscriber &subscriberIn );
+	void Flush( TSubscriber &subscriberIn );
+	void Drop( TSubscriber &subscriberIn );
+	void PassOver( TSubscriber &subscriberIn );
+	
+	TSubscriber* FindSubscriber( const std::string &identityIn );
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A single muxed output unit. The init segment is ftyp+moov, every other fragment is one moof+mdat.
+struct TFragment
+{
+	std::vector<uint8_t> 	m_data;
+	
+	int64_t 				m_timestamp_us 	= 0;		// When the frame was muxed (av_gettime), which is also its pts. Counted from 0 at the frame rate when remuxing a file.
+	uint64_t 				m_sequence 		= 0;
+	bool 					m_isKeyframe 	= false;
+	bool 					m_isInit 		= false;
+};
+
+// Fragments are immutable once published, so sinks share them instead of copying
+typedef std::shared_ptr<const TFragment> TFragmentPtr;
+
+class CFragmentSink
+{
+public:
+	virtual ~CFragmentSink(){}
+	
+	// Called from the muxer thread. Implementations must not block.
+	virtual void OnInitSegment( const TFragmentPtr &initSegmentIn ) = 0;
+	virtual void OnFragment( const TFragmentPtr &fragmentIn ) = 0;
+};
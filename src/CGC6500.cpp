@@ -5,6 +5,9 @@
 
 #include "CGC6500.h"
 #include "CVideoChannel.h"
+#include "CHttpServer.h"
+#include "CRtspServer.h"
+#include "CWebRtcServer.h"
 #include "Utility.h"
 
 extern "C" 
@@ -22,6 +25,7 @@ CGC6500::CGC6500( const std::string &cameraNameIn, CpperoMQ::Context *contextIn
 	: m_pContext( contextIn )
 	, m_cameraName( cameraNameIn )
 	, m_cameraRegistrar( contextIn )
+	, m_faststartWorker( [this](){ return IsAnyChannelUnderPressure(); } )
 {
 	if( std::all_of( m_cameraName.begin(), m_cameraName.end(), ::isdigit ) == false )
 	{
@@ -50,11 +54,20 @@ CGC6500::CGC6500( const std::string &cameraNameIn, CpperoMQ::Context *contextIn
 	
 	cout << "Camera initialized" << endl;
 	
-	// Registration
-	if( m_cameraRegistrar.RegisterCamera( m_cameraName ) == false )
+	// Registration completes in the background. Capture and muxing don't wait on cockpit.
+	std::string cameraName( m_cameraName );
+	
+	m_cameraRegistrar.RegisterCamera( m_cameraName, [ cameraName ]( bool acceptedIn )
 	{
-		throw std::runtime_error( "Failed to register camera: " + m_cameraName );
-	}
+		if( acceptedIn )
+		{
+			cout << "Registered camera " << cameraName << endl;
+		}
+		else
+		{
+			cerr << "Failed to register camera: " << cameraName << endl;
+		}
+	} );
 	
 	// Create channels
 	CreateChannels();
@@ -62,6 +75,9 @@ CGC6500::CGC6500( const std::string &cameraNameIn, CpperoMQ::Context *contextIn
 
 CGC6500::~CGC6500()
 {
+	// The worker checks on the channels, so stop it before they go away
+	m_faststartWorker.Stop();
+	
 	if( m_initialized )
 	{
 		// Deinit mxuvc
@@ -78,6 +94,37 @@ CGC6500::~CGC6500()
 	}
 }
 
+void CGC6500::AttachHttpStreams( CHttpServer &serverIn )
+{
+	for( auto &channel : m_pChannels )
+	{
+		std::string name( "video" + m_cameraName + "_" + std::to_string( (int)channel->GetChannel() ) );
+		
+		channel->AddFragmentSink( serverIn.AddStream( name ) );
+		
+		if( channel->IsMjpeg() )
+		{
+			channel->SetJpegInput( serverIn.AddJpegStream( name ) );
+		}
+	}
+}
+
+void CGC6500::AttachRtspStreams( CRtspServer &serverIn )
+{
+	for( auto &channel : m_pChannels )
+	{
+		channel->SetRtspInput( serverIn.AddStream( "video" + m_cameraName + "_" + std::to_string( (int)channel->GetChannel() ) ) );
+	}
+}
+
+void CGC6500::AttachWebRtcStreams( CWebRtcServer &serverIn )
+{
+	for( auto &channel : m_pChannels )
+	{
+		channel->SetWebRtcInput( serverIn.AddStream( "video" + m_cameraName + "_" + std::to_string( (int)channel->GetChannel() ) ) );
+	}
+}
+
 void CGC6500::CreateChannels()
 {
 	// Get the number of channels on the camera
@@ -96,18 +143,33 @@ void CGC6500::CreateChannels()
 			// Attempt to create channel
 			auto channel( util::make_unique<CVideoChannel>( m_cameraName, (video_channel_t)i , m_pContext ) );
 			
-			m_pChannels.push_back( std::move( channel ) );
-			
-			cout << "Registering channel " << i << endl;
+			channel->SetSegmentClosedCallback( [this]( const std::string &segmentPathIn ){ m_faststartWorker.Queue( segmentPathIn ); } );
 			
-			// Register channel with cockpit
-			if( m_cameraRegistrar.RegisterChannel( m_cameraName, i ) == false )
 			{
-				m_pChannels.pop_back();
-				throw std::runtime_error( "Registration denied" );
+				std::lock_guard<std::mutex> lock( m_channelMutex );
+				m_pChannels.push_back( std::move( channel ) );
 			}
 			
-			cout << "Registered channel " << i << endl;
+			cout << "Registering channel " << i << endl;
+			
+			// Register channel with cockpit. The reply arrives asynchronously.
+			std::string cameraName( m_cameraName );
+			
+			m_cameraRegistrar.RegisterChannel( m_cameraName, i, [ this, cameraName, i ]( bool acceptedIn )
+			{
+				if( acceptedIn )
+				{
+					cout << "Registered channel " << i << endl;
+				}
+				else
+				{
+					cerr << "Registration denied for channel " << i << " on camera: " << cameraName << endl;
+					
+					// The channel is removed on the main thread, which owns it
+					std::lock_guard<std::mutex> lock( m_deniedMutex );
+					m_deniedChannels.push_back( i );
+				}
+			} );
 		}
 		catch( const std::exception &e )
 		{
@@ -137,10 +199,22 @@ void CGC6500::HandleMessage( const nlohmann::json &commandIn )
 	{		
 		if( commandIn[ "cmd" ].get<std::string>() == "chCmd" )
 		{
-			size_t channelNum = commandIn.at( "ch" ).get<size_t>();
+			uint32_t channelNum = commandIn.at( "ch" ).get<uint32_t>();
+			
+			// By channel number, not position: denied channels are removed from the list
+			auto it = std::find_if( m_pChannels.begin(), m_pChannels.end(), [ channelNum ]( const std::unique_ptr<CVideoChannel> &channelIn ){ return channelIn->GetChannel() == (video_channel_t)channelNum; } );
+			
+			if( it == m_pChannels.end() )
+			{
+				throw std::runtime_error( "Unknown channel: " + std::to_string( channelNum ) );
+			}
 			
 			// Pass message down to specified channel
-			m_pChannels.at( channelNum )->HandleMessage( commandIn );
+			(*it)->HandleMessage( commandIn );
+		}
+		else if( commandIn[ "cmd" ].get<std::string>() == "faststart_cancel" )
+		{
+			m_faststartWorker.CancelAll();
 		}
 		else
 		{
@@ -153,6 +227,65 @@ void CGC6500::HandleMessage( const nlohmann::json &commandIn )
 	}
 }
 
+void CGC6500::Update()
+{
+	RemoveDeniedChannels();
+	
+	for( auto &channel : m_pChannels )
+	{
+		try
+		{
+			channel->Update();
+		}
+		catch( const std::exception &e )
+		{
+			std::cerr << "Error updating channel: " << e.what() << std::endl;
+		}
+	}
+}
+
+void CGC6500::RemoveDeniedChannels()
+{
+	std::vector<uint32_t> denied;
+	
+	{
+		std::lock_guard<std::mutex> lock( m_deniedMutex );
+		denied.swap( m_deniedChannels );
+	}
+	
+	for( uint32_t channelNum : denied )
+	{
+		auto it = std::find_if( m_pChannels.begin(), m_pChannels.end(), [ channelNum ]( const std::unique_ptr<CVideoChannel> &channelIn ){ return channelIn->GetChannel() == (video_channel_t)channelNum; } );
+		
+		if( it == m_pChannels.end() )
+		{
+			continue;
+		}
+		
+		// It may already be streaming, and the video callback points at the channel
+		mxuvc_video_stop( (*it)->GetChannel() );
+		
+		std::lock_guard<std::mutex> lock( m_channelMutex );
+		m_pChannels.erase( it );
+		
+		cout << "Removed channel " << channelNum << endl;
+	}
+}
+
+bool CGC6500::IsAnyChannelUnderPressure()
+{
+	std::lock_guard<std::mutex> lock( m_channelMutex );
+	bool underPressure = false;
+	
+	// Check every channel, so each one's drop counters stay current
+	for( auto &channel : m_pChannels )
+	{
+		underPressure |= channel->IsUnderPressure();
+	}
+	
+	return underPressure;
+}
+
 bool CGC6500::IsAlive()
 {
 	return mxuvc_video_alive() == 1;
@@ -3,11 +3,18 @@
 // Includes
 #include <mxuvc.h>
 #include <json.hpp>
+#include <mutex>
+#include <vector>
+#include <memory>
 
 #include "CCameraRegistrar.h"
+#include "CFaststartWorker.h"
 
 // Forward decs
 class CVideoChannel;
+class CHttpServer;
+class CRtspServer;
+class CWebRtcServer;
 
 // Defines
 #define VIDEO_BACKEND "\"v4l2\""
@@ -20,7 +27,13 @@ public:
 	virtual ~CGC6500();
 	
 	void HandleMessage( const nlohmann::json &commandIn );
+	void Update();
 	bool IsAlive();
+	
+	// Adds a stream named video<camera>_<channel> to the server for every channel
+	void AttachHttpStreams( CHttpServer &serverIn );
+	void AttachRtspStreams( CRtspServer &serverIn );
+	void AttachWebRtcStreams( CWebRtcServer &serverIn );
 
 private:	
 	// Pointers
@@ -29,10 +42,20 @@ private:
 	// Attributes
 	bool											m_initialized = false;
 	std::string 									m_cameraName;
+	
+	// Filled by registration replies on the registrar's thread, removed in Update(). Declared before the registrar,
+	// whose thread can still deliver replies while it shuts down.
+	std::mutex 										m_deniedMutex;
+	std::vector<uint32_t> 							m_deniedChannels;
+	
 	CCameraRegistrar								m_cameraRegistrar;
+	CFaststartWorker								m_faststartWorker;
 	
 	std::vector<std::unique_ptr<CVideoChannel>> 	m_pChannels;
+	std::mutex 										m_channelMutex;		// Only taken where the channel list changes or is used off the main thread
 	
 	// Methods
 	void CreateChannels();
+	void RemoveDeniedChannels();
+	bool IsAnyChannelUnderPressure();
 };
\ No newline at end of file
@@ -10,14 +10,40 @@ using namespace CpperoMQ;
 
 using json = nlohmann::json;
 
-CGeomux::CGeomux( int argCountIn, char* argsIn[] )
+namespace
+{
+	// Both servers together put at most this much on the wire back to back
+	const size_t k_pacingBurstBytes = 16 * 1024;
+}
+
+CGeomux::CGeomux( int argCountIn, char* argsIn[], const std::string &cameraOffsetIn, uint16_t httpPortIn, uint16_t rtspPortIn, uint16_t webRtcPortIn, uint64_t paceRate_bpsIn )
 	: CApp( argCountIn, argsIn )
-	, m_cameraOffset( ( (m_arguments.size() > 1 ) ? m_arguments.at( 1 ) : "0" ) )
+	, m_cameraOffset( cameraOffsetIn )
 	, m_commandSubscriber( m_cameraOffset, &m_context )
+	, m_pPacingBucket( ( paceRate_bpsIn != 0 ) ? std::make_shared<CTokenBucket>( paceRate_bpsIn, k_pacingBurstBytes ) : nullptr )
+	, m_pHttpServer( ( httpPortIn != 0 ) ? util::make_unique<CHttpServer>( httpPortIn ) : nullptr )
+	, m_pRtspServer( ( rtspPortIn != 0 ) ? util::make_unique<CRtspServer>( rtspPortIn, m_pPacingBucket ) : nullptr )
+	, m_pWebRtcServer( ( webRtcPortIn != 0 ) ? util::make_unique<CWebRtcServer>( webRtcPortIn, m_pPacingBucket ) : nullptr )
 	, m_gc6500( m_cameraOffset, &m_context )
 	, m_lastExecutionTime( std::chrono::steady_clock::now() )
 {	
+	if( m_pHttpServer )
+	{
+		m_gc6500.AttachHttpStreams( *m_pHttpServer );
+		m_pHttpServer->Start();
+	}
 	
+	if( m_pRtspServer )
+	{
+		m_gc6500.AttachRtspStreams( *m_pRtspServer );
+		m_pRtspServer->Start();
+	}
+	
+	if( m_pWebRtcServer )
+	{
+		m_gc6500.AttachWebRtcStreams( *m_pWebRtcServer );
+		m_pWebRtcServer->Start();
+	}
 }
 
 CGeomux::~CGeomux(){ cout << "Cleaning up CGeomux" << endl; }
@@ -45,6 +71,7 @@ void CGeomux::Run()
 void CGeomux::Update()
 {	
 	HandleMessages();
+	m_gc6500.Update();
 	
 	if( ( std::chrono::steady_clock::now() - m_lastExecutionTime ) > std::chrono::seconds( 5 ) )
 	{
@@ -56,6 +83,8 @@ void CGeomux::Update()
 			Shutdown();
 		}
 		
+		ReportPacing();
+		
 		m_lastExecutionTime = std::chrono::steady_clock::now();
 	}
 }
@@ -97,6 +126,33 @@ void CGeomux::HandleMessages()
 	}
 }
 
+void CGeomux::ReportPacing()
+{
+	auto report = []( const char *nameIn, const TPacingStats *statsIn )
+	{
+		if( statsIn == nullptr || statsIn->m_packetsPaced == 0 )
+		{
+			return;
+		}
+		
+		uint64_t paced = statsIn->m_packetsPaced;
+		
+		cout << nameIn << " pacing: " << paced << " packets, " << statsIn->m_packetsDelayed << " delayed, "
+			<< ( statsIn->m_totalDelay_us / paced ) << " us mean delay, " << statsIn->m_maxDelay_us << " us max, "
+			<< statsIn->m_packetsDropped << " dropped" << endl;
+	};
+	
+	if( m_pRtspServer )
+	{
+		report( "RTSP", m_pRtspServer->GetPacingStats() );
+	}
+	
+	if( m_pWebRtcServer )
+	{
+		report( "WebRTC", m_pWebRtcServer->GetPacingStats() );
+	}
+}
+
 void CGeomux::Shutdown()
 {
 	m_quit = true;
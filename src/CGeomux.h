@@ -3,16 +3,22 @@
 // Includes
 #include <CpperoMQ/All.hpp>
 #include <chrono>
+#include <memory>
 
 #include "CApp.h"
 #include "CCommandSubscriber.h"
 #include "CGC6500.h"
+#include "CHttpServer.h"
+#include "CRtspServer.h"
+#include "CWebRtcServer.h"
 
 class CGeomux : public CApp
 {
 public:
 	// Methods
-	CGeomux( int argCountIn, char* argsIn[] );
+	// A port of 0 disables the corresponding built-in server. A pacing rate of 0 disables pacing of their UDP output. The rate
+	// is shared by the RTSP and WebRTC servers together, since they go out over the same link.
+	CGeomux( int argCountIn, char* argsIn[], const std::string &cameraOffsetIn, uint16_t httpPortIn, uint16_t rtspPortIn, uint16_t webRtcPortIn, uint64_t paceRate_bpsIn );
 	virtual ~CGeomux();
 
 	virtual void Run();
@@ -23,6 +29,13 @@ private:
 	
 	std::string					m_cameraOffset;
 	CCommandSubscriber			m_commandSubscriber;
+	
+	// Declared before the camera so they outlive the channels feeding them
+	std::shared_ptr<CTokenBucket>	m_pPacingBucket;
+	std::unique_ptr<CHttpServer>	m_pHttpServer;
+	std::unique_ptr<CRtspServer>	m_pRtspServer;
+	std::unique_ptr<CWebRtcServer>	m_pWebRtcServer;
+	
 	CGC6500 					m_gc6500;
 	
 	std::chrono::steady_clock::time_point m_lastExecutionTime;
@@ -30,6 +43,7 @@ private:
 	// Methods
 	void Update();
 	void HandleMessages();
+	void ReportPacing();
 	
 	void Shutdown();
 	void Restart();
@@ -0,0 +1,616 @@
+// Includes
+#include "CHlsWriter.h"
+#include "Mp4Box.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace
+{
+	const char *k_playlistName = "live.m3u8";
+	
+	void WriteAll( int fdIn, const uint8_t *dataIn, size_t sizeIn, const std::string &pathIn )
+	{
+		while( sizeIn > 0 )
+		{
+			ssize_t bytesWritten = write( fdIn, dataIn, sizeIn );
+			
+			if( bytesWritten < 0 )
+			{
+				if( errno == EINTR )
+				{
+					continue;
+				}
+				
+				throw std::runtime_error( "Failed to write " + pathIn + ": " + strerror( errno ) );
+			}
+			
+			dataIn += bytesWritten;
+			sizeIn -= bytesWritten;
+		}
+	}
+	
+	std::string FormatSeconds( double secondsIn )
+	{
+		char buffer[ 32 ];
+		snprintf( buffer, sizeof( buffer ), "%.3f", secondsIn );
+		return std::string( buffer );
+	}
+}
+
+CHlsWriter::CHlsWriter()
+	: m_isRunning( false )
+	, m_partsWritten( 0 )
+	, m_segmentsWritten( 0 )
+	, m_fragmentsDropped( 0 )
+	, m_killThread( false )
+{
+}
+
+CHlsWriter::~CHlsWriter()
+{
+	try
+	{
+		Stop();
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error cleaning up CHlsWriter: " << e.what() << endl;
+	}
+}
+
+void CHlsWriter::Start( const THlsConfig &configIn )
+{
+	if( m_thread.joinable() )
+	{
+		throw std::runtime_error( "Already writing HLS" );
+	}
+	
+	struct stat info;
+	
+	if( stat( configIn.m_directory.c_str(), &info ) != 0 || !S_ISDIR( info.st_mode ) )
+	{
+		throw std::runtime_error( "HLS directory does not exist: " + configIn.m_directory );
+	}
+	
+	if( configIn.m_partTarget_ms == 0 || configIn.m_playlistSegments == 0 )
+	{
+		throw std::runtime_error( "Part duration and playlist length must be non-zero" );
+	}
+	
+	m_config 			= configIn;
+	m_initIndex 		= 0;
+	m_haveInit 			= false;
+	m_nextSequence 		= 0;
+	m_segmentFd 		= -1;
+	m_targetDuration_s 	= 1;
+	m_frameInterval 	= 0;
+	m_segments.clear();
+	m_partFragments.clear();
+	
+	m_partsWritten 		= 0;
+	m_segmentsWritten 	= 0;
+	m_fragmentsDropped 	= 0;
+	
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		
+		m_queue.clear();
+		m_queuedBytes 	= 0;
+		m_needKeyframe 	= true;
+		
+		// Start from the current init segment, the muxer only sends a new one on restart
+		if( m_pInitSegment )
+		{
+			m_queue.push_back( m_pInitSegment );
+		}
+	}
+	
+	m_killThread 	= false;
+	m_isRunning 	= true;
+	
+	m_thread = std::thread( &CHlsWriter::ThreadLoop, this );
+}
+
+void CHlsWriter::Stop()
+{
+	if( !m_thread.joinable() )
+	{
+		return;
+	}
+	
+	m_isRunning 	= false;
+	m_killThread 	= true;
+	
+	m_dataAvailableCondition.notify_one();
+	m_thread.join();
+	
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_queue.clear();
+		m_queuedBytes = 0;
+	}
+	
+	// A stale playlist would look like a stalled stream to players
+	RemoveFiles();
+}
+
+void CHlsWriter::OnInitSegment( const TFragmentPtr &initSegmentIn )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_pInitSegment = initSegmentIn;
+	
+	if( m_isRunning )
+	{
+		m_queue.push_back( initSegmentIn );
+		m_needKeyframe = true;
+	}
+}
+
+void CHlsWriter::OnFragment( const TFragmentPtr &fragmentIn )
+{
+	if( !m_isRunning )
+	{
+		return;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		
+		if( m_needKeyframe && !fragmentIn->m_isKeyframe )
+		{
+			m_fragmentsDropped++;
+			return;
+		}
+		
+		// The writer has fallen behind. Drop rather than stall the live path, and tell the writer to end the segment there.
+		if( m_queuedBytes + fragmentIn->m_data.size() > m_config.m_maxQueuedBytes )
+		{
+			if( !m_needKeyframe )
+			{
+				m_queue.push_back( nullptr );
+			}
+			
+			m_fragmentsDropped++;
+			m_needKeyframe = true;
+			return;
+		}
+		
+		m_needKeyframe = false;
+		m_queuedBytes += fragmentIn->m_data.size();
+		m_queue.push_back( fragmentIn );
+	}
+	
+	m_dataAvailableCondition.notify_one();
+}
+
+void CHlsWriter::ThreadLoop()
+{
+	try
+	{
+		while( true )
+		{
+			std::deque<TFragmentPtr> work;
+			
+			{
+				std::unique_lock<std::mutex> lock( m_mutex );
+				
+				m_dataAvailableCondition.wait_for( lock, k_wakeInterval, [this](){ return m_killThread || !m_queue.empty(); } );
+				
+				work.swap( m_queue );
+				m_queuedBytes = 0;
+			}
+			
+			for( auto &fragment : work )
+			{
+				if( !fragment )
+				{
+					EndSegment();
+				}
+				else if( fragment->m_isInit )
+				{
+					HandleInitSegment( fragment );
+				}
+				else
+				{
+					WriteFragment( fragment );
+				}
+			}
+			
+			if( m_killThread )
+			{
+				break;
+			}
+		}
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "HLS output stopped due to error: " << e.what() << endl;
+		m_isRunning = false;
+	}
+	
+	if( m_segmentFd >= 0 )
+	{
+		close( m_segmentFd );
+		m_segmentFd = -1;
+	}
+}
+
+void CHlsWriter::HandleInitSegment( const TFragmentPtr &initSegmentIn )
+{
+	// Fragments of the old init segment are done. The new one is written when its first segment starts.
+	EndSegment();
+	
+	m_pPendingInit = initSegmentIn;
+	
+	if( !mp4::GetTrackTimescale( initSegmentIn->m_data.data(), initSegmentIn->m_data.size(), m_trackTimescale ) || m_trackTimescale == 0 )
+	{
+		m_trackTimescale = 90000;
+	}
+}
+
+void CHlsWriter::WriteFragment( const TFragmentPtr &fragmentIn )
+{
+	uint64_t decodeTime;
+	
+	if( ( !m_haveInit && !m_pPendingInit ) || !mp4::GetBaseMediaDecodeTime( fragmentIn->m_data.data(), fragmentIn->m_data.size(), decodeTime ) )
+	{
+		m_fragmentsDropped++;
+		return;
+	}
+	
+	if( m_segmentFd >= 0 && decodeTime > m_lastDecodeTime )
+	{
+		m_frameInterval = decodeTime - m_lastDecodeTime;
+	}
+	
+	if( fragmentIn->m_isKeyframe )
+	{
+		// One segment per GOP, so every segment starts independently decodable
+		bool closedSegment = ( m_segmentFd >= 0 );
+		
+		if( closedSegment )
+		{
+			ClosePart( decodeTime );
+			CloseSegment( decodeTime );
+		}
+		
+		OpenSegment( decodeTime );
+		
+		if( closedSegment )
+		{
+			WritePlaylist();
+		}
+	}
+	else if( m_segmentFd < 0 )
+	{
+		// Waiting for a keyframe
+		m_fragmentsDropped++;
+		return;
+	}
+	else
+	{
+		// Close the part if this frame would take it past the part target
+		const uint64_t partTarget = (uint64_t)m_config.m_partTarget_ms * m_trackTimescale / 1000;
+		
+		if( !m_partFragments.empty() && ( decodeTime - m_partStartTime ) + m_frameInterval > partTarget )
+		{
+			ClosePart( decodeTime );
+			WritePlaylist();
+		}
+	}
+	
+	if( m_partFragments.empty() )
+	{
+		m_partStartTime = decodeTime;
+	}
+	
+	m_partFragments.push_back( fragmentIn );
+	m_lastDecodeTime = decodeTime;
+}
+
+void CHlsWriter::OpenSegment( uint64_t decodeTimeIn )
+{
+	if( m_pPendingInit )
+	{
+		// Consecutive indices, so each index change in the playlist is exactly one discontinuity
+		m_initIndex = m_haveInit ? m_initIndex + 1 : 0;
+		m_haveInit 	= true;
+		
+		WriteFile( GetInitName( m_initIndex ), std::vector<TFragmentPtr>{ m_pPendingInit } );
+		m_pPendingInit.reset();
+	}
+	
+	TSegment segment;
+	segment.m_sequence 	= m_nextSequence++;
+	segment.m_initIndex = m_initIndex;
+	
+	// The segment is its parts back to back, so it is appended to as parts close and renamed into place at the end
+	const std::string path = GetPath( GetSegmentName( segment.m_sequence ) ) + ".tmp";
+	
+	m_segmentFd = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+	
+	if( m_segmentFd < 0 )
+	{
+		throw std::runtime_error( "Failed to open " + path + ": " + strerror( errno ) );
+	}
+	
+	m_segments.push_back( segment );
+	m_segmentStartTime = decodeTimeIn;
+	m_partFragments.clear();
+}
+
+void CHlsWriter::ClosePart( uint64_t decodeTimeIn )
+{
+	if( m_partFragments.empty() || m_segments.empty() )
+	{
+		return;
+	}
+	
+	TSegment &segment = m_segments.back();
+	
+	TPart part;
+	part.m_index 			= (uint32_t)segment.m_parts.size();
+	part.m_duration_s 		= (double)( decodeTimeIn - m_partStartTime ) / m_trackTimescale;
+	part.m_isIndependent 	= m_partFragments.front()->m_isKeyframe;
+	
+	WriteFile( GetPartName( segment.m_sequence, part.m_index ), m_partFragments );
+	
+	const std::string path = GetPath( GetSegmentName( segment.m_sequence ) );
+	
+	for( auto &fragment : m_partFragments )
+	{
+		WriteAll( m_segmentFd, fragment->m_data.data(), fragment->m_data.size(), path );
+	}
+	
+	segment.m_parts.push_back( part );
+	m_partFragments.clear();
+	m_partsWritten++;
+}
+
+void CHlsWriter::CloseSegment( uint64_t decodeTimeIn )
+{
+	if( m_segmentFd < 0 || m_segments.empty() )
+	{
+		return;
+	}
+	
+	TSegment &segment = m_segments.back();
+	const std::string path = GetPath( GetSegmentName( segment.m_sequence ) );
+	
+	close( m_segmentFd );
+	m_segmentFd = -1;
+	
+	if( rename( ( path + ".tmp" ).c_str(), path.c_str() ) != 0 )
+	{
+		throw std::runtime_error( "Failed to rename " + path + ": " + strerror( errno ) );
+	}
+	
+	segment.m_duration_s 	= (double)( decodeTimeIn - m_segmentStartTime ) / m_trackTimescale;
+	segment.m_isComplete 	= true;
+	m_targetDuration_s 		= std::max( m_targetDuration_s, (uint32_t)std::lround( segment.m_duration_s ) );
+	
+	m_segmentsWritten++;
+	
+	RemoveExpiredSegments();
+}
+
+void CHlsWriter::EndSegment()
+{
+	if( m_segmentFd < 0 )
+	{
+		return;
+	}
+	
+	// No next frame to take the end time from, so assume the last frame lasted as long as the one before
+	const uint64_t endTime = m_lastDecodeTime + m_frameInterval;
+	
+	ClosePart( endTime );
+	CloseSegment( endTime );
+	WritePlaylist();
+}
+
+void CHlsWriter::RemoveExpiredSegments()
+{
+	size_t completeSegments = std::count_if( m_segments.begin(), m_segments.end(), []( const TSegment &segmentIn ){ return segmentIn.m_isComplete; } );
+	
+	while( completeSegments > m_config.m_playlistSegments + m_config.m_retainedSegments )
+	{
+		const TSegment &oldest = m_segments.front();
+		
+		RemoveSegmentFiles( oldest );
+		
+		// Init files go once no remaining segment needs them
+		uint32_t nextInitIndex = ( m_segments.size() > 1 ) ? m_segments[ 1 ].m_initIndex : m_initIndex;
+		
+		for( uint32_t index = oldest.m_initIndex; index < nextInitIndex; ++index )
+		{
+			unlink( GetPath( GetInitName( index ) ).c_str() );
+		}
+		
+		m_segments.pop_front();
+		completeSegments--;
+	}
+}
+
+void CHlsWriter::RemoveSegmentFiles( const TSegment &segmentIn )
+{
+	const std::string path = GetPath( GetSegmentName( segmentIn.m_sequence ) );
+	
+	unlink( ( segmentIn.m_isComplete ? path : path + ".tmp" ).c_str() );
+	
+	for( const TPart &part : segmentIn.m_parts )
+	{
+		unlink( GetPath( GetPartName( segmentIn.m_sequence, part.m_index ) ).c_str() );
+	}
+}
+
+void CHlsWriter::WritePlaylist()
+{
+	// Complete segments in the window, plus the one being written
+	size_t first = m_segments.size();
+	uint32_t completeSegments = 0;
+	
+	while( first > 0 && ( !m_segments[ first - 1 ].m_isComplete || completeSegments < m_config.m_playlistSegments ) )
+	{
+		first--;
+		
+		if( m_segments[ first ].m_isComplete )
+		{
+			completeSegments++;
+		}
+	}
+	
+	if( first == m_segments.size() )
+	{
+		return;
+	}
+	
+	// Parts are only listed for roughly the last three target durations, older segments are listed whole
+	size_t firstWithParts = m_segments.size();
+	double partWindow_s = 0.0;
+	
+	while( firstWithParts > first && partWindow_s < 3.0 * m_targetDuration_s )
+	{
+		firstWithParts--;
+		partWindow_s += m_segments[ firstWithParts ].m_duration_s;
+	}
+	
+	const double partTarget_s = m_config.m_partTarget_ms / 1000.0;
+	std::string playlist;
+	
+	playlist += "#EXTM3U\n";
+	playlist += "#EXT-X-VERSION:6\n";
+	playlist += "#EXT-X-TARGETDURATION:" + std::to_string( m_targetDuration_s ) + "\n";
+	playlist += "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=" + FormatSeconds( 3.0 * partTarget_s ) + "\n";
+	playlist += "#EXT-X-PART-INF:PART-TARGET=" + FormatSeconds( partTarget_s ) + "\n";
+	playlist += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string( m_segments[ first ].m_sequence ) + "\n";
+	playlist += "#EXT-X-DISCONTINUITY-SEQUENCE:" + std::to_string( m_segments[ first ].m_initIndex ) + "\n";
+	playlist += "#EXT-X-MAP:URI=\"" + GetInitName( m_segments[ first ].m_initIndex ) + "\"\n";
+	
+	for( size_t i = first; i < m_segments.size(); ++i )
+	{
+		const TSegment &segment = m_segments[ i ];
+		
+		if( i > first && segment.m_initIndex != m_segments[ i - 1 ].m_initIndex )
+		{
+			playlist += "#EXT-X-DISCONTINUITY\n";
+			playlist += "#EXT-X-MAP:URI=\"" + GetInitName( segment.m_initIndex ) + "\"\n";
+		}
+		
+		if( i >= firstWithParts )
+		{
+			for( const TPart &part : segment.m_parts )
+			{
+				playlist += "#EXT-X-PART:DURATION=" + FormatSeconds( part.m_duration_s ) + ",URI=\"" + GetPartName( segment.m_sequence, part.m_index ) + "\"";
+				playlist += part.m_isIndependent ? ",INDEPENDENT=YES\n" : "\n";
+			}
+		}
+		
+		if( segment.m_isComplete )
+		{
+			playlist += "#EXTINF:" + FormatSeconds( segment.m_duration_s ) + ",\n";
+			playlist += GetSegmentName( segment.m_sequence ) + "\n";
+		}
+	}
+	
+	WriteFile( k_playlistName, playlist );
+}
+
+void CHlsWriter::WriteFile( const std::string &nameIn, const std::vector<TFragmentPtr> &fragmentsIn )
+{
+	// Write under a temporary name and rename, so readers only ever see complete files
+	const std::string path = GetPath( nameIn );
+	const std::string tempPath = path + ".tmp";
+	
+	int fd = open( tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+	
+	if( fd < 0 )
+	{
+		throw std::runtime_error( "Failed to open " + tempPath + ": " + strerror( errno ) );
+	}
+	
+	try
+	{
+		for( auto &fragment : fragmentsIn )
+		{
+			WriteAll( fd, fragment->m_data.data(), fragment->m_data.size(), tempPath );
+		}
+	}
+	catch( ... )
+	{
+		close( fd );
+		unlink( tempPath.c_str() );
+		throw;
+	}
+	
+	close( fd );
+	
+	if( rename( tempPath.c_str(), path.c_str() ) != 0 )
+	{
+		throw std::runtime_error( "Failed to rename " + tempPath + ": " + strerror( errno ) );
+	}
+}
+
+void CHlsWriter::WriteFile( const std::string &nameIn, const std::string &contentsIn )
+{
+	auto fragment = std::make_shared<TFragment>();
+	fragment->m_data.assign( contentsIn.begin(), contentsIn.end() );
+	
+	WriteFile( nameIn, std::vector<TFragmentPtr>{ fragment } );
+}
+
+void CHlsWriter::RemoveFiles()
+{
+	unlink( GetPath( k_playlistName ).c_str() );
+	
+	if( m_haveInit )
+	{
+		uint32_t firstInitIndex = m_segments.empty() ? m_initIndex : m_segments.front().m_initIndex;
+		
+		for( uint32_t index = firstInitIndex; index <= m_initIndex; ++index )
+		{
+			unlink( GetPath( GetInitName( index ) ).c_str() );
+		}
+	}
+	
+	for( const TSegment &segment : m_segments )
+	{
+		RemoveSegmentFiles( segment );
+	}
+	
+	m_segments.clear();
+	m_partFragments.clear();
+	m_pPendingInit.reset();
+}
+
+std::string CHlsWriter::GetPath( const std::string &nameIn ) const
+{
+	return m_config.m_directory + "/" + nameIn;
+}
+
+std::string CHlsWriter::GetSegmentName( uint64_t sequenceIn )
+{
+	return std::to_string( sequenceIn ) + ".m4s";
+}
+
+std::string CHlsWriter::GetPartName( uint64_t sequenceIn, uint32_t partIn )
+{
+	return std::to_string( sequenceIn ) + "." + std::to_string( partIn ) + ".m4s";
+}
+
+std::string CHlsWriter::GetInitName( uint32_t indexIn )
+{
+	return "init_" + std::to_string( indexIn ) + ".mp4";
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include "CFragmentSink.h"
+
+struct THlsConfig
+{
+	std::string 	m_directory;
+	
+	uint32_t 		m_partTarget_ms			= 200;					// Parts close at the first frame past this duration
+	uint32_t 		m_playlistSegments		= 6;					// Complete segments listed in the playlist
+	uint32_t 		m_retainedSegments		= 2;					// Extra segments kept on disk after leaving the playlist
+	size_t 			m_maxQueuedBytes		= 8 * 1024 * 1024;		// Fragments beyond this are dropped, never waited on
+};
+
+// Low-latency HLS output built from the muxer's own fragments, with no remux. Every fragment is one frame (moof+mdat), so:
+//   - a part is the frames of one part target duration, written as <seq>.<part>.m4s
+//   - a segment is one GOP, written as <seq>.m4s, which is exactly its parts back to back
+//   - live.m3u8 lists the last few segments, with parts for the most recent ones
+// All files are written under a temporary name and renamed into place, so a web server serving the directory never
+// sees a partial file. Intended for a tmpfs directory: nothing is fsynced, and old files are deleted as the window moves on.
+class CHlsWriter : public CFragmentSink
+{
+public:
+	// Attributes
+	std::atomic<bool> 		m_isRunning;
+	
+	std::atomic<uint64_t> 	m_partsWritten;
+	std::atomic<uint64_t> 	m_segmentsWritten;
+	std::atomic<uint64_t> 	m_fragmentsDropped;
+	
+	// Methods
+	CHlsWriter();
+	virtual ~CHlsWriter();
+	
+	void Start( const THlsConfig &configIn );
+	
+	// Stops writing and removes every file the writer created
+	void Stop();
+	
+	// CFragmentSink
+	virtual void OnInitSegment( const TFragmentPtr &initSegmentIn );
+	virtual void OnFragment( const TFragmentPtr &fragmentIn );
+
+private:
+	struct TPart
+	{
+		uint32_t 		m_index;
+		double 			m_duration_s;
+		bool 			m_isIndependent;
+	};
+	
+	struct TSegment
+	{
+		uint64_t 			m_sequence;
+		uint32_t 			m_initIndex;			// Which init_<n>.mp4 the segment needs
+		double 				m_duration_s	= 0.0;
+		bool 				m_isComplete	= false;
+		std::vector<TPart> 	m_parts;
+	};
+	
+	// Attributes
+	THlsConfig 					m_config;
+	
+	std::thread 				m_thread;
+	std::atomic<bool> 			m_killThread;
+	
+	std::mutex 					m_mutex;
+	std::condition_variable 	m_dataAvailableCondition;
+	std::deque<TFragmentPtr> 	m_queue;				// Init segments are queued in line with fragments. Null marks dropped fragments.
+	size_t 						m_queuedBytes		= 0;
+	bool 						m_needKeyframe		= true;
+	TFragmentPtr 				m_pInitSegment;
+	
+	// Writer thread state
+	uint32_t 					m_initIndex			= 0;	// Index of the last init file written
+	bool 						m_haveInit			= false;
+	uint32_t 					m_trackTimescale	= 90000;
+	uint64_t 					m_nextSequence		= 0;
+	std::deque<TSegment> 		m_segments;				// Oldest first. Includes retained segments no longer listed.
+	std::vector<TFragmentPtr> 	m_partFragments;		// Frames of the open part
+	TFragmentPtr 				m_pPendingInit;			// Written out when the next segment starts
+	uint64_t 					m_partStartTime		= 0;	// Track time units
+	uint64_t 					m_segmentStartTime	= 0;
+	uint64_t 					m_lastDecodeTime	= 0;
+	uint64_t 					m_frameInterval		= 0;
+	int 						m_segmentFd			= -1;
+	uint32_t 					m_targetDuration_s	= 1;	// Only ever grows, as the spec requires
+	
+	const std::chrono::milliseconds k_wakeInterval	= std::chrono::milliseconds( 250 );
+	
+	// Methods
+	void ThreadLoop();
+	void HandleInitSegment( const TFragmentPtr &initSegmentIn );
+	void WriteFragment( const TFragmentPtr &fragmentIn );
+	
+	void OpenSegment( uint64_t decodeTimeIn );
+	void ClosePart( uint64_t decodeTimeIn );
+	void CloseSegment( uint64_t decodeTimeIn );
+	void EndSegment();
+	void RemoveExpiredSegments();
+	void RemoveSegmentFiles( const TSegment &segmentIn );
+	
+	void WritePlaylist();
+	void WriteFile( const std::string &nameIn, const std::vector<TFragmentPtr> &fragmentsIn );
+	void WriteFile( const std::string &nameIn, const std::string &contentsIn );
+	void RemoveFiles();
+	
+	std::string GetPath( const std::string &nameIn ) const;
+	static std::string GetSegmentName( uint64_t sequenceIn );
+	static std::string GetPartName( uint64_t sequenceIn, uint32_t partIn );
+	static std::string GetInitName( uint32_t indexIn );
+};
@@ -0,0 +1,1016 @@
+// Includes
+#include "CHttpServer.h"
+#include "Mp4Box.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <json.hpp>
+
+extern "C"
+{
+	// FFmpeg
+	#include <libavutil/sha.h>
+	#include <libavutil/base64.h>
+	#include <libavutil/mem.h>
+}
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+	const char *k_webSocketGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	
+	const uint8_t k_opText		= 0x1;
+	const uint8_t k_opBinary	= 0x2;
+	const uint8_t k_opClose		= 0x8;
+	const uint8_t k_opPing		= 0x9;
+	const uint8_t k_opPong		= 0xA;
+	
+	const char *k_multipartBoundary = "jpegframe";
+	
+	bool SetNonBlocking( int socketIn )
+	{
+		int flags = fcntl( socketIn, F_GETFL, 0 );
+		return ( flags != -1 ) && ( fcntl( socketIn, F_SETFL, flags | O_NONBLOCK ) != -1 );
+	}
+}
+
+CHttpServer::CHttpServer( uint16_t portIn )
+	: m_clientCount( 0 )
+	, m_fragmentsSent( 0 )
+	, m_fragmentsDropped( 0 )
+	, m_jpegFramesSent( 0 )
+	, m_jpegFramesDropped( 0 )
+	, m_port( portIn )
+	, m_killThread( false )
+{
+}
+
+CHttpServer::~CHttpServer()
+{
+	Stop();
+}
+
+CFragmentSink* CHttpServer::AddStream( const std::string &nameIn )
+{
+	if( m_thread.joinable() )
+	{
+		throw std::runtime_error( "Streams must be added before the HTTP server starts" );
+	}
+	
+	TStream stream;
+	stream.m_name 	= nameIn;
+	stream.m_pSink 	= std::unique_ptr<CStreamSink>( new CStreamSink( this, (int)m_streams.size() ) );
+	
+	m_streams.push_back( std::move( stream ) );
+	
+	return m_streams.back().m_pSink.get();
+}
+
+CHttpServer::CJpegInput* CHttpServer::AddJpegStream( const std::string &nameIn )
+{
+	if( m_thread.joinable() )
+	{
+		throw std::runtime_error( "Streams must be added before the HTTP server starts" );
+	}
+	
+	TJpegStream stream;
+	stream.m_name 	= nameIn;
+	stream.m_pInput = std::unique_ptr<CJpegInput>( new CJpegInput( this, (int)m_jpegStreams.size() ) );
+	
+	m_jpegStreams.push_back( std::move( stream ) );
+	
+	return m_jpegStreams.back().m_pInput.get();
+}
+
+void CHttpServer::CJpegInput::Write( const uint8_t *dataIn, size_t sizeIn )
+{
+	m_frame.insert( m_frame.end(), dataIn, dataIn + sizeIn );
+	
+	while( ExtractFrame() )
+	{
+	}
+	
+	if( m_frame.size() > k_maxFrameSize )
+	{
+		// Never found the end. Drop it and resync on the next SOI.
+		cerr << "Discarding oversized MJPEG frame" << endl;
+		
+		m_frame.clear();
+		m_scanOffset 	= 0;
+		m_inScan 		= false;
+	}
+}
+
+bool CHttpServer::CJpegInput::ExtractFrame()
+{
+	// Walk the marker segments rather than searching for FFD9, which can also turn up inside an embedded EXIF thumbnail
+	if( m_scanOffset == 0 )
+	{
+		size_t start = 0;
+		
+		while( start + 1 < m_frame.size() && !( m_frame[ start ] == 0xFF && m_frame[ start + 1 ] == 0xD8 ) )
+		{
+			start++;
+		}
+		
+		m_frame.erase( m_frame.begin(), m_frame.begin() + start );
+		
+		if( m_frame.size() < 2 )
+		{
+			return false;
+		}
+		
+		m_scanOffset 	= 2;
+		m_inScan 		= false;
+	}
+	
+	while( m_scanOffset + 1 < m_frame.size() )
+	{
+		uint8_t byte 	= m_frame[ m_scanOffset ];
+		uint8_t next 	= m_frame[ m_scanOffset + 1 ];
+		
+		if( m_inScan )
+		{
+			if( byte != 0xFF || next == 0x00 || ( next >= 0xD0 && next <= 0xD7 ) )
+			{
+				m_scanOffset += ( byte == 0xFF ) ? 2 : 1;
+				continue;
+			}
+			
+			// A real marker ends the scan. Progressive JPEGs carry on with more tables and scans.
+			m_inScan = false;
+		}
+		
+		if( byte != 0xFF )
+		{
+			// Not a JPEG after all. Skip this SOI and look for the next one.
+			m_frame.erase( m_frame.begin(), m_frame.begin() + 2 );
+			m_scanOffset = 0;
+			return true;
+		}
+		
+		if( next == 0xFF )
+		{
+			// Fill byte
+			m_scanOffset++;
+		}
+		else if( next == 0xD9 )
+		{
+			size_t frameSize = m_scanOffset + 2;
+			
+			auto frame = std::make_shared<TFragment>();
+			frame->m_sequence 		= m_sequence++;
+			frame->m_isKeyframe 	= true;
+			
+			// The camera normally delivers exactly one frame per callback, which can be handed over without another copy
+			if( frameSize == m_frame.size() )
+			{
+				frame->m_data.swap( m_frame );
+			}
+			else
+			{
+				frame->m_data.assign( m_frame.begin(), m_frame.begin() + frameSize );
+				m_frame.erase( m_frame.begin(), m_frame.begin() + frameSize );
+			}
+			
+			m_pServer->QueueFragment( m_index, frame, true );
+			m_scanOffset = 0;
+			return true;
+		}
+		else if( next == 0x01 || ( next >= 0xD0 && next <= 0xD7 ) )
+		{
+			// Markers without a length
+			m_scanOffset += 2;
+		}
+		else
+		{
+			if( m_scanOffset + 4 > m_frame.size() )
+			{
+				return false;
+			}
+			
+			size_t length = ( m_frame[ m_scanOffset + 2 ] << 8 ) | m_frame[ m_scanOffset + 3 ];
+			
+			m_scanOffset 	+= 2 + length;
+			m_inScan 		= ( next == 0xDA );
+		}
+	}
+	
+	return false;
+}
+
+void CHttpServer::Start()
+{
+	m_listenSocket = socket( AF_INET, SOCK_STREAM, 0 );
+	
+	if( m_listenSocket < 0 )
+	{
+		throw std::runtime_error( "Failed to create HTTP socket: " + std::string( strerror( errno ) ) );
+	}
+	
+	int reuse = 1;
+	setsockopt( m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+	
+	sockaddr_in address;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family 		= AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_ANY );
+	address.sin_port 		= htons( m_port );
+	
+	if( bind( m_listenSocket, (sockaddr*)&address, sizeof( address ) ) < 0 || listen( m_listenSocket, 16 ) < 0 || !SetNonBlocking( m_listenSocket ) )
+	{
+		std::string error( strerror( errno ) );
+		
+		close( m_listenSocket );
+		m_listenSocket = -1;
+		
+		throw std::runtime_error( "Failed to listen on HTTP port " + std::to_string( m_port ) + ": " + error );
+	}
+	
+	m_wakeFd = eventfd( 0, EFD_NONBLOCK );
+	
+	if( m_wakeFd < 0 )
+	{
+		close( m_listenSocket );
+		m_listenSocket = -1;
+		
+		throw std::runtime_error( "Failed to create HTTP server eventfd" );
+	}
+	
+	m_killThread 	= false;
+	m_thread 		= std::thread( &CHttpServer::ThreadLoop, this );
+	
+	cout << "HTTP server listening on port " << m_port << endl;
+}
+
+void CHttpServer::Stop()
+{
+	if( m_thread.joinable() )
+	{
+		m_killThread = true;
+		
+		uint64_t wake = 1;
+		if( write( m_wakeFd, &wake, sizeof( wake ) ) < 0 )
+		{
+			cerr << "Failed to wake HTTP server thread" << endl;
+		}
+		
+		m_thread.join();
+	}
+	
+	for( TClient &client : m_clients )
+	{
+		close( client.m_socket );
+	}
+	
+	m_clients.clear();
+	m_clientCount = 0;
+	
+	if( m_listenSocket >= 0 )
+	{
+		close( m_listenSocket );
+		m_listenSocket = -1;
+	}
+	
+	if( m_wakeFd >= 0 )
+	{
+		close( m_wakeFd );
+		m_wakeFd = -1;
+	}
+}
+
+void CHttpServer::QueueFragment( int streamIn, const TFragmentPtr &fragmentIn, bool isJpegIn )
+{
+	// Called from muxer and video callback threads: only a pointer is queued, the server thread does the rest
+	{
+		std::lock_guard<std::mutex> lock( m_pendingMutex );
+		m_pending.push_back( { streamIn, fragmentIn, isJpegIn } );
+	}
+	
+	if( m_wakeFd >= 0 )
+	{
+		uint64_t wake = 1;
+		if( write( m_wakeFd, &wake, sizeof( wake ) ) < 0 )
+		{
+			// Counter is saturated, the server thread is already due to wake up
+		}
+	}
+}
+
+void CHttpServer::ThreadLoop()
+{
+	std::vector<pollfd> pollFds;
+	
+	while( !m_killThread )
+	{
+		pollFds.clear();
+		pollFds.push_back( { m_listenSocket, POLLIN, 0 } );
+		pollFds.push_back( { m_wakeFd, POLLIN, 0 } );
+		
+		for( TClient &client : m_clients )
+		{
+			pollFds.push_back( { client.m_socket, (short)( POLLIN | ( client.m_queue.empty() ? 0 : POLLOUT ) ), 0 } );
+		}
+		
+		if( poll( pollFds.data(), pollFds.size(), k_pollTimeout_ms ) < 0 )
+		{
+			if( errno != EINTR )
+			{
+				cerr << "HTTP server poll failed: " << strerror( errno ) << endl;
+			}
+			
+			continue;
+		}
+		
+		if( pollFds[ 1 ].revents & POLLIN )
+		{
+			uint64_t count;
+			if( read( m_wakeFd, &count, sizeof( count ) ) < 0 )
+			{
+				// Nothing to clear
+			}
+		}
+		
+		DistributePending();
+		
+		// Clients, in the same order they were added to the poll set. New clients are only added after this.
+		auto now = std::chrono::steady_clock::now();
+		
+		for( size_t i = 0; i < m_clients.size(); ++i )
+		{
+			TClient &client = m_clients[ i ];
+			short events 	= pollFds[ i + 2 ].revents;
+			bool keep 		= true;
+			
+			if( events & ( POLLERR | POLLHUP | POLLNVAL ) )
+			{
+				keep = false;
+			}
+			
+			if( keep && ( events & POLLIN ) )
+			{
+				keep = ReadFromClient( client );
+			}
+			
+			if( keep && !client.m_queue.empty() )
+			{
+				keep = WriteToClient( client );
+			}
+			
+			if( keep && client.m_state == EClientState::CLOSING && client.m_queue.empty() )
+			{
+				keep = false;
+			}
+			
+			if( keep && client.m_state == EClientState::READING_REQUEST && ( now - client.m_connectTime ) > k_requestTimeout )
+			{
+				keep = false;
+			}
+			
+			if( !keep )
+			{
+				CloseClient( client );
+			}
+		}
+		
+		m_clients.erase( std::remove_if( m_clients.begin(), m_clients.end(), []( const TClient &clientIn ){ return clientIn.m_socket < 0; } ), m_clients.end() );
+		
+		if( pollFds[ 0 ].revents & POLLIN )
+		{
+			AcceptClients();
+		}
+		
+		m_clientCount = (uint32_t)m_clients.size();
+	}
+}
+
+void CHttpServer::AcceptClients()
+{
+	while( true )
+	{
+		int clientSocket = accept( m_listenSocket, nullptr, nullptr );
+		
+		if( clientSocket < 0 )
+		{
+			return;
+		}
+		
+		if( m_clients.size() >= k_maxClients || !SetNonBlocking( clientSocket ) )
+		{
+			close( clientSocket );
+			continue;
+		}
+		
+		// Fragments are written whole, no need to wait for more data
+		int noDelay = 1;
+		setsockopt( clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+		
+		TClient client;
+		client.m_socket 		= clientSocket;
+		client.m_connectTime 	= std::chrono::steady_clock::now();
+		
+		m_clients.push_back( std::move( client ) );
+	}
+}
+
+void CHttpServer::DistributePending()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_pendingMutex );
+		m_draining.swap( m_pending );
+	}
+	
+	for( TPendingFragment &pending : m_draining )
+	{
+		if( pending.m_isJpeg )
+		{
+			m_jpegStreams[ pending.m_stream ].m_pLatestFrame = pending.m_pFragment;
+			
+			for( TClient &client : m_clients )
+			{
+				if( client.m_state == EClientState::MULTIPART && client.m_stream == pending.m_stream )
+				{
+					SendJpegFrame( client, pending.m_pFragment );
+				}
+			}
+			
+			continue;
+		}
+		
+		TStream &stream = m_streams[ pending.m_stream ];
+		
+		if( pending.m_pFragment->m_isInit )
+		{
+			stream.m_pInitSegment = pending.m_pFragment;
+			
+			const std::vector<uint8_t> &init = pending.m_pFragment->m_data;
+			std::string codec;
+			
+			stream.m_mimeType = mp4::GetAvcCodecString( init.data(), init.size(), codec ) ? "video/mp4; codecs=\"" + codec + "\"" : "video/mp4";
+		}
+		
+		for( TClient &client : m_clients )
+		{
+			if( client.m_state == EClientState::WEBSOCKET && client.m_stream == pending.m_stream )
+			{
+				SendFragment( client, pending.m_pFragment );
+			}
+		}
+	}
+	
+	m_draining.clear();
+}
+
+void CHttpServer::SendFragment( TClient &clientIn, const TFragmentPtr &fragmentIn )
+{
+	if( fragmentIn->m_isInit )
+	{
+		// The muxer restarted: start over with the new init segment at the next keyframe
+		json message = { { "type", "init" }, { "mime", m_streams[ clientIn.m_stream ].m_mimeType } };
+		std::string text = message.dump();
+		
+		QueueWebSocketFrame( clientIn, k_opText, (const uint8_t*)text.data(), text.size() );
+		QueueWebSocketFrame( clientIn, k_opBinary, nullptr, 0, fragmentIn );
+		
+		clientIn.m_waitingForKeyframe = true;
+		return;
+	}
+	
+	if( clientIn.m_waitingForKeyframe )
+	{
+		if( !fragmentIn->m_isKeyframe )
+		{
+			return;
+		}
+		
+		clientIn.m_waitingForKeyframe = false;
+	}
+	
+	if( clientIn.m_queuedBytes + fragmentIn->m_data.size() > k_maxQueuedBytes )
+	{
+		// Too far behind. Drop the media not yet on the wire and pick up again at the next keyframe. The upgrade response,
+		// init segments and control frames stay, the client can't do without them.
+		auto isDroppable = []( const TOutgoing &outgoingIn )
+		{
+			return outgoingIn.m_isMedia && outgoingIn.m_offset == 0;
+		};
+		
+		for( const TOutgoing &outgoing : clientIn.m_queue )
+		{
+			if( isDroppable( outgoing ) )
+			{
+				clientIn.m_queuedBytes -= outgoing.GetSize();
+				m_fragmentsDropped++;
+			}
+		}
+		
+		clientIn.m_queue.erase( std::remove_if( clientIn.m_queue.begin(), clientIn.m_queue.end(), isDroppable ), clientIn.m_queue.end() );
+		
+		m_fragmentsDropped++;
+		clientIn.m_waitingForKeyframe = true;
+		return;
+	}
+	
+	QueueWebSocketFrame( clientIn, k_opBinary, nullptr, 0, fragmentIn );
+	clientIn.m_queue.back().m_isMedia = true;
+	m_fragmentsSent++;
+}
+
+void CHttpServer::SendJpegFrame( TClient &clientIn, const TFragmentPtr &frameIn )
+{
+	// The leading CRLF ends the previous part. Before the first boundary it is preamble, which clients ignore.
+	std::string header = "\r\n--" + std::string( k_multipartBoundary ) + "\r\nContent-Type: image/jpeg\r\nContent-Length: "
+						+ std::to_string( frameIn->m_data.size() ) + "\r\n\r\n";
+	
+	if( !clientIn.m_queue.empty() && clientIn.m_queue.back().m_pFragment && clientIn.m_queue.back().m_offset == 0 )
+	{
+		// The client hasn't started on the last frame yet: show it this one instead
+		TOutgoing &outgoing = clientIn.m_queue.back();
+		
+		clientIn.m_queuedBytes -= outgoing.GetSize();
+		
+		outgoing.m_header.assign( header.begin(), header.end() );
+		outgoing.m_pFragment = frameIn;
+		
+		clientIn.m_queuedBytes += outgoing.GetSize();
+		m_jpegFramesDropped++;
+		return;
+	}
+	
+	TOutgoing outgoing;
+	outgoing.m_header.assign( header.begin(), header.end() );
+	outgoing.m_pFragment = frameIn;
+	
+	clientIn.m_queuedBytes += outgoing.GetSize();
+	clientIn.m_queue.push_back( std::move( outgoing ) );
+	m_jpegFramesSent++;
+}
+
+bool CHttpServer::ReadFromClient( TClient &clientIn )
+{
+	char buffer[ 4096 ];
+	
+	while( true )
+	{
+		ssize_t bytesRead = recv( clientIn.m_socket, buffer, sizeof( buffer ), 0 );
+		
+		if( bytesRead == 0 )
+		{
+			return false;
+		}
+		
+		if( bytesRead < 0 )
+		{
+			if( errno == EAGAIN || errno == EWOULDBLOCK )
+			{
+				break;
+			}
+			
+			return ( errno == EINTR );
+		}
+		
+		clientIn.m_input.append( buffer, bytesRead );
+		
+		if( clientIn.m_input.size() > k_maxRequestSize )
+		{
+			return false;
+		}
+	}
+	
+	if( clientIn.m_state == EClientState::READING_REQUEST )
+	{
+		if( clientIn.m_input.find( "\r\n\r\n" ) != std::string::npos )
+		{
+			HandleRequest( clientIn );
+		}
+	}
+	else if( clientIn.m_state == EClientState::WEBSOCKET )
+	{
+		HandleWebSocketInput( clientIn );
+	}
+	else
+	{
+		// Closing, ignore anything else
+		clientIn.m_input.clear();
+	}
+	
+	return true;
+}
+
+bool CHttpServer::WriteToClient( TClient &clientIn )
+{
+	while( !clientIn.m_queue.empty() )
+	{
+		TOutgoing &outgoing = clientIn.m_queue.front();
+		
+		// Header and payload go out in one call, starting wherever the last partial write stopped
+		iovec parts[ 2 ];
+		int partCount = 0;
+		
+		if( outgoing.m_offset < outgoing.m_header.size() )
+		{
+			parts[ partCount ].iov_base = outgoing.m_header.data() + outgoing.m_offset;
+			parts[ partCount ].iov_len 	= outgoing.m_header.size() - outgoing.m_offset;
+			partCount++;
+		}
+		
+		if( outgoing.m_pFragment )
+		{
+			size_t payloadOffset = ( outgoing.m_offset > outgoing.m_header.size() ) ? outgoing.m_offset - outgoing.m_header.size() : 0;
+			
+			parts[ partCount ].iov_base = (void*)( outgoing.m_pFragment->m_data.data() + payloadOffset );
+			parts[ partCount ].iov_len 	= outgoing.m_pFragment->m_data.size() - payloadOffset;
+			partCount++;
+		}
+		
+		msghdr message;
+		memset( &message, 0, sizeof( message ) );
+		message.msg_iov 	= parts;
+		message.msg_iovlen 	= partCount;
+		
+		ssize_t bytesSent = sendmsg( clientIn.m_socket, &message, MSG_NOSIGNAL );
+		
+		if( bytesSent < 0 )
+		{
+			return ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR );
+		}
+		
+		outgoing.m_offset += bytesSent;
+		
+		if( outgoing.m_offset < outgoing.GetSize() )
+		{
+			// Socket buffer is full, wait for POLLOUT
+			return true;
+		}
+		
+		clientIn.m_queuedBytes -= outgoing.GetSize();
+		clientIn.m_queue.pop_front();
+	}
+	
+	return true;
+}
+
+void CHttpServer::HandleRequest( TClient &clientIn )
+{
+	const std::string &request = clientIn.m_input;
+	
+	// Request line: GET <path> HTTP/1.1
+	size_t methodEnd 	= request.find( ' ' );
+	size_t pathEnd 		= ( methodEnd == std::string::npos ) ? std::string::npos : request.find( ' ', methodEnd + 1 );
+	
+	if( pathEnd == std::string::npos || request.compare( 0, methodEnd, "GET" ) != 0 )
+	{
+		QueueResponse( clientIn, "405 Method Not Allowed", "text/plain", "Only GET is supported\n" );
+		return;
+	}
+	
+	std::string path = request.substr( methodEnd + 1, pathEnd - methodEnd - 1 );
+	std::string key = GetHeader( request, "sec-websocket-key" );
+	
+	if( path == "/" )
+	{
+		json streams = json::array();
+		
+		for( const TStream &stream : m_streams )
+		{
+			json entry = { { "name", stream.m_name }, { "websocket", "/" + stream.m_name }, { "init", "/" + stream.m_name + "/init.mp4" }, { "mime", stream.m_mimeType } };
+			
+			if( FindJpegStream( stream.m_name ) >= 0 )
+			{
+				entry[ "mjpeg" ] = "/" + stream.m_name + ".mjpg";
+			}
+			
+			streams.push_back( entry );
+		}
+		
+		QueueResponse( clientIn, "200 OK", "application/json", streams.dump() );
+		return;
+	}
+	
+	const std::string initSuffix( "/init.mp4" );
+	
+	if( path.size() > initSuffix.size() && path.compare( path.size() - initSuffix.size(), initSuffix.size(), initSuffix ) == 0 )
+	{
+		int stream = FindStream( path.substr( 1, path.size() - initSuffix.size() - 1 ) );
+		
+		if( stream < 0 )
+		{
+			QueueResponse( clientIn, "404 Not Found", "text/plain", "Unknown stream\n" );
+		}
+		else if( !m_streams[ stream ].m_pInitSegment )
+		{
+			QueueResponse( clientIn, "503 Service Unavailable", "text/plain", "Stream has not started\n" );
+		}
+		else
+		{
+			TOutgoing outgoing;
+			std::string header = "HTTP/1.1 200 OK\r\nContent-Type: video/mp4\r\nContent-Length: " + std::to_string( m_streams[ stream ].m_pInitSegment->m_data.size() )
+								+ "\r\nAccess-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n";
+			
+			outgoing.m_header.assign( header.begin(), header.end() );
+			outgoing.m_pFragment = m_streams[ stream ].m_pInitSegment;
+			
+			clientIn.m_queuedBytes += outgoing.GetSize();
+			clientIn.m_queue.push_back( std::move( outgoing ) );
+			clientIn.m_state = EClientState::CLOSING;
+		}
+		
+		return;
+	}
+	
+	const std::string jpegSuffix( ".mjpg" );
+	
+	if( path.size() > jpegSuffix.size() && path.compare( path.size() - jpegSuffix.size(), jpegSuffix.size(), jpegSuffix ) == 0 )
+	{
+		int jpegStream = FindJpegStream( path.substr( 1, path.size() - jpegSuffix.size() - 1 ) );
+		
+		if( jpegStream < 0 )
+		{
+			QueueResponse( clientIn, "404 Not Found", "text/plain", "Unknown MJPEG stream\n" );
+			return;
+		}
+		
+		// No Content-Length: the response ends when the client disconnects
+		std::string response = "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=" + std::string( k_multipartBoundary )
+								+ "\r\nCache-Control: no-cache, no-store\r\nAccess-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n";
+		
+		TOutgoing outgoing;
+		outgoing.m_header.assign( response.begin(), response.end() );
+		
+		clientIn.m_queuedBytes += outgoing.GetSize();
+		clientIn.m_queue.push_back( std::move( outgoing ) );
+		
+		clientIn.m_state 	= EClientState::MULTIPART;
+		clientIn.m_stream 	= jpegStream;
+		clientIn.m_input.clear();
+		
+		// Something to look at straight away instead of waiting for the next capture
+		if( m_jpegStreams[ jpegStream ].m_pLatestFrame )
+		{
+			SendJpegFrame( clientIn, m_jpegStreams[ jpegStream ].m_pLatestFrame );
+		}
+		
+		return;
+	}
+	
+	int stream = FindStream( path.substr( 1 ) );
+	
+	if( stream < 0 )
+	{
+		QueueResponse( clientIn, "404 Not Found", "text/plain", "Unknown stream\n" );
+		return;
+	}
+	
+	if( key.empty() || GetHeader( request, "upgrade" ).find( "websocket" ) == std::string::npos )
+	{
+		QueueResponse( clientIn, "426 Upgrade Required", "text/plain", "Connect with a WebSocket\n" );
+		return;
+	}
+	
+	std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + MakeWebSocketAccept( key ) + "\r\n\r\n";
+	
+	TOutgoing outgoing;
+	outgoing.m_header.assign( response.begin(), response.end() );
+	
+	clientIn.m_queuedBytes += outgoing.GetSize();
+	clientIn.m_queue.push_back( std::move( outgoing ) );
+	
+	clientIn.m_state 				= EClientState::WEBSOCKET;
+	clientIn.m_stream 				= stream;
+	clientIn.m_waitingForKeyframe 	= true;
+	clientIn.m_input.clear();
+	
+	// Late joiners get the current init segment right away, and media from the next keyframe
+	if( m_streams[ stream ].m_pInitSegment )
+	{
+		SendFragment( clientIn, m_streams[ stream ].m_pInitSegment );
+	}
+}
+
+void CHttpServer::HandleWebSocketInput( TClient &clientIn )
+{
+	std::string &input = clientIn.m_input;
+	
+	// Browsers only send us control frames. Client frames are always masked.
+	while( input.size() >= 2 )
+	{
+		uint8_t opcode 		= (uint8_t)input[ 0 ] & 0x0F;
+		bool isMasked 		= (uint8_t)input[ 1 ] & 0x80;
+		uint64_t length 	= (uint8_t)input[ 1 ] & 0x7F;
+		size_t headerSize 	= 2;
+		
+		if( length == 126 )
+		{
+			if( input.size() < 4 )
+			{
+				return;
+			}
+			
+			length 		= ( (uint8_t)input[ 2 ] << 8 ) | (uint8_t)input[ 3 ];
+			headerSize 	= 4;
+		}
+		else if( length == 127 )
+		{
+			// Nothing we accept is this large
+			clientIn.m_state = EClientState::CLOSING;
+			input.clear();
+			return;
+		}
+		
+		size_t maskOffset = headerSize;
+		headerSize += ( isMasked ? 4 : 0 );
+		
+		if( input.size() < headerSize + length )
+		{
+			return;
+		}
+		
+		std::vector<uint8_t> payload( input.begin() + headerSize, input.begin() + headerSize + length );
+		
+		if( isMasked )
+		{
+			for( size_t i = 0; i < payload.size(); ++i )
+			{
+				payload[ i ] ^= (uint8_t)input[ maskOffset + ( i % 4 ) ];
+			}
+		}
+		
+		input.erase( 0, headerSize + length );
+		
+		if( opcode == k_opClose )
+		{
+			QueueWebSocketFrame( clientIn, k_opClose, payload.data(), std::min<size_t>( payload.size(), 2 ) );
+			clientIn.m_state = EClientState::CLOSING;
+			input.clear();
+			return;
+		}
+		else if( opcode == k_opPing )
+		{
+			QueueWebSocketFrame( clientIn, k_opPong, payload.data(), payload.size() );
+		}
+	}
+}
+
+void CHttpServer::QueueResponse( TClient &clientIn, const std::string &statusIn, const std::string &contentTypeIn, const std::string &bodyIn )
+{
+	std::string response = "HTTP/1.1 " + statusIn + "\r\nContent-Type: " + contentTypeIn + "\r\nContent-Length: " + std::to_string( bodyIn.size() )
+							+ "\r\nAccess-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n" + bodyIn;
+	
+	TOutgoing outgoing;
+	outgoing.m_header.assign( response.begin(), response.end() );
+	
+	clientIn.m_queuedBytes += outgoing.GetSize();
+	clientIn.m_queue.push_back( std::move( outgoing ) );
+	clientIn.m_state = EClientState::CLOSING;
+}
+
+void CHttpServer::QueueWebSocketFrame( TClient &clientIn, uint8_t opcodeIn, const uint8_t *payloadIn, size_t sizeIn, const TFragmentPtr &fragmentIn )
+{
+	// Payload is either inline (control and text frames) or a shared fragment
+	size_t payloadSize = fragmentIn ? fragmentIn->m_data.size() : sizeIn;
+	
+	TOutgoing outgoing;
+	std::vector<uint8_t> &header = outgoing.m_header;
+	
+	header.push_back( 0x80 | opcodeIn );
+	
+	if( payloadSize < 126 )
+	{
+		header.push_back( (uint8_t)payloadSize );
+	}
+	else if( payloadSize < 65536 )
+	{
+		header.push_back( 126 );
+		header.push_back( (uint8_t)( payloadSize >> 8 ) );
+		header.push_back( (uint8_t)payloadSize );
+	}
+	else
+	{
+		header.push_back( 127 );
+		
+		for( int shift = 56; shift >= 0; shift -= 8 )
+		{
+			header.push_back( (uint8_t)( (uint64_t)payloadSize >> shift ) );
+		}
+	}
+	
+	if( fragmentIn )
+	{
+		outgoing.m_pFragment = fragmentIn;
+	}
+	else
+	{
+		header.insert( header.end(), payloadIn, payloadIn + sizeIn );
+	}
+	
+	clientIn.m_queuedBytes += outgoing.GetSize();
+	clientIn.m_queue.push_back( std::move( outgoing ) );
+}
+
+void CHttpServer::CloseClient( TClient &clientIn )
+{
+	if( clientIn.m_socket >= 0 )
+	{
+		close( clientIn.m_socket );
+		clientIn.m_socket = -1;
+	}
+	
+	clientIn.m_queue.clear();
+	clientIn.m_queuedBytes = 0;
+}
+
+int CHttpServer::FindStream( const std::string &nameIn )
+{
+	for( size_t i = 0; i < m_streams.size(); ++i )
+	{
+		if( m_streams[ i ].m_name == nameIn )
+		{
+			return (int)i;
+		}
+	}
+	
+	return -1;
+}
+
+int CHttpServer::FindJpegStream( const std::string &nameIn )
+{
+	for( size_t i = 0; i < m_jpegStreams.size(); ++i )
+	{
+		if( m_jpegStreams[ i ].m_name == nameIn )
+		{
+			return (int)i;
+		}
+	}
+	
+	return -1;
+}
+
+std::string CHttpServer::GetHeader( const std::string &requestIn, const std::string &nameIn )
+{
+	// Header names are case insensitive
+	std::string lowerRequest( requestIn );
+	std::transform( lowerRequest.begin(), lowerRequest.end(), lowerRequest.begin(), ::tolower );
+	
+	size_t position = lowerRequest.find( "\r\n" + nameIn + ":" );
+	
+	if( position == std::string::npos )
+	{
+		return "";
+	}
+	
+	size_t valueStart 	= requestIn.find_first_not_of( " \t", position + 3 + nameIn.size() );
+	size_t valueEnd 	= requestIn.find( "\r\n", position + 2 );
+	
+	if( valueStart == std::string::npos || valueStart >= valueEnd )
+	{
+		return "";
+	}
+	
+	std::string value = requestIn.substr( valueStart, valueEnd - valueStart );
+	
+	// Callers compare tokens like "websocket" case insensitively, keys are returned as sent
+	if( nameIn != "sec-websocket-key" )
+	{
+		std::transform( value.begin(), value.end(), value.begin(), ::tolower );
+	}
+	
+	return value;
+}
+
+std::string CHttpServer::MakeWebSocketAccept( const std::string &keyIn )
+{
+	// base64( SHA-1( key + GUID ) )
+	std::string input = keyIn + k_webSocketGuid;
+	uint8_t digest[ 20 ];
+	
+	struct AVSHA *sha = av_sha_alloc();
+	
+	if( sha == nullptr )
+	{
+		throw std::runtime_error( "Failed to allocate SHA context" );
+	}
+	
+	av_sha_init( sha, 160 );
+	av_sha_update( sha, (const uint8_t*)input.data(), input.size() );
+	av_sha_final( sha, digest );
+	av_free( sha );
+	
+	char encoded[ AV_BASE64_SIZE( 20 ) ];
+	av_base64_encode( encoded, sizeof( encoded ), digest, sizeof( digest ) );
+	
+	return std::string( encoded );
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "CFragmentSink.h"
+
+// Serves muxer output straight to browsers, without a relay process in between. Single threaded and non-blocking (poll).
+//
+// GET /                        JSON list of streams
+// GET /<stream>/init.mp4       Current init segment
+// GET /<stream> (WebSocket)    A text message {"type":"init","mime":...} for MediaSource.addSourceBuffer, the init segment
+//                              as a binary message, then one binary message per moof+mdat starting at the next keyframe
+// GET /<stream>.mjpg           MJPEG channels only: multipart/x-mixed-replace, one complete JPEG per part, as captured
+//
+// Each client has a bounded send queue. A client that falls behind has its unsent fragments dropped and resumes at the next keyframe,
+// so one slow browser never holds up the muxer or the other clients. MJPEG clients never hold more than one frame beyond the one
+// on the wire: a newer frame replaces it, so a slow client sees a lower framerate rather than growing latency.
+class CHttpServer
+{
+public:
+	// Splits an MJPEG channel's capture data into complete JPEGs (SOI to EOI) and hands them to the server thread
+	class CJpegInput
+	{
+	public:
+		// Called from the video callback with the raw capture buffer. Frames may span calls.
+		void Write( const uint8_t *dataIn, size_t sizeIn );
+	
+	private:
+		friend class CHttpServer;
+		
+		CJpegInput( CHttpServer *serverIn, int indexIn ) : m_pServer( serverIn ), m_index( indexIn ){}
+		
+		// Attributes
+		CHttpServer 			*m_pServer;
+		int 					m_index;
+		std::vector<uint8_t> 	m_frame;					// Bytes of the frame being assembled, starting at SOI
+		size_t 					m_scanOffset	= 0;		// Everything before this has been parsed
+		bool 					m_inScan		= false;	// Inside entropy coded data, where only RST and FF00 are not markers
+		uint64_t 				m_sequence		= 0;
+		
+		const size_t 			k_maxFrameSize	= 8 * 1024 * 1024;
+		
+		// Methods
+		bool ExtractFrame();
+	};
+	
+	// Attributes
+	std::atomic<uint32_t> 		m_clientCount;
+	std::atomic<uint64_t> 		m_fragmentsSent;
+	std::atomic<uint64_t> 		m_fragmentsDropped;
+	std::atomic<uint64_t> 		m_jpegFramesSent;
+	std::atomic<uint64_t> 		m_jpegFramesDropped;		// Replaced by a newer frame before a slow client got to it
+	
+	// Methods
+	CHttpServer( uint16_t portIn );
+	virtual ~CHttpServer();
+	
+	// Streams must all be added before Start(). The returned sink belongs to the server and must be removed
+	// from its muxer before the server is destroyed.
+	CFragmentSink* AddStream( const std::string &nameIn );
+	
+	// Same for MJPEG channels, served at /<name>.mjpg. The input must not be written to after the server is destroyed.
+	CJpegInput* AddJpegStream( const std::string &nameIn );
+	
+	void Start();
+	void Stop();
+
+private:
+	enum class EClientState
+	{
+		READING_REQUEST,
+		WEBSOCKET,
+		MULTIPART,			// Streaming JPEGs until the client goes away
+		CLOSING				// Close once the send queue is empty
+	};
+	
+	struct TOutgoing
+	{
+		std::vector<uint8_t> 	m_header;			// HTTP headers or WebSocket frame header, sent first
+		TFragmentPtr 			m_pFragment;		// Optional payload, shared with the muxer
+		size_t 					m_offset	= 0;	// Bytes of header + payload already sent
+		bool 					m_isMedia	= false;	// A media fragment, which a client that falls behind can skip
+		
+		size_t GetSize() const { return m_header.size() + ( m_pFragment ? m_pFragment->m_data.size() : 0 ); }
+	};
+	
+	struct TClient
+	{
+		int 						m_socket			= -1;
+		EClientState 				m_state				= EClientState::READING_REQUEST;
+		std::string 				m_input;
+		int 						m_stream			= -1;
+		bool 						m_waitingForKeyframe	= true;
+		
+		std::deque<TOutgoing> 		m_queue;
+		size_t 						m_queuedBytes		= 0;
+		
+		std::chrono::steady_clock::time_point 	m_connectTime;
+	};
+	
+	// Receives fragments on a muxer thread and hands them to the server thread
+	class CStreamSink : public CFragmentSink
+	{
+	public:
+		CStreamSink( CHttpServer *serverIn, int indexIn ) : m_pServer( serverIn ), m_index( indexIn ){}
+		
+		virtual void OnInitSegment( const TFragmentPtr &initSegmentIn ) { m_pServer->QueueFragment( m_index, initSegmentIn ); }
+		virtual void OnFragment( const TFragmentPtr &fragmentIn ) { m_pServer->QueueFragment( m_index, fragmentIn ); }
+	
+	private:
+		CHttpServer 	*m_pServer;
+		int 			m_index;
+	};
+	
+	struct TStream
+	{
+		std::string 					m_name;
+		std::unique_ptr<CStreamSink> 	m_pSink;
+		TFragmentPtr 					m_pInitSegment;		// Server thread only
+		std::string 					m_mimeType;
+	};
+	
+	struct TJpegStream
+	{
+		std::string 					m_name;
+		std::unique_ptr<CJpegInput> 	m_pInput;
+		TFragmentPtr 					m_pLatestFrame;		// Server thread only
+	};
+	
+	struct TPendingFragment
+	{
+		int 			m_stream;
+		TFragmentPtr 	m_pFragment;
+		bool 			m_isJpeg;			// m_stream indexes m_jpegStreams
+	};
+	
+	// Attributes
+	uint16_t 						m_port;
+	int 							m_listenSocket		= -1;
+	int 							m_wakeFd			= -1;
+	
+	std::vector<TStream> 			m_streams;
+	std::vector<TJpegStream> 		m_jpegStreams;
+	std::vector<TClient> 			m_clients;
+	
+	// Filled by the muxer threads, drained by the server thread
+	std::mutex 						m_pendingMutex;
+	std::vector<TPendingFragment> 	m_pending;
+	std::vector<TPendingFragment> 	m_draining;
+	
+	std::thread 					m_thread;
+	std::atomic<bool> 				m_killThread;
+	
+	const size_t 					k_maxClients			= 16;
+	const size_t 					k_maxRequestSize		= 8192;
+	const size_t 					k_maxQueuedBytes		= 4 * 1024 * 1024;
+	const int 						k_pollTimeout_ms		= 1000;
+	const std::chrono::seconds 		k_requestTimeout		= std::chrono::seconds( 10 );
+	
+	// Methods
+	void QueueFragment( int streamIn, const TFragmentPtr &fragmentIn, bool isJpegIn = false );
+	
+	void ThreadLoop();
+	void AcceptClients();
+	void DistributePending();
+	void SendFragment( TClient &clientIn, const TFragmentPtr &fragmentIn );
+	void SendJpegFrame( TClient &clientIn, const TFragmentPtr &frameIn );
+	
+	bool ReadFromClient( TClient &clientIn );
+	bool WriteToClient( TClient &clientIn );
+	
+	void HandleRequest( TClient &clientIn );
+	void HandleWebSocketInput( TClient &clientIn );
+	
+	void QueueResponse( TClient &clientIn, const std::string &statusIn, const std::string &contentTypeIn, const std::string &bodyIn );
+	void QueueWebSocketFrame( TClient &clientIn, uint8_t opcodeIn, const uint8_t *payloadIn, size_t sizeIn, const TFragmentPtr &fragmentIn = nullptr );
+	void CloseClient( TClient &clientIn );
+	
+	int FindStream( const std::string &nameIn );
+	int FindJpegStream( const std::string &nameIn );
+	static std::string GetHeader( const std::string &requestIn, const std::string &nameIn );
+	static std::string MakeWebSocketAccept( const std::string &keyIn );
+};
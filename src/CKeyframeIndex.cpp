@@ -0,0 +1,209 @@
+// Includes
+#include "CKeyframeIndex.h"
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+	const char k_magic[ 4 ] = { 'G', 'M', 'X', 'I' };
+	
+	void PutLE( uint8_t *bufferOut, uint64_t valueIn, size_t bytesIn )
+	{
+		for( size_t i = 0; i < bytesIn; ++i )
+		{
+			bufferOut[ i ] = (uint8_t)( valueIn >> ( 8 * i ) );
+		}
+	}
+	
+	uint64_t GetLE( const uint8_t *bufferIn, size_t bytesIn )
+	{
+		uint64_t value = 0;
+		
+		for( size_t i = 0; i < bytesIn; ++i )
+		{
+			value |= (uint64_t)bufferIn[ i ] << ( 8 * i );
+		}
+		
+		return value;
+	}
+}
+
+CKeyframeIndex::CKeyframeIndex()
+{
+}
+
+CKeyframeIndex::~CKeyframeIndex()
+{
+	try
+	{
+		Close();
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error closing keyframe index: " << e.what() << endl;
+	}
+}
+
+std::string CKeyframeIndex::GetIndexPath( const std::string &segmentPathIn )
+{
+	return segmentPathIn + ".idx";
+}
+
+void CKeyframeIndex::Create( const std::string &pathIn, uint64_t initSegmentSizeIn )
+{
+	Close();
+	
+	m_path 				= pathIn;
+	m_initSegmentSize 	= initSegmentSizeIn;
+	m_entries.clear();
+	m_flushedEntries 	= 0;
+	
+	m_fd = open( m_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644 );
+	
+	if( m_fd < 0 )
+	{
+		throw std::runtime_error( "Failed to create index " + m_path + ": " + strerror( errno ) );
+	}
+	
+	uint8_t header[ k_headerSize ];
+	
+	memcpy( header, k_magic, sizeof( k_magic ) );
+	PutLE( header + 4, k_version, 4 );
+	PutLE( header + 8, m_initSegmentSize, 8 );
+	
+	if( write( m_fd, header, sizeof( header ) ) != (ssize_t)sizeof( header ) )
+	{
+		throw std::runtime_error( "Failed to write index header " + m_path + ": " + strerror( errno ) );
+	}
+}
+
+void CKeyframeIndex::Append( int64_t timestamp_usIn, uint64_t offsetIn )
+{
+	m_entries.push_back( TKeyframeEntry{ timestamp_usIn, offsetIn } );
+}
+
+void CKeyframeIndex::Flush()
+{
+	if( m_fd < 0 || m_flushedEntries == m_entries.size() )
+	{
+		return;
+	}
+	
+	// Serialize everything appended since the last flush in a single write
+	std::vector<uint8_t> buffer( ( m_entries.size() - m_flushedEntries ) * k_entrySize );
+	uint8_t *pos = buffer.data();
+	
+	for( size_t i = m_flushedEntries; i < m_entries.size(); ++i )
+	{
+		PutLE( pos, (uint64_t)m_entries[ i ].m_timestamp_us, 8 );
+		PutLE( pos + 8, m_entries[ i ].m_offset, 8 );
+		pos += k_entrySize;
+	}
+	
+	if( write( m_fd, buffer.data(), buffer.size() ) != (ssize_t)buffer.size() )
+	{
+		throw std::runtime_error( "Failed to write index " + m_path + ": " + strerror( errno ) );
+	}
+	
+	fdatasync( m_fd );
+	
+	m_flushedEntries = m_entries.size();
+}
+
+void CKeyframeIndex::Close()
+{
+	if( m_fd < 0 )
+	{
+		return;
+	}
+	
+	Flush();
+	
+	close( m_fd );
+	m_fd = -1;
+}
+
+void CKeyframeIndex::Load( const std::string &pathIn )
+{
+	std::ifstream file( pathIn, std::ios::binary );
+	
+	if( !file )
+	{
+		throw std::runtime_error( "Failed to open index " + pathIn );
+	}
+	
+	std::vector<uint8_t> data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+	
+	if( data.size() < k_headerSize || memcmp( data.data(), k_magic, sizeof( k_magic ) ) != 0 )
+	{
+		throw std::runtime_error( "Not a keyframe index: " + pathIn );
+	}
+	
+	if( GetLE( data.data() + 4, 4 ) != k_version )
+	{
+		throw std::runtime_error( "Unsupported keyframe index version: " + pathIn );
+	}
+	
+	m_path 				= pathIn;
+	m_initSegmentSize 	= GetLE( data.data() + 8, 8 );
+	m_entries.clear();
+	
+	// A trailing partial entry (power cut mid-write) is ignored
+	size_t entryCount = ( data.size() - k_headerSize ) / k_entrySize;
+	m_entries.reserve( entryCount );
+	
+	for( size_t i = 0; i < entryCount; ++i )
+	{
+		const uint8_t *pos = data.data() + k_headerSize + ( i * k_entrySize );
+		m_entries.push_back( TKeyframeEntry{ (int64_t)GetLE( pos, 8 ), GetLE( pos + 8, 8 ) } );
+	}
+	
+	m_flushedEntries = m_entries.size();
+}
+
+bool CKeyframeIndex::Lookup( int64_t timestamp_usIn, TKeyframeEntry &entryOut ) const
+{
+	// First entry strictly after the time, then step back one
+	auto it = std::upper_bound( m_entries.begin(), m_entries.end(), timestamp_usIn, []( int64_t timeIn, const TKeyframeEntry &entryIn ){ return timeIn < entryIn.m_timestamp_us; } );
+	
+	if( it == m_entries.begin() )
+	{
+		return false;
+	}
+	
+	entryOut = *( --it );
+	return true;
+}
+
+bool CKeyframeIndex::LookupNext( int64_t timestamp_usIn, TKeyframeEntry &entryOut ) const
+{
+	auto it = std::upper_bound( m_entries.begin(), m_entries.end(), timestamp_usIn, []( int64_t timeIn, const TKeyframeEntry &entryIn ){ return timeIn < entryIn.m_timestamp_us; } );
+	
+	if( it == m_entries.end() )
+	{
+		return false;
+	}
+	
+	entryOut = *it;
+	return true;
+}
+
+const std::vector<TKeyframeEntry>& CKeyframeIndex::GetEntries() const
+{
+	return m_entries;
+}
+
+uint64_t CKeyframeIndex::GetInitSegmentSize() const
+{
+	return m_initSegmentSize;
+}
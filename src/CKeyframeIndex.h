@@ -0,0 +1,58 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sidecar index for a recorded segment, stored next to it as <segment>.idx
+//
+// Layout (little-endian):
+// 		Header: 	"GMXI" | uint32 version | uint64 init segment size
+// 		Entries: 	int64 keyframe timestamp (us, mux clock) | uint64 byte offset of the keyframe's moof
+struct TKeyframeEntry
+{
+	int64_t 	m_timestamp_us;
+	uint64_t 	m_offset;
+};
+
+class CKeyframeIndex
+{
+public:
+	// Methods
+	CKeyframeIndex();
+	virtual ~CKeyframeIndex();
+	
+	static std::string GetIndexPath( const std::string &segmentPathIn );
+	
+	// Writing. Entries are buffered and only hit the file on Flush(), so the index never points past synced data.
+	void Create( const std::string &pathIn, uint64_t initSegmentSizeIn );
+	void Append( int64_t timestamp_usIn, uint64_t offsetIn );
+	void Flush();
+	void Close();
+	
+	// Reading
+	void Load( const std::string &pathIn );
+	
+	// Finds the last keyframe at or before the given time. Returns false if the time precedes the first keyframe.
+	bool Lookup( int64_t timestamp_usIn, TKeyframeEntry &entryOut ) const;
+	
+	// Finds the first keyframe after the given time. Returns false if there is none.
+	bool LookupNext( int64_t timestamp_usIn, TKeyframeEntry &entryOut ) const;
+	
+	const std::vector<TKeyframeEntry>& GetEntries() const;
+	uint64_t GetInitSegmentSize() const;
+
+private:
+	// Attributes
+	int 						m_fd					= -1;
+	std::string 				m_path;
+	uint64_t 					m_initSegmentSize		= 0;
+	
+	std::vector<TKeyframeEntry> m_entries;
+	size_t 						m_flushedEntries		= 0;
+	
+	static const uint32_t 		k_version				= 1;
+	static const size_t 		k_headerSize			= 16;
+	static const size_t 		k_entrySize				= 16;
+};
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <unistd.h>
 #include <cstdlib>
+#include <algorithm>
 
 using namespace std;
 using namespace CpperoMQ;
@@ -13,6 +14,7 @@ CMuxer::CMuxer( CpperoMQ::Context *contextIn, const std::string &endpointIn, EVi
 	, m_format( formatIn )
 	, m_pContext( contextIn )
 	, m_dataPub( m_pContext->createPublishSocket() )
+	, m_framesFailed( 0 )
 	, m_droppedFrames( 0 )
 {
 	// Bind the data publisher
@@ -165,7 +167,7 @@ void CMuxer::Update()
 			int score = AVPROBE_SCORE_MAX / 4;
 	
 			// Let the input buffer grow to a decent size before attempting to probe it
-			if( probeData.buf_size > 2000000 )
+			if( probeData.buf_size >= (int)m_probeSize )
 			{
 				// Probe data
 				cout << "Probing input buffer for format info..." << endl;
@@ -298,13 +300,16 @@ void CMuxer::Update()
 					return;
 				}
 				
-				// Flush any buffered data so we can start fresh with the most recent frame
-				avio_flush( m_pInputAvioContext );
-				avformat_flush( m_pInputFormatContext );
-				
-				// Flush input buffer and clear write counts so we can start tracking dropped frames
-				m_inputBuffer.Clear();
-				m_inputBuffer.ClearWriteCounts();
+				if( m_frameDuration_us == 0 )
+				{
+					// Flush any buffered data so we can start fresh with the most recent frame
+					avio_flush( m_pInputAvioContext );
+					avformat_flush( m_pInputFormatContext );
+					
+					// Flush input buffer and clear write counts so we can start tracking dropped frames
+					m_inputBuffer.Clear();
+					m_inputBuffer.ClearWriteCounts();
+				}
 				
 				cout << "Ready to mux!" << endl;
 				
@@ -333,7 +338,9 @@ void CMuxer::Update()
 				}
 
 				// Set the timestamp for the packet
-				packet.pts = packet.dts = av_rescale_q( av_gettime(), AV_TIME_BASE_Q, m_pInputFormatContext->streams[0]->time_base );
+				m_packetTimestamp_us 	= ( m_frameDuration_us == 0 ) ? av_gettime() : ( m_frameCount++ * m_frameDuration_us );
+				m_packetIsKeyframe 		= ( packet.flags & AV_PKT_FLAG_KEY );
+				packet.pts = packet.dts = av_rescale_q( m_packetTimestamp_us, AV_TIME_BASE_Q, m_pInputFormatContext->streams[0]->time_base );
 			
 				// Write moof+dat with one frame in it
 				// Call the second time with a null packet to flush the buffer and trigger a write_packet call
@@ -359,6 +366,70 @@ void CMuxer::Update()
 	}
 }
 
+void CMuxer::AddSink( CFragmentSink *sinkIn )
+{
+	std::lock_guard<std::mutex> lock( m_sinkMutex );
+	
+	m_sinks.push_back( sinkIn );
+	
+	// Late joiners still need the init segment before any fragments
+	if( m_pInitSegment )
+	{
+		sinkIn->OnInitSegment( m_pInitSegment );
+	}
+}
+
+void CMuxer::RemoveSink( CFragmentSink *sinkIn )
+{
+	std::lock_guard<std::mutex> lock( m_sinkMutex );
+	
+	m_sinks.erase( std::remove( m_sinks.begin(), m_sinks.end(), sinkIn ), m_sinks.end() );
+}
+
+void CMuxer::SetOffline( int64_t frameDuration_usIn, size_t probeSizeIn )
+{
+	m_frameDuration_us 	= frameDuration_usIn;
+	m_frameCount 		= 0;
+	m_probeSize 		= probeSizeIn;
+}
+
+void CMuxer::PublishToSinks( uint8_t *dataIn, int sizeIn, bool isInitIn )
+{
+	std::lock_guard<std::mutex> lock( m_sinkMutex );
+	
+	if( m_sinks.empty() && !isInitIn )
+	{
+		// Nobody to share with, skip the copy
+		return;
+	}
+	
+	// Copy the avio buffer once. Every sink shares this fragment from here on.
+	auto fragment = std::make_shared<TFragment>();
+	
+	fragment->m_data.assign( dataIn, dataIn + sizeIn );
+	fragment->m_timestamp_us 	= m_packetTimestamp_us;
+	fragment->m_sequence 		= m_fragmentSequence++;
+	fragment->m_isKeyframe 		= isInitIn || m_packetIsKeyframe;
+	fragment->m_isInit 			= isInitIn;
+	
+	if( isInitIn )
+	{
+		m_pInitSegment = fragment;
+	}
+	
+	for( auto sink : m_sinks )
+	{
+		if( isInitIn )
+		{
+			sink->OnInitSegment( fragment );
+		}
+		else
+		{
+			sink->OnFragment( fragment );
+		}
+	}
+}
+
 void CMuxer::ThreadLoop()
 {
 	Initialize();
@@ -407,6 +478,7 @@ int CMuxer::ReadPacket( void *muxerIn, uint8_t *avioBufferOut, int avioBufferSiz
 			
 			// Clear buffer
 			muxer->m_inputBuffer.Clear();
+			muxer->m_inputBuffer.m_dataConsumedCondition.notify_all();
 		}
 			
 		// Read 0 bytes
@@ -423,6 +495,7 @@ int CMuxer::ReadPacket( void *muxerIn, uint8_t *avioBufferOut, int avioBufferSiz
 		// Copy data from input buffer to input AVIO context, then clear the buffer
 		memcpy( avioBufferOut, muxer->m_inputBuffer.Begin(), bytesToConsume );
 		muxer->m_inputBuffer.Clear();
+		muxer->m_inputBuffer.m_dataConsumedCondition.notify_all();
 		
 		
 	}
@@ -458,6 +531,8 @@ int CMuxer::WritePacket( void *muxerIn, uint8_t *avioBufferIn, int bytesAvailabl
 				
 				muxer->m_isComposingInitFrame = false;
 				muxer->m_holdBuffer = false;
+				
+				muxer->PublishToSinks( avioBufferIn, bytesAvailableIn, true );
 			}
 		}
 		catch (const std::exception &e)
@@ -470,6 +545,9 @@ int CMuxer::WritePacket( void *muxerIn, uint8_t *avioBufferIn, int bytesAvailabl
 	{
 		try
 		{
+			// Local sinks (recording etc.) get every fragment, regardless of how zmq delivery goes
+			muxer->PublishToSinks( avioBufferIn, bytesAvailableIn, false );
+			
 			#ifdef DROP_ZMQ_FRAME
 			if( std::rand() % 100 == 0 )
 			{
@@ -3,10 +3,12 @@
 // Includes
 #include <CpperoMQ/All.hpp>
 #include "CVideoBuffer.h"
+#include "CFragmentSink.h"
 
 #include <thread>
 #include <mutex> 
 #include <atomic>
+#include <vector>
  
 extern "C" 
 { 
@@ -51,6 +53,14 @@ public:
 	void Initialize();
 	void Update();
 	void ThreadLoop();
+	
+	// Sinks get a shared reference to the init segment and to every fragment published after it
+	void AddSink( CFragmentSink *sinkIn );
+	void RemoveSink( CFragmentSink *sinkIn );
+	
+	// Offline input (remuxing a file): timestamps come from the frame count instead of the wall clock,
+	// and data read while probing is muxed instead of flushed. Must be called before any input is written.
+	void SetOffline( int64_t frameDuration_usIn, size_t probeSizeIn );
 		
 	EVideoFormat 				m_format;
 
@@ -58,13 +68,14 @@ public:
 	CpperoMQ::PublishSocket 	m_dataPub;
 	
 	size_t				m_avioContextBufferSize		= 4000000; // ~4mb
+	size_t				m_probeSize					= 2000000; // Input buffered before probing the format
 	
 	int64_t				m_timestamp					= 0;
 	int64_t				m_streamTimebase			= 0;
 	
 	TFrameStats			m_frameStats;
 	uint64_t			m_framesDelivered			= 0;
-	uint64_t			m_framesFailed				= 0;
+	std::atomic<uint64_t>	m_framesFailed;				// Read by the bitrate controller
 	
 	std::atomic<uint64_t> 	m_droppedFrames;
 	std::atomic<uint32_t> 	m_latency_us;
@@ -73,6 +84,20 @@ public:
 	bool				m_holdBuffer 				= false;
 	bool				m_isComposingInitFrame 		= false;
 	
+	// Fragment sinks
+	std::mutex					m_sinkMutex;
+	std::vector<CFragmentSink*>	m_sinks;
+	TFragmentPtr				m_pInitSegment;
+	
+	// Info about the packet currently being written, attached to the fragment it produces
+	int64_t				m_packetTimestamp_us		= 0;
+	bool				m_packetIsKeyframe			= false;
+	uint64_t			m_fragmentSequence			= 0;
+	
+	// Offline mode
+	int64_t				m_frameDuration_us			= 0;		// 0 when live
+	int64_t				m_frameCount				= 0;
+	
 	// Input structures
 	AVFormatContext 	*m_pInputFormatContext 		= NULL;
 	AVIOContext 		*m_pInputAvioContext 		= NULL;
@@ -97,4 +122,6 @@ public:
 	static int ReadPacket( void *muxerIn, uint8_t *avioBufferOut, int avioBufferSizeAvailableIn );
 	static int WritePacket( void *sharedDataIn, uint8_t *avioBufferIn, int bytesAvailableIn );
 	
+	void PublishToSinks( uint8_t *dataIn, int sizeIn, bool isInitIn );
+	
 };
\ No newline at end of file
@@ -0,0 +1,117 @@
+// Includes
+#include "CPacedSender.h"
+
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+
+CPacedSender::CPacedSender( std::shared_ptr<CTokenBucket> bucketIn )
+	: m_pBucket( bucketIn )
+	, m_maxQueuedBytes( 0 )
+{
+	m_maxQueuedBytes = (size_t)( m_pBucket->GetRate() / 8 * k_maxQueueDuration.count() );
+}
+
+bool CPacedSender::HasRoom( size_t bytesIn ) const
+{
+	return m_queuedBytes + bytesIn <= m_maxQueuedBytes;
+}
+
+void CPacedSender::Queue( const uint8_t *dataIn, size_t sizeIn, const sockaddr_in &addressIn )
+{
+	TDatagram datagram;
+	datagram.m_data.assign( dataIn, dataIn + sizeIn );
+	datagram.m_address 		= addressIn;
+	datagram.m_queueTime 	= CTokenBucket::TClock::now();
+	datagram.m_wasHeld 		= false;
+	
+	m_queuedBytes += sizeIn;
+	m_queue.push_back( std::move( datagram ) );
+}
+
+int CPacedSender::Flush( int socketIn )
+{
+	auto now = CTokenBucket::TClock::now();
+	std::chrono::microseconds wait( 0 );
+	
+	while( !m_queue.empty() && wait.count() == 0 )
+	{
+		// Everything the bucket allows right now, in one system call
+		mmsghdr messages[ k_batchSize ];
+		iovec parts[ k_batchSize ];
+		size_t count = 0;
+		
+		memset( messages, 0, sizeof( messages ) );
+		
+		while( count < k_batchSize && count < m_queue.size() )
+		{
+			TDatagram &datagram = m_queue[ count ];
+			
+			wait = m_pBucket->TryConsume( datagram.m_data.size(), now );
+			
+			if( wait.count() > 0 )
+			{
+				break;
+			}
+			
+			parts[ count ].iov_base 	= datagram.m_data.data();
+			parts[ count ].iov_len 		= datagram.m_data.size();
+			
+			messages[ count ].msg_hdr.msg_name 		= &datagram.m_address;
+			messages[ count ].msg_hdr.msg_namelen 	= sizeof( datagram.m_address );
+			messages[ count ].msg_hdr.msg_iov 		= &parts[ count ];
+			messages[ count ].msg_hdr.msg_iovlen 	= 1;
+			
+			count++;
+		}
+		
+		size_t sent = 0;
+		
+		while( sent < count )
+		{
+			// The tokens are spent either way. A full socket buffer means the link is already saturated, so the rest are lost.
+			int result = sendmmsg( socketIn, messages + sent, count - sent, MSG_DONTWAIT );
+			
+			if( result <= 0 )
+			{
+				if( result < 0 && errno == EINTR )
+				{
+					continue;
+				}
+				
+				break;
+			}
+			
+			sent += result;
+		}
+		
+		for( size_t i = 0; i < count; ++i )
+		{
+			if( i < sent )
+			{
+				m_stats.Record( (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>( now - m_queue.front().m_queueTime ).count(), m_queue.front().m_wasHeld );
+			}
+			else
+			{
+				m_stats.m_packetsDropped++;
+			}
+			
+			m_queuedBytes -= m_queue.front().m_data.size();
+			m_queue.pop_front();
+		}
+	}
+	
+	if( m_queue.empty() )
+	{
+		return -1;
+	}
+	
+	for( TDatagram &datagram : m_queue )
+	{
+		datagram.m_wasHeld = true;
+	}
+	
+	// Rounded up, so the next Flush() doesn't come too early to send anything
+	return (int)( ( wait.count() + 999 ) / 1000 );
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <memory>
+
+#include <netinet/in.h>
+
+#include "CTokenBucket.h"
+
+// Token bucket paced UDP output for a poll() driven server thread. Datagrams are queued as a frame's packets are made, and
+// go out at the peak rate on later Flush() calls, so an IDR is spread out instead of hitting the tether modem in one burst.
+// The bucket may be shared with other servers' senders, so that together they stay under the one peak rate.
+// Not thread safe: everything is called from the server thread.
+class CPacedSender
+{
+public:
+	// Attributes
+	TPacingStats 		m_stats;
+	
+	// Methods
+	CPacedSender( std::shared_ptr<CTokenBucket> bucketIn );
+	
+	// Room for a whole frame. Frames that don't fit are dropped whole, never in part.
+	bool HasRoom( size_t bytesIn ) const;
+	
+	void Queue( const uint8_t *dataIn, size_t sizeIn, const sockaddr_in &addressIn );
+	
+	// Sends what the bucket allows on socketIn. Returns the poll() timeout until the next datagram is due, or -1 with nothing queued.
+	int Flush( int socketIn );
+
+private:
+	struct TDatagram
+	{
+		std::vector<uint8_t> 				m_data;
+		sockaddr_in 						m_address;
+		CTokenBucket::TClock::time_point 	m_queueTime;
+		bool 								m_wasHeld;		// Left queued by a Flush() for lack of tokens
+	};
+	
+	// Attributes
+	std::shared_ptr<CTokenBucket> 	m_pBucket;
+	std::deque<TDatagram> 	m_queue;
+	size_t 					m_queuedBytes		= 0;
+	size_t 					m_maxQueuedBytes;
+	
+	// A second at the peak rate. Anything later than that is no use to a live viewer.
+	const std::chrono::seconds 	k_maxQueueDuration	= std::chrono::seconds( 1 );
+	static const size_t 		k_batchSize			= 32;
+};
@@ -0,0 +1,349 @@
+// Includes
+#include "CPlayback.h"
+#include "Mp4Box.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace CpperoMQ;
+
+CPlayback::CPlayback( CpperoMQ::Context *contextIn, const std::string &endpointIn )
+	: m_isPlaying( false )
+	, m_position_s( 0.0f )
+	, m_dataPub( contextIn->createPublishSocket() )
+	, m_killThread( false )
+{
+	m_dataPub.bind( endpointIn.c_str() );
+}
+
+CPlayback::~CPlayback()
+{
+	try
+	{
+		Stop();
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error cleaning up CPlayback: " << e.what() << endl;
+	}
+}
+
+void CPlayback::Start( const std::string &segmentPathIn, float speedIn, double start_sIn )
+{
+	if( speedIn < 0.0f )
+	{
+		throw std::runtime_error( "Playback speed must not be negative" );
+	}
+	
+	Stop();
+	Load( segmentPathIn );
+	
+	try
+	{
+		m_speed 		= speedIn;
+		m_nextFragment 	= ( start_sIn > 0.0 ) ? FindKeyframe( start_sIn ) : 0;
+		m_restartPacing = true;
+		m_sendInit 		= true;
+	}
+	catch( ... )
+	{
+		Unload();
+		throw;
+	}
+	
+	// The socket is only used from the playback thread until it is joined again
+	m_killThread 	= false;
+	m_isPlaying 	= true;
+	m_position_s 	= 0.0f;
+	m_thread 		= std::thread( &CPlayback::ThreadLoop, this );
+}
+
+void CPlayback::Seek( double position_sIn )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	if( !m_isPlaying )
+	{
+		throw std::runtime_error( "Nothing is playing" );
+	}
+	
+	m_nextFragment 	= FindKeyframe( position_sIn );
+	m_restartPacing = true;
+	m_sendInit 		= true;
+	
+	m_wakeCondition.notify_one();
+}
+
+void CPlayback::SetSpeed( float speedIn )
+{
+	if( speedIn < 0.0f )
+	{
+		throw std::runtime_error( "Playback speed must not be negative" );
+	}
+	
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	m_speed 		= speedIn;
+	m_restartPacing = true;
+	
+	m_wakeCondition.notify_one();
+}
+
+void CPlayback::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_killThread = true;
+	}
+	
+	m_wakeCondition.notify_one();
+	
+	if( m_thread.joinable() )
+	{
+		m_thread.join();
+	}
+	
+	Unload();
+}
+
+void CPlayback::Load( const std::string &segmentPathIn )
+{
+	m_fd = open( segmentPathIn.c_str(), O_RDONLY | O_CLOEXEC );
+	
+	if( m_fd < 0 )
+	{
+		throw std::runtime_error( "Failed to open " + segmentPathIn + ": " + strerror( errno ) );
+	}
+	
+	try
+	{
+		struct stat info;
+		
+		if( fstat( m_fd, &info ) != 0 || info.st_size == 0 )
+		{
+			throw std::runtime_error( "Failed to stat " + segmentPathIn );
+		}
+		
+		m_size = info.st_size;
+		
+		void *data = mmap( nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0 );
+		
+		if( data == MAP_FAILED )
+		{
+			throw std::runtime_error( "Failed to map " + segmentPathIn + ": " + strerror( errno ) );
+		}
+		
+		m_pData = (const uint8_t*)data;
+		madvise( data, m_size, MADV_SEQUENTIAL );
+		
+		// Walk the top level boxes. Everything before the first moof is the init segment, and each fragment
+		// runs up to the end of its mdat. Stops at the first incomplete box, in case the segment is still being written.
+		uint64_t offset 		= 0;
+		uint64_t fragmentStart 	= 0;
+		uint64_t decodeTime 	= 0;
+		bool haveMoof 			= false;
+		mp4::TBox box;
+		
+		m_fragments.clear();
+		m_initSize = 0;
+		
+		while( mp4::ParseBox( m_pData, m_size, offset, box ) && box.m_type != 0 )
+		{
+			if( box.m_type == mp4::FourCC( 'm', 'o', 'o', 'f' ) )
+			{
+				if( m_fragments.empty() && !haveMoof )
+				{
+					m_initSize = fragmentStart;
+				}
+				
+				haveMoof = mp4::GetBaseMediaDecodeTime( m_pData + box.m_offset, box.m_size, decodeTime );
+			}
+			else if( box.m_type == mp4::FourCC( 'm', 'd', 'a', 't' ) && haveMoof )
+			{
+				m_fragments.push_back( TPlaybackFragment{ fragmentStart, box.GetEnd() - fragmentStart, decodeTime } );
+				haveMoof 		= false;
+				fragmentStart 	= box.GetEnd();
+			}
+			else if( box.m_type == mp4::FourCC( 'm', 'o', 'o', 'v' ) )
+			{
+				fragmentStart = box.GetEnd();
+			}
+			
+			offset = box.GetEnd();
+		}
+		
+		if( m_fragments.empty() || !mp4::GetTrackTimescale( m_pData, m_initSize, m_timescale ) || m_timescale == 0 )
+		{
+			throw std::runtime_error( "No playable fragments in " + segmentPathIn );
+		}
+		
+		// The index is only needed to seek
+		try
+		{
+			std::unique_ptr<CKeyframeIndex> index( new CKeyframeIndex() );
+			index->Load( CKeyframeIndex::GetIndexPath( segmentPathIn ) );
+			m_pIndex = std::move( index );
+		}
+		catch( const std::exception &e )
+		{
+			cerr << "Playback of " << segmentPathIn << " will not be seekable: " << e.what() << endl;
+		}
+	}
+	catch( ... )
+	{
+		Unload();
+		throw;
+	}
+}
+
+void CPlayback::Unload()
+{
+	if( m_pData != nullptr )
+	{
+		munmap( (void*)m_pData, m_size );
+		m_pData = nullptr;
+	}
+	
+	if( m_fd >= 0 )
+	{
+		close( m_fd );
+		m_fd = -1;
+	}
+	
+	m_size 		= 0;
+	m_initSize 	= 0;
+	m_fragments.clear();
+	m_pIndex.reset();
+}
+
+size_t CPlayback::FindKeyframe( double position_sIn )
+{
+	if( !m_pIndex || m_pIndex->GetEntries().empty() )
+	{
+		throw std::runtime_error( "Segment has no keyframe index" );
+	}
+	
+	const std::vector<TKeyframeEntry> &entries = m_pIndex->GetEntries();
+	
+	TKeyframeEntry keyframe;
+	
+	if( !m_pIndex->Lookup( entries.front().m_timestamp_us + (int64_t)( position_sIn * 1000000.0 ), keyframe ) )
+	{
+		keyframe = entries.front();
+	}
+	
+	// Last fragment starting at or before the keyframe's offset
+	auto it = std::upper_bound( m_fragments.begin(), m_fragments.end(), keyframe.m_offset,
+								[]( uint64_t offsetIn, const TPlaybackFragment &fragmentIn ){ return offsetIn < fragmentIn.m_offset; } );
+	
+	if( it == m_fragments.begin() )
+	{
+		return 0;
+	}
+	
+	return ( it - m_fragments.begin() ) - 1;
+}
+
+void CPlayback::ThreadLoop()
+{
+	std::chrono::steady_clock::time_point pacingStartTime;
+	uint64_t pacingStartDecodeTime = 0;
+	uint64_t readAheadOffset = 0;
+	
+	try
+	{
+		std::unique_lock<std::mutex> lock( m_mutex );
+		
+		while( !m_killThread && m_nextFragment < m_fragments.size() )
+		{
+			const TPlaybackFragment &fragment = m_fragments[ m_nextFragment ];
+			
+			if( m_sendInit )
+			{
+				// (Re)send the init segment so clients can reset their decoder before a jump
+				m_sendInit = false;
+				
+				lock.unlock();
+				SendInit();
+				lock.lock();
+				continue;
+			}
+			
+			if( m_restartPacing )
+			{
+				// Seeking or a speed change resets the clock, so fragments are paced from here
+				pacingStartTime 		= std::chrono::steady_clock::now();
+				pacingStartDecodeTime 	= fragment.m_decodeTime;
+				readAheadOffset 		= fragment.m_offset;
+				m_restartPacing 		= false;
+			}
+			
+			if( m_speed > 0.0f && fragment.m_decodeTime > pacingStartDecodeTime )
+			{
+				double delay_s = (double)( fragment.m_decodeTime - pacingStartDecodeTime ) / m_timescale / m_speed;
+				auto dueTime = pacingStartTime + std::chrono::microseconds( (int64_t)( delay_s * 1000000.0 ) );
+				
+				if( m_wakeCondition.wait_until( lock, dueTime, [this](){ return m_killThread || m_restartPacing || m_sendInit; } ) )
+				{
+					continue;
+				}
+			}
+			
+			TPlaybackFragment current = fragment;
+			m_nextFragment++;
+			
+			lock.unlock();
+			
+			// Keep the page cache ahead of the read position so pacing isn't held up by the disk
+			if( current.m_offset + current.m_size > readAheadOffset )
+			{
+				readAheadOffset = std::min<uint64_t>( current.m_offset + k_readAhead, m_size );
+				
+				uint64_t pageStart = current.m_offset & ~(uint64_t)( sysconf( _SC_PAGESIZE ) - 1 );
+				madvise( (void*)( m_pData + pageStart ), readAheadOffset - pageStart, MADV_WILLNEED );
+			}
+			
+			SendFragment( current );
+			m_position_s = (float)( (double)( current.m_decodeTime - m_fragments.front().m_decodeTime ) / m_timescale );
+			
+			lock.lock();
+		}
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Playback error: " << e.what() << endl;
+	}
+	
+	m_isPlaying = false;
+}
+
+void CPlayback::SendInit()
+{
+	OutgoingMessage topic( "i" );
+	OutgoingMessage payload( m_initSize, m_pData );
+	
+	if( !topic.send( m_dataPub, true ) || !payload.send( m_dataPub, false ) )
+	{
+		throw std::runtime_error( "Failed to send init segment" );
+	}
+}
+
+void CPlayback::SendFragment( const TPlaybackFragment &fragmentIn )
+{
+	OutgoingMessage topic( "v" );
+	OutgoingMessage payload( fragmentIn.m_size, m_pData + fragmentIn.m_offset );
+	
+	if( !topic.send( m_dataPub, true ) || !payload.send( m_dataPub, false ) )
+	{
+		cerr << "Failed to send playback fragment over zmq" << endl;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+// Includes
+#include <CpperoMQ/All.hpp>
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <memory>
+
+#include "CKeyframeIndex.h"
+
+struct TPlaybackFragment
+{
+	uint64_t 	m_offset;
+	uint64_t 	m_size;
+	uint64_t 	m_decodeTime;		// tfdt, in track timescale units
+};
+
+// Plays a recorded segment back over its own PUB endpoint, using the same "i"/"v" topics as the live video endpoint,
+// so clients can review recordings with the live client stack
+class CPlayback
+{
+public:
+	// Attributes
+	std::atomic<bool> 		m_isPlaying;
+	std::atomic<float> 		m_position_s;
+	
+	// Methods
+	CPlayback( CpperoMQ::Context *contextIn, const std::string &endpointIn );
+	virtual ~CPlayback();
+	
+	// Speed is a multiple of real time. 0 publishes as fast as the subscribers can take it.
+	// Positions are in seconds from the first keyframe of the segment and snap back to a keyframe.
+	void Start( const std::string &segmentPathIn, float speedIn, double start_sIn );
+	void Seek( double position_sIn );
+	void SetSpeed( float speedIn );
+	void Stop();
+
+private:
+	// Attributes
+	CpperoMQ::PublishSocket 		m_dataPub;
+	
+	std::thread 					m_thread;
+	std::mutex 						m_mutex;
+	std::condition_variable 		m_wakeCondition;
+	std::atomic<bool> 				m_killThread;
+	
+	// Loaded segment
+	int 							m_fd				= -1;
+	const uint8_t 					*m_pData			= nullptr;
+	size_t 							m_size				= 0;
+	uint64_t 						m_initSize			= 0;
+	uint32_t 						m_timescale			= 0;
+	std::vector<TPlaybackFragment> 	m_fragments;
+	std::unique_ptr<CKeyframeIndex> m_pIndex;
+	
+	// Playback control, shared with the playback thread
+	float 							m_speed				= 1.0f;
+	size_t 							m_nextFragment		= 0;
+	bool 							m_restartPacing		= true;
+	bool 							m_sendInit			= true;
+	
+	const size_t 					k_readAhead			= 4 * 1024 * 1024;
+	
+	// Methods
+	void ThreadLoop();
+	void Load( const std::string &segmentPathIn );
+	void Unload();
+	
+	size_t FindKeyframe( double position_sIn );
+	
+	void SendInit();
+	void SendFragment( const TPlaybackFragment &fragmentIn );
+};
@@ -0,0 +1,123 @@
+// Includes
+#include "CPreEventBuffer.h"
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+CPreEventBuffer::CPreEventBuffer( std::chrono::seconds durationIn, size_t maxBytesIn )
+	: m_bufferedBytes( 0 )
+	, m_bufferedDuration_s( 0.0f )
+	, k_duration( durationIn )
+	, k_maxBytes( maxBytesIn )
+{
+}
+
+CPreEventBuffer::~CPreEventBuffer()
+{
+}
+
+std::vector<TFragmentPtr> CPreEventBuffer::Snapshot()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	std::vector<TFragmentPtr> snapshot;
+	
+	if( !m_pInitSegment || m_fragments.empty() )
+	{
+		return snapshot;
+	}
+	
+	// Only the references are copied. The fragment data stays shared with the live path.
+	snapshot.reserve( m_fragments.size() + 1 );
+	snapshot.push_back( m_pInitSegment );
+	snapshot.insert( snapshot.end(), m_fragments.begin(), m_fragments.end() );
+	
+	return snapshot;
+}
+
+void CPreEventBuffer::WriteToFile( const std::vector<TFragmentPtr> &fragmentsIn, const std::string &pathIn )
+{
+	std::ofstream file( pathIn, std::ios::binary | std::ios::trunc );
+	
+	if( !file )
+	{
+		throw std::runtime_error( "Failed to open " + pathIn );
+	}
+	
+	for( auto &fragment : fragmentsIn )
+	{
+		file.write( (const char*)fragment->m_data.data(), fragment->m_data.size() );
+	}
+	
+	file.close();
+	
+	if( !file )
+	{
+		throw std::runtime_error( "Failed to write " + pathIn );
+	}
+}
+
+void CPreEventBuffer::OnInitSegment( const TFragmentPtr &initSegmentIn )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	// Fragments muxed under a previous header can't be played with the new one
+	m_pInitSegment = initSegmentIn;
+	m_fragments.clear();
+	m_bytes = 0;
+	
+	m_bufferedBytes 		= 0;
+	m_bufferedDuration_s 	= 0.0f;
+}
+
+void CPreEventBuffer::OnFragment( const TFragmentPtr &fragmentIn )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	// The ring must start at a keyframe
+	if( m_fragments.empty() && !fragmentIn->m_isKeyframe )
+	{
+		return;
+	}
+	
+	m_fragments.push_back( fragmentIn );
+	m_bytes += fragmentIn->m_data.size();
+	
+	Trim();
+	
+	m_bufferedBytes 		= m_bytes;
+	m_bufferedDuration_s 	= m_fragments.empty() ? 0.0f : (float)( m_fragments.back()->m_timestamp_us - m_fragments.front()->m_timestamp_us ) / 1000000.0f;
+}
+
+void CPreEventBuffer::Trim()
+{
+	auto isOverBudget = [this]()
+	{
+		return ( m_bytes > k_maxBytes ) || ( ( m_fragments.back()->m_timestamp_us - m_fragments.front()->m_timestamp_us ) > k_duration.count() );
+	};
+	
+	while( !m_fragments.empty() && isOverBudget() )
+	{
+		// Evict a whole GOP at a time so the front is always a keyframe. The newest GOP stays, even over budget, or the ring
+		// would be left empty until the next keyframe.
+		auto nextKeyframe = std::find_if( m_fragments.begin() + 1, m_fragments.end(), []( const TFragmentPtr &fragmentIn )
+		{
+			return fragmentIn->m_isKeyframe;
+		} );
+		
+		if( nextKeyframe == m_fragments.end() )
+		{
+			break;
+		}
+		
+		for( auto it = m_fragments.begin(); it != nextKeyframe; ++it )
+		{
+			m_bytes -= (*it)->m_data.size();
+		}
+		
+		m_fragments.erase( m_fragments.begin(), nextKeyframe );
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include "CFragmentSink.h"
+
+// Keeps the last N seconds of muxed fragments in memory, by reference, always starting at a keyframe
+class CPreEventBuffer : public CFragmentSink
+{
+public:
+	// Attributes
+	std::atomic<uint64_t> 	m_bufferedBytes;
+	std::atomic<float> 		m_bufferedDuration_s;
+	
+	// Methods
+	CPreEventBuffer( std::chrono::seconds durationIn = std::chrono::seconds( 30 ), size_t maxBytesIn = 32 * 1024 * 1024 );
+	virtual ~CPreEventBuffer();
+	
+	// Returns the init segment followed by the buffered fragments. Empty if there is nothing playable yet.
+	std::vector<TFragmentPtr> Snapshot();
+	
+	// Writes a snapshot out as a standalone MP4 file
+	static void WriteToFile( const std::vector<TFragmentPtr> &fragmentsIn, const std::string &pathIn );
+	
+	// CFragmentSink
+	virtual void OnInitSegment( const TFragmentPtr &initSegmentIn );
+	virtual void OnFragment( const TFragmentPtr &fragmentIn );
+
+private:
+	// Attributes
+	const std::chrono::microseconds 	k_duration;
+	const size_t 						k_maxBytes;
+	
+	std::mutex 							m_mutex;
+	std::deque<TFragmentPtr> 			m_fragments;
+	TFragmentPtr 						m_pInitSegment;
+	size_t 								m_bytes		= 0;
+	
+	// Methods
+	void Trim();
+};
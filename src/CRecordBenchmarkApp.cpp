@@ -0,0 +1,185 @@
+// Includes
+#include "CRecordBenchmarkApp.h"
+#include "CRecorder.h"
+#include "Utility.h"
+
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <memory>
+#include <thread>
+#include <cstring>
+
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace std;
+
+CRecordBenchmarkApp::CRecordBenchmarkApp( int argCountIn, char* argsIn[], const std::string &directoryIn )
+	: CApp( argCountIn, argsIn )
+	, m_directory( directoryIn )
+{
+}
+
+CRecordBenchmarkApp::~CRecordBenchmarkApp()
+{
+}
+
+void CRecordBenchmarkApp::Run()
+{
+	// Fragments are immutable and shared, so every channel reuses the same three. Only the recorders' own work is timed.
+	auto init = std::make_shared<TFragment>();
+	init->m_data.assign( 1024, 0 );
+	init->m_isInit = true;
+	
+	auto keyframe = std::make_shared<TFragment>();
+	keyframe->m_data.assign( k_keyframeSize, 0x55 );
+	keyframe->m_isKeyframe = true;
+	
+	auto frame = std::make_shared<TFragment>();
+	frame->m_data.assign( k_frameSize, 0x55 );
+	
+	m_pInitSegment 	= init;
+	m_pKeyframe 	= keyframe;
+	m_pFrame 		= frame;
+	
+	double channelRate_Bps = (double)( k_keyframeSize + ( k_gopLength - 1 ) * k_frameSize ) * k_framerate / k_gopLength;
+	
+	cout << "Recording to " << m_directory << " for " << k_runDuration.count() << " s per run. One channel is "
+		<< std::fixed << std::setprecision( 1 ) << ( channelRate_Bps * 8.0 / 1000000.0 ) << " Mbit/s in real time." << endl;
+	cout << std::left << std::setw( 11 ) << "mode" << std::right << std::setw( 10 ) << "channels" << std::setw( 14 ) << "offered MB/s"
+		<< std::setw( 14 ) << "written MB/s" << std::setw( 10 ) << "dropped" << std::setw( 10 ) << "segments" << endl;
+	
+	bool keptUp = true;
+	
+	for( bool isRealTime : { true, false } )
+	{
+		for( size_t channels : { 1, 2, 4 } )
+		{
+			TRunResult result = RunChannels( channels, isRealTime );
+			RemoveFiles();
+			
+			keptUp = keptUp && ( !isRealTime || result.m_fragmentsDropped == 0 );
+			
+			cout << std::left << std::setw( 11 ) << ( isRealTime ? "real time" : "flood" ) << std::right << std::setw( 10 ) << channels
+				<< std::fixed << std::setprecision( 1 ) << std::setw( 14 );
+			
+			// Flooding offers whatever the queues will take, and drops the rest, so only what was written means anything
+			if( isRealTime )
+			{
+				cout << ( result.m_bytesOffered / result.m_seconds / 1000000.0 );
+			}
+			else
+			{
+				cout << "-";
+			}
+			
+			cout << std::setw( 14 ) << ( result.m_bytesWritten / result.m_seconds / 1000000.0 )
+				<< std::setw( 10 ) << ( isRealTime ? std::to_string( result.m_fragmentsDropped ) : std::string( "-" ) )
+				<< std::setw( 10 ) << result.m_segmentsClosed << endl;
+		}
+	}
+	
+	if( !keptUp )
+	{
+		throw std::runtime_error( "Recording dropped fragments at the real time rate" );
+	}
+	
+	cout << "Every channel count kept up in real time" << endl;
+}
+
+CRecordBenchmarkApp::TRunResult CRecordBenchmarkApp::RunChannels( size_t channelCountIn, bool isRealTimeIn )
+{
+	std::vector<std::unique_ptr<CRecorder>> recorders;
+	std::vector<TRunResult> results( channelCountIn );
+	std::vector<std::thread> threads;
+	
+	for( size_t i = 0; i < channelCountIn; ++i )
+	{
+		TRecorderConfig config;
+		config.m_directory 			= m_directory;
+		config.m_filePrefix 		= k_filePrefix + std::to_string( i );
+		config.m_segmentSize_bytes 	= k_segmentSize_bytes;
+		
+		recorders.push_back( util::make_unique<CRecorder>() );
+		recorders.back()->OnInitSegment( m_pInitSegment );
+		recorders.back()->Start( config );
+	}
+	
+	auto start 	= std::chrono::steady_clock::now();
+	auto end 	= start + k_runDuration;
+	
+	for( size_t i = 0; i < channelCountIn; ++i )
+	{
+		threads.push_back( std::thread( &CRecordBenchmarkApp::Feed, this, std::ref( *recorders[ i ] ), isRealTimeIn, end, std::ref( results[ i ] ) ) );
+	}
+	
+	for( std::thread &thread : threads )
+	{
+		thread.join();
+	}
+	
+	TRunResult total;
+	
+	for( size_t i = 0; i < channelCountIn; ++i )
+	{
+		// Drains the queue, then closes and syncs the last segment. That is part of the cost.
+		recorders[ i ]->Stop();
+		
+		total.m_bytesOffered 		+= results[ i ].m_bytesOffered;
+		total.m_fragmentsOffered 	+= results[ i ].m_fragmentsOffered;
+		total.m_bytesWritten 		+= recorders[ i ]->m_bytesWritten;
+		total.m_fragmentsDropped 	+= recorders[ i ]->m_fragmentsDropped;
+		total.m_segmentsClosed 		+= recorders[ i ]->m_segmentsClosed;
+	}
+	
+	total.m_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+	
+	return total;
+}
+
+void CRecordBenchmarkApp::Feed( CFragmentSink &sinkIn, bool isRealTimeIn, std::chrono::steady_clock::time_point endIn, TRunResult &resultOut )
+{
+	auto nextFrame = std::chrono::steady_clock::now();
+	
+	while( std::chrono::steady_clock::now() < endIn )
+	{
+		const TFragmentPtr &fragment = ( resultOut.m_fragmentsOffered % k_gopLength == 0 ) ? m_pKeyframe : m_pFrame;
+		
+		sinkIn.OnFragment( fragment );
+		
+		resultOut.m_fragmentsOffered++;
+		resultOut.m_bytesOffered += fragment->m_data.size();
+		
+		if( isRealTimeIn )
+		{
+			nextFrame += std::chrono::microseconds( 1000000 / k_framerate );
+			std::this_thread::sleep_until( nextFrame );
+		}
+		else
+		{
+			// Let the writer threads at the queue locks
+			std::this_thread::yield();
+		}
+	}
+}
+
+void CRecordBenchmarkApp::RemoveFiles()
+{
+	DIR *dir = opendir( m_directory.c_str() );
+	
+	if( dir == nullptr )
+	{
+		return;
+	}
+	
+	while( dirent *entry = readdir( dir ) )
+	{
+		if( strncmp( entry->d_name, k_filePrefix.c_str(), k_filePrefix.size() ) == 0 )
+		{
+			unlink( ( m_directory + "/" + entry->d_name ).c_str() );
+		}
+	}
+	
+	closedir( dir );
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "CApp.h"
+#include "CFragmentSink.h"
+
+// Measures sustained CRecorder write throughput into a directory for 1, 2 and 4 channels recording at once. Each channel
+// is fed a synthetic fragment stream from its own thread, the way the muxers would: first at a real camera rate, to show
+// every channel keeps up without drops, then as fast as the recorders accept it, to find the disk's ceiling. The files
+// written are removed again.
+class CRecordBenchmarkApp : public CApp
+{
+public:
+	// Methods
+	CRecordBenchmarkApp( int argCountIn, char* argsIn[], const std::string &directoryIn );
+	virtual ~CRecordBenchmarkApp();
+	
+	virtual void Run();
+
+private:
+	struct TRunResult
+	{
+		uint64_t 		m_bytesOffered		= 0;
+		uint64_t 		m_bytesWritten		= 0;
+		uint64_t 		m_fragmentsOffered	= 0;
+		uint64_t 		m_fragmentsDropped	= 0;
+		uint64_t 		m_segmentsClosed	= 0;
+		double 			m_seconds			= 0.0;		// Start to the last segment closed and synced
+	};
+	
+	// Attributes
+	std::string 				m_directory;
+	TFragmentPtr 				m_pInitSegment;
+	TFragmentPtr 				m_pKeyframe;
+	TFragmentPtr 				m_pFrame;
+	
+	const std::string 			k_filePrefix			= "geomux_record_benchmark";
+	const std::chrono::seconds 	k_runDuration			= std::chrono::seconds( 5 );
+	const int 					k_framerate				= 30;
+	const int 					k_gopLength				= 30;
+	const size_t 				k_keyframeSize			= 160 * 1024;		// With the P-frames, about 8 Mbit/s per channel at 30fps
+	const size_t 				k_frameSize				= 28 * 1024;
+	const uint64_t 				k_segmentSize_bytes		= 64 * 1024 * 1024;	// Small enough to rotate several times per run
+	
+	// Methods
+	TRunResult RunChannels( size_t channelCountIn, bool isRealTimeIn );
+	void Feed( CFragmentSink &sinkIn, bool isRealTimeIn, std::chrono::steady_clock::time_point endIn, TRunResult &resultOut );
+	void RemoveFiles();
+};
@@ -0,0 +1,528 @@
+// Includes
+#include "CRecorder.h"
+#include "Mp4Box.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+CRecorder::CRecorder()
+	: m_isRecording( false )
+	, m_bytesWritten( 0 )
+	, m_fragmentsWritten( 0 )
+	, m_fragmentsDropped( 0 )
+	, m_segmentsClosed( 0 )
+	, m_writeRate_Bps( 0.0f )
+	, m_telemetryWritten( 0 )
+	, m_killThread( false )
+{
+}
+
+CRecorder::~CRecorder()
+{
+	try
+	{
+		Stop();
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error cleaning up CRecorder: " << e.what() << endl;
+	}
+}
+
+void CRecorder::SetSegmentClosedCallback( TSegmentClosedCallback callbackIn )
+{
+	m_segmentClosedCallback = callbackIn;
+}
+
+void CRecorder::SetTelemetrySource( CTelemetrySubscriber *telemetryIn )
+{
+	m_pTelemetry = telemetryIn;
+}
+
+void CRecorder::Start( const TRecorderConfig &configIn )
+{
+	if( m_thread.joinable() )
+	{
+		throw std::runtime_error( "Already recording" );
+	}
+	
+	struct stat info;
+	
+	if( stat( configIn.m_directory.c_str(), &info ) != 0 || !S_ISDIR( info.st_mode ) )
+	{
+		throw std::runtime_error( "Recording directory does not exist: " + configIn.m_directory );
+	}
+	
+	// Aligned staging buffer for batched writes
+	void *batch = nullptr;
+	
+	if( posix_memalign( &batch, k_alignment, k_batchCapacity ) != 0 )
+	{
+		throw std::runtime_error( "Failed to allocate recording buffer" );
+	}
+	
+	m_config 			= configIn;
+	m_pBatch 			= (uint8_t*)batch;
+	m_batchSize 		= 0;
+	m_batchFlushed 		= 0;
+	m_batchFileOffset 	= 0;
+	m_segmentCounter 	= 0;
+	
+	m_bytesWritten 		= 0;
+	m_fragmentsWritten 	= 0;
+	m_fragmentsDropped 	= 0;
+	m_segmentsClosed 	= 0;
+	m_writeRate_Bps 	= 0.0f;
+	m_telemetryWritten 	= 0;
+	
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		
+		m_queue.clear();
+		m_queuedBytes 	= 0;
+		m_needKeyframe 	= true;
+	}
+	
+	m_killThread 	= false;
+	m_isRecording 	= true;
+	
+	m_thread = std::thread( &CRecorder::ThreadLoop, this );
+}
+
+void CRecorder::Stop()
+{
+	if( !m_thread.joinable() )
+	{
+		return;
+	}
+	
+	m_isRecording 	= false;
+	m_killThread 	= true;
+	
+	m_dataAvailableCondition.notify_one();
+	m_thread.join();
+	
+	free( m_pBatch );
+	m_pBatch = nullptr;
+	
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_queue.clear();
+	m_queuedBytes = 0;
+}
+
+void CRecorder::OnInitSegment( const TFragmentPtr &initSegmentIn )
+{
+	// Keep the latest init segment whether or not we are recording, so a recording can start at any time
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_pInitSegment = initSegmentIn;
+}
+
+void CRecorder::OnFragment( const TFragmentPtr &fragmentIn )
+{
+	if( !m_isRecording )
+	{
+		return;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		
+		// After a drop, the file must resume on a keyframe
+		if( m_needKeyframe && !fragmentIn->m_isKeyframe )
+		{
+			m_fragmentsDropped++;
+			return;
+		}
+		
+		// The writer has fallen behind. Drop rather than stall the live path.
+		if( m_queuedBytes + fragmentIn->m_data.size() > m_config.m_maxQueuedBytes )
+		{
+			m_fragmentsDropped++;
+			m_needKeyframe = true;
+			return;
+		}
+		
+		m_needKeyframe = false;
+		m_queuedBytes += fragmentIn->m_data.size();
+		m_queue.push_back( fragmentIn );
+	}
+	
+	m_dataAvailableCondition.notify_one();
+}
+
+void CRecorder::ThreadLoop()
+{
+	m_lastSyncTime = m_lastRateTime = std::chrono::steady_clock::now();
+	m_lastRateBytes = 0;
+	
+	try
+	{
+		while( true )
+		{
+			std::deque<TFragmentPtr> work;
+			
+			{
+				std::unique_lock<std::mutex> lock( m_mutex );
+				
+				// Wake up periodically even without data, so fsync deadlines are met
+				m_dataAvailableCondition.wait_for( lock, k_wakeInterval, [this](){ return m_killThread || !m_queue.empty(); } );
+				
+				work.swap( m_queue );
+				m_queuedBytes = 0;
+			}
+			
+			for( auto &fragment : work )
+			{
+				WriteFragment( fragment );
+			}
+			
+			auto now = std::chrono::steady_clock::now();
+			
+			// Bound the amount of data a power cut can take with it
+			if( now - m_lastSyncTime >= std::chrono::seconds( m_config.m_fsyncInterval_s ) )
+			{
+				SyncSegment();
+				m_lastSyncTime = now;
+			}
+			
+			// Throughput (rough diagnostic)
+			auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>( now - m_lastRateTime ).count();
+			
+			if( elapsed_us >= 1000000 )
+			{
+				m_writeRate_Bps 	= (float)( m_bytesWritten - m_lastRateBytes ) * 1000000.0f / (float)elapsed_us;
+				m_lastRateBytes 	= m_bytesWritten;
+				m_lastRateTime 		= now;
+			}
+			
+			if( m_killThread )
+			{
+				break;
+			}
+		}
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Recording stopped due to error: " << e.what() << endl;
+		m_isRecording = false;
+	}
+	
+	try
+	{
+		CloseSegment();
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error closing recording segment: " << e.what() << endl;
+	}
+}
+
+void CRecorder::WriteFragment( const TFragmentPtr &fragmentIn )
+{
+	if( ShouldRotate( fragmentIn ) )
+	{
+		// Segments always start with a keyframe so each one plays on its own
+		if( !fragmentIn->m_isKeyframe )
+		{
+			m_fragmentsDropped++;
+			return;
+		}
+		
+		CloseSegment();
+		OpenSegment();
+		
+		if( m_fd < 0 )
+		{
+			m_fragmentsDropped++;
+			return;
+		}
+	}
+	
+	const size_t size = fragmentIn->m_data.size();
+	
+	if( fragmentIn->m_isKeyframe )
+	{
+		// Index the keyframe at the offset its moof is about to land on
+		m_index.Append( fragmentIn->m_timestamp_us, m_segmentBytes );
+	}
+	
+	// Telemetry goes between fragments, after the index entry so seeking and clipping keep it
+	WriteTelemetry( fragmentIn );
+	
+	Preallocate( m_segmentBytes + size );
+	AppendToBatch( fragmentIn->m_data.data(), size );
+	
+	m_segmentBytes += size;
+	m_bytesWritten += size;
+	m_fragmentsWritten++;
+}
+
+bool CRecorder::ShouldRotate( const TFragmentPtr &fragmentIn )
+{
+	if( m_fd < 0 )
+	{
+		return true;
+	}
+	
+	if( !fragmentIn->m_isKeyframe )
+	{
+		return false;
+	}
+	
+	bool durationExceeded 	= ( std::chrono::steady_clock::now() - m_segmentStartTime ) >= std::chrono::seconds( m_config.m_segmentDuration_s );
+	bool sizeExceeded 		= ( m_segmentBytes + fragmentIn->m_data.size() ) > m_config.m_segmentSize_bytes;
+	
+	return durationExceeded || sizeExceeded;
+}
+
+void CRecorder::WriteTelemetry( const TFragmentPtr &fragmentIn )
+{
+	if( m_pTelemetry == nullptr )
+	{
+		return;
+	}
+	
+	const int64_t fragmentTimestamp_us = fragmentIn->m_timestamp_us;
+	uint64_t fragmentDecodeTime = 0;
+	bool haveDecodeTime = false;
+	TTelemetrySample *sample;
+	
+	// Everything that arrived up to this frame. Later samples wait for the next fragment.
+	while( ( sample = m_pTelemetry->m_samples.Front() ) != nullptr && sample->m_timestamp_us <= fragmentTimestamp_us )
+	{
+		const uint64_t age_us = fragmentTimestamp_us - sample->m_timestamp_us;
+		
+		if( age_us <= (uint64_t)k_maxTelemetryAge_us )
+		{
+			if( !haveDecodeTime )
+			{
+				// Place samples relative to the frame's own decode time, so they share its timeline exactly
+				haveDecodeTime = mp4::GetBaseMediaDecodeTime( fragmentIn->m_data.data(), fragmentIn->m_data.size(), fragmentDecodeTime );
+				
+				if( !haveDecodeTime )
+				{
+					break;
+				}
+			}
+			
+			uint64_t offset = age_us * m_trackTimescale / 1000000;
+			uint64_t presentationTime = ( fragmentDecodeTime > offset ) ? ( fragmentDecodeTime - offset ) : 0;
+			
+			std::vector<uint8_t> box = mp4::BuildEventMessage( "urn:geomux:telemetry", sample->m_topic, m_trackTimescale,
+																presentationTime, 0, m_eventId++,
+																(const uint8_t*)sample->m_payload.data(), sample->m_payload.size() );
+			
+			Preallocate( m_segmentBytes + box.size() );
+			AppendToBatch( box.data(), box.size() );
+			
+			m_segmentBytes += box.size();
+			m_bytesWritten += box.size();
+			m_telemetryWritten++;
+		}
+		
+		m_pTelemetry->m_samples.Pop();
+	}
+}
+
+void CRecorder::OpenSegment()
+{
+	TFragmentPtr initSegment;
+	
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		initSegment = m_pInitSegment;
+	}
+	
+	if( !initSegment )
+	{
+		// Muxer hasn't produced a header yet. Nothing playable can be written.
+		return;
+	}
+	
+	// Name the segment after its wall clock start time
+	char timeString[ 32 ];
+	time_t now = time( nullptr );
+	struct tm localTime;
+	
+	localtime_r( &now, &localTime );
+	strftime( timeString, sizeof( timeString ), "%Y%m%d_%H%M%S", &localTime );
+	
+	m_segmentPath = m_config.m_directory + "/" + m_config.m_filePrefix + "_" + timeString + "_" + std::to_string( m_segmentCounter++ ) + ".mp4";
+	
+	m_fd = open( m_segmentPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+	
+	if( m_fd < 0 )
+	{
+		throw std::runtime_error( "Failed to open segment " + m_segmentPath + ": " + strerror( errno ) );
+	}
+	
+	m_segmentBytes 		= 0;
+	m_allocatedBytes 	= 0;
+	m_batchSize 		= 0;
+	m_batchFlushed 		= 0;
+	m_batchFileOffset 	= 0;
+	m_segmentStartTime 	= std::chrono::steady_clock::now();
+	
+	cout << "Recording to: " << m_segmentPath << endl;
+	
+	m_index.Create( CKeyframeIndex::GetIndexPath( m_segmentPath ), initSegment->m_data.size() );
+	
+	// Telemetry is stamped in track time units, like the fragments' decode times
+	if( !mp4::GetTrackTimescale( initSegment->m_data.data(), initSegment->m_data.size(), m_trackTimescale ) || m_trackTimescale == 0 )
+	{
+		m_trackTimescale = 90000;
+	}
+	
+	// Every segment starts with its own copy of the init segment
+	Preallocate( initSegment->m_data.size() );
+	AppendToBatch( initSegment->m_data.data(), initSegment->m_data.size() );
+	
+	m_segmentBytes += initSegment->m_data.size();
+	m_bytesWritten += initSegment->m_data.size();
+}
+
+void CRecorder::CloseSegment()
+{
+	if( m_fd < 0 )
+	{
+		return;
+	}
+	
+	FlushBatch();
+	
+	// Hand back any preallocated space past the end of the data
+	if( ftruncate( m_fd, m_segmentBytes ) != 0 )
+	{
+		cerr << "Failed to truncate segment " << m_segmentPath << ": " << strerror( errno ) << endl;
+	}
+	
+	fdatasync( m_fd );
+	close( m_fd );
+	
+	m_index.Close();
+	
+	m_fd = -1;
+	m_segmentsClosed++;
+	
+	cout << "Closed recording segment: " << m_segmentPath << " (" << m_segmentBytes << " bytes)" << endl;
+	
+	if( m_segmentClosedCallback )
+	{
+		try
+		{
+			m_segmentClosedCallback( m_segmentPath );
+		}
+		catch( const std::exception &e )
+		{
+			cerr << "Error in segment closed callback: " << e.what() << endl;
+		}
+	}
+}
+
+void CRecorder::AppendToBatch( const uint8_t *dataIn, size_t sizeIn )
+{
+	while( sizeIn > 0 )
+	{
+		size_t bytesToCopy = std::min( sizeIn, k_batchCapacity - m_batchSize );
+		
+		memcpy( m_pBatch + m_batchSize, dataIn, bytesToCopy );
+		
+		m_batchSize += bytesToCopy;
+		dataIn 		+= bytesToCopy;
+		sizeIn 		-= bytesToCopy;
+		
+		if( m_batchSize == k_batchCapacity )
+		{
+			// Full aligned block. Write it and start the next one at the following aligned offset.
+			WriteAt( m_pBatch, k_batchCapacity, m_batchFileOffset );
+			
+			m_batchFileOffset 	+= k_batchCapacity;
+			m_batchSize 		= 0;
+			m_batchFlushed 		= 0;
+		}
+	}
+}
+
+void CRecorder::FlushBatch()
+{
+	if( m_fd < 0 || m_batchSize == m_batchFlushed )
+	{
+		return;
+	}
+	
+	// Write the partial block, but keep it staged so it is rewritten whole (and aligned) once full
+	WriteAt( m_pBatch, m_batchSize, m_batchFileOffset );
+	m_batchFlushed = m_batchSize;
+}
+
+void CRecorder::SyncSegment()
+{
+	if( m_fd < 0 )
+	{
+		return;
+	}
+	
+	FlushBatch();
+	
+	if( fdatasync( m_fd ) != 0 )
+	{
+		cerr << "fdatasync failed on " << m_segmentPath << ": " << strerror( errno ) << endl;
+		return;
+	}
+	
+	// Only index data that is known to be on disk
+	m_index.Flush();
+}
+
+void CRecorder::WriteAt( const uint8_t *dataIn, size_t sizeIn, uint64_t offsetIn )
+{
+	while( sizeIn > 0 )
+	{
+		ssize_t ret = pwrite( m_fd, dataIn, sizeIn, offsetIn );
+		
+		if( ret < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			
+			throw std::runtime_error( "Failed to write " + m_segmentPath + ": " + strerror( errno ) );
+		}
+		
+		dataIn 		+= ret;
+		sizeIn 		-= ret;
+		offsetIn 	+= ret;
+	}
+}
+
+void CRecorder::Preallocate( uint64_t requiredBytesIn )
+{
+	if( requiredBytesIn <= m_allocatedBytes )
+	{
+		return;
+	}
+	
+	uint64_t length = std::max( k_preallocSize, requiredBytesIn - m_allocatedBytes );
+	
+	// Reserve extents ahead of the writes without changing the file size, to keep the file contiguous
+	if( fallocate( m_fd, FALLOC_FL_KEEP_SIZE, m_allocatedBytes, length ) != 0 )
+	{
+		// Not supported by this filesystem. Just let it grow.
+		m_allocatedBytes = UINT64_MAX;
+		return;
+	}
+	
+	m_allocatedBytes += length;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+
+#include "CFragmentSink.h"
+#include "CKeyframeIndex.h"
+#include "CTelemetrySubscriber.h"
+
+struct TRecorderConfig
+{
+	std::string 	m_directory;
+	std::string 	m_filePrefix;
+	
+	uint32_t 		m_segmentDuration_s		= 300;					// Rotate after this long...
+	uint64_t 		m_segmentSize_bytes		= 512 * 1024 * 1024;	// ...or this many bytes, whichever comes first
+	uint32_t 		m_fsyncInterval_s		= 2;					// Upper bound on data lost to a power cut
+	size_t 			m_maxQueuedBytes		= 32 * 1024 * 1024;		// Fragments beyond this are dropped, never waited on
+};
+
+// Typedefs
+typedef std::function<void( const std::string &segmentPathIn )> TSegmentClosedCallback;
+
+class CRecorder : public CFragmentSink
+{
+public:
+	// Attributes
+	std::atomic<bool> 		m_isRecording;
+	
+	std::atomic<uint64_t> 	m_bytesWritten;
+	std::atomic<uint64_t> 	m_fragmentsWritten;
+	std::atomic<uint64_t> 	m_fragmentsDropped;
+	std::atomic<uint64_t> 	m_segmentsClosed;
+	std::atomic<float> 		m_writeRate_Bps;
+	std::atomic<uint64_t> 	m_telemetryWritten;
+	
+	// Methods
+	CRecorder();
+	virtual ~CRecorder();
+	
+	void Start( const TRecorderConfig &configIn );
+	void Stop();
+	
+	// Called from the writer thread once a segment is synced and closed. Set before recording starts.
+	void SetSegmentClosedCallback( TSegmentClosedCallback callbackIn );
+	
+	// Telemetry samples are written as emsg boxes ahead of the fragment they arrived with. Set before recording starts.
+	void SetTelemetrySource( CTelemetrySubscriber *telemetryIn );
+	
+	// CFragmentSink
+	virtual void OnInitSegment( const TFragmentPtr &initSegmentIn );
+	virtual void OnFragment( const TFragmentPtr &fragmentIn );
+
+private:
+	// Attributes
+	TRecorderConfig 			m_config;
+	TSegmentClosedCallback 		m_segmentClosedCallback;
+	CTelemetrySubscriber 		*m_pTelemetry		= nullptr;
+	
+	std::thread 				m_thread;
+	std::atomic<bool> 			m_killThread;
+	
+	std::mutex 					m_mutex;
+	std::condition_variable 	m_dataAvailableCondition;
+	std::deque<TFragmentPtr> 	m_queue;
+	size_t 						m_queuedBytes		= 0;
+	bool 						m_needKeyframe		= true;
+	TFragmentPtr 				m_pInitSegment;
+	
+	// Writer thread state
+	int 						m_fd				= -1;
+	std::string 				m_segmentPath;
+	uint64_t 					m_segmentBytes		= 0;
+	uint64_t 					m_allocatedBytes	= 0;
+	uint32_t 					m_segmentCounter	= 0;
+	CKeyframeIndex 				m_index;
+	uint32_t 					m_trackTimescale	= 0;
+	uint32_t 					m_eventId			= 0;
+	
+	// Batched writes go out at aligned file offsets. A partial batch is written for fsync but kept,
+	// and rewritten in full once it fills, so the next batch still starts aligned.
+	uint8_t 					*m_pBatch			= nullptr;
+	size_t 						m_batchSize			= 0;
+	size_t 						m_batchFlushed		= 0;
+	uint64_t 					m_batchFileOffset	= 0;
+	
+	std::chrono::steady_clock::time_point m_segmentStartTime;
+	std::chrono::steady_clock::time_point m_lastSyncTime;
+	std::chrono::steady_clock::time_point m_lastRateTime;
+	uint64_t 					m_lastRateBytes		= 0;
+	
+	const size_t 				k_batchCapacity		= 1024 * 1024;			// Aligned write size
+	const size_t 				k_alignment			= 4096;
+	const uint64_t 				k_preallocSize		= 64 * 1024 * 1024;
+	const std::chrono::milliseconds k_wakeInterval	= std::chrono::milliseconds( 250 );
+	const int64_t 				k_maxTelemetryAge_us	= 1000000;		// Older samples were queued while not recording
+	
+	// Methods
+	void ThreadLoop();
+	void WriteFragment( const TFragmentPtr &fragmentIn );
+	void WriteTelemetry( const TFragmentPtr &fragmentIn );
+	
+	void OpenSegment();
+	void CloseSegment();
+	bool ShouldRotate( const TFragmentPtr &fragmentIn );
+	
+	void AppendToBatch( const uint8_t *dataIn, size_t sizeIn );
+	void FlushBatch();
+	void SyncSegment();
+	void WriteAt( const uint8_t *dataIn, size_t sizeIn, uint64_t offsetIn );
+	void Preallocate( uint64_t requiredBytesIn );
+};
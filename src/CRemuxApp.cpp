@@ -0,0 +1,200 @@
+// Includes
+#include "CRemuxApp.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+	// PUB socket the muxer binds when writing to a file. Nothing subscribes to it.
+	const char *k_fileOutputEndpoint = "inproc://geomux_remux";
+}
+
+CRemuxApp::CRemuxApp( int argCountIn, char* argsIn[], const std::string &inputPathIn, const std::string &outputIn, float framerateIn )
+	: CApp( argCountIn, argsIn )
+	, m_inputPath( inputPathIn )
+	, m_output( outputIn )
+	, m_isFileOutput( !IsEndpoint( outputIn ) )
+	, m_framerate( framerateIn )
+	, m_muxer( &m_context, ( m_isFileOutput ? std::string( k_fileOutputEndpoint ) : m_output ), EVideoFormat::UNKNOWN )
+	, m_framesMuxed( 0 )
+	, m_bytesMuxed( 0 )
+	, m_lastFragmentTime_us( 0 )
+{
+	if( m_framerate <= 0.0f )
+	{
+		throw std::runtime_error( "Framerate must be positive" );
+	}
+}
+
+CRemuxApp::~CRemuxApp()
+{
+	m_muxer.RemoveSink( this );
+}
+
+bool CRemuxApp::IsEndpoint( const std::string &outputIn )
+{
+	return ( outputIn.find( "://" ) != std::string::npos );
+}
+
+void CRemuxApp::Run()
+{
+	try
+	{
+		std::ifstream input( m_inputPath, std::ios::binary | std::ios::ate );
+		
+		if( !input )
+		{
+			throw std::runtime_error( "Failed to open " + m_inputPath );
+		}
+		
+		size_t inputSize = input.tellg();
+		input.seekg( 0 );
+		
+		if( m_isFileOutput )
+		{
+			m_outputFile.open( m_output, std::ios::binary | std::ios::trunc );
+			
+			if( !m_outputFile )
+			{
+				throw std::runtime_error( "Failed to open " + m_output );
+			}
+		}
+		
+		// Synthetic timestamps at the given framerate. Small inputs are probed once they are fully buffered.
+		m_muxer.SetOffline( (int64_t)( 1000000.0f / m_framerate ), std::min<size_t>( inputSize, m_muxer.m_probeSize ) );
+		m_muxer.AddSink( this );
+		
+		cout << "Remuxing " << m_inputPath << " to " << m_output << endl;
+		
+		m_startTime = std::chrono::steady_clock::now();
+		
+		std::vector<uint8_t> chunk( k_chunkSize );
+		auto lastReportTime = m_startTime;
+		
+		while( !m_quit && input )
+		{
+			input.read( (char*)chunk.data(), chunk.size() );
+			
+			if( input.gcount() > 0 )
+			{
+				Feed( chunk.data(), input.gcount() );
+			}
+			
+			if( std::chrono::steady_clock::now() - lastReportTime > std::chrono::seconds( 1 ) )
+			{
+				ReportStats( false );
+				lastReportTime = std::chrono::steady_clock::now();
+			}
+		}
+		
+		Drain();
+		
+		if( m_isFileOutput )
+		{
+			m_outputFile.close();
+			
+			if( !m_outputFile )
+			{
+				throw std::runtime_error( "Failed to write " + m_output );
+			}
+		}
+		
+		ReportStats( true );
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Exception in Run(): " << e.what() << endl;
+	}
+}
+
+void CRemuxApp::Feed( uint8_t *dataIn, size_t sizeIn )
+{
+	WaitForBufferSpace( sizeIn );
+	
+	// Same path as the mxuvc callback
+	m_muxer.m_inputBuffer.Write( dataIn, sizeIn );
+}
+
+void CRemuxApp::WaitForBufferSpace( size_t sizeIn )
+{
+	CVideoBuffer &buffer = m_muxer.m_inputBuffer;
+	std::unique_lock<std::mutex> lock( buffer.m_mutex );
+	
+	// Back-pressure instead of real-time pacing: hold off until the muxer has consumed enough. The muxer only
+	// waits for a signal without checking for data, so keep signaling in case it wasn't waiting the first time.
+	while( buffer.GetSize() + sizeIn > k_maxBufferedBytes )
+	{
+		buffer.m_dataAvailableCondition.notify_one();
+		buffer.m_dataConsumedCondition.wait_for( lock, std::chrono::milliseconds( 10 ) );
+	}
+}
+
+void CRemuxApp::Drain()
+{
+	// Wait for the muxer to take the rest of the input...
+	WaitForBufferSpace( k_maxBufferedBytes );
+	
+	// ...and to finish writing it out
+	int64_t inputDone_us = GetElapsed_us();
+	
+	while( true )
+	{
+		int64_t lastActivity_us = std::max<int64_t>( inputDone_us, m_lastFragmentTime_us );
+		
+		if( GetElapsed_us() - lastActivity_us > std::chrono::duration_cast<std::chrono::microseconds>( k_drainTimeout ).count() )
+		{
+			break;
+		}
+		
+		std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+	}
+}
+
+void CRemuxApp::OnInitSegment( const TFragmentPtr &initSegmentIn )
+{
+	if( m_isFileOutput )
+	{
+		m_outputFile.write( (const char*)initSegmentIn->m_data.data(), initSegmentIn->m_data.size() );
+	}
+}
+
+void CRemuxApp::OnFragment( const TFragmentPtr &fragmentIn )
+{
+	// Blocking the muxer thread is fine here, the input waits on it anyway
+	if( m_isFileOutput )
+	{
+		m_outputFile.write( (const char*)fragmentIn->m_data.data(), fragmentIn->m_data.size() );
+	}
+	
+	m_framesMuxed++;
+	m_bytesMuxed += fragmentIn->m_data.size();
+	m_lastFragmentTime_us = GetElapsed_us();
+}
+
+void CRemuxApp::ReportStats( bool finalIn )
+{
+	// Time to the last fragment, so the drain timeout isn't counted
+	int64_t elapsed_us = ( finalIn ? (int64_t)m_lastFragmentTime_us : GetElapsed_us() );
+	double elapsed_s = std::max( elapsed_us, (int64_t)1 ) / 1000000.0;
+	
+	cout << ( finalIn ? "Remux complete: " : "Remuxing: " )
+		<< m_framesMuxed << " frames, "
+		<< std::fixed << std::setprecision( 2 )
+		<< ( m_bytesMuxed / 1000000.0 ) << " MB in " << elapsed_s << "s ("
+		<< ( m_framesMuxed / elapsed_s ) << " frames/sec, "
+		<< ( m_bytesMuxed / 1000000.0 / elapsed_s ) << " MB/sec)" << endl;
+	
+	cout.unsetf( std::ios::floatfield );
+}
+
+int64_t CRemuxApp::GetElapsed_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - m_startTime ).count();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// Includes
+#include <CpperoMQ/All.hpp>
+
+#include <string>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+
+#include "CApp.h"
+#include "CMuxer.h"
+#include "CFragmentSink.h"
+
+// Runs a raw H264 (Annex-B) or MJPEG capture through the live CVideoBuffer/CMuxer pipeline as fast as the muxer
+// will take it, writing fragmented MP4 to a file or publishing it on a ZMQ endpoint. Doubles as a mux benchmark.
+class CRemuxApp : public CApp, public CFragmentSink
+{
+public:
+	// Methods
+	CRemuxApp( int argCountIn, char* argsIn[], const std::string &inputPathIn, const std::string &outputIn, float framerateIn );
+	virtual ~CRemuxApp();
+	
+	virtual void Run();
+	
+	// CFragmentSink
+	virtual void OnInitSegment( const TFragmentPtr &initSegmentIn );
+	virtual void OnFragment( const TFragmentPtr &fragmentIn );
+
+private:
+	// Attributes
+	CpperoMQ::Context 			m_context;
+	
+	std::string 				m_inputPath;
+	std::string 				m_output;
+	bool 						m_isFileOutput;
+	float 						m_framerate;
+	
+	CMuxer 						m_muxer;
+	std::ofstream 				m_outputFile;
+	
+	std::atomic<uint64_t> 		m_framesMuxed;
+	std::atomic<uint64_t> 		m_bytesMuxed;
+	std::atomic<int64_t> 		m_lastFragmentTime_us;
+	
+	std::chrono::steady_clock::time_point m_startTime;
+	
+	const size_t 				k_chunkSize			= 256 * 1024;
+	const size_t 				k_maxBufferedBytes	= 2500000;		// Enough to probe, and under the muxer's avio buffer size
+	const std::chrono::milliseconds k_drainTimeout	= std::chrono::milliseconds( 500 );
+	
+	// Methods
+	static bool IsEndpoint( const std::string &outputIn );
+	
+	void Feed( uint8_t *dataIn, size_t sizeIn );
+	void WaitForBufferSpace( size_t sizeIn );
+	void Drain();
+	void ReportStats( bool finalIn );
+	
+	int64_t GetElapsed_us();
+};
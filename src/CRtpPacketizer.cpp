@@ -0,0 +1,235 @@
+// Includes
+#include "CRtpPacketizer.h"
+#include "H264.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+	const uint8_t k_fuA 		= 28;
+	const uint8_t k_fuStart 	= 0x80;
+	const uint8_t k_fuEnd 		= 0x40;
+}
+
+CRtpPacketizer::CRtpPacketizer( uint32_t ssrcIn, uint8_t payloadTypeIn, size_t mtuIn )
+	: m_ssrc( ssrcIn )
+	, m_payloadType( payloadTypeIn )
+	, m_maxPayloadSize( mtuIn - k_rtpHeaderSize )
+	, m_sequence( (uint16_t)std::rand() )
+{
+}
+
+TRtpBurstPtr CRtpPacketizer::Packetize( const TBufferSegment *segmentsIn, size_t segmentCountIn, uint32_t timestampIn, bool isFrameStartIn )
+{
+	auto burst = std::make_shared<TRtpBurst>();
+	
+	size_t totalSize = m_heldPacket.size();
+	
+	for( size_t i = 0; i < segmentCountIn; ++i )
+	{
+		totalSize += segmentsIn[ i ].m_size;
+	}
+	
+	// Header overhead is small next to the frame, reserve once
+	burst->m_data.reserve( totalSize + ( totalSize / m_maxPayloadSize + 8 ) * ( k_interleaveHeaderSize + k_rtpHeaderSize + 2 ) );
+	
+	if( isFrameStartIn )
+	{
+		// Whole access units per callback are marked as they go, split ones once the next access unit starts
+		m_isSplitAccessUnits 	= ( m_callbacksInAccessUnit > 1 );
+		m_callbacksInAccessUnit = 0;
+		m_isKeyframeAccessUnit 	= false;
+		
+		m_accessUnitSps.clear();
+		m_accessUnitPps.clear();
+	}
+	
+	ReleaseHeldPacket( *burst, isFrameStartIn );
+	m_callbacksInAccessUnit++;
+	
+	const size_t releasedPackets = burst->m_packets.size();
+	
+	for( size_t i = 0; i < segmentCountIn; ++i )
+	{
+		const uint8_t *cursor 	= segmentsIn[ i ].m_pData;
+		const uint8_t *end 		= cursor + segmentsIn[ i ].m_size;
+		h264::TNalUnit nal;
+		
+		while( h264::NextNalUnit( cursor, end, nal ) )
+		{
+			if( nal.m_size == 0 )
+			{
+				continue;
+			}
+			
+			switch( nal.GetType() )
+			{
+				case h264::NAL_IDR_SLICE:
+				{
+					if( m_isKeyframeAccessUnit )
+					{
+						break;
+					}
+					
+					// With maxnal the parameter sets came in an earlier callback. Repeat them, a client starting here needs them.
+					if( burst->m_sps.empty() && !m_accessUnitSps.empty() )
+					{
+						burst->m_sps = m_accessUnitSps;
+						PacketizeNal( *burst, timestampIn, m_accessUnitSps.data(), m_accessUnitSps.size() );
+					}
+					
+					if( burst->m_pps.empty() && !m_accessUnitPps.empty() )
+					{
+						burst->m_pps = m_accessUnitPps;
+						PacketizeNal( *burst, timestampIn, m_accessUnitPps.data(), m_accessUnitPps.size() );
+					}
+					
+					burst->m_isKeyframe 	= true;
+					m_isKeyframeAccessUnit 	= true;
+					break;
+				}
+				
+				case h264::NAL_SPS:
+					burst->m_sps.assign( nal.m_pData, nal.m_pData + nal.m_size );
+					m_accessUnitSps = burst->m_sps;
+					break;
+				
+				case h264::NAL_PPS:
+					burst->m_pps.assign( nal.m_pData, nal.m_pData + nal.m_size );
+					m_accessUnitPps = burst->m_pps;
+					break;
+				
+				case h264::NAL_AUD:
+					// Access units are delimited by the timestamp and marker bit in RTP
+					continue;
+				
+				default:
+					break;
+			}
+			
+			PacketizeNal( *burst, timestampIn, nal.m_pData, nal.m_size );
+		}
+	}
+	
+	if( burst->m_packets.size() > releasedPackets )
+	{
+		if( m_isSplitAccessUnits )
+		{
+			HoldLastPacket( *burst );
+		}
+		else
+		{
+			SetMarker( *burst );
+		}
+	}
+	
+	return burst;
+}
+
+void CRtpPacketizer::ReleaseHeldPacket( TRtpBurst &burstIn, bool isAccessUnitEndIn )
+{
+	if( m_heldPacket.empty() )
+	{
+		return;
+	}
+	
+	burstIn.m_packets.push_back( { burstIn.m_data.size(), m_heldPacket.size() - k_interleaveHeaderSize } );
+	burstIn.m_data.insert( burstIn.m_data.end(), m_heldPacket.begin(), m_heldPacket.end() );
+	burstIn.m_isKeyframe = m_isHeldKeyframe;
+	
+	if( isAccessUnitEndIn )
+	{
+		SetMarker( burstIn );
+	}
+	
+	m_heldPacket.clear();
+	m_isHeldKeyframe = false;
+}
+
+void CRtpPacketizer::HoldLastPacket( TRtpBurst &burstIn )
+{
+	size_t offset = burstIn.m_packets.back().m_offset;
+	
+	m_heldPacket.assign( burstIn.m_data.begin() + offset, burstIn.m_data.end() );
+	
+	burstIn.m_data.resize( offset );
+	burstIn.m_packets.pop_back();
+	
+	// Nothing left to start a client on. The burst the packet goes out in will be the keyframe instead.
+	m_isHeldKeyframe = burstIn.m_isKeyframe && burstIn.m_packets.empty();
+	burstIn.m_isKeyframe = burstIn.m_isKeyframe && !burstIn.m_packets.empty();
+}
+
+void CRtpPacketizer::SetMarker( TRtpBurst &burstIn )
+{
+	burstIn.m_data[ burstIn.m_packets.back().m_offset + k_interleaveHeaderSize + 1 ] |= 0x80;
+}
+
+void CRtpPacketizer::PacketizeNal( TRtpBurst &burstIn, uint32_t timestampIn, const uint8_t *nalIn, size_t sizeIn )
+{
+	if( sizeIn <= m_maxPayloadSize )
+	{
+		// Single NAL unit packet
+		AddPacket( burstIn, timestampIn, nullptr, 0, nalIn, sizeIn );
+		return;
+	}
+	
+	// FU-A: the NAL header is replaced by an indicator (NRI + type 28) and a header (S/E + original type) on every fragment
+	const size_t maxFragmentSize = m_maxPayloadSize - 2;
+	const uint8_t *payload = nalIn + 1;
+	size_t remaining = sizeIn - 1;
+	bool isFirst = true;
+	
+	while( remaining > 0 )
+	{
+		size_t fragmentSize = std::min( remaining, maxFragmentSize );
+		
+		uint8_t prefix[ 2 ];
+		prefix[ 0 ] = ( nalIn[ 0 ] & 0xE0 ) | k_fuA;
+		prefix[ 1 ] = ( nalIn[ 0 ] & 0x1F ) | ( isFirst ? k_fuStart : 0 ) | ( fragmentSize == remaining ? k_fuEnd : 0 );
+		
+		AddPacket( burstIn, timestampIn, prefix, sizeof( prefix ), payload, fragmentSize );
+		
+		payload 	+= fragmentSize;
+		remaining 	-= fragmentSize;
+		isFirst 	= false;
+	}
+}
+
+void CRtpPacketizer::AddPacket( TRtpBurst &burstIn, uint32_t timestampIn, const uint8_t *prefixIn, size_t prefixSizeIn, const uint8_t *payloadIn, size_t payloadSizeIn )
+{
+	const size_t packetSize = k_rtpHeaderSize + prefixSizeIn + payloadSizeIn;
+	std::vector<uint8_t> &data = burstIn.m_data;
+	
+	burstIn.m_packets.push_back( { data.size(), packetSize } );
+	
+	// Interleave header. Channel 0 is filled in, senders using another channel patch their own copy.
+	data.push_back( '$' );
+	data.push_back( 0 );
+	data.push_back( (uint8_t)( packetSize >> 8 ) );
+	data.push_back( (uint8_t)packetSize );
+	
+	// RTP header: V=2, no padding, extension or CSRCs
+	data.push_back( 0x80 );
+	data.push_back( m_payloadType & 0x7F );
+	data.push_back( (uint8_t)( m_sequence >> 8 ) );
+	data.push_back( (uint8_t)m_sequence );
+	
+	for( int shift = 24; shift >= 0; shift -= 8 )
+	{
+		data.push_back( (uint8_t)( timestampIn >> shift ) );
+	}
+	
+	for( int shift = 24; shift >= 0; shift -= 8 )
+	{
+		data.push_back( (uint8_t)( m_ssrc >> shift ) );
+	}
+	
+	data.insert( data.end(), prefixIn, prefixIn + prefixSizeIn );
+	data.insert( data.end(), payloadIn, payloadIn + payloadSizeIn );
+	
+	m_sequence++;
+}
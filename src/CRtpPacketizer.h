@@ -0,0 +1,74 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+#include "CVideoBuffer.h"
+
+// RTP packets for one video callback, laid out for RTSP interleaved TCP: each packet is preceded by the 4 byte
+// '$' <channel> <length> header, which UDP senders skip. Immutable once built, so every client shares it.
+struct TRtpBurst
+{
+	struct TPacket
+	{
+		size_t 	m_offset;		// Of the interleave header
+		size_t 	m_size;			// RTP packet size, without the interleave header
+	};
+	
+	std::vector<uint8_t> 	m_data;
+	std::vector<TPacket> 	m_packets;
+	
+	bool 					m_isKeyframe	= false;	// Has the first IDR slice of an access unit, so a new client can start here
+	std::vector<uint8_t> 	m_sps;						// Parameter sets carried in this burst, without start codes
+	std::vector<uint8_t> 	m_pps;
+};
+
+typedef std::shared_ptr<const TRtpBurst> TRtpBurstPtr;
+
+// H264 over RTP (RFC 6184), packetization mode 1. NAL units that fit the MTU go out as single NAL unit packets,
+// larger ones are split into FU-A fragments.
+class CRtpPacketizer
+{
+public:
+	static const size_t 	k_interleaveHeaderSize	= 4;
+	static const size_t 	k_rtpHeaderSize			= 12;
+	
+	// Methods
+	CRtpPacketizer( uint32_t ssrcIn, uint8_t payloadTypeIn, size_t mtuIn = 1400 );
+	
+	// Packetizes the Annex-B NAL units of one video callback. All callbacks of an access unit share its timestamp.
+	// The marker bit goes on the last packet of the access unit. When the camera splits access units over several
+	// callbacks (maxnal), that is only known once the next one starts, so the last packet of each callback is held back
+	// and sent at the front of the next burst.
+	TRtpBurstPtr Packetize( const TBufferSegment *segmentsIn, size_t segmentCountIn, uint32_t timestampIn, bool isFrameStartIn );
+	
+	uint32_t GetSsrc() const { return m_ssrc; }
+
+private:
+	// Attributes
+	uint32_t 	m_ssrc;
+	uint8_t 	m_payloadType;
+	size_t 		m_maxPayloadSize;
+	uint16_t 	m_sequence;
+	
+	// The access unit being packetized
+	uint32_t 				m_callbacksInAccessUnit		= 0;
+	bool 					m_isSplitAccessUnits		= false;	// The last access unit came over several callbacks
+	bool 					m_isKeyframeAccessUnit		= false;	// Its first IDR slice has been packetized
+	std::vector<uint8_t> 	m_accessUnitSps;
+	std::vector<uint8_t> 	m_accessUnitPps;
+	
+	// Last packet of the previous callback, interleave header included, until it is known whether it ends the access unit
+	std::vector<uint8_t> 	m_heldPacket;
+	bool 					m_isHeldKeyframe			= false;	// It was all there was of a keyframe burst
+	
+	// Methods
+	void AddPacket( TRtpBurst &burstIn, uint32_t timestampIn, const uint8_t *prefixIn, size_t prefixSizeIn, const uint8_t *payloadIn, size_t payloadSizeIn );
+	void PacketizeNal( TRtpBurst &burstIn, uint32_t timestampIn, const uint8_t *nalIn, size_t sizeIn );
+	void ReleaseHeldPacket( TRtpBurst &burstIn, bool isAccessUnitEndIn );
+	void HoldLastPacket( TRtpBurst &burstIn );
+	void SetMarker( TRtpBurst &burstIn );
+};
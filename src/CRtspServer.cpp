@@ -0,0 +1,967 @@
+// Includes
+#include "CRtspServer.h"
+#include "H264.h"
+#include "Utility.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+extern "C"
+{
+	// FFmpeg
+	#include <libavutil/time.h>
+	#include <libavutil/base64.h>
+}
+
+using namespace std;
+
+namespace
+{
+	bool SetNonBlocking( int socketIn )
+	{
+		int flags = fcntl( socketIn, F_GETFL, 0 );
+		return ( flags != -1 ) && ( fcntl( socketIn, F_SETFL, flags | O_NONBLOCK ) != -1 );
+	}
+	
+	std::string Base64( const std::vector<uint8_t> &dataIn )
+	{
+		std::vector<char> encoded( AV_BASE64_SIZE( dataIn.size() ) );
+		av_base64_encode( encoded.data(), encoded.size(), dataIn.data(), dataIn.size() );
+		return std::string( encoded.data() );
+	}
+}
+
+// ----------------------------------------------------
+// CStreamInput
+
+CRtspServer::CStreamInput::CStreamInput( CRtspServer *serverIn, int indexIn )
+	: m_pServer( serverIn )
+	, m_index( indexIn )
+	, m_packetizer( (uint32_t)std::rand(), serverIn->k_payloadType )
+{
+}
+
+void CRtspServer::CStreamInput::Write( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool isFrameStartIn )
+{
+	if( isFrameStartIn )
+	{
+		// 90kHz capture clock, shared by every callback of the access unit
+		m_timestamp = (uint32_t)( (uint64_t)av_gettime() * 9 / 100 );
+	}
+	
+	if( m_pServer->m_playingCount == 0 )
+	{
+		// Nobody to send to. Only keep the parameter sets current for DESCRIBE.
+		std::vector<uint8_t> sps, pps;
+		
+		for( size_t i = 0; i < segmentCountIn; ++i )
+		{
+			const uint8_t *cursor 	= segmentsIn[ i ].m_pData;
+			const uint8_t *end 		= cursor + segmentsIn[ i ].m_size;
+			h264::TNalUnit nal;
+			
+			while( h264::NextNalUnit( cursor, end, nal ) )
+			{
+				if( nal.m_size > 0 && nal.GetType() == h264::NAL_SPS )
+				{
+					sps.assign( nal.m_pData, nal.m_pData + nal.m_size );
+				}
+				else if( nal.m_size > 0 && nal.GetType() == h264::NAL_PPS )
+				{
+					pps.assign( nal.m_pData, nal.m_pData + nal.m_size );
+				}
+				else if( nal.IsVCL() )
+				{
+					// Parameter sets come first
+					break;
+				}
+			}
+		}
+		
+		UpdateParameterSets( sps, pps );
+		return;
+	}
+	
+	TRtpBurstPtr burst = m_packetizer.Packetize( segmentsIn, segmentCountIn, m_timestamp, isFrameStartIn );
+	
+	UpdateParameterSets( burst->m_sps, burst->m_pps );
+	
+	if( !burst->m_packets.empty() )
+	{
+		m_pServer->QueueBurst( m_index, burst );
+	}
+}
+
+void CRtspServer::CStreamInput::UpdateParameterSets( const std::vector<uint8_t> &spsIn, const std::vector<uint8_t> &ppsIn )
+{
+	if( spsIn.empty() && ppsIn.empty() )
+	{
+		return;
+	}
+	
+	std::lock_guard<std::mutex> lock( m_parameterSetMutex );
+	
+	if( !spsIn.empty() )
+	{
+		m_sps = spsIn;
+	}
+	
+	if( !ppsIn.empty() )
+	{
+		m_pps = ppsIn;
+	}
+}
+
+// ----------------------------------------------------
+// CRtspServer
+
+CRtspServer::CRtspServer( uint16_t portIn, std::shared_ptr<CTokenBucket> pacingBucketIn )
+	: m_clientCount( 0 )
+	, m_playingCount( 0 )
+	, m_packetsSent( 0 )
+	, m_burstsDropped( 0 )
+	, m_port( portIn )
+	, m_pPacer( pacingBucketIn ? util::make_unique<CPacedSender>( pacingBucketIn ) : nullptr )
+	, m_killThread( false )
+{
+}
+
+CRtspServer::~CRtspServer()
+{
+	Stop();
+}
+
+CRtspServer::CStreamInput* CRtspServer::AddStream( const std::string &nameIn )
+{
+	if( m_thread.joinable() )
+	{
+		throw std::runtime_error( "Streams must be added before the RTSP server starts" );
+	}
+	
+	TStream stream;
+	stream.m_name 	= nameIn;
+	stream.m_pInput = std::unique_ptr<CStreamInput>( new CStreamInput( this, (int)m_streams.size() ) );
+	
+	m_streams.push_back( std::move( stream ) );
+	
+	return m_streams.back().m_pInput.get();
+}
+
+void CRtspServer::Start()
+{
+	OpenSockets();
+	
+	m_killThread 	= false;
+	m_thread 		= std::thread( &CRtspServer::ThreadLoop, this );
+	
+	cout << "RTSP server listening on port " << m_port << ", RTP on UDP " << m_rtpPort << "-" << ( m_rtpPort + 1 ) << endl;
+}
+
+void CRtspServer::Stop()
+{
+	if( m_thread.joinable() )
+	{
+		m_killThread = true;
+		
+		uint64_t wake = 1;
+		if( write( m_wakeFd, &wake, sizeof( wake ) ) < 0 )
+		{
+			cerr << "Failed to wake RTSP server thread" << endl;
+		}
+		
+		m_thread.join();
+	}
+	
+	for( TClient &client : m_clients )
+	{
+		close( client.m_socket );
+	}
+	
+	m_clients.clear();
+	m_clientCount 	= 0;
+	m_playingCount 	= 0;
+	
+	CloseSockets();
+}
+
+void CRtspServer::OpenSockets()
+{
+	m_listenSocket = socket( AF_INET, SOCK_STREAM, 0 );
+	
+	if( m_listenSocket < 0 )
+	{
+		throw std::runtime_error( "Failed to create RTSP socket: " + std::string( strerror( errno ) ) );
+	}
+	
+	int reuse = 1;
+	setsockopt( m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+	
+	sockaddr_in address;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family 		= AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_ANY );
+	address.sin_port 		= htons( m_port );
+	
+	if( bind( m_listenSocket, (sockaddr*)&address, sizeof( address ) ) < 0 || listen( m_listenSocket, 16 ) < 0 || !SetNonBlocking( m_listenSocket ) )
+	{
+		std::string error( strerror( errno ) );
+		CloseSockets();
+		
+		throw std::runtime_error( "Failed to listen on RTSP port " + std::to_string( m_port ) + ": " + error );
+	}
+	
+	// RTP and RTCP need an even/odd port pair. Let the kernel pick the RTP port until the one above it is free too.
+	for( int attempt = 0; attempt < 32 && m_rtcpSocket < 0; ++attempt )
+	{
+		int rtpSocket 	= socket( AF_INET, SOCK_DGRAM, 0 );
+		int rtcpSocket 	= socket( AF_INET, SOCK_DGRAM, 0 );
+		
+		sockaddr_in udpAddress;
+		socklen_t addressSize = sizeof( udpAddress );
+		
+		memset( &udpAddress, 0, sizeof( udpAddress ) );
+		udpAddress.sin_family 		= AF_INET;
+		udpAddress.sin_addr.s_addr 	= htonl( INADDR_ANY );
+		udpAddress.sin_port 		= 0;
+		
+		if( rtpSocket >= 0 && rtcpSocket >= 0
+			&& bind( rtpSocket, (sockaddr*)&udpAddress, sizeof( udpAddress ) ) == 0
+			&& getsockname( rtpSocket, (sockaddr*)&udpAddress, &addressSize ) == 0
+			&& ( ntohs( udpAddress.sin_port ) % 2 ) == 0 )
+		{
+			uint16_t rtpPort = ntohs( udpAddress.sin_port );
+			udpAddress.sin_port = htons( rtpPort + 1 );
+			
+			if( bind( rtcpSocket, (sockaddr*)&udpAddress, sizeof( udpAddress ) ) == 0 )
+			{
+				m_rtpSocket 	= rtpSocket;
+				m_rtcpSocket 	= rtcpSocket;
+				m_rtpPort 		= rtpPort;
+				
+				SetNonBlocking( m_rtpSocket );
+				SetNonBlocking( m_rtcpSocket );
+				break;
+			}
+		}
+		
+		if( rtpSocket >= 0 )
+		{
+			close( rtpSocket );
+		}
+		
+		if( rtcpSocket >= 0 )
+		{
+			close( rtcpSocket );
+		}
+	}
+	
+	if( m_rtpSocket < 0 )
+	{
+		CloseSockets();
+		throw std::runtime_error( "Failed to bind an RTP/RTCP port pair" );
+	}
+	
+	// A whole IDR goes out in one go, give it room
+	int sendBufferSize = 2 * 1024 * 1024;
+	setsockopt( m_rtpSocket, SOL_SOCKET, SO_SNDBUF, &sendBufferSize, sizeof( sendBufferSize ) );
+	
+	m_wakeFd = eventfd( 0, EFD_NONBLOCK );
+	
+	if( m_wakeFd < 0 )
+	{
+		CloseSockets();
+		throw std::runtime_error( "Failed to create RTSP server eventfd" );
+	}
+}
+
+void CRtspServer::CloseSockets()
+{
+	for( int *fd : { &m_listenSocket, &m_rtpSocket, &m_rtcpSocket, &m_wakeFd } )
+	{
+		if( *fd >= 0 )
+		{
+			close( *fd );
+			*fd = -1;
+		}
+	}
+}
+
+void CRtspServer::QueueBurst( int streamIn, const TRtpBurstPtr &burstIn )
+{
+	// Called from the video callback: only a pointer is queued, the server thread does the sending
+	{
+		std::lock_guard<std::mutex> lock( m_pendingMutex );
+		m_pending.push_back( { streamIn, burstIn } );
+	}
+	
+	if( m_wakeFd >= 0 )
+	{
+		uint64_t wake = 1;
+		if( write( m_wakeFd, &wake, sizeof( wake ) ) < 0 )
+		{
+			// Counter is saturated, the server thread is already due to wake up
+		}
+	}
+}
+
+void CRtspServer::ThreadLoop()
+{
+	std::vector<pollfd> pollFds;
+	
+	while( !m_killThread )
+	{
+		pollFds.clear();
+		pollFds.push_back( { m_listenSocket, POLLIN, 0 } );
+		pollFds.push_back( { m_wakeFd, POLLIN, 0 } );
+		pollFds.push_back( { m_rtpSocket, POLLIN, 0 } );
+		pollFds.push_back( { m_rtcpSocket, POLLIN, 0 } );
+		
+		const size_t k_clientOffset = pollFds.size();
+		
+		for( TClient &client : m_clients )
+		{
+			pollFds.push_back( { client.m_socket, (short)( POLLIN | ( client.m_queue.empty() ? 0 : POLLOUT ) ), 0 } );
+		}
+		
+		// Wake up in time for the next paced packet
+		int timeout = ( m_pacingTimeout_ms >= 0 ) ? std::min( m_pacingTimeout_ms, k_pollTimeout_ms ) : k_pollTimeout_ms;
+		
+		if( poll( pollFds.data(), pollFds.size(), timeout ) < 0 )
+		{
+			if( errno != EINTR )
+			{
+				cerr << "RTSP server poll failed: " << strerror( errno ) << endl;
+			}
+			
+			continue;
+		}
+		
+		if( pollFds[ 1 ].revents & POLLIN )
+		{
+			DrainSocket( m_wakeFd );
+		}
+		
+		// Receiver reports are not used
+		if( pollFds[ 2 ].revents & POLLIN )
+		{
+			DrainSocket( m_rtpSocket );
+		}
+		
+		if( pollFds[ 3 ].revents & POLLIN )
+		{
+			DrainSocket( m_rtcpSocket );
+		}
+		
+		DistributePending();
+		
+		if( m_pPacer )
+		{
+			m_pacingTimeout_ms = m_pPacer->Flush( m_rtpSocket );
+		}
+		
+		for( size_t i = 0; i < m_clients.size(); ++i )
+		{
+			TClient &client = m_clients[ i ];
+			short events 	= pollFds[ i + k_clientOffset ].revents;
+			bool keep 		= !( events & ( POLLERR | POLLHUP | POLLNVAL ) );
+			
+			if( keep && ( events & POLLIN ) )
+			{
+				keep = ReadFromClient( client );
+			}
+			
+			if( keep && !client.m_queue.empty() )
+			{
+				keep = WriteToClient( client );
+			}
+			
+			if( keep && client.m_closing && client.m_queue.empty() )
+			{
+				keep = false;
+			}
+			
+			if( !keep )
+			{
+				CloseClient( client );
+			}
+		}
+		
+		m_clients.erase( std::remove_if( m_clients.begin(), m_clients.end(), []( const TClient &clientIn ){ return clientIn.m_socket < 0; } ), m_clients.end() );
+		
+		if( pollFds[ 0 ].revents & POLLIN )
+		{
+			AcceptClients();
+		}
+		
+		m_clientCount = (uint32_t)m_clients.size();
+	}
+}
+
+void CRtspServer::AcceptClients()
+{
+	while( true )
+	{
+		sockaddr_in address;
+		socklen_t addressSize = sizeof( address );
+		
+		int clientSocket = accept( m_listenSocket, (sockaddr*)&address, &addressSize );
+		
+		if( clientSocket < 0 )
+		{
+			return;
+		}
+		
+		if( m_clients.size() >= k_maxClients || !SetNonBlocking( clientSocket ) )
+		{
+			close( clientSocket );
+			continue;
+		}
+		
+		int noDelay = 1;
+		setsockopt( clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+		
+		TClient client;
+		client.m_socket 	= clientSocket;
+		client.m_address 	= address;
+		
+		m_clients.push_back( std::move( client ) );
+	}
+}
+
+void CRtspServer::DistributePending()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_pendingMutex );
+		m_draining.swap( m_pending );
+	}
+	
+	for( TPendingBurst &pending : m_draining )
+	{
+		for( TClient &client : m_clients )
+		{
+			if( client.m_isPlaying && client.m_stream == pending.m_stream )
+			{
+				SendBurst( client, pending.m_pBurst );
+			}
+		}
+	}
+	
+	m_draining.clear();
+}
+
+void CRtspServer::SendBurst( TClient &clientIn, const TRtpBurstPtr &burstIn )
+{
+	if( clientIn.m_waitingForKeyframe )
+	{
+		if( !burstIn->m_isKeyframe )
+		{
+			return;
+		}
+		
+		clientIn.m_waitingForKeyframe = false;
+	}
+	
+	if( !clientIn.m_isInterleaved )
+	{
+		sockaddr_in destination 	= clientIn.m_address;
+		destination.sin_port 		= htons( clientIn.m_clientRtpPort );
+		
+		if( m_pPacer )
+		{
+			// The whole frame or none of it. A frame that doesn't fit means the link is too slow: resume at the next IDR.
+			if( !m_pPacer->HasRoom( burstIn->m_data.size() ) )
+			{
+				m_burstsDropped++;
+				clientIn.m_waitingForKeyframe = true;
+				return;
+			}
+			
+			for( const TRtpBurst::TPacket &packet : burstIn->m_packets )
+			{
+				m_pPacer->Queue( burstIn->m_data.data() + packet.m_offset + CRtpPacketizer::k_interleaveHeaderSize, packet.m_size, destination );
+			}
+			
+			m_packetsSent += burstIn->m_packets.size();
+			return;
+		}
+		
+		for( const TRtpBurst::TPacket &packet : burstIn->m_packets )
+		{
+			// UDP is allowed to lose packets. Never wait on it.
+			if( sendto( m_rtpSocket, burstIn->m_data.data() + packet.m_offset + CRtpPacketizer::k_interleaveHeaderSize, packet.m_size,
+						MSG_DONTWAIT, (sockaddr*)&destination, sizeof( destination ) ) < 0 )
+			{
+				m_burstsDropped++;
+				return;
+			}
+			
+			m_packetsSent++;
+		}
+		
+		return;
+	}
+	
+	if( clientIn.m_queuedBytes + burstIn->m_data.size() > k_maxQueuedBytes )
+	{
+		// Too far behind. Drop the RTP not yet on the wire and pick up again at the next IDR. RTSP responses interleaved
+		// with it stay, or the client would wait on them forever.
+		auto isDroppable = []( const TOutgoing &outgoingIn )
+		{
+			return outgoingIn.m_isMedia && outgoingIn.m_offset == 0;
+		};
+		
+		for( const TOutgoing &outgoing : clientIn.m_queue )
+		{
+			if( isDroppable( outgoing ) )
+			{
+				clientIn.m_queuedBytes -= outgoing.Get().size();
+				m_burstsDropped++;
+			}
+		}
+		
+		clientIn.m_queue.erase( std::remove_if( clientIn.m_queue.begin(), clientIn.m_queue.end(), isDroppable ), clientIn.m_queue.end() );
+		
+		m_burstsDropped++;
+		clientIn.m_waitingForKeyframe = true;
+		return;
+	}
+	
+	TOutgoing outgoing;
+	outgoing.m_isMedia = true;
+	
+	if( clientIn.m_rtpChannel == 0 )
+	{
+		outgoing.m_pBurst = burstIn;
+	}
+	else
+	{
+		// The shared burst is framed for channel 0
+		outgoing.m_data = burstIn->m_data;
+		
+		for( const TRtpBurst::TPacket &packet : burstIn->m_packets )
+		{
+			outgoing.m_data[ packet.m_offset + 1 ] = clientIn.m_rtpChannel;
+		}
+	}
+	
+	QueueOutgoing( clientIn, std::move( outgoing ) );
+	m_packetsSent += burstIn->m_packets.size();
+}
+
+bool CRtspServer::ReadFromClient( TClient &clientIn )
+{
+	char buffer[ 4096 ];
+	
+	while( true )
+	{
+		ssize_t bytesRead = recv( clientIn.m_socket, buffer, sizeof( buffer ), 0 );
+		
+		if( bytesRead == 0 )
+		{
+			return false;
+		}
+		
+		if( bytesRead < 0 )
+		{
+			if( errno == EAGAIN || errno == EWOULDBLOCK )
+			{
+				break;
+			}
+			
+			return ( errno == EINTR );
+		}
+		
+		clientIn.m_input.append( buffer, bytesRead );
+		
+		if( clientIn.m_input.size() > k_maxRequestSize )
+		{
+			return false;
+		}
+	}
+	
+	if( clientIn.m_closing )
+	{
+		clientIn.m_input.clear();
+		return true;
+	}
+	
+	HandleInput( clientIn );
+	return true;
+}
+
+bool CRtspServer::WriteToClient( TClient &clientIn )
+{
+	while( !clientIn.m_queue.empty() )
+	{
+		TOutgoing &outgoing = clientIn.m_queue.front();
+		const std::vector<uint8_t> &data = outgoing.Get();
+		
+		ssize_t bytesSent = send( clientIn.m_socket, data.data() + outgoing.m_offset, data.size() - outgoing.m_offset, MSG_NOSIGNAL );
+		
+		if( bytesSent < 0 )
+		{
+			return ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR );
+		}
+		
+		outgoing.m_offset += bytesSent;
+		
+		if( outgoing.m_offset < data.size() )
+		{
+			// Socket buffer is full, wait for POLLOUT
+			return true;
+		}
+		
+		clientIn.m_queuedBytes -= data.size();
+		clientIn.m_queue.pop_front();
+	}
+	
+	return true;
+}
+
+void CRtspServer::DrainSocket( int socketIn )
+{
+	uint8_t buffer[ 2048 ];
+	
+	while( recv( socketIn, buffer, sizeof( buffer ), MSG_DONTWAIT ) > 0 )
+	{
+	}
+}
+
+void CRtspServer::HandleInput( TClient &clientIn )
+{
+	std::string &input = clientIn.m_input;
+	
+	while( !input.empty() && !clientIn.m_closing )
+	{
+		// Interleaved RTCP from TCP clients shares the connection with requests: '$' <channel> <length16> <data>
+		if( input[ 0 ] == '$' )
+		{
+			if( input.size() < 4 )
+			{
+				return;
+			}
+			
+			size_t length = ( (uint8_t)input[ 2 ] << 8 ) | (uint8_t)input[ 3 ];
+			
+			if( input.size() < 4 + length )
+			{
+				return;
+			}
+			
+			input.erase( 0, 4 + length );
+			continue;
+		}
+		
+		size_t headerEnd = input.find( "\r\n\r\n" );
+		
+		if( headerEnd == std::string::npos )
+		{
+			return;
+		}
+		
+		TRequest request;
+		request.m_headers = input.substr( 0, headerEnd + 2 );
+		
+		// Bodies (SET_PARAMETER etc.) are skipped
+		size_t bodySize = std::strtoul( GetHeader( request.m_headers, "content-length" ).c_str(), nullptr, 10 );
+		
+		if( input.size() < headerEnd + 4 + bodySize )
+		{
+			return;
+		}
+		
+		input.erase( 0, headerEnd + 4 + bodySize );
+		
+		// Request line: <method> <url> RTSP/1.0
+		size_t methodEnd 	= request.m_headers.find( ' ' );
+		size_t urlEnd 		= ( methodEnd == std::string::npos ) ? std::string::npos : request.m_headers.find( ' ', methodEnd + 1 );
+		
+		if( urlEnd == std::string::npos )
+		{
+			clientIn.m_closing = true;
+			return;
+		}
+		
+		request.m_method 	= request.m_headers.substr( 0, methodEnd );
+		request.m_url 		= request.m_headers.substr( methodEnd + 1, urlEnd - methodEnd - 1 );
+		request.m_cseq 		= GetHeader( request.m_headers, "cseq" );
+		
+		HandleRequest( clientIn, request );
+	}
+}
+
+void CRtspServer::HandleRequest( TClient &clientIn, const TRequest &requestIn )
+{
+	const std::string &method = requestIn.m_method;
+	
+	if( method == "OPTIONS" )
+	{
+		QueueResponse( clientIn, requestIn, "200 OK", "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n" );
+	}
+	else if( method == "DESCRIBE" )
+	{
+		int stream = FindStream( requestIn.m_url );
+		
+		if( stream < 0 )
+		{
+			QueueResponse( clientIn, requestIn, "404 Not Found" );
+			return;
+		}
+		
+		std::string baseUrl = requestIn.m_url;
+		
+		if( baseUrl.back() != '/' )
+		{
+			baseUrl += "/";
+		}
+		
+		QueueResponse( clientIn, requestIn, "200 OK", "Content-Base: " + baseUrl + "\r\nContent-Type: application/sdp\r\n", BuildSdp( stream ) );
+	}
+	else if( method == "SETUP" )
+	{
+		HandleSetup( clientIn, requestIn );
+	}
+	else if( method == "PLAY" )
+	{
+		if( clientIn.m_stream < 0 )
+		{
+			QueueResponse( clientIn, requestIn, "455 Method Not Valid in This State" );
+			return;
+		}
+		
+		if( !clientIn.m_isPlaying )
+		{
+			clientIn.m_isPlaying 			= true;
+			clientIn.m_waitingForKeyframe 	= true;
+			m_playingCount++;
+		}
+		
+		QueueResponse( clientIn, requestIn, "200 OK", "Range: npt=0.000-\r\n" );
+	}
+	else if( method == "TEARDOWN" )
+	{
+		QueueResponse( clientIn, requestIn, "200 OK" );
+		clientIn.m_closing = true;
+	}
+	else if( method == "GET_PARAMETER" || method == "SET_PARAMETER" )
+	{
+		// Keepalive
+		QueueResponse( clientIn, requestIn, "200 OK" );
+	}
+	else
+	{
+		QueueResponse( clientIn, requestIn, "501 Not Implemented" );
+	}
+}
+
+void CRtspServer::HandleSetup( TClient &clientIn, const TRequest &requestIn )
+{
+	int stream = FindStream( requestIn.m_url );
+	
+	if( stream < 0 )
+	{
+		QueueResponse( clientIn, requestIn, "404 Not Found" );
+		return;
+	}
+	
+	// One track per session
+	if( clientIn.m_stream >= 0 && clientIn.m_stream != stream )
+	{
+		QueueResponse( clientIn, requestIn, "459 Aggregate Operation Not Allowed" );
+		return;
+	}
+	
+	const std::string transport = GetHeader( requestIn.m_headers, "transport" );
+	std::string transportOut;
+	
+	size_t interleaved 	= transport.find( "interleaved=" );
+	size_t clientPort 	= transport.find( "client_port=" );
+	
+	if( transport.find( "RTP/AVP/TCP" ) != std::string::npos )
+	{
+		uint8_t channel = ( interleaved != std::string::npos ) ? (uint8_t)std::strtoul( transport.c_str() + interleaved + 12, nullptr, 10 ) : 0;
+		
+		clientIn.m_isInterleaved 	= true;
+		clientIn.m_rtpChannel 		= channel;
+		
+		transportOut = "RTP/AVP/TCP;unicast;interleaved=" + std::to_string( channel ) + "-" + std::to_string( channel + 1 );
+	}
+	else if( clientPort != std::string::npos )
+	{
+		uint16_t port = (uint16_t)std::strtoul( transport.c_str() + clientPort + 12, nullptr, 10 );
+		
+		clientIn.m_isInterleaved 	= false;
+		clientIn.m_clientRtpPort 	= port;
+		
+		transportOut = "RTP/AVP;unicast;client_port=" + std::to_string( port ) + "-" + std::to_string( port + 1 )
+						+ ";server_port=" + std::to_string( m_rtpPort ) + "-" + std::to_string( m_rtpPort + 1 );
+	}
+	else
+	{
+		QueueResponse( clientIn, requestIn, "461 Unsupported Transport" );
+		return;
+	}
+	
+	char ssrc[ 16 ];
+	snprintf( ssrc, sizeof( ssrc ), "%08X", m_streams[ stream ].m_pInput->m_packetizer.GetSsrc() );
+	transportOut += ";ssrc=" + std::string( ssrc );
+	
+	if( clientIn.m_sessionId.empty() )
+	{
+		char sessionId[ 16 ];
+		snprintf( sessionId, sizeof( sessionId ), "%08X", (uint32_t)std::rand() );
+		clientIn.m_sessionId = sessionId;
+	}
+	
+	clientIn.m_stream = stream;
+	
+	QueueResponse( clientIn, requestIn, "200 OK", "Transport: " + transportOut + "\r\n" );
+}
+
+std::string CRtspServer::BuildSdp( int streamIn )
+{
+	CStreamInput &input = *m_streams[ streamIn ].m_pInput;
+	std::vector<uint8_t> sps, pps;
+	
+	{
+		std::lock_guard<std::mutex> lock( input.m_parameterSetMutex );
+		sps = input.m_sps;
+		pps = input.m_pps;
+	}
+	
+	std::string fmtp = "a=fmtp:" + std::to_string( k_payloadType ) + " packetization-mode=1";
+	
+	if( sps.size() >= 4 )
+	{
+		char profileLevelId[ 8 ];
+		snprintf( profileLevelId, sizeof( profileLevelId ), "%02x%02x%02x", sps[ 1 ], sps[ 2 ], sps[ 3 ] );
+		
+		fmtp += ";profile-level-id=" + std::string( profileLevelId );
+	}
+	
+	if( !sps.empty() && !pps.empty() )
+	{
+		fmtp += ";sprop-parameter-sets=" + Base64( sps ) + "," + Base64( pps );
+	}
+	
+	return "v=0\r\n"
+			"o=- " + std::to_string( input.m_packetizer.GetSsrc() ) + " 1 IN IP4 0.0.0.0\r\n"
+			"s=" + m_streams[ streamIn ].m_name + "\r\n"
+			"c=IN IP4 0.0.0.0\r\n"
+			"t=0 0\r\n"
+			"a=control:*\r\n"
+			"m=video 0 RTP/AVP " + std::to_string( k_payloadType ) + "\r\n"
+			"a=rtpmap:" + std::to_string( k_payloadType ) + " H264/90000\r\n"
+			+ fmtp + "\r\n"
+			"a=control:track0\r\n";
+}
+
+void CRtspServer::QueueResponse( TClient &clientIn, const TRequest &requestIn, const std::string &statusIn, const std::string &headersIn, const std::string &bodyIn )
+{
+	std::string response = "RTSP/1.0 " + statusIn + "\r\nCSeq: " + requestIn.m_cseq + "\r\n";
+	
+	if( !clientIn.m_sessionId.empty() )
+	{
+		response += "Session: " + clientIn.m_sessionId + ";timeout=60\r\n";
+	}
+	
+	response += headersIn;
+	
+	if( !bodyIn.empty() )
+	{
+		response += "Content-Length: " + std::to_string( bodyIn.size() ) + "\r\n";
+	}
+	
+	response += "\r\n" + bodyIn;
+	
+	TOutgoing outgoing;
+	outgoing.m_data.assign( response.begin(), response.end() );
+	
+	QueueOutgoing( clientIn, std::move( outgoing ) );
+}
+
+void CRtspServer::QueueOutgoing( TClient &clientIn, TOutgoing &&outgoingIn )
+{
+	clientIn.m_queuedBytes += outgoingIn.Get().size();
+	clientIn.m_queue.push_back( std::move( outgoingIn ) );
+}
+
+void CRtspServer::CloseClient( TClient &clientIn )
+{
+	if( clientIn.m_isPlaying )
+	{
+		clientIn.m_isPlaying = false;
+		m_playingCount--;
+	}
+	
+	if( clientIn.m_socket >= 0 )
+	{
+		close( clientIn.m_socket );
+		clientIn.m_socket = -1;
+	}
+	
+	clientIn.m_queue.clear();
+	clientIn.m_queuedBytes = 0;
+}
+
+int CRtspServer::FindStream( const std::string &urlIn )
+{
+	// rtsp://host[:port]/<stream>[/track0][?query]
+	size_t pathStart = urlIn.find( "://" );
+	pathStart = urlIn.find( '/', ( pathStart == std::string::npos ) ? 0 : pathStart + 3 );
+	
+	if( pathStart == std::string::npos )
+	{
+		return -1;
+	}
+	
+	size_t nameEnd = urlIn.find_first_of( "/?", pathStart + 1 );
+	std::string name = urlIn.substr( pathStart + 1, ( nameEnd == std::string::npos ) ? std::string::npos : nameEnd - pathStart - 1 );
+	
+	for( size_t i = 0; i < m_streams.size(); ++i )
+	{
+		if( m_streams[ i ].m_name == name )
+		{
+			return (int)i;
+		}
+	}
+	
+	return -1;
+}
+
+std::string CRtspServer::GetHeader( const std::string &headersIn, const std::string &nameIn )
+{
+	// Header names are case insensitive
+	std::string lowerHeaders( headersIn );
+	std::transform( lowerHeaders.begin(), lowerHeaders.end(), lowerHeaders.begin(), ::tolower );
+	
+	size_t position = lowerHeaders.find( "\r\n" + nameIn + ":" );
+	
+	if( position == std::string::npos )
+	{
+		return "";
+	}
+	
+	size_t valueStart 	= headersIn.find_first_not_of( " \t", position + 3 + nameIn.size() );
+	size_t valueEnd 	= headersIn.find( "\r\n", position + 2 );
+	
+	if( valueStart == std::string::npos || valueEnd == std::string::npos || valueStart >= valueEnd )
+	{
+		return "";
+	}
+	
+	return headersIn.substr( valueStart, valueEnd - valueStart );
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include <netinet/in.h>
+
+#include "CVideoBuffer.h"
+#include "CRtpPacketizer.h"
+#include "CPacedSender.h"
+
+// Serves H264 over RTSP/RTP straight from the Annex-B NAL units in the video callback, skipping the muxer entirely.
+// Single threaded and non-blocking (poll), like CHttpServer.
+//
+// rtsp://<host>:<port>/<stream> supports OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN and GET_PARAMETER (keepalive).
+// RTP goes over UDP (client_port) or interleaved on the RTSP connection (RTP/AVP/TCP). A session lasts as long as its
+// RTSP connection. New players start at the next IDR. With a pacing rate, RTP over UDP is spread out at that peak rate
+// instead of leaving in one burst per frame.
+class CRtspServer
+{
+public:
+	// Feeds one stream from the video callback
+	class CStreamInput
+	{
+	public:
+		// Called with the same segments written to the muxer
+		void Write( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool isFrameStartIn );
+	
+	private:
+		friend class CRtspServer;
+		
+		CStreamInput( CRtspServer *serverIn, int indexIn );
+		
+		// Attributes
+		CRtspServer 			*m_pServer;
+		int 					m_index;
+		CRtpPacketizer 			m_packetizer;
+		uint32_t 				m_timestamp		= 0;
+		
+		// Latest parameter sets, for DESCRIBE
+		std::mutex 				m_parameterSetMutex;
+		std::vector<uint8_t> 	m_sps;
+		std::vector<uint8_t> 	m_pps;
+		
+		// Methods
+		void UpdateParameterSets( const std::vector<uint8_t> &spsIn, const std::vector<uint8_t> &ppsIn );
+	};
+	
+	// Attributes
+	std::atomic<uint32_t> 		m_clientCount;
+	std::atomic<uint32_t> 		m_playingCount;
+	std::atomic<uint64_t> 		m_packetsSent;
+	std::atomic<uint64_t> 		m_burstsDropped;
+	
+	// Methods
+	// Without a pacing bucket, each frame's UDP packets are sent as soon as they are made. The bucket may be shared with other servers.
+	CRtspServer( uint16_t portIn, std::shared_ptr<CTokenBucket> pacingBucketIn );
+	virtual ~CRtspServer();
+	
+	// Streams must all be added before Start(). The returned input belongs to the server.
+	CStreamInput* AddStream( const std::string &nameIn );
+	
+	void Start();
+	void Stop();
+	
+	// Null without pacing
+	const TPacingStats* GetPacingStats() const { return m_pPacer ? &m_pPacer->m_stats : nullptr; }
+
+private:
+	struct TOutgoing
+	{
+		std::vector<uint8_t> 	m_data;				// Response, or a burst copy with a different interleave channel
+		TRtpBurstPtr 			m_pBurst;			// Shared burst, sent as is, when m_data is empty
+		size_t 					m_offset	= 0;
+		bool 					m_isMedia	= false;	// RTP, which a client that falls behind can skip. Responses never are.
+		
+		const std::vector<uint8_t>& Get() const { return m_data.empty() && m_pBurst ? m_pBurst->m_data : m_data; }
+	};
+	
+	struct TClient
+	{
+		int 						m_socket				= -1;
+		sockaddr_in 				m_address;
+		std::string 				m_input;
+		bool 						m_closing				= false;	// Close once the send queue is empty
+		
+		// Session
+		int 						m_stream				= -1;
+		std::string 				m_sessionId;
+		bool 						m_isPlaying				= false;
+		bool 						m_isInterleaved			= false;
+		uint8_t 					m_rtpChannel			= 0;
+		uint16_t 					m_clientRtpPort			= 0;
+		bool 						m_waitingForKeyframe	= true;
+		
+		std::deque<TOutgoing> 		m_queue;
+		size_t 						m_queuedBytes			= 0;
+	};
+	
+	struct TStream
+	{
+		std::string 					m_name;
+		std::unique_ptr<CStreamInput> 	m_pInput;
+	};
+	
+	struct TPendingBurst
+	{
+		int 			m_stream;
+		TRtpBurstPtr 	m_pBurst;
+	};
+	
+	struct TRequest
+	{
+		std::string 	m_method;
+		std::string 	m_url;
+		std::string 	m_cseq;
+		std::string 	m_headers;
+	};
+	
+	// Attributes
+	uint16_t 						m_port;
+	int 							m_listenSocket		= -1;
+	int 							m_rtpSocket			= -1;
+	int 							m_rtcpSocket		= -1;
+	uint16_t 						m_rtpPort			= 0;
+	int 							m_wakeFd			= -1;
+	
+	std::vector<TStream> 			m_streams;
+	std::vector<TClient> 			m_clients;
+	
+	// Filled by the video callbacks, drained by the server thread
+	std::mutex 						m_pendingMutex;
+	std::vector<TPendingBurst> 		m_pending;
+	std::vector<TPendingBurst> 		m_draining;
+	
+	std::unique_ptr<CPacedSender> 	m_pPacer;
+	int 							m_pacingTimeout_ms	= -1;
+	
+	std::thread 					m_thread;
+	std::atomic<bool> 				m_killThread;
+	
+	const size_t 					k_maxClients			= 16;
+	const size_t 					k_maxRequestSize		= 16384;
+	const size_t 					k_maxQueuedBytes		= 4 * 1024 * 1024;
+	const int 						k_pollTimeout_ms		= 1000;
+	const uint8_t 					k_payloadType			= 96;
+	
+	// Methods
+	void QueueBurst( int streamIn, const TRtpBurstPtr &burstIn );
+	
+	void OpenSockets();
+	void CloseSockets();
+	
+	void ThreadLoop();
+	void AcceptClients();
+	void DistributePending();
+	void SendBurst( TClient &clientIn, const TRtpBurstPtr &burstIn );
+	
+	bool ReadFromClient( TClient &clientIn );
+	bool WriteToClient( TClient &clientIn );
+	void DrainSocket( int socketIn );
+	
+	void HandleInput( TClient &clientIn );
+	void HandleRequest( TClient &clientIn, const TRequest &requestIn );
+	void HandleSetup( TClient &clientIn, const TRequest &requestIn );
+	std::string BuildSdp( int streamIn );
+	
+	void QueueResponse( TClient &clientIn, const TRequest &requestIn, const std::string &statusIn, const std::string &headersIn = "", const std::string &bodyIn = "" );
+	void QueueOutgoing( TClient &clientIn, TOutgoing &&outgoingIn );
+	void CloseClient( TClient &clientIn );
+	
+	int FindStream( const std::string &urlIn );
+	static std::string GetHeader( const std::string &headersIn, const std::string &nameIn );
+};
@@ -0,0 +1,99 @@
+// Includes
+#include "CScanBenchmarkApp.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+CScanBenchmarkApp::CScanBenchmarkApp( int argCountIn, char* argsIn[], const std::string &inputPathIn )
+	: CApp( argCountIn, argsIn )
+	, m_inputPath( inputPathIn )
+{
+}
+
+CScanBenchmarkApp::~CScanBenchmarkApp()
+{
+}
+
+void CScanBenchmarkApp::Run()
+{
+	std::ifstream input( m_inputPath, std::ios::binary | std::ios::ate );
+	
+	if( !input )
+	{
+		throw std::runtime_error( "Failed to open " + m_inputPath );
+	}
+	
+	m_data.resize( input.tellg() );
+	input.seekg( 0 );
+	
+	if( !input.read( (char*)m_data.data(), m_data.size() ) )
+	{
+		throw std::runtime_error( "Failed to read " + m_inputPath );
+	}
+	
+	const std::vector<h264::TScanner> &scanners = h264::GetScanners();
+	
+	cout << "Scanning " << m_inputPath << " (" << m_data.size() << " bytes). FindStartCode uses: " << scanners.back().m_name << endl;
+	
+	// The byte loop is the reference the others must agree with
+	size_t expectedStartCodes 	= CountMatches( scanners.front().m_scan, 0x01 );
+	size_t expectedEscapes 		= CountMatches( scanners.front().m_scan, 0x03 );
+	bool allAgree 				= true;
+	
+	for( const h264::TScanner &scanner : scanners )
+	{
+		size_t startCodes 	= 0;
+		size_t escapes 		= 0;
+		size_t passes 		= 0;
+		
+		auto start 		= std::chrono::steady_clock::now();
+		auto elapsed 	= std::chrono::steady_clock::duration::zero();
+		
+		do
+		{
+			startCodes 	= CountMatches( scanner.m_scan, 0x01 );
+			escapes 	= CountMatches( scanner.m_scan, 0x03 );
+			passes++;
+			
+			elapsed = std::chrono::steady_clock::now() - start;
+		}
+		while( elapsed < k_minDuration );
+		
+		double elapsed_s 	= std::chrono::duration_cast<std::chrono::microseconds>( elapsed ).count() / 1000000.0;
+		double scanned_MB 	= ( 2.0 * passes * m_data.size() ) / 1000000.0;
+		bool agrees 		= ( startCodes == expectedStartCodes && escapes == expectedEscapes );
+		
+		allAgree = allAgree && agrees;
+		
+		cout << std::left << std::setw( 10 ) << scanner.m_name << std::right
+			<< std::fixed << std::setprecision( 1 ) << std::setw( 10 ) << ( scanned_MB / elapsed_s ) << " MB/sec, "
+			<< startCodes << " start codes, " << escapes << " emulation prevention bytes"
+			<< ( agrees ? "" : "  MISMATCH" ) << endl;
+	}
+	
+	cout.unsetf( std::ios::floatfield );
+	
+	if( !allAgree )
+	{
+		throw std::runtime_error( "Scanners disagree" );
+	}
+}
+
+size_t CScanBenchmarkApp::CountMatches( h264::TPatternScanner scanIn, uint8_t thirdByteIn )
+{
+	const uint8_t *end 		= m_data.data() + m_data.size();
+	const uint8_t *cursor 	= m_data.data();
+	size_t count 			= 0;
+	
+	while( ( cursor = scanIn( cursor, end, thirdByteIn ) ) != end )
+	{
+		count++;
+		cursor += 3;
+	}
+	
+	return count;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "CApp.h"
+#include "H264.h"
+
+// Times every start code scanner available on this machine over a raw H264 (Annex-B) capture,
+// and checks that they all find the same start codes and emulation prevention bytes.
+class CScanBenchmarkApp : public CApp
+{
+public:
+	// Methods
+	CScanBenchmarkApp( int argCountIn, char* argsIn[], const std::string &inputPathIn );
+	virtual ~CScanBenchmarkApp();
+	
+	virtual void Run();
+
+private:
+	// Attributes
+	std::string 					m_inputPath;
+	std::vector<uint8_t> 			m_data;
+	
+	// Each scanner runs over the capture for at least this long
+	const std::chrono::milliseconds k_minDuration 	= std::chrono::milliseconds( 1000 );
+	
+	// Methods
+	size_t CountMatches( h264::TPatternScanner scanIn, uint8_t thirdByteIn );
+};
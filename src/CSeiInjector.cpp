@@ -0,0 +1,108 @@
+// Includes
+#include "CSeiInjector.h"
+#include "H264.h"
+#include "Mp4Box.h"
+
+#include <algorithm>
+
+extern "C" 
+{
+	#include <libavutil/time.h>
+}
+
+// Identifies our payload among any other unregistered user data in the stream
+const uint8_t CSeiInjector::k_uuid[ 16 ] = 
+{
+	0x67, 0x65, 0x6F, 0x6D, 0x75, 0x78, 0x2D, 0x73,
+	0x65, 0x69, 0x2D, 0x76, 0x31, 0x00, 0x00, 0x00
+};
+
+CSeiInjector::CSeiInjector()
+	: m_seiInserted( 0 )
+{
+}
+
+CSeiInjector::~CSeiInjector()
+{
+}
+
+void CSeiInjector::Configure( bool enabledIn, uint32_t intervalIn, bool keyframesOnlyIn, const std::string &userDataIn )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	m_enabled 		= enabledIn;
+	m_interval 		= ( intervalIn == 0 ) ? 1 : intervalIn;
+	m_keyframesOnly = keyframesOnlyIn;
+	m_frameCount 	= 0;
+	
+	m_userData.assign( userDataIn.begin(), userDataIn.end() );
+}
+
+size_t CSeiInjector::Process( const uint8_t *frameIn, size_t sizeIn, uint64_t cameraTimestampIn, TBufferSegment ( &segmentsOut )[ 3 ] )
+{
+	// Unless tagged, the frame goes out as is
+	segmentsOut[ 0 ].m_pData 	= frameIn;
+	segmentsOut[ 0 ].m_size 	= sizeIn;
+	
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	if( !m_enabled )
+	{
+		return 1;
+	}
+	
+	// Only walk the NAL headers up to the first slice, never the slice data
+	const uint8_t *end 		= frameIn + sizeIn;
+	const uint8_t *cursor 	= frameIn;
+	const uint8_t *insertAt = nullptr;
+	bool isKeyframe 		= false;
+	h264::TNalUnit nal;
+	
+	while( h264::NextNalUnit( cursor, end, nal ) )
+	{
+		if( nal.IsVCL() )
+		{
+			// Frames split across callbacks only get tagged on their first piece
+			if( h264::IsFirstSliceOfPicture( nal ) )
+			{
+				insertAt 	= nal.m_pStartCode;
+				isKeyframe 	= ( nal.GetType() == h264::NAL_IDR_SLICE );
+			}
+			
+			break;
+		}
+	}
+	
+	if( insertAt == nullptr || ( m_keyframesOnly && !isKeyframe ) || ( m_frameCount++ % m_interval ) != 0 )
+	{
+		return 1;
+	}
+	
+	BuildPayload( cameraTimestampIn );
+	h264::BuildUserDataUnregisteredSei( k_uuid, m_payload.data(), m_payload.size(), m_sei );
+	
+	// Parameter sets and AUD stay ahead of the SEI, the slices follow it
+	segmentsOut[ 0 ].m_size 	= insertAt - frameIn;
+	segmentsOut[ 1 ].m_pData 	= m_sei.data();
+	segmentsOut[ 1 ].m_size 	= m_sei.size();
+	segmentsOut[ 2 ].m_pData 	= insertAt;
+	segmentsOut[ 2 ].m_size 	= end - insertAt;
+	
+	m_seiInserted++;
+	return 3;
+}
+
+void CSeiInjector::BuildPayload( uint64_t cameraTimestampIn )
+{
+	// version(1), capture time us(8), sequence(4), camera timestamp(8), then user data
+	m_payload.resize( 1 + 8 + 4 + 8 + m_userData.size() );
+	
+	uint8_t *out = m_payload.data();
+	
+	out[ 0 ] = k_payloadVersion;
+	mp4::WriteU64( out + 1, (uint64_t)av_gettime() );
+	mp4::WriteU32( out + 9, m_sequence++ );
+	mp4::WriteU64( out + 13, cameraTimestampIn );
+	
+	std::copy( m_userData.begin(), m_userData.end(), out + 21 );
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+
+#include "CVideoBuffer.h"
+
+// Inserts an SEI user_data_unregistered NAL ahead of the first slice of selected H264 access units.
+// The payload carries capture time and a sequence number so they survive remuxing and transcoding.
+class CSeiInjector
+{
+public:
+	// Attributes
+	std::atomic<uint64_t> 		m_seiInserted;
+	
+	// Methods
+	CSeiInjector();
+	virtual ~CSeiInjector();
+	
+	// Tags every intervalIn'th selected frame. userDataIn is appended verbatim after the fixed fields.
+	void Configure( bool enabledIn, uint32_t intervalIn, bool keyframesOnlyIn, const std::string &userDataIn );
+	
+	// Called from the video callback. Splits the frame into segments to write, with the SEI between them if this frame
+	// is selected. Returns the segment count. The SEI segment stays valid until the next call.
+	size_t Process( const uint8_t *frameIn, size_t sizeIn, uint64_t cameraTimestampIn, TBufferSegment ( &segmentsOut )[ 3 ] );
+
+private:
+	// Attributes
+	std::mutex 					m_mutex;
+	bool 						m_enabled			= false;
+	uint32_t 					m_interval			= 1;
+	bool 						m_keyframesOnly		= false;
+	std::vector<uint8_t> 		m_userData;
+	
+	uint64_t 					m_frameCount		= 0;
+	uint32_t 					m_sequence			= 0;
+	
+	// Reused for every frame so tagging doesn't allocate
+	std::vector<uint8_t> 		m_payload;
+	std::vector<uint8_t> 		m_sei;
+	
+	static const uint8_t 		k_uuid[ 16 ];
+	const uint8_t 				k_payloadVersion	= 1;
+	
+	// Methods
+	void BuildPayload( uint64_t cameraTimestampIn );
+};
@@ -0,0 +1,324 @@
+// Includes
+#include "CSpsRewriter.h"
+#include "CBitstream.h"
+#include "H264.h"
+
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+	// Helpers that read a field and write it straight back out
+	uint32_t CopyBits( CBitReader &readerIn, CBitWriter &writerIn, uint32_t countIn )
+	{
+		uint32_t value = readerIn.ReadBits( countIn );
+		writerIn.WriteBits( value, countIn );
+		return value;
+	}
+	
+	uint32_t CopyUE( CBitReader &readerIn, CBitWriter &writerIn )
+	{
+		uint32_t value = readerIn.ReadUE();
+		writerIn.WriteUE( value );
+		return value;
+	}
+}
+
+CSpsRewriter::CSpsRewriter()
+	: m_spsRewritten( 0 )
+	, m_spsFailed( 0 )
+{
+}
+
+CSpsRewriter::~CSpsRewriter()
+{
+}
+
+void CSpsRewriter::Configure( bool enabledIn, uint32_t framerateIn )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	m_enabled 	= enabledIn;
+	m_framerate = framerateIn;
+	
+	m_lastInput.clear();
+	m_lastOutput.clear();
+}
+
+void CSpsRewriter::Process( const uint8_t *&dataIO, size_t &sizeIO )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	if( !m_enabled )
+	{
+		return;
+	}
+	
+	// Parameter sets come ahead of the first slice, no need to look further
+	const uint8_t *end 		= dataIO + sizeIO;
+	const uint8_t *cursor 	= dataIO;
+	h264::TNalUnit nal;
+	bool found = false;
+	
+	while( h264::NextNalUnit( cursor, end, nal ) )
+	{
+		if( nal.IsVCL() )
+		{
+			break;
+		}
+		
+		if( nal.GetType() == h264::NAL_SPS )
+		{
+			found = true;
+			break;
+		}
+	}
+	
+	if( !found )
+	{
+		return;
+	}
+	
+	if( m_lastInput.size() != nal.m_size || !std::equal( m_lastInput.begin(), m_lastInput.end(), nal.m_pData ) )
+	{
+		m_lastInput.assign( nal.m_pData, nal.m_pData + nal.m_size );
+		
+		if( !RewriteSps( nal.m_pData, nal.m_size, m_lastOutput ) )
+		{
+			// Pass the camera's SPS through untouched
+			m_lastOutput = m_lastInput;
+		}
+	}
+	
+	m_frame.clear();
+	m_frame.reserve( sizeIO + m_lastOutput.size() );
+	m_frame.insert( m_frame.end(), dataIO, nal.m_pData );
+	m_frame.insert( m_frame.end(), m_lastOutput.begin(), m_lastOutput.end() );
+	m_frame.insert( m_frame.end(), nal.m_pData + nal.m_size, end );
+	
+	dataIO = m_frame.data();
+	sizeIO = m_frame.size();
+}
+
+bool CSpsRewriter::RewriteSps( const uint8_t *nalIn, size_t sizeIn, std::vector<uint8_t> &nalOut )
+{
+	try
+	{
+		// Skip the NAL header byte
+		h264::RemoveEmulationPrevention( nalIn + 1, sizeIn - 1, m_rbsp );
+		
+		CBitReader reader( m_rbsp.data(), m_rbsp.size() );
+		
+		m_rewrittenRbsp.clear();
+		CBitWriter writer( m_rewrittenRbsp );
+		
+		// Everything up to frame_mbs_only_flag goes through as is
+		h264::TSpsInfo sps;
+		h264::ReadSpsFields( reader, sps, &writer );
+		
+		// mb_adaptive_frame_field_flag if interlaced
+		if( !sps.m_frameMbsOnly )
+		{
+			CopyBits( reader, writer, 1 );
+		}
+		
+		// direct_8x8_inference_flag
+		CopyBits( reader, writer, 1 );
+		
+		// frame_cropping_flag and offsets
+		if( CopyBits( reader, writer, 1 ) )
+		{
+			for( int i = 0; i < 4; ++i )
+			{
+				CopyUE( reader, writer );
+			}
+		}
+		
+		// vui_parameters_present_flag is always set on the way out
+		bool hasVui = reader.ReadBit();
+		writer.WriteBit( 1 );
+		
+		if( hasVui )
+		{
+			CopyVui( reader, writer, sps.m_maxRefFrames );
+		}
+		else
+		{
+			// No aspect ratio, overscan, video signal or chroma location info
+			writer.WriteBits( 0, 4 );
+			
+			if( m_framerate != 0 )
+			{
+				// Frame rate = time_scale / ( 2 * num_units_in_tick ). Not fixed, auto exposure can lower it.
+				writer.WriteBit( 1 );
+				writer.WriteBits( 1000, 32 );
+				writer.WriteBits( m_framerate * 2000, 32 );
+				writer.WriteBit( 0 );
+			}
+			else
+			{
+				writer.WriteBit( 0 );
+			}
+			
+			// No HRD parameters, no pic_struct
+			writer.WriteBits( 0, 3 );
+			
+			WriteBitstreamRestriction( writer, sps.m_maxRefFrames );
+		}
+		
+		writer.WriteTrailingBits();
+		
+		nalOut.clear();
+		nalOut.push_back( nalIn[ 0 ] );
+		h264::AppendEscaped( m_rewrittenRbsp.data(), m_rewrittenRbsp.size(), nalOut );
+		
+		m_spsRewritten++;
+		return true;
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Failed to rewrite SPS: " << e.what() << endl;
+		
+		m_spsFailed++;
+		return false;
+	}
+}
+
+void CSpsRewriter::CopyVui( CBitReader &readerIn, CBitWriter &writerIn, uint32_t maxRefFramesIn )
+{
+	// aspect_ratio_info_present_flag
+	if( CopyBits( readerIn, writerIn, 1 ) )
+	{
+		// aspect_ratio_idc, then sar_width and sar_height for Extended_SAR
+		if( CopyBits( readerIn, writerIn, 8 ) == 255 )
+		{
+			CopyBits( readerIn, writerIn, 32 );
+		}
+	}
+	
+	// overscan_info_present_flag, overscan_appropriate_flag
+	if( CopyBits( readerIn, writerIn, 1 ) )
+	{
+		CopyBits( readerIn, writerIn, 1 );
+	}
+	
+	// video_signal_type_present_flag
+	if( CopyBits( readerIn, writerIn, 1 ) )
+	{
+		// video_format, video_full_range_flag
+		CopyBits( readerIn, writerIn, 4 );
+		
+		// colour_description_present_flag, then primaries, transfer and matrix
+		if( CopyBits( readerIn, writerIn, 1 ) )
+		{
+			CopyBits( readerIn, writerIn, 24 );
+		}
+	}
+	
+	// chroma_loc_info_present_flag
+	if( CopyBits( readerIn, writerIn, 1 ) )
+	{
+		CopyUE( readerIn, writerIn );
+		CopyUE( readerIn, writerIn );
+	}
+	
+	// Keep the camera's timing info if it has any
+	if( readerIn.ReadBit() )
+	{
+		writerIn.WriteBit( 1 );
+		CopyBits( readerIn, writerIn, 32 );
+		CopyBits( readerIn, writerIn, 32 );
+		CopyBits( readerIn, writerIn, 1 );
+	}
+	else if( m_framerate != 0 )
+	{
+		writerIn.WriteBit( 1 );
+		writerIn.WriteBits( 1000, 32 );
+		writerIn.WriteBits( m_framerate * 2000, 32 );
+		writerIn.WriteBit( 0 );
+	}
+	else
+	{
+		writerIn.WriteBit( 0 );
+	}
+	
+	bool nalHrd = CopyBits( readerIn, writerIn, 1 );
+	
+	if( nalHrd )
+	{
+		CopyHrdParameters( readerIn, writerIn );
+	}
+	
+	bool vclHrd = CopyBits( readerIn, writerIn, 1 );
+	
+	if( vclHrd )
+	{
+		CopyHrdParameters( readerIn, writerIn );
+	}
+	
+	if( nalHrd || vclHrd )
+	{
+		// low_delay_hrd_flag
+		CopyBits( readerIn, writerIn, 1 );
+	}
+	
+	// pic_struct_present_flag
+	CopyBits( readerIn, writerIn, 1 );
+	
+	if( readerIn.ReadBit() )
+	{
+		// Keep the existing motion vector limits, but replace the reordering and buffering values
+		writerIn.WriteBit( 1 );
+		
+		CopyBits( readerIn, writerIn, 1 );
+		
+		for( int i = 0; i < 4; ++i )
+		{
+			CopyUE( readerIn, writerIn );
+		}
+		
+		readerIn.ReadUE();
+		readerIn.ReadUE();
+		
+		writerIn.WriteUE( 0 );
+		writerIn.WriteUE( maxRefFramesIn );
+	}
+	else
+	{
+		WriteBitstreamRestriction( writerIn, maxRefFramesIn );
+	}
+}
+
+void CSpsRewriter::CopyHrdParameters( CBitReader &readerIn, CBitWriter &writerIn )
+{
+	uint32_t cpbCount = CopyUE( readerIn, writerIn ) + 1;
+	
+	// bit_rate_scale, cpb_size_scale
+	CopyBits( readerIn, writerIn, 8 );
+	
+	for( uint32_t i = 0; i < cpbCount; ++i )
+	{
+		// bit_rate_value_minus1, cpb_size_value_minus1, cbr_flag
+		CopyUE( readerIn, writerIn );
+		CopyUE( readerIn, writerIn );
+		CopyBits( readerIn, writerIn, 1 );
+	}
+	
+	// initial_cpb_removal_delay_length_minus1, cpb_removal_delay_length_minus1, dpb_output_delay_length_minus1, time_offset_length
+	CopyBits( readerIn, writerIn, 20 );
+}
+
+void CSpsRewriter::WriteBitstreamRestriction( CBitWriter &writerIn, uint32_t maxRefFramesIn )
+{
+	// bitstream_restriction_flag, then the spec's inferred values for everything but reordering and buffering
+	writerIn.WriteBit( 1 );
+	writerIn.WriteBit( 1 );
+	writerIn.WriteUE( 2 );
+	writerIn.WriteUE( 1 );
+	writerIn.WriteUE( 16 );
+	writerIn.WriteUE( 16 );
+	writerIn.WriteUE( 0 );
+	writerIn.WriteUE( maxRefFramesIn );
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+class CBitReader;
+class CBitWriter;
+
+// Rewrites the camera's SPS in-band so decoders can output frames immediately: adds VUI timing info if it is missing
+// and a bitstream_restriction with max_num_reorder_frames = 0 and max_dec_frame_buffering = max_num_ref_frames.
+// Runs ahead of the muxer, so the rewritten SPS also ends up in the avcC of the next init segment.
+class CSpsRewriter
+{
+public:
+	// Attributes
+	std::atomic<uint64_t> 		m_spsRewritten;
+	std::atomic<uint64_t> 		m_spsFailed;
+	
+	// Methods
+	CSpsRewriter();
+	virtual ~CSpsRewriter();
+	
+	// framerateIn of 0 leaves timing info out if the camera doesn't send it
+	void Configure( bool enabledIn, uint32_t framerateIn );
+	
+	// Called from the video callback. If the frame carries an SPS, dataIO/sizeIO are pointed at a rewritten copy of the frame,
+	// which stays valid until the next call.
+	void Process( const uint8_t *&dataIO, size_t &sizeIO );
+
+private:
+	// Attributes
+	std::mutex 					m_mutex;
+	bool 						m_enabled			= false;
+	uint32_t 					m_framerate			= 0;
+	
+	// The camera repeats the same SPS every GOP, so the last rewrite is cached
+	std::vector<uint8_t> 		m_lastInput;
+	std::vector<uint8_t> 		m_lastOutput;
+	
+	// Reused between frames
+	std::vector<uint8_t> 		m_rbsp;
+	std::vector<uint8_t> 		m_rewrittenRbsp;
+	std::vector<uint8_t> 		m_frame;
+	
+	// Methods
+	bool RewriteSps( const uint8_t *nalIn, size_t sizeIn, std::vector<uint8_t> &nalOut );
+	void CopyVui( CBitReader &readerIn, CBitWriter &writerIn, uint32_t maxRefFramesIn );
+	void CopyHrdParameters( CBitReader &readerIn, CBitWriter &writerIn );
+	void WriteBitstreamRestriction( CBitWriter &writerIn, uint32_t maxRefFramesIn );
+};
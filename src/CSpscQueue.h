@@ -0,0 +1,76 @@
+#pragma once
+
+// Includes
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread
+template<typename T>
+class CSpscQueue
+{
+public:
+	// Methods
+	explicit CSpscQueue( size_t capacityIn )
+		: k_slots( capacityIn + 1 )
+		, m_items( k_slots )
+		, m_head( 0 )
+		, m_tail( 0 )
+	{
+	}
+	
+	// Producer. Returns false, leaving the queue untouched, when it is full.
+	bool TryPush( T &&itemIn )
+	{
+		const size_t tail 	= m_tail.load( std::memory_order_relaxed );
+		const size_t next 	= ( tail + 1 ) % k_slots;
+		
+		if( next == m_head.load( std::memory_order_acquire ) )
+		{
+			return false;
+		}
+		
+		m_items[ tail ] = std::move( itemIn );
+		m_tail.store( next, std::memory_order_release );
+		
+		return true;
+	}
+	
+	// Consumer. Returns the oldest item without removing it, or nullptr when empty.
+	T* Front()
+	{
+		const size_t head = m_head.load( std::memory_order_relaxed );
+		
+		if( head == m_tail.load( std::memory_order_acquire ) )
+		{
+			return nullptr;
+		}
+		
+		return &m_items[ head ];
+	}
+	
+	// Consumer. Only valid after Front() returned an item.
+	void Pop()
+	{
+		const size_t head = m_head.load( std::memory_order_relaxed );
+		
+		// Release whatever the item holds now rather than when the slot is reused
+		m_items[ head ] = T();
+		m_head.store( ( head + 1 ) % k_slots, std::memory_order_release );
+	}
+
+private:
+	static const size_t 		k_cacheLineSize		= 64;
+	
+	// Attributes
+	const size_t 				k_slots;			// One slot is always empty, to tell full from empty
+	std::vector<T> 				m_items;
+	
+	// Written by different threads, so keep them off the same cache line. Padding rather than alignas, which would make
+	// every owner over-aligned and its plain new warn (-Waligned-new) before C++17.
+	char 						m_headPadding[ k_cacheLineSize ];
+	std::atomic<size_t> 		m_head;
+	char 						m_tailPadding[ k_cacheLineSize - sizeof( std::atomic<size_t> ) ];
+	std::atomic<size_t> 		m_tail;
+	char 						m_endPadding[ k_cacheLineSize - sizeof( std::atomic<size_t> ) ];
+};
@@ -0,0 +1,210 @@
+// Includes
+#include "CSrtpContext.h"
+
+#include <stdexcept>
+#include <cstring>
+
+#include <openssl/hmac.h>
+#include <openssl/crypto.h>
+
+namespace
+{
+	// Key derivation labels (RFC 3711 4.3.1). SRTCP's follow SRTP's.
+	const uint8_t 	k_labelCipherKey 	= 0;
+	const uint8_t 	k_labelAuthKey 		= 1;
+	const uint8_t 	k_labelSalt 		= 2;
+	const uint8_t 	k_rtcpLabelOffset 	= 3;
+	
+	const size_t 	k_rtcpHeaderSize 	= 8;
+	
+	// The AES-CM PRF: the keystream for the master salt with the label XORed in
+	void DeriveKey( const uint8_t *masterKeyIn, const uint8_t *masterSaltIn, uint8_t labelIn, uint8_t *keyOut, int sizeIn )
+	{
+		uint8_t iv[ 16 ] = {};
+		memcpy( iv, masterSaltIn, CSrtpContext::k_masterSaltSize );
+		iv[ 7 ] ^= labelIn;
+		
+		uint8_t zeros[ 32 ] = {};
+		int size = 0;
+		
+		EVP_CIPHER_CTX *cipher = EVP_CIPHER_CTX_new();
+		
+		if( cipher == nullptr
+			|| EVP_EncryptInit_ex( cipher, EVP_aes_128_ctr(), nullptr, masterKeyIn, iv ) != 1
+			|| EVP_EncryptUpdate( cipher, keyOut, &size, zeros, sizeIn ) != 1 )
+		{
+			EVP_CIPHER_CTX_free( cipher );
+			throw std::runtime_error( "Failed to derive SRTP session keys" );
+		}
+		
+		EVP_CIPHER_CTX_free( cipher );
+	}
+	
+	void Write32( uint8_t *dataOut, uint32_t valueIn )
+	{
+		dataOut[ 0 ] = (uint8_t)( valueIn >> 24 );
+		dataOut[ 1 ] = (uint8_t)( valueIn >> 16 );
+		dataOut[ 2 ] = (uint8_t)( valueIn >> 8 );
+		dataOut[ 3 ] = (uint8_t)valueIn;
+	}
+	
+	uint32_t Read32( const uint8_t *dataIn )
+	{
+		return ( (uint32_t)dataIn[ 0 ] << 24 ) | ( dataIn[ 1 ] << 16 ) | ( dataIn[ 2 ] << 8 ) | dataIn[ 3 ];
+	}
+}
+
+CSrtpContext::CSrtpContext( const uint8_t *masterKeyIn, const uint8_t *masterSaltIn )
+	: m_pRtpCipher( nullptr )
+	, m_pRtcpCipher( nullptr )
+{
+	DeriveKeys( masterKeyIn, masterSaltIn, 0, m_rtpKeys );
+	DeriveKeys( masterKeyIn, masterSaltIn, k_rtcpLabelOffset, m_rtcpKeys );
+	
+	m_pRtpCipher 	= CreateCipher( m_rtpKeys.m_cipherKey );
+	m_pRtcpCipher 	= CreateCipher( m_rtcpKeys.m_cipherKey );
+	
+	if( m_pRtpCipher == nullptr || m_pRtcpCipher == nullptr )
+	{
+		EVP_CIPHER_CTX_free( m_pRtpCipher );
+		EVP_CIPHER_CTX_free( m_pRtcpCipher );
+		
+		throw std::runtime_error( "Failed to create SRTP cipher" );
+	}
+}
+
+CSrtpContext::~CSrtpContext()
+{
+	EVP_CIPHER_CTX_free( m_pRtpCipher );
+	EVP_CIPHER_CTX_free( m_pRtcpCipher );
+	
+	OPENSSL_cleanse( &m_rtpKeys, sizeof( m_rtpKeys ) );
+	OPENSSL_cleanse( &m_rtcpKeys, sizeof( m_rtcpKeys ) );
+}
+
+bool CSrtpContext::ProtectRtp( uint8_t *packetInOut, size_t sizeIn, size_t &sizeOut )
+{
+	if( sizeIn < 12 )
+	{
+		return false;
+	}
+	
+	// Header, CSRCs and extension stay in the clear
+	size_t headerSize = 12 + 4 * ( packetInOut[ 0 ] & 0x0F );
+	
+	if( ( packetInOut[ 0 ] & 0x10 ) && headerSize + 4 <= sizeIn )
+	{
+		headerSize += 4 + 4 * ( ( packetInOut[ headerSize + 2 ] << 8 ) | packetInOut[ headerSize + 3 ] );
+	}
+	
+	if( headerSize > sizeIn )
+	{
+		return false;
+	}
+	
+	uint16_t sequence = (uint16_t)( ( packetInOut[ 2 ] << 8 ) | packetInOut[ 3 ] );
+	
+	// We are the sender, so the sequence only wraps forwards
+	if( m_hasSentPacket && sequence < m_lastSequence && ( m_lastSequence - sequence ) > 0x8000 )
+	{
+		m_rolloverCounter++;
+	}
+	
+	m_lastSequence 	= sequence;
+	m_hasSentPacket = true;
+	
+	uint64_t index = ( (uint64_t)m_rolloverCounter << 16 ) | sequence;
+	
+	if( !Crypt( m_pRtpCipher, m_rtpKeys.m_salt, Read32( packetInOut + 8 ), index, packetInOut + headerSize, sizeIn - headerSize ) )
+	{
+		return false;
+	}
+	
+	// The tag covers the packet and the rollover counter. The counter goes where the tag will be, then gets overwritten.
+	uint8_t tag[ 20 ];
+	unsigned int tagSize = sizeof( tag );
+	
+	Write32( packetInOut + sizeIn, m_rolloverCounter );
+	HMAC( EVP_sha1(), m_rtpKeys.m_authKey, sizeof( m_rtpKeys.m_authKey ), packetInOut, sizeIn + 4, tag, &tagSize );
+	memcpy( packetInOut + sizeIn, tag, k_authTagSize );
+	
+	sizeOut = sizeIn + k_authTagSize;
+	return true;
+}
+
+bool CSrtpContext::UnprotectRtcp( uint8_t *packetInOut, size_t sizeIn, size_t &sizeOut )
+{
+	if( sizeIn < k_rtcpHeaderSize + k_srtcpTrailerSize )
+	{
+		return false;
+	}
+	
+	size_t authenticatedSize = sizeIn - k_authTagSize;
+	
+	uint8_t tag[ 20 ];
+	unsigned int tagSize = sizeof( tag );
+	
+	HMAC( EVP_sha1(), m_rtcpKeys.m_authKey, sizeof( m_rtcpKeys.m_authKey ), packetInOut, authenticatedSize, tag, &tagSize );
+	
+	if( CRYPTO_memcmp( tag, packetInOut + authenticatedSize, k_authTagSize ) != 0 )
+	{
+		return false;
+	}
+	
+	// E flag and the 31 bit SRTCP index
+	size_t payloadEnd 	= authenticatedSize - 4;
+	uint32_t trailer 	= Read32( packetInOut + payloadEnd );
+	
+	if( ( trailer & 0x80000000 ) && !Crypt( m_pRtcpCipher, m_rtcpKeys.m_salt, Read32( packetInOut + 4 ), trailer & 0x7FFFFFFF,
+											packetInOut + k_rtcpHeaderSize, payloadEnd - k_rtcpHeaderSize ) )
+	{
+		return false;
+	}
+	
+	sizeOut = payloadEnd;
+	return true;
+}
+
+void CSrtpContext::DeriveKeys( const uint8_t *masterKeyIn, const uint8_t *masterSaltIn, uint8_t firstLabelIn, TSessionKeys &keysOut )
+{
+	DeriveKey( masterKeyIn, masterSaltIn, firstLabelIn + k_labelCipherKey, keysOut.m_cipherKey, sizeof( keysOut.m_cipherKey ) );
+	DeriveKey( masterKeyIn, masterSaltIn, firstLabelIn + k_labelAuthKey, keysOut.m_authKey, sizeof( keysOut.m_authKey ) );
+	DeriveKey( masterKeyIn, masterSaltIn, firstLabelIn + k_labelSalt, keysOut.m_salt, sizeof( keysOut.m_salt ) );
+}
+
+EVP_CIPHER_CTX* CSrtpContext::CreateCipher( const uint8_t *keyIn )
+{
+	EVP_CIPHER_CTX *cipher = EVP_CIPHER_CTX_new();
+	
+	// Keyed once here. Each packet only sets its IV.
+	if( cipher != nullptr && EVP_EncryptInit_ex( cipher, EVP_aes_128_ctr(), nullptr, keyIn, nullptr ) != 1 )
+	{
+		EVP_CIPHER_CTX_free( cipher );
+		return nullptr;
+	}
+	
+	return cipher;
+}
+
+bool CSrtpContext::Crypt( EVP_CIPHER_CTX *cipherIn, const uint8_t *saltIn, uint32_t ssrcIn, uint64_t indexIn, uint8_t *dataInOut, size_t sizeIn )
+{
+	// IV = ( salt << 16 ) ^ ( SSRC << 64 ) ^ ( index << 16 )
+	uint8_t iv[ 16 ] = {};
+	
+	Write32( iv + 4, ssrcIn );
+	
+	for( int i = 0; i < 6; ++i )
+	{
+		iv[ 8 + i ] = (uint8_t)( indexIn >> ( 40 - 8 * i ) );
+	}
+	
+	for( size_t i = 0; i < k_masterSaltSize; ++i )
+	{
+		iv[ i ] ^= saltIn[ i ];
+	}
+	
+	int size = 0;
+	
+	return EVP_EncryptInit_ex( cipherIn, nullptr, nullptr, nullptr, iv ) == 1
+		&& EVP_EncryptUpdate( cipherIn, dataInOut, &size, dataInOut, (int)sizeIn ) == 1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+
+#include <openssl/evp.h>
+
+// SRTP/SRTCP (RFC 3711) with the one profile every browser offers, AES_CM_128_HMAC_SHA1_80. One context per
+// direction: the sending side protects our RTP, the receiving side opens the browser's RTCP feedback.
+// Replay protection is left out: a replayed PLI only costs an extra keyframe request, which is rate limited anyway.
+class CSrtpContext
+{
+public:
+	static const size_t 	k_masterKeySize		= 16;
+	static const size_t 	k_masterSaltSize	= 14;
+	static const size_t 	k_authTagSize		= 10;
+	static const size_t 	k_srtcpTrailerSize	= 4 + k_authTagSize;
+	
+	// Methods
+	CSrtpContext( const uint8_t *masterKeyIn, const uint8_t *masterSaltIn );
+	virtual ~CSrtpContext();
+	
+	// Encrypts an RTP packet in place and appends the auth tag: packetInOut needs k_authTagSize bytes of room after sizeIn
+	bool ProtectRtp( uint8_t *packetInOut, size_t sizeIn, size_t &sizeOut );
+	
+	// Authenticates and decrypts an SRTCP packet in place. False if it doesn't authenticate.
+	bool UnprotectRtcp( uint8_t *packetInOut, size_t sizeIn, size_t &sizeOut );
+
+private:
+	struct TSessionKeys
+	{
+		uint8_t 	m_cipherKey[ 16 ];
+		uint8_t 	m_authKey[ 20 ];
+		uint8_t 	m_salt[ 14 ];
+	};
+	
+	// Attributes
+	TSessionKeys 		m_rtpKeys;
+	TSessionKeys 		m_rtcpKeys;
+	EVP_CIPHER_CTX 		*m_pRtpCipher;
+	EVP_CIPHER_CTX 		*m_pRtcpCipher;
+	
+	// Rollover counter, extending the 16 bit sequence number into the 48 bit packet index
+	uint32_t 			m_rolloverCounter	= 0;
+	uint16_t 			m_lastSequence		= 0;
+	bool 				m_hasSentPacket		= false;
+	
+	// Methods
+	static void DeriveKeys( const uint8_t *masterKeyIn, const uint8_t *masterSaltIn, uint8_t firstLabelIn, TSessionKeys &keysOut );
+	static EVP_CIPHER_CTX* CreateCipher( const uint8_t *keyIn );
+	static bool Crypt( EVP_CIPHER_CTX *cipherIn, const uint8_t *saltIn, uint32_t ssrcIn, uint64_t indexIn, uint8_t *dataInOut, size_t sizeIn );
+};
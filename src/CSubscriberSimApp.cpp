@@ -0,0 +1,239 @@
+// Includes
+#include "CSubscriberSimApp.h"
+#include "CFragmentRouter.h"
+
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <memory>
+
+extern "C"
+{
+	// FFmpeg
+	#include <libavutil/time.h>
+}
+
+using namespace std;
+using namespace CpperoMQ;
+
+CSubscriberSimApp::CSubscriberSimApp( int argCountIn, char* argsIn[] )
+	: CApp( argCountIn, argsIn )
+	, m_stopConsumers( false )
+{
+}
+
+CSubscriberSimApp::~CSubscriberSimApp()
+{
+}
+
+void CSubscriberSimApp::Run()
+{
+	const std::vector<TConsumer> consumers =
+	{
+		{ "fast", 0.0, std::chrono::seconds( 0 ), std::chrono::seconds( 0 ) },
+		{ "half-rate", 0.5, std::chrono::seconds( 0 ), std::chrono::seconds( 0 ) },
+		{ "quarter-rate", 0.25, std::chrono::seconds( 0 ), std::chrono::seconds( 0 ) },
+		{ "stalls", 0.0, std::chrono::seconds( 3 ), std::chrono::seconds( 4 ) }
+	};
+	
+	std::vector<TResult> results( consumers.size() );
+	std::vector<TSubscriberStats> stats;
+	uint64_t produced = 0;
+	
+	{
+		// Binds before the consumers connect, as inproc requires
+		CFragmentRouter router( &m_context, k_endpoint );
+		std::vector<std::thread> threads;
+		
+		for( size_t i = 0; i < consumers.size(); ++i )
+		{
+			threads.push_back( std::thread( &CSubscriberSimApp::Consume, this, std::cref( consumers[ i ] ), std::ref( results[ i ] ) ) );
+		}
+		
+		// Let everyone subscribe before the first keyframe
+		std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+		
+		auto init = std::make_shared<TFragment>();
+		init->m_data.assign( 64, 0 );
+		init->m_isInit = true;
+		
+		router.OnInitSegment( init );
+		
+		auto start 		= std::chrono::steady_clock::now();
+		auto nextFrame 	= start;
+		
+		while( std::chrono::steady_clock::now() - start < k_duration )
+		{
+			bool isKeyframe = ( produced % k_gopLength ) == 0;
+			int64_t now 	= av_gettime();
+			
+			auto fragment = std::make_shared<TFragment>();
+			fragment->m_data.assign( isKeyframe ? k_keyframeSize : k_frameSize, 0x55 );
+			fragment->m_timestamp_us 	= now;
+			fragment->m_sequence 		= produced;
+			fragment->m_isKeyframe 		= isKeyframe;
+			
+			memcpy( fragment->m_data.data(), &produced, sizeof( produced ) );
+			memcpy( fragment->m_data.data() + 8, &now, sizeof( now ) );
+			fragment->m_data[ 16 ] = isKeyframe ? 1 : 0;
+			
+			router.OnFragment( fragment );
+			produced++;
+			
+			nextFrame += std::chrono::microseconds( 1000000 / k_framerate );
+			std::this_thread::sleep_until( nextFrame );
+		}
+		
+		// Give the fast subscriber time to drain before the counts are taken
+		std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+		
+		stats = router.GetSubscriberStats();
+		
+		m_stopConsumers = true;
+		
+		for( std::thread &thread : threads )
+		{
+			thread.join();
+		}
+	}
+	
+	double seconds = std::chrono::duration_cast<std::chrono::milliseconds>( k_duration ).count() / 1000.0;
+	
+	cout << "Produced " << produced << " fragments (" << k_framerate << " fps, GOP " << k_gopLength << ") over " << seconds << " s" << endl;
+	cout << std::left << std::setw( 14 ) << "subscriber" << std::right << std::setw( 10 ) << "received" << std::setw( 8 ) << "fps"
+		<< std::setw( 8 ) << "gaps" << std::setw( 8 ) << "broken" << std::setw( 10 ) << "dropped" << std::setw( 8 ) << "skips"
+		<< std::setw( 14 ) << "max latency" << endl;
+	
+	bool passed = true;
+	
+	for( size_t i = 0; i < consumers.size(); ++i )
+	{
+		const TResult &result = results[ i ];
+		TSubscriberStats routerStats;
+		
+		for( const TSubscriberStats &subscriber : stats )
+		{
+			if( subscriber.m_name == consumers[ i ].m_name )
+			{
+				routerStats = subscriber;
+			}
+		}
+		
+		passed = passed && result.m_gotInit && ( result.m_broken == 0 ) && ( result.m_fragments > 0 );
+		
+		cout << std::left << std::setw( 14 ) << consumers[ i ].m_name << std::right << std::setw( 10 ) << result.m_fragments
+			<< std::fixed << std::setprecision( 1 ) << std::setw( 8 ) << ( result.m_fragments / seconds )
+			<< std::setw( 8 ) << result.m_gaps << std::setw( 8 ) << result.m_broken
+			<< std::setw( 10 ) << routerStats.m_fragmentsDropped << std::setw( 8 ) << routerStats.m_skips
+			<< std::setw( 11 ) << ( result.m_maxLatency_us / 1000 ) << " ms" << endl;
+	}
+	
+	if( !passed )
+	{
+		throw std::runtime_error( "A subscriber received a broken GOP" );
+	}
+	
+	cout << "No subscriber received a fragment without its predecessors" << endl;
+}
+
+void CSubscriberSimApp::Consume( const TConsumer &consumerIn, TResult &resultOut )
+{
+	try
+	{
+		DealerSocket dealer = m_context.createDealerSocket();
+		
+		// Keep ZMQ's own buffering small, so a slow reader pushes back on the router's queue quickly
+		int highWaterMark = 2;
+		zmq_setsockopt( static_cast<void*>( dealer ), ZMQ_RCVHWM, &highWaterMark, sizeof( highWaterMark ) );
+		
+		dealer.setLinger( 0 );
+		dealer.connect( k_endpoint.c_str() );
+		
+		OutgoingMessage subscribe( "subscribe" );
+		OutgoingMessage name( consumerIn.m_name );
+		
+		subscribe.send( dealer, true );
+		name.send( dealer, false );
+		
+		double streamBytesPerSecond = (double)( k_keyframeSize + ( k_gopLength - 1 ) * k_frameSize ) * k_framerate / k_gopLength;
+		
+		auto start 				= std::chrono::steady_clock::now();
+		uint64_t lastSequence 	= 0;
+		bool hasSequence 		= false;
+		
+		while( !m_stopConsumers )
+		{
+			auto elapsed = std::chrono::steady_clock::now() - start;
+			
+			if( elapsed >= consumerIn.m_stallStart && elapsed < consumerIn.m_stallStart + consumerIn.m_stallLength )
+			{
+				std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+				continue;
+			}
+			
+			zmq_pollitem_t item = { static_cast<void*>( dealer ), 0, ZMQ_POLLIN, 0 };
+			
+			if( zmq_poll( &item, 1, 100 ) <= 0 || !( item.revents & ZMQ_POLLIN ) )
+			{
+				continue;
+			}
+			
+			IncomingMessage topic;
+			IncomingMessage payload;
+			bool more = false;
+			
+			if( !topic.receive( dealer, more ) || !more || !payload.receive( dealer, more ) )
+			{
+				continue;
+			}
+			
+			if( topic.size() == 1 && topic.charData()[ 0 ] == 'i' )
+			{
+				resultOut.m_gotInit = true;
+				continue;
+			}
+			
+			if( payload.size() < k_headerSize )
+			{
+				continue;
+			}
+			
+			uint64_t sequence;
+			int64_t captureTime;
+			const uint8_t *data = (const uint8_t*)payload.data();
+			
+			memcpy( &sequence, data, sizeof( sequence ) );
+			memcpy( &captureTime, data + 8, sizeof( captureTime ) );
+			bool isKeyframe = ( data[ 16 ] != 0 );
+			
+			resultOut.m_fragments++;
+			resultOut.m_maxLatency_us 	= std::max( resultOut.m_maxLatency_us, av_gettime() - captureTime );
+			
+			// The first fragment must be a keyframe, as must any that follows a gap
+			if( !hasSequence || sequence != lastSequence + 1 )
+			{
+				resultOut.m_gaps 	+= hasSequence ? 1 : 0;
+				resultOut.m_broken 	+= isKeyframe ? 0 : 1;
+			}
+			
+			lastSequence 	= sequence;
+			hasSequence 	= true;
+			
+			// Simulated decode/network time for a reader limited to a share of the stream bitrate
+			if( consumerIn.m_rateFactor > 0.0 )
+			{
+				std::this_thread::sleep_for( std::chrono::microseconds( (int64_t)( payload.size() / ( streamBytesPerSecond * consumerIn.m_rateFactor ) * 1000000.0 ) ) );
+			}
+		}
+		
+		OutgoingMessage unsubscribe( "unsubscribe" );
+		unsubscribe.send( dealer, false );
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Simulated subscriber " << consumerIn.m_name << " failed: " << e.what() << endl;
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// Includes
+#include <CpperoMQ/All.hpp>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+#include "CApp.h"
+
+// Drives a CFragmentRouter with a synthetic 30fps stream and several simulated subscribers: one that keeps up, two that can
+// only read at a fraction of the stream's bitrate, and one that stops reading for a while. Reports what each received and
+// checks that none of them ever got a fragment whose predecessor was dropped, unless it was a keyframe.
+class CSubscriberSimApp : public CApp
+{
+public:
+	// Methods
+	CSubscriberSimApp( int argCountIn, char* argsIn[] );
+	virtual ~CSubscriberSimApp();
+	
+	virtual void Run();
+
+private:
+	struct TConsumer
+	{
+		const char 				*m_name;
+		double 					m_rateFactor;		// Share of the stream bitrate it can read, 0 for unlimited
+		std::chrono::seconds 	m_stallStart;		// Stops reading for m_stallLength from here
+		std::chrono::seconds 	m_stallLength;
+	};
+	
+	struct TResult
+	{
+		uint64_t 		m_fragments			= 0;
+		uint64_t 		m_gaps				= 0;		// Times the sequence jumped
+		uint64_t 		m_broken			= 0;		// Jumps that didn't land on a keyframe: a viewer would show corruption
+		int64_t 		m_maxLatency_us		= 0;
+		bool 			m_gotInit			= false;
+	};
+	
+	// Attributes
+	CpperoMQ::Context 		m_context;
+	std::atomic<bool> 		m_stopConsumers;
+	
+	const std::string 		k_endpoint				= "inproc://subscriber-sim";
+	const std::chrono::seconds k_duration			= std::chrono::seconds( 12 );
+	const int 				k_framerate				= 30;
+	const int 				k_gopLength				= 30;
+	const size_t 			k_keyframeSize			= 80 * 1024;
+	const size_t 			k_frameSize				= 10 * 1024;
+	const size_t 			k_headerSize			= 17;		// Sequence, capture time and keyframe flag at the start of each payload
+	
+	// Methods
+	void Consume( const TConsumer &consumerIn, TResult &resultOut );
+};
@@ -0,0 +1,78 @@
+// Includes
+#include "CTaskQueue.h"
+#include <iostream>
+
+using namespace std;
+
+CTaskQueue::CTaskQueue()
+	: m_killThread( false )
+{
+	m_thread = std::thread( &CTaskQueue::ThreadLoop, this );
+}
+
+CTaskQueue::~CTaskQueue()
+{
+	{
+		// Under the lock, or the thread can test the predicate, miss the notify and never wake
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_killThread = true;
+	}
+	
+	try
+	{
+		// Pending tasks are still run before the thread exits
+		m_taskAvailableCondition.notify_one();
+		m_thread.join();
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error cleaning up CTaskQueue: " << e.what() << endl;
+	}
+}
+
+void CTaskQueue::Post( std::function<void()> taskIn )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_tasks.push_back( std::move( taskIn ) );
+	}
+	
+	m_taskAvailableCondition.notify_one();
+}
+
+size_t CTaskQueue::GetPendingCount()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	return m_tasks.size();
+}
+
+void CTaskQueue::ThreadLoop()
+{
+	while( true )
+	{
+		std::function<void()> task;
+		
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			
+			m_taskAvailableCondition.wait( lock, [this](){ return m_killThread || !m_tasks.empty(); } );
+			
+			if( m_tasks.empty() )
+			{
+				return;
+			}
+			
+			task = std::move( m_tasks.front() );
+			m_tasks.pop_front();
+		}
+		
+		try
+		{
+			task();
+		}
+		catch( const std::exception &e )
+		{
+			cerr << "Background task failed: " << e.what() << endl;
+		}
+	}
+}
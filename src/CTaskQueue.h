@@ -0,0 +1,32 @@
+#pragma once
+
+// Includes
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+
+// Runs file jobs (buffer dumps, exports, ...) one at a time on a background thread, off the live path
+class CTaskQueue
+{
+public:
+	// Methods
+	CTaskQueue();
+	virtual ~CTaskQueue();
+	
+	void Post( std::function<void()> taskIn );
+	size_t GetPendingCount();
+
+private:
+	// Attributes
+	std::thread 						m_thread;
+	std::mutex 							m_mutex;
+	std::condition_variable 			m_taskAvailableCondition;
+	std::deque<std::function<void()>> 	m_tasks;
+	std::atomic<bool> 					m_killThread;
+	
+	// Methods
+	void ThreadLoop();
+};
@@ -0,0 +1,150 @@
+// Includes
+#include "CTelemetrySubscriber.h"
+
+#include <iostream>
+#include <stdexcept>
+
+extern "C" 
+{ 
+	// FFmpeg
+	#include <libavutil/time.h>
+}
+
+using namespace std;
+using namespace CpperoMQ;
+
+CTelemetrySubscriber::CTelemetrySubscriber( CpperoMQ::Context *contextIn )
+	: m_isRunning( false )
+	, m_samplesReceived( 0 )
+	, m_samplesDropped( 0 )
+	, m_samples( k_queueCapacity )
+	, m_pContext( contextIn )
+	, m_sub( m_pContext->createSubscribeSocket() )
+	, m_killThread( false )
+{
+}
+
+CTelemetrySubscriber::~CTelemetrySubscriber()
+{
+	try
+	{
+		Stop();
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Error cleaning up CTelemetrySubscriber: " << e.what() << endl;
+	}
+}
+
+void CTelemetrySubscriber::Start( const std::string &endpointIn, const std::vector<std::string> &topicsIn )
+{
+	Stop();
+	
+	// Fresh socket for each endpoint. It is only used from the subscriber thread once that starts.
+	m_sub = m_pContext->createSubscribeSocket();
+	m_sub.setLinger( 0 );
+	m_sub.connect( endpointIn.c_str() );
+	
+	if( topicsIn.empty() )
+	{
+		m_sub.subscribe();
+	}
+	
+	for( auto &topic : topicsIn )
+	{
+		m_sub.subscribe( topic.c_str() );
+	}
+	
+	m_samplesReceived 	= 0;
+	m_samplesDropped 	= 0;
+	m_killThread 		= false;
+	m_isRunning 		= true;
+	
+	m_thread = std::thread( &CTelemetrySubscriber::ThreadLoop, this );
+}
+
+void CTelemetrySubscriber::Stop()
+{
+	m_killThread = true;
+	
+	if( m_thread.joinable() )
+	{
+		m_thread.join();
+	}
+	
+	m_isRunning = false;
+}
+
+void CTelemetrySubscriber::ThreadLoop()
+{
+	while( !m_killThread )
+	{
+		try
+		{
+			// Poll with a timeout so Stop() is noticed
+			zmq_pollitem_t items[] = { { static_cast<void*>( m_sub ), 0, ZMQ_POLLIN, 0 } };
+			
+			if( zmq_poll( items, 1, k_pollTimeout_ms ) <= 0 || !( items[ 0 ].revents & ZMQ_POLLIN ) )
+			{
+				continue;
+			}
+			
+			TTelemetrySample sample;
+			
+			if( !ReceiveSample( sample ) )
+			{
+				continue;
+			}
+			
+			m_samplesReceived++;
+			
+			// Never wait on the recorder. If it isn't keeping up (or isn't recording), the newest samples are lost.
+			if( !m_samples.TryPush( std::move( sample ) ) )
+			{
+				m_samplesDropped++;
+			}
+		}
+		catch( const std::exception &e )
+		{
+			cerr << "Error receiving telemetry: " << e.what() << endl;
+		}
+	}
+}
+
+bool CTelemetrySubscriber::ReceiveSample( TTelemetrySample &sampleOut )
+{
+	IncomingMessage first;
+	bool more = false;
+	
+	if( !first.receive( m_sub, more ) )
+	{
+		return false;
+	}
+	
+	// Stamp as early as possible, on the muxer's clock
+	sampleOut.m_timestamp_us = av_gettime();
+	
+	if( !more )
+	{
+		// Single frame message, topic and payload together
+		sampleOut.m_payload.assign( first.charData(), first.size() );
+		return true;
+	}
+	
+	// Multipart: topic frame, then the payload
+	sampleOut.m_topic.assign( first.charData(), first.size() );
+	
+	while( more )
+	{
+		IncomingMessage part;
+		
+		if( !part.receive( m_sub, more ) )
+		{
+			return false;
+		}
+		
+		sampleOut.m_payload.append( part.charData(), part.size() );
+	}
+	
+	return true;
+}
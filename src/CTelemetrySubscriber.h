@@ -0,0 +1,54 @@
+#pragma once
+
+// Includes
+#include <CpperoMQ/All.hpp>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "CSpscQueue.h"
+
+struct TTelemetrySample
+{
+	int64_t 		m_timestamp_us	= 0;		// Arrival time on the same clock as TFragment::m_timestamp_us
+	std::string 	m_topic;
+	std::string 	m_payload;
+};
+
+// Subscribes to a telemetry publisher and timestamps each sample on arrival, for the recorder to interleave with video
+class CTelemetrySubscriber
+{
+public:
+	// Attributes
+	std::atomic<bool> 					m_isRunning;
+	std::atomic<uint64_t> 				m_samplesReceived;
+	std::atomic<uint64_t> 				m_samplesDropped;
+	
+	// Filled by the subscriber thread. The only consumer is the recorder's writer thread.
+	CSpscQueue<TTelemetrySample> 		m_samples;
+	
+	// Methods
+	CTelemetrySubscriber( CpperoMQ::Context *contextIn );
+	virtual ~CTelemetrySubscriber();
+	
+	// An empty topic list subscribes to everything
+	void Start( const std::string &endpointIn, const std::vector<std::string> &topicsIn );
+	void Stop();
+
+private:
+	// Attributes
+	CpperoMQ::Context 					*m_pContext;
+	CpperoMQ::SubscribeSocket 			m_sub;
+	
+	std::thread 						m_thread;
+	std::atomic<bool> 					m_killThread;
+	
+	static const size_t 				k_queueCapacity		= 4096;
+	const long 							k_pollTimeout_ms	= 100;
+	
+	// Methods
+	void ThreadLoop();
+	bool ReceiveSample( TTelemetrySample &sampleOut );
+};
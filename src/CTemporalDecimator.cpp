@@ -0,0 +1,117 @@
+// Includes
+#include "CTemporalDecimator.h"
+#include "H264.h"
+
+#include <stdexcept>
+
+CTemporalDecimator::CTemporalDecimator()
+	: m_framesKept( 0 )
+	, m_framesDropped( 0 )
+{
+}
+
+CTemporalDecimator::~CTemporalDecimator()
+{
+}
+
+void CTemporalDecimator::Configure( uint32_t hierarchyLevelsIn, uint32_t divisorIn )
+{
+	uint32_t droppedLayers = 0;
+	
+	while( ( 1u << droppedLayers ) < divisorIn )
+	{
+		droppedLayers++;
+	}
+	
+	if( divisorIn == 0 || ( 1u << droppedLayers ) != divisorIn )
+	{
+		throw std::runtime_error( "Divisor must be a power of two" );
+	}
+	
+	if( droppedLayers > hierarchyLevelsIn )
+	{
+		throw std::runtime_error( "Divisor needs a GOP hierarchy level of at least " + std::to_string( droppedLayers ) );
+	}
+	
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	m_hierarchyLevels 		= hierarchyLevelsIn;
+	m_droppedLayers 		= droppedLayers;
+	
+	// The position count is only meaningful from an IDR onwards
+	m_waitingForKeyframe 	= true;
+	m_keepingPicture 		= false;
+}
+
+bool CTemporalDecimator::ShouldKeep( const uint8_t *dataIn, size_t sizeIn )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	const uint8_t *end 		= dataIn + sizeIn;
+	const uint8_t *cursor 	= dataIn;
+	h264::TNalUnit nal;
+	bool hasVcl = false;
+	
+	while( h264::NextNalUnit( cursor, end, nal ) )
+	{
+		if( !nal.IsVCL() )
+		{
+			continue;
+		}
+		
+		hasVcl = true;
+		
+		if( !h264::IsFirstSliceOfPicture( nal ) )
+		{
+			// Remaining slices of the current picture
+			break;
+		}
+		
+		if( nal.GetType() == h264::NAL_IDR_SLICE )
+		{
+			m_position 				= 0;
+			m_waitingForKeyframe 	= false;
+			m_keepingPicture 		= true;
+		}
+		else if( m_waitingForKeyframe )
+		{
+			m_keepingPicture = false;
+		}
+		else
+		{
+			m_position++;
+			
+			uint32_t period = 1u << m_hierarchyLevels;
+			uint32_t layer 	= 0;
+			
+			if( m_position % period != 0 )
+			{
+				// Trailing zero count of the position within the period
+				uint32_t zeros = 0;
+				
+				while( ( ( m_position >> zeros ) & 1 ) == 0 )
+				{
+					zeros++;
+				}
+				
+				layer = m_hierarchyLevels - zeros;
+			}
+			
+			m_keepingPicture = ( layer + m_droppedLayers <= m_hierarchyLevels ) && ( m_droppedLayers == 0 || nal.GetRefIdc() != 0 );
+		}
+		
+		if( m_keepingPicture )
+		{
+			m_framesKept++;
+		}
+		else
+		{
+			m_framesDropped++;
+		}
+		
+		break;
+	}
+	
+	// Parameter sets and SEI arriving in their own callbacks are passed through, the decoder needs them for the next IDR
+	return hasVcl ? m_keepingPicture : true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <atomic>
+
+// Picks the frames of a hierarchical-P H264 stream that make up its lower temporal layers, without decoding.
+// With a hierarchy of L levels the reference structure repeats every 2^L frames after an IDR, and the frame at
+// position p belongs to layer L - ctz(p) (layer 0 for p % 2^L == 0). Keeping layers 0..K gives 1 / 2^(L-K) of the framerate.
+// Non-reference pictures (nal_ref_idc == 0) are never needed by other frames and are dropped whenever any decimation is on.
+class CTemporalDecimator
+{
+public:
+	// Attributes
+	std::atomic<uint64_t> 		m_framesKept;
+	std::atomic<uint64_t> 		m_framesDropped;
+	
+	// Methods
+	CTemporalDecimator();
+	virtual ~CTemporalDecimator();
+	
+	// divisorIn must be a power of two no greater than 2^hierarchyLevelsIn
+	void Configure( uint32_t hierarchyLevelsIn, uint32_t divisorIn );
+	
+	// Called from the video callback for every buffer. Buffers continuing a picture follow the decision for its first slice,
+	// buffers without slices are always kept.
+	bool ShouldKeep( const uint8_t *dataIn, size_t sizeIn );
+
+private:
+	// Attributes
+	std::mutex 					m_mutex;
+	uint32_t 					m_hierarchyLevels		= 0;
+	uint32_t 					m_droppedLayers			= 0;
+	
+	uint32_t 					m_position				= 0;	// Frames since the last IDR
+	bool 						m_keepingPicture		= false;
+	bool 						m_waitingForKeyframe	= true;
+};
@@ -0,0 +1,42 @@
+// Includes
+#include "CTokenBucket.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+CTokenBucket::CTokenBucket( uint64_t rate_bpsIn, size_t depthBytesIn )
+	: m_rate_bps( rate_bpsIn )
+	, m_depth( (double)depthBytesIn )
+	, m_tokens( (double)depthBytesIn )
+	, m_lastRefill( TClock::now() )
+{
+	if( rate_bpsIn == 0 || depthBytesIn == 0 )
+	{
+		throw std::runtime_error( "Token bucket needs a non-zero rate and depth" );
+	}
+}
+
+std::chrono::microseconds CTokenBucket::TryConsume( size_t sizeIn, TClock::time_point nowIn )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	
+	if( nowIn > m_lastRefill )
+	{
+		double elapsed_s = std::chrono::duration<double>( nowIn - m_lastRefill ).count();
+		
+		m_tokens 		= std::min( m_depth, m_tokens + elapsed_s * m_rate_bps / 8.0 );
+		m_lastRefill 	= nowIn;
+	}
+	
+	double needed = std::min( (double)sizeIn, m_depth );
+	
+	if( m_tokens >= needed )
+	{
+		m_tokens -= (double)sizeIn;
+		return std::chrono::microseconds( 0 );
+	}
+	
+	// Never zero, or the caller would spin
+	return std::chrono::microseconds( std::max<int64_t>( 1, (int64_t)std::ceil( ( needed - m_tokens ) * 8.0 * 1000000.0 / m_rate_bps ) ) );
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+
+// Pacing delay statistics, shared by every paced output
+struct TPacingStats
+{
+	std::atomic<uint64_t> 	m_packetsPaced;
+	std::atomic<uint64_t> 	m_packetsDelayed;			// Had to wait for tokens at all
+	std::atomic<uint64_t> 	m_packetsDropped;			// Didn't fit the queue, or the socket refused them
+	std::atomic<uint64_t> 	m_totalDelay_us;
+	std::atomic<uint64_t> 	m_maxDelay_us;
+	
+	TPacingStats() : m_packetsPaced( 0 ), m_packetsDelayed( 0 ), m_packetsDropped( 0 ), m_totalDelay_us( 0 ), m_maxDelay_us( 0 ){}
+	
+	void Record( uint64_t delay_usIn, bool wasHeldIn )
+	{
+		m_packetsPaced++;
+		m_packetsDelayed 	+= wasHeldIn ? 1 : 0;
+		m_totalDelay_us 	+= delay_usIn;
+		
+		// Only ever written by the one sending thread
+		if( delay_usIn > m_maxDelay_us )
+		{
+			m_maxDelay_us = delay_usIn;
+		}
+	}
+	
+	void Reset()
+	{
+		m_packetsPaced 		= 0;
+		m_packetsDelayed 	= 0;
+		m_packetsDropped 	= 0;
+		m_totalDelay_us 	= 0;
+		m_maxDelay_us 		= 0;
+	}
+};
+
+// Rate limiter for network outputs. Tokens are bytes, refilled at the peak rate up to the bucket depth, so at most one
+// bucket's worth goes out back to back however long the output was idle. A send larger than the whole bucket waits for
+// a full bucket and then leaves it in debt, which keeps the average rate right.
+//
+// Thread safe, so outputs on different threads can share one bucket and with it one peak rate.
+class CTokenBucket
+{
+public:
+	typedef std::chrono::steady_clock TClock;
+	
+	// Methods
+	CTokenBucket( uint64_t rate_bpsIn, size_t depthBytesIn );
+	
+	// Zero if sizeIn bytes may go now, in which case they are taken from the bucket. Otherwise how long until they may.
+	std::chrono::microseconds TryConsume( size_t sizeIn, TClock::time_point nowIn );
+	
+	uint64_t GetRate() const { return m_rate_bps; }
+
+private:
+	// Attributes
+	std::mutex 			m_mutex;
+	uint64_t 			m_rate_bps;
+	double 				m_depth;
+	double 				m_tokens;
+	TClock::time_point 	m_lastRefill;
+};
@@ -0,0 +1,424 @@
+// Includes
+#include "CTsMulticastOutput.h"
+#include "Utility.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <random>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+CTsMulticastOutput::CTsMulticastOutput()
+	: m_isRunning( false )
+	, m_datagramsSent( 0 )
+	, m_bytesSent( 0 )
+	, m_framesDropped( 0 )
+	, m_framesSkipped( 0 )
+	, m_fecPacketsSent( 0 )
+	, m_killThread( false )
+{
+}
+
+CTsMulticastOutput::~CTsMulticastOutput()
+{
+	Stop();
+}
+
+void CTsMulticastOutput::Start( const TTsMulticastConfig &configIn )
+{
+	if( m_thread.joinable() )
+	{
+		throw std::runtime_error( "Multicast output already running" );
+	}
+	
+	if( configIn.m_maxRate_bps == 0 || configIn.m_maxBurstBytes == 0 )
+	{
+		throw std::runtime_error( "Pacing rate and burst size must be non-zero" );
+	}
+	
+	if( configIn.m_fecColumns != 0 && configIn.m_port > 65535 - 4 )
+	{
+		throw std::runtime_error( "No room for the FEC ports above port " + std::to_string( configIn.m_port ) );
+	}
+	
+	m_config = configIn;
+	m_pBucket = util::make_unique<CTokenBucket>( m_config.m_maxRate_bps, m_config.m_maxBurstBytes );
+	m_pFecEncoder.reset();
+	m_pacingStats.Reset();
+	
+	if( m_config.m_fecColumns != 0 )
+	{
+		// Validates the matrix size
+		m_pFecEncoder = util::make_unique<CFecEncoder>( m_config.m_fecColumns, m_config.m_fecRows, m_config.m_fecRowPackets );
+		
+		std::random_device random;
+		m_rtpSequence 	= (uint16_t)random();
+		m_rtpSsrc 		= random();
+	}
+	
+	try
+	{
+		m_socket = OpenSocket( m_config.m_port );
+		
+		if( m_pFecEncoder )
+		{
+			m_columnFecSocket = OpenSocket( m_config.m_port + 2 );
+			
+			if( m_config.m_fecRowPackets )
+			{
+				m_rowFecSocket = OpenSocket( m_config.m_port + 4 );
+			}
+		}
+	}
+	catch( const std::exception & )
+	{
+		CloseSockets();
+		throw;
+	}
+	
+	m_datagramsSent 	= 0;
+	m_bytesSent 		= 0;
+	m_framesDropped 	= 0;
+	m_framesSkipped 	= 0;
+	m_fecPacketsSent 	= 0;
+	m_needKeyframe 		= true;
+	m_packetizer.Reset();
+	
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_queue.clear();
+		m_queuedBytes = 0;
+	}
+	
+	m_killThread 	= false;
+	m_isRunning 	= true;
+	
+	m_thread = std::thread( &CTsMulticastOutput::ThreadLoop, this );
+	
+	if( m_pFecEncoder )
+	{
+		cout << "Sending MPEG-TS to rtp://" << m_config.m_address << ":" << m_config.m_port << " with "
+			<< (int)m_config.m_fecColumns << "x" << (int)m_config.m_fecRows << ( m_config.m_fecRowPackets ? " 2D" : " 1D" ) << " FEC" << endl;
+	}
+	else
+	{
+		cout << "Sending MPEG-TS to udp://" << m_config.m_address << ":" << m_config.m_port << endl;
+	}
+}
+
+void CTsMulticastOutput::Stop()
+{
+	if( !m_thread.joinable() )
+	{
+		return;
+	}
+	
+	m_isRunning 	= false;
+	m_killThread 	= true;
+	
+	m_dataAvailableCondition.notify_one();
+	m_thread.join();
+	
+	CloseSockets();
+	
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_queue.clear();
+	m_queuedBytes = 0;
+}
+
+int CTsMulticastOutput::OpenSocket( uint16_t portIn )
+{
+	sockaddr_in destination;
+	memset( &destination, 0, sizeof( destination ) );
+	destination.sin_family 	= AF_INET;
+	destination.sin_port 	= htons( portIn );
+	
+	if( inet_pton( AF_INET, m_config.m_address.c_str(), &destination.sin_addr ) != 1 || !IN_MULTICAST( ntohl( destination.sin_addr.s_addr ) ) )
+	{
+		throw std::runtime_error( "Not an IPv4 multicast address: " + m_config.m_address );
+	}
+	
+	int fd = socket( AF_INET, SOCK_DGRAM, 0 );
+	
+	if( fd < 0 )
+	{
+		throw std::runtime_error( "Failed to create multicast socket: " + std::string( strerror( errno ) ) );
+	}
+	
+	int ttl 		= m_config.m_ttl;
+	int loop 		= 1;		// Lets viewers on the same host, and loopback tests, receive it
+	int bufferSize 	= 1024 * 1024;
+	
+	setsockopt( fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof( ttl ) );
+	setsockopt( fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof( loop ) );
+	setsockopt( fd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof( bufferSize ) );
+	
+	if( !m_config.m_interface.empty() )
+	{
+		in_addr interface;
+		
+		if( inet_pton( AF_INET, m_config.m_interface.c_str(), &interface ) != 1
+			|| setsockopt( fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof( interface ) ) != 0 )
+		{
+			close( fd );
+			
+			throw std::runtime_error( "Invalid multicast interface: " + m_config.m_interface );
+		}
+	}
+	
+	// Connected, so every send goes to the group without an address per message
+	if( connect( fd, (sockaddr*)&destination, sizeof( destination ) ) != 0 )
+	{
+		std::string error( strerror( errno ) );
+		
+		close( fd );
+		
+		throw std::runtime_error( "Failed to connect multicast socket: " + error );
+	}
+	
+	return fd;
+}
+
+void CTsMulticastOutput::CloseSockets()
+{
+	for( int *fd : { &m_socket, &m_columnFecSocket, &m_rowFecSocket } )
+	{
+		if( *fd >= 0 )
+		{
+			close( *fd );
+			*fd = -1;
+		}
+	}
+}
+
+void CTsMulticastOutput::Write( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool isFrameStartIn )
+{
+	if( !m_isRunning )
+	{
+		return;
+	}
+	
+	size_t inputSize = 0;
+	
+	for( size_t i = 0; i < segmentCountIn; ++i )
+	{
+		inputSize += segmentsIn[ i ].m_size;
+	}
+	
+	bool isQueueFull = false;
+	
+	{
+		// Decided before packetizing, so nothing dropped uses up continuity counters. The packets only add their headers.
+		std::lock_guard<std::mutex> lock( m_mutex );
+		isQueueFull = ( m_queuedBytes + inputSize > m_config.m_maxQueuedBytes );
+	}
+	
+	if( isQueueFull )
+	{
+		// Count each frame once, whether it was cut short or lost whole
+		if( isFrameStartIn || !m_needKeyframe )
+		{
+			m_framesDropped++;
+		}
+		
+		m_needKeyframe = true;
+		return;
+	}
+	
+	// After a drop, viewers can only resume at an IDR
+	auto packets = std::make_shared<std::vector<uint8_t>>();
+	const uint64_t skipped = m_packetizer.m_accessUnitsSkipped;
+	
+	m_packetizer.Packetize( segmentsIn, segmentCountIn, isFrameStartIn, *packets, m_needKeyframe );
+	
+	m_framesSkipped += m_packetizer.m_accessUnitsSkipped - skipped;
+	
+	if( packets->empty() )
+	{
+		// Skipped, or held until the access unit's first slice
+		return;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		
+		m_needKeyframe = false;
+		m_queuedBytes += packets->size();
+		m_queue.push_back( packets );
+	}
+	
+	m_dataAvailableCondition.notify_one();
+}
+
+void CTsMulticastOutput::ThreadLoop()
+{
+	while( !m_killThread )
+	{
+		TPacketsPtr packets;
+		
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			
+			m_dataAvailableCondition.wait( lock, [this](){ return m_killThread || !m_queue.empty(); } );
+			
+			if( m_queue.empty() )
+			{
+				continue;
+			}
+			
+			packets = m_queue.front();
+			m_queue.pop_front();
+			m_queuedBytes -= packets->size();
+		}
+		
+		Send( *packets );
+	}
+}
+
+void CTsMulticastOutput::Send( const std::vector<uint8_t> &packetsIn )
+{
+	const size_t datagramSize 	= k_packetsPerDatagram * CTsPacketizer::k_packetSize;
+	const bool isRtp 			= ( m_pFecEncoder != nullptr );
+	const auto frameStart 		= CTokenBucket::TClock::now();
+	bool wasHeld 				= false;
+	size_t offset 				= 0;
+	
+	while( offset < packetsIn.size() && !m_killThread )
+	{
+		// Up to k_datagramsPerBatch datagrams per system call. The last datagram of a frame may be short.
+		mmsghdr messages[ k_datagramsPerBatch ];
+		iovec parts[ k_datagramsPerBatch ][ 2 ];
+		uint8_t rtpHeaders[ k_datagramsPerBatch ][ fec::k_rtpHeaderSize ];
+		size_t count = 0;
+		size_t batchBytes = 0;
+		
+		memset( messages, 0, sizeof( messages ) );
+		m_fecPackets.clear();
+		
+		// RFC 2250: the timestamp is the transmission time, on a 90kHz clock
+		const uint32_t timestamp = (uint32_t)( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() * 9 / 100 );
+		
+		while( count < k_datagramsPerBatch && offset < packetsIn.size() )
+		{
+			const uint8_t *payload 	= packetsIn.data() + offset;
+			size_t size 			= std::min( datagramSize, packetsIn.size() - offset );
+			size_t partCount 		= 0;
+			
+			if( isRtp )
+			{
+				fec::WriteRtpHeader( rtpHeaders[ count ], fec::k_mediaPayloadType, m_rtpSequence, timestamp, m_rtpSsrc );
+				m_pFecEncoder->Add( m_rtpSequence, timestamp, payload, size, m_fecPackets );
+				m_rtpSequence++;
+				
+				parts[ count ][ partCount ].iov_base 	= rtpHeaders[ count ];
+				parts[ count ][ partCount ].iov_len 	= fec::k_rtpHeaderSize;
+				partCount++;
+				
+				batchBytes += fec::k_rtpHeaderSize;
+			}
+			
+			parts[ count ][ partCount ].iov_base 	= (void*)payload;
+			parts[ count ][ partCount ].iov_len 	= size;
+			partCount++;
+			
+			messages[ count ].msg_hdr.msg_iov 		= parts[ count ];
+			messages[ count ].msg_hdr.msg_iovlen 	= partCount;
+			
+			offset 		+= size;
+			batchBytes 	+= size;
+			count++;
+		}
+		
+		for( const TFecPacket &packet : m_fecPackets )
+		{
+			batchBytes += packet.m_data.size();
+		}
+		
+		wasHeld = Pace( batchBytes ) || wasHeld;
+		
+		uint64_t delay_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>( CTokenBucket::TClock::now() - frameStart ).count();
+		size_t sent = 0;
+		
+		while( sent < count )
+		{
+			int result = sendmmsg( m_socket, messages + sent, count - sent, 0 );
+			
+			if( result < 0 )
+			{
+				if( errno == EINTR )
+				{
+					continue;
+				}
+				
+				// Nobody listening (ECONNREFUSED) or no route: not worth stopping the output over
+				break;
+			}
+			
+			for( int i = 0; i < result; ++i )
+			{
+				m_bytesSent += messages[ sent + i ].msg_len;
+			}
+			
+			m_datagramsSent += result;
+			sent 			+= result;
+		}
+		
+		for( size_t i = 0; i < count; ++i )
+		{
+			if( i < sent )
+			{
+				m_pacingStats.Record( delay_us, wasHeld );
+			}
+			else
+			{
+				m_pacingStats.m_packetsDropped++;
+			}
+		}
+		
+		SendFec();
+	}
+}
+
+void CTsMulticastOutput::SendFec()
+{
+	// At most a few per batch, so plain sends will do
+	for( const TFecPacket &packet : m_fecPackets )
+	{
+		ssize_t result = send( packet.m_isRow ? m_rowFecSocket : m_columnFecSocket, packet.m_data.data(), packet.m_data.size(), 0 );
+		
+		if( result > 0 )
+		{
+			m_fecPacketsSent++;
+			m_bytesSent += result;
+		}
+	}
+}
+
+bool CTsMulticastOutput::Pace( size_t bytesIn )
+{
+	// Each batch waits for its share of the rate ceiling. Idle time only earns one bucket's worth of burst.
+	bool waited = false;
+	
+	while( !m_killThread )
+	{
+		std::chrono::microseconds wait = m_pBucket->TryConsume( bytesIn, CTokenBucket::TClock::now() );
+		
+		if( wait.count() == 0 )
+		{
+			break;
+		}
+		
+		std::this_thread::sleep_for( wait );
+		waited = true;
+	}
+	
+	return waited;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <memory>
+
+#include "CVideoBuffer.h"
+#include "CTsPacketizer.h"
+#include "CFecEncoder.h"
+#include "CTokenBucket.h"
+
+struct TTsMulticastConfig
+{
+	std::string 	m_address;								// Multicast group
+	uint16_t 		m_port					= 5004;
+	uint8_t 		m_ttl					= 1;
+	std::string 	m_interface;							// Local address of the outgoing interface. Empty for the default route.
+	uint32_t 		m_maxRate_bps			= 20000000;		// Pacing ceiling, comfortably above the stream's peak bitrate
+	size_t 			m_maxBurstBytes			= 32 * 1024;		// Most sent back to back, however long the output was idle
+	size_t 			m_maxQueuedBytes		= 4 * 1024 * 1024;	// Frames beyond this are dropped, never waited on
+	
+	// SMPTE 2022-1 FEC matrix. Column FEC goes to port + 2, row FEC to port + 4. FEC needs sequence numbers, so when
+	// it's enabled the TS datagrams are sent as RTP (RFC 2250) instead of plain UDP.
+	uint8_t 		m_fecColumns			= 0;				// L. 0 disables FEC.
+	uint8_t 		m_fecRows				= 10;				// D
+	bool 			m_fecRowPackets			= true;				// Row FEC as well as column FEC (2D)
+};
+
+// MPEG-TS over UDP multicast, so any number of topside viewers share one copy of the stream on the tether.
+// Frames are packetized on the video callback and sent from a sender thread in 7 x 188 byte datagrams, batched
+// with sendmmsg and paced so an IDR doesn't go out as a single burst. Optional XOR FEC lets viewers rebuild
+// packets lost on the tether without a retransmission round trip.
+class CTsMulticastOutput
+{
+public:
+	// Attributes
+	std::atomic<bool> 		m_isRunning;
+	
+	std::atomic<uint64_t> 	m_datagramsSent;
+	std::atomic<uint64_t> 	m_bytesSent;
+	std::atomic<uint64_t> 	m_framesDropped;			// Didn't fit the send queue
+	std::atomic<uint64_t> 	m_framesSkipped;			// Passed over while waiting for an IDR to resume at
+	std::atomic<uint64_t> 	m_fecPacketsSent;
+	TPacingStats 			m_pacingStats;			// Per datagram, measured from when its frame started sending
+	
+	// Methods
+	CTsMulticastOutput();
+	virtual ~CTsMulticastOutput();
+	
+	void Start( const TTsMulticastConfig &configIn );
+	void Stop();
+	
+	// Called from the video callback with the same segments written to the muxer
+	void Write( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool isFrameStartIn );
+
+private:
+	typedef std::shared_ptr<const std::vector<uint8_t>> TPacketsPtr;
+	
+	// Attributes
+	TTsMulticastConfig 			m_config;
+	int 						m_socket			= -1;
+	int 						m_columnFecSocket	= -1;
+	int 						m_rowFecSocket		= -1;
+	
+	std::thread 				m_thread;
+	std::atomic<bool> 			m_killThread;
+	
+	// Video callback state
+	CTsPacketizer 				m_packetizer;
+	bool 						m_needKeyframe		= true;
+	
+	std::mutex 					m_mutex;
+	std::condition_variable 	m_dataAvailableCondition;
+	std::deque<TPacketsPtr> 	m_queue;
+	size_t 						m_queuedBytes		= 0;
+	
+	// Sender thread state
+	std::unique_ptr<CTokenBucket> 	m_pBucket;
+	std::unique_ptr<CFecEncoder> 	m_pFecEncoder;		// Null without FEC
+	std::vector<TFecPacket> 	m_fecPackets;
+	uint16_t 					m_rtpSequence		= 0;
+	uint32_t 					m_rtpSsrc			= 0;
+	
+	static const size_t 		k_packetsPerDatagram	= 7;
+	static const size_t 		k_datagramsPerBatch		= 16;
+	
+	// Methods
+	int OpenSocket( uint16_t portIn );
+	void CloseSockets();
+	void ThreadLoop();
+	void Send( const std::vector<uint8_t> &packetsIn );
+	void SendFec();
+	bool Pace( size_t bytesIn );					// True if it had to wait for tokens
+};
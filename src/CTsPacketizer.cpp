@@ -0,0 +1,335 @@
+// Includes
+#include "CTsPacketizer.h"
+#include "H264.h"
+
+#include <algorithm>
+
+extern "C"
+{
+	// FFmpeg
+	#include <libavutil/time.h>
+}
+
+using namespace std;
+
+namespace
+{
+	const size_t 	k_headerSize 		= 4;
+	const size_t 	k_pcrFieldSize 		= 6;
+	const uint8_t 	k_streamTypeH264 	= 0x1B;
+	const uint8_t 	k_accessUnitDelimiter[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xF0 };
+	
+	// CRC-32/MPEG-2, as used by PSI sections
+	uint32_t Crc32( const uint8_t *dataIn, size_t sizeIn )
+	{
+		uint32_t crc = 0xFFFFFFFF;
+		
+		for( size_t i = 0; i < sizeIn; ++i )
+		{
+			crc ^= (uint32_t)dataIn[ i ] << 24;
+			
+			for( int bit = 0; bit < 8; ++bit )
+			{
+				crc = ( crc & 0x80000000 ) ? ( crc << 1 ) ^ 0x04C11DB7 : ( crc << 1 );
+			}
+		}
+		
+		return crc;
+	}
+	
+	TBufferSegment MakeSegment( const uint8_t *dataIn, size_t sizeIn )
+	{
+		TBufferSegment segment;
+		segment.m_pData 	= dataIn;
+		segment.m_size 		= sizeIn;
+		
+		return segment;
+	}
+	
+	void AppendTimestamp( std::vector<uint8_t> &dataOut, uint8_t prefixIn, uint64_t timestampIn )
+	{
+		// 33 bits in 5 bytes, with marker bits
+		dataOut.push_back( ( prefixIn << 4 ) | ( ( timestampIn >> 29 ) & 0x0E ) | 0x01 );
+		dataOut.push_back( (uint8_t)( timestampIn >> 22 ) );
+		dataOut.push_back( ( ( timestampIn >> 14 ) & 0xFE ) | 0x01 );
+		dataOut.push_back( (uint8_t)( timestampIn >> 7 ) );
+		dataOut.push_back( ( ( timestampIn << 1 ) & 0xFE ) | 0x01 );
+	}
+}
+
+CTsPacketizer::CTsPacketizer()
+{
+}
+
+void CTsPacketizer::Reset()
+{
+	m_lastTableTime_us = 0;
+	
+	// Without its start, the rest of the current access unit is no use
+	m_hasPesStarted = true;
+	m_isDiscarding 	= true;
+	m_prefix.clear();
+}
+
+bool CTsPacketizer::Packetize( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool isFrameStartIn, std::vector<uint8_t> &packetsOut,
+								bool isKeyframeOnlyIn )
+{
+	if( isFrameStartIn )
+	{
+		m_hasPesStarted = false;
+		m_isDiscarding 	= false;
+		m_prefix.clear();
+	}
+	
+	if( m_hasPesStarted )
+	{
+		if( m_isDiscarding || isKeyframeOnlyIn )
+		{
+			m_isDiscarding = true;
+			return false;
+		}
+		
+		// Rest of an access unit that started in an earlier callback
+		WritePayload( segmentsIn, segmentCountIn, false, false, -1, packetsOut );
+		return false;
+	}
+	
+	bool isKeyframe 	= false;
+	bool hasDelimiter 	= false;
+	
+	if( !FindFirstSlice( segmentsIn, segmentCountIn, isKeyframe, hasDelimiter ) )
+	{
+		// Delimiter, parameter sets or SEI only. Hold them until the first slice shows what kind of access unit this is.
+		for( size_t i = 0; i < segmentCountIn; ++i )
+		{
+			m_prefix.insert( m_prefix.end(), segmentsIn[ i ].m_pData, segmentsIn[ i ].m_pData + segmentsIn[ i ].m_size );
+		}
+		
+		return false;
+	}
+	
+	m_hasPesStarted = true;
+	
+	if( isKeyframeOnlyIn && !isKeyframe )
+	{
+		m_isDiscarding = true;
+		m_prefix.clear();
+		m_accessUnitsSkipped++;
+		return false;
+	}
+	
+	if( !m_prefix.empty() )
+	{
+		// The held NAL units decide whether the access unit already has its delimiter
+		TBufferSegment prefix = MakeSegment( m_prefix.data(), m_prefix.size() );
+		bool isPrefixIdr = false;
+		
+		hasDelimiter = false;
+		FindFirstSlice( &prefix, 1, isPrefixIdr, hasDelimiter );
+	}
+	
+	const int64_t now_us = av_gettime();
+	
+	if( isKeyframe || now_us - m_lastTableTime_us >= k_tableInterval_us )
+	{
+		WriteTables( packetsOut );
+		m_lastTableTime_us = now_us;
+	}
+	
+	// 90kHz clocks. PCR is stamped on the first packet of every frame, well within the 100ms the spec asks for.
+	const int64_t pcr = now_us * 9 / 100;
+	const uint64_t pts = (uint64_t)( ( now_us + k_ptsDelay_us ) * 9 / 100 ) & 0x1FFFFFFFFULL;
+	
+	// PES header: no length (allowed for video), PTS only since frames are never reordered
+	std::vector<uint8_t> pesHeader = { 0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 0x05 };
+	AppendTimestamp( pesHeader, 0x2, pts );
+	
+	// Transport streams require an access unit delimiter at the start of every access unit
+	std::vector<TBufferSegment> chunks;
+	chunks.push_back( MakeSegment( pesHeader.data(), pesHeader.size() ) );
+	
+	if( !hasDelimiter )
+	{
+		chunks.push_back( MakeSegment( k_accessUnitDelimiter, sizeof( k_accessUnitDelimiter ) ) );
+	}
+	
+	if( !m_prefix.empty() )
+	{
+		chunks.push_back( MakeSegment( m_prefix.data(), m_prefix.size() ) );
+	}
+	
+	chunks.insert( chunks.end(), segmentsIn, segmentsIn + segmentCountIn );
+	
+	WritePayload( chunks.data(), chunks.size(), true, isKeyframe, pcr, packetsOut );
+	m_prefix.clear();
+	
+	return isKeyframe;
+}
+
+bool CTsPacketizer::FindFirstSlice( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool &isIdrOut, bool &hasDelimiterOut ) const
+{
+	for( size_t i = 0; i < segmentCountIn; ++i )
+	{
+		const uint8_t *cursor 	= segmentsIn[ i ].m_pData;
+		const uint8_t *end 		= cursor + segmentsIn[ i ].m_size;
+		h264::TNalUnit nal;
+		
+		while( h264::NextNalUnit( cursor, end, nal ) )
+		{
+			if( nal.m_size == 0 )
+			{
+				continue;
+			}
+			
+			if( i == 0 && nal.m_pStartCode == segmentsIn[ 0 ].m_pData && nal.GetType() == h264::NAL_AUD )
+			{
+				hasDelimiterOut = true;
+			}
+			
+			if( nal.IsVCL() )
+			{
+				isIdrOut = ( nal.GetType() == h264::NAL_IDR_SLICE );
+				return true;
+			}
+		}
+	}
+	
+	return false;
+}
+
+void CTsPacketizer::WriteTables( std::vector<uint8_t> &packetsOut )
+{
+	// PAT: program 1 -> PMT PID
+	std::vector<uint8_t> pat =
+	{
+		0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00,
+		0x00, 0x01, (uint8_t)( 0xE0 | ( k_pmtPid >> 8 ) ), (uint8_t)k_pmtPid
+	};
+	
+	// PMT: one H264 stream, which also carries the PCR
+	std::vector<uint8_t> pmt =
+	{
+		0x02, 0xB0, 0x12, 0x00, 0x01, 0xC1, 0x00, 0x00,
+		(uint8_t)( 0xE0 | ( k_videoPid >> 8 ) ), (uint8_t)k_videoPid, 0xF0, 0x00,
+		k_streamTypeH264, (uint8_t)( 0xE0 | ( k_videoPid >> 8 ) ), (uint8_t)k_videoPid, 0xF0, 0x00
+	};
+	
+	WriteSection( 0x0000, m_patCounter, pat, packetsOut );
+	WriteSection( k_pmtPid, m_pmtCounter, pmt, packetsOut );
+}
+
+void CTsPacketizer::WriteSection( uint16_t pidIn, uint8_t &counterIn, const std::vector<uint8_t> &sectionIn, std::vector<uint8_t> &packetsOut )
+{
+	const uint32_t crc = Crc32( sectionIn.data(), sectionIn.size() );
+	const size_t start = packetsOut.size();
+	
+	packetsOut.resize( start + k_packetSize, 0xFF );
+	uint8_t *packet = packetsOut.data() + start;
+	
+	packet[ 0 ] = 0x47;
+	packet[ 1 ] = 0x40 | ( pidIn >> 8 );
+	packet[ 2 ] = (uint8_t)pidIn;
+	packet[ 3 ] = 0x10 | ( counterIn++ & 0x0F );
+	packet[ 4 ] = 0x00;		// pointer_field
+	
+	std::copy( sectionIn.begin(), sectionIn.end(), packet + 5 );
+	
+	uint8_t *crcOut = packet + 5 + sectionIn.size();
+	crcOut[ 0 ] = (uint8_t)( crc >> 24 );
+	crcOut[ 1 ] = (uint8_t)( crc >> 16 );
+	crcOut[ 2 ] = (uint8_t)( crc >> 8 );
+	crcOut[ 3 ] = (uint8_t)crc;
+}
+
+void CTsPacketizer::WritePayload( const TBufferSegment *chunksIn, size_t chunkCountIn, bool isUnitStartIn, bool isRandomAccessIn,
+									int64_t pcrIn, std::vector<uint8_t> &packetsOut )
+{
+	size_t remaining = 0;
+	
+	for( size_t i = 0; i < chunkCountIn; ++i )
+	{
+		remaining += chunksIn[ i ].m_size;
+	}
+	
+	packetsOut.reserve( packetsOut.size() + ( remaining / ( k_packetSize - k_headerSize ) + 2 ) * k_packetSize );
+	
+	size_t chunk 		= 0;
+	size_t chunkOffset 	= 0;
+	bool isFirst 		= true;
+	
+	while( remaining > 0 )
+	{
+		const bool hasPcr = isFirst && pcrIn >= 0;
+		
+		// Adaptation field: length + flags + PCR on the first packet, then stuffing to fill out the last one
+		size_t adaptationSize 	= hasPcr ? 2 + k_pcrFieldSize : 0;
+		size_t payloadSize 		= std::min( remaining, k_packetSize - k_headerSize - adaptationSize );
+		
+		adaptationSize = k_packetSize - k_headerSize - payloadSize;
+		
+		const size_t start = packetsOut.size();
+		packetsOut.resize( start + k_packetSize );
+		uint8_t *packet = packetsOut.data() + start;
+		
+		packet[ 0 ] = 0x47;
+		packet[ 1 ] = ( ( isFirst && isUnitStartIn ) ? 0x40 : 0x00 ) | ( k_videoPid >> 8 );
+		packet[ 2 ] = (uint8_t)k_videoPid;
+		packet[ 3 ] = ( adaptationSize > 0 ? 0x30 : 0x10 ) | ( m_videoCounter++ & 0x0F );
+		
+		uint8_t *out = packet + k_headerSize;
+		
+		if( adaptationSize > 0 )
+		{
+			out[ 0 ] = (uint8_t)( adaptationSize - 1 );
+			
+			if( adaptationSize > 1 )
+			{
+				out[ 1 ] = ( hasPcr ? 0x10 : 0x00 ) | ( ( isFirst && isRandomAccessIn ) ? 0x40 : 0x00 );
+				
+				size_t used = 2;
+				
+				if( hasPcr )
+				{
+					// 33 bit base, 6 reserved bits, 9 bit extension (zero)
+					const uint64_t base = (uint64_t)pcrIn & 0x1FFFFFFFFULL;
+					
+					out[ 2 ] = (uint8_t)( base >> 25 );
+					out[ 3 ] = (uint8_t)( base >> 17 );
+					out[ 4 ] = (uint8_t)( base >> 9 );
+					out[ 5 ] = (uint8_t)( base >> 1 );
+					out[ 6 ] = (uint8_t)( ( base << 7 ) | 0x7E );
+					out[ 7 ] = 0x00;
+					
+					used += k_pcrFieldSize;
+				}
+				
+				std::fill( out + used, out + adaptationSize, 0xFF );
+			}
+			
+			out += adaptationSize;
+		}
+		
+		// Payload, possibly spanning chunk boundaries
+		size_t toCopy = payloadSize;
+		
+		while( toCopy > 0 )
+		{
+			size_t count = std::min( toCopy, chunksIn[ chunk ].m_size - chunkOffset );
+			
+			std::copy( chunksIn[ chunk ].m_pData + chunkOffset, chunksIn[ chunk ].m_pData + chunkOffset + count, out );
+			
+			out 		+= count;
+			toCopy 		-= count;
+			chunkOffset += count;
+			
+			if( chunkOffset == chunksIn[ chunk ].m_size )
+			{
+				chunk++;
+				chunkOffset = 0;
+			}
+		}
+		
+		remaining 	-= payloadSize;
+		isFirst 	= false;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "CVideoBuffer.h"
+
+// Minimal MPEG-2 transport stream writer for a single H264 video program, without libavformat.
+// Each access unit becomes one PES packet (unbounded length, so frames that arrive over several callbacks
+// simply continue it). PAT/PMT go out ahead of every IDR and at least every k_tableInterval_us.
+//
+// Whether an access unit is an IDR is only known at its first slice, which with maxnal set comes a callback or more
+// after the delimiter and parameter sets. Those are held until then, so the PES packet can start with the tables and
+// the random access indicator in place.
+class CTsPacketizer
+{
+public:
+	static const size_t 	k_packetSize		= 188;
+	
+	// Attributes
+	uint64_t 				m_accessUnitsSkipped	= 0;	// Not IDRs, so passed over with isKeyframeOnlyIn
+	
+	// Methods
+	CTsPacketizer();
+	
+	// Appends the TS packets for one video callback to packetsOut. Returns true if they start an IDR access unit.
+	// With isKeyframeOnlyIn, anything but the start of an IDR access unit is discarded without using up continuity
+	// counters, for resuming after output was interrupted.
+	bool Packetize( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool isFrameStartIn, std::vector<uint8_t> &packetsOut,
+					bool isKeyframeOnlyIn = false );
+	
+	// Forces tables on the next frame, e.g. after output was interrupted, and discards the rest of the current one
+	void Reset();
+
+private:
+	// Attributes
+	uint8_t 	m_patCounter		= 0;
+	uint8_t 	m_pmtCounter		= 0;
+	uint8_t 	m_videoCounter		= 0;
+	int64_t 	m_lastTableTime_us	= 0;
+	
+	// The access unit being packetized
+	bool 					m_hasPesStarted		= false;	// Its first slice has been seen and its PES packet started
+	bool 					m_isDiscarding		= false;	// The rest of it is being thrown away
+	std::vector<uint8_t> 	m_prefix;						// NAL units ahead of its first slice
+	
+	const uint16_t 	k_pmtPid			= 0x1000;
+	const uint16_t 	k_videoPid			= 0x0100;
+	const int64_t 	k_tableInterval_us	= 100000;
+	const int64_t 	k_ptsDelay_us		= 100000;		// PTS runs ahead of PCR by the decoder's buffering allowance
+	
+	// Methods
+	bool FindFirstSlice( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool &isIdrOut, bool &hasDelimiterOut ) const;
+	void WriteTables( std::vector<uint8_t> &packetsOut );
+	void WriteSection( uint16_t pidIn, uint8_t &counterIn, const std::vector<uint8_t> &sectionIn, std::vector<uint8_t> &packetsOut );
+	void WritePayload( const TBufferSegment *chunksIn, size_t chunkCountIn, bool isUnitStartIn, bool isRandomAccessIn,
+						int64_t pcrIn, std::vector<uint8_t> &packetsOut );
+};
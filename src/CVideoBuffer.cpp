@@ -69,46 +69,66 @@ void CVideoBuffer::ClearWriteCounts()
 }
 
 bool CVideoBuffer::Write( uint8_t *rawBufferIn, size_t bufferSizeIn, bool shouldSignalConditionIn )
+{
+	TBufferSegment segment;
+	segment.m_pData = rawBufferIn;
+	segment.m_size 	= bufferSizeIn;
+	
+	return Write( &segment, 1, shouldSignalConditionIn );
+}
+
+bool CVideoBuffer::Write( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool shouldSignalConditionIn, bool isFrameStartIn )
 {	
+	size_t frameSize = 0;
+	
+	for( size_t i = 0; i < segmentCountIn; ++i )
+	{
+		frameSize += segmentsIn[ i ].m_size;
+	}
+	
 	auto now = std::chrono::high_resolution_clock::now();
 	
 	// Lock
 	std::lock_guard<std::mutex> lock( m_mutex );
 	
-	// Increment framecounter
-	m_frameStats.m_frameAttempts++;
-	
-	#ifdef DROP_CAMERA_FRAME
-	if( std::rand() % 100 == 0 )
+	if( isFrameStartIn )
 	{
-		std::cout << "Causing random camera frame drop" << endl;
-		m_frameStats.m_frameFails += m_framesStored;
-		return false;
+		// Increment framecounter
+		m_frameStats.m_frameAttempts++;
+		
+		#ifdef DROP_CAMERA_FRAME
+		if( std::rand() % 100 == 0 )
+		{
+			std::cout << "Causing random camera frame drop" << endl;
+			m_frameStats.m_frameFails += m_framesStored;
+			return false;
+		}
+		#endif
+		
+		// Calculate framerate (rough diagnostic)
+		m_frameStats.m_fps = ( 1000000.0f / (float)std::chrono::duration_cast<std::chrono::microseconds>( now - m_frameStats.m_lastWriteTime ).count() );
+		
+		// Set last write time
+		m_frameStats.m_lastWriteTime = std::move( now );
 	}
-	#endif
-	
-	// Calculate framerate (rough diagnostic)
-	m_frameStats.m_fps = ( 1000000.0f / (float)std::chrono::duration_cast<std::chrono::microseconds>( now - m_frameStats.m_lastWriteTime ).count() );
-	
-	// Set last write time
-	m_frameStats.m_lastWriteTime = std::move( now );
-	
-	
 	
 	// Check capacity
-	if( bufferSizeIn > m_remainingCapacity )
+	if( frameSize > m_remainingCapacity )
 	{
 		m_frameStats.m_frameFails += m_framesStored;
 		std::cerr << "Video buffer full. Dropped frames: " << m_framesStored << std::endl;
 		Clear();
 	}
 	
-	// Copy the source buffer to the end of the buffer
-	memcpy( End(), rawBufferIn, bufferSizeIn );
-	
-	// Update index and capacity
-	m_endIndex 			+= bufferSizeIn;
-	m_remainingCapacity -= bufferSizeIn;
+	// Copy the source segments to the end of the buffer
+	for( size_t i = 0; i < segmentCountIn; ++i )
+	{
+		memcpy( End(), segmentsIn[ i ].m_pData, segmentsIn[ i ].m_size );
+		
+		// Update index and capacity
+		m_endIndex 			+= segmentsIn[ i ].m_size;
+		m_remainingCapacity -= segmentsIn[ i ].m_size;
+	}
 	
 	if( shouldSignalConditionIn )
 	{
@@ -116,8 +136,11 @@ bool CVideoBuffer::Write( uint8_t *rawBufferIn, size_t bufferSizeIn, bool should
 		m_dataAvailableCondition.notify_one();
 	}
 	
-	m_framesStored++;
-	m_frameStats.m_frameWrites++;
+	if( isFrameStartIn )
+	{
+		m_framesStored++;
+		m_frameStats.m_frameWrites++;
+	}
 		
 	return true;
 }
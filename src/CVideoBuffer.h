@@ -27,12 +27,20 @@ struct TFrameStats
 	}
 };
 
+// One piece of a frame written with a single scatter write
+struct TBufferSegment
+{
+	const uint8_t 	*m_pData	= nullptr;
+	size_t 			m_size		= 0;
+};
+
 class CVideoBuffer
 {
 public:
 	// Attributes		
 	std::mutex 						m_mutex;
 	std::condition_variable 		m_dataAvailableCondition;
+	std::condition_variable 		m_dataConsumedCondition;		// Signaled when the muxer empties the buffer
 	
 	TFrameStats						m_frameStats;
 	size_t							m_framesStored		= 0;
@@ -54,6 +62,10 @@ public:
 	void Clear();
 	bool Write( uint8_t *rawBufferIn, size_t bufferSizeIn, bool shouldSignalConditionIn = true );
 	
+	// Writes the segments back to back as one frame, so inserted data costs no extra copy of the frame.
+	// Pass isFrameStartIn = false for the remaining NALs of a frame, so they don't count towards the frame stats.
+	bool Write( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool shouldSignalConditionIn = true, bool isFrameStartIn = true );
+	
 private:
 	// Attributes
 	const size_t					k_containerSize;	
@@ -4,8 +4,11 @@
 #include <chrono>
 #include <fstream>
 #include <algorithm>
+#include <sstream>
 
 #include "CVideoChannel.h"
+#include "CClipExtractor.h"
+#include "Utility.h"
 #include "GC6500_API.h"
 
 using namespace std;
@@ -13,12 +16,25 @@ using json = nlohmann::json;
 
 CVideoChannel::CVideoChannel( const std::string &cameraOffsetIn, video_channel_t channelIn, CpperoMQ::Context *contextIn )
 	: m_channel( channelIn )
+	, m_pContext( contextIn )
 	, m_cameraString( cameraOffsetIn )
 	, m_channelString( std::to_string( (int)m_channel ) )
 	, m_eventEndpoint( std::string( "ipc:///tmp/geomux_event" + m_cameraString + "_" + m_channelString + ".ipc" ) )
 	, m_videoEndpoint( std::string( "ipc:///tmp/geomux_video" + m_cameraString + "_" + m_channelString + ".ipc" ) )
+	, m_playbackEndpoint( std::string( "ipc:///tmp/geomux_playback" + m_cameraString + "_" + m_channelString + ".ipc" ) )
+	, m_baseLayerEndpoint( std::string( "ipc:///tmp/geomux_video" + m_cameraString + "_" + m_channelString + "_base.ipc" ) )
+	, m_routerEndpoint( std::string( "ipc:///tmp/geomux_video" + m_cameraString + "_" + m_channelString + "_router.ipc" ) )
 	, m_eventEmitter( contextIn, m_eventEndpoint )
 	, m_muxer( contextIn, m_videoEndpoint, EVideoFormat::UNKNOWN )
+	, m_telemetry( contextIn )
+	, m_fragmentRouter( contextIn, m_routerEndpoint )
+	, m_playback( contextIn, m_playbackEndpoint )
+	, m_baseLayerEnabled( false )
+	, m_pRtspInput( nullptr )
+	, m_pWebRtcInput( nullptr )
+	, m_pJpegInput( nullptr )
+	, m_pKeyframeRequested( std::make_shared<std::atomic<bool>>( false ) )
+	, m_faststartRecording( false )
 {
 	cout << "Registering API" << endl;
 	// Map command strings to API
@@ -44,10 +60,41 @@ CVideoChannel::CVideoChannel( const std::string &cameraOffsetIn, video_channel_t
 	{
 		throw std::runtime_error( "Failed to register video callback!" );
 	}
+	
+	// Feed muxed fragments to the recorder, pre-event buffer, HLS output and queued subscribers
+	m_muxer.AddSink( &m_recorder );
+	m_muxer.AddSink( &m_preEventBuffer );
+	m_muxer.AddSink( &m_hlsWriter );
+	m_muxer.AddSink( &m_fragmentRouter );
+	
+	m_recorder.SetTelemetrySource( &m_telemetry );
+	m_recorder.SetSegmentClosedCallback( [this]( const std::string &segmentPathIn )
+	{
+		if( m_faststartRecording && m_segmentClosedCallback )
+		{
+			m_segmentClosedCallback( segmentPathIn );
+		}
+	} );
 }
 
 CVideoChannel::~CVideoChannel()
 {
+	// Detach sinks before they are destroyed, the muxer thread outlives them
+	m_muxer.RemoveSink( &m_recorder );
+	m_muxer.RemoveSink( &m_preEventBuffer );
+	m_muxer.RemoveSink( &m_hlsWriter );
+	m_muxer.RemoveSink( &m_fragmentRouter );
+	
+	for( CFragmentSink *sink : m_externalSinks )
+	{
+		m_muxer.RemoveSink( sink );
+	}
+	
+	// Closing the last segment runs the segment closed callback, which uses members destroyed before the recorder
+	m_recorder.Stop();
+	
+	// The base layer muxer goes before the video callback's other targets
+	m_baseLayerEnabled = false;
 }
 
 void CVideoChannel::Initialize()
@@ -94,6 +141,100 @@ void CVideoChannel::HandleMessage( const nlohmann::json &commandIn )
 	}
 }
 
+void CVideoChannel::Update()
+{
+	if( !m_pBitrateController )
+	{
+		return;
+	}
+	
+	auto now = std::chrono::steady_clock::now();
+	
+	if( now < m_nextBitrateUpdate )
+	{
+		return;
+	}
+	
+	m_nextBitrateUpdate = now + k_bitrateUpdateInterval;
+	
+	// The muxer's latency is left at its last value while video is stopped. Only sample while frames are arriving.
+	uint64_t callbacks = m_accessUnitAssembler.m_callbacks;
+	
+	if( callbacks == m_lastBitrateCallbacks )
+	{
+		return;
+	}
+	
+	m_lastBitrateCallbacks = callbacks;
+	
+	TCongestionSignals signals;
+	
+	{
+		std::lock_guard<std::mutex> lock( m_muxer.m_inputBuffer.m_mutex );
+		signals.m_bufferFill = (float)m_muxer.m_inputBuffer.GetSize() / (float)m_muxer.m_inputBuffer.GetReservedSize();
+	}
+	
+	signals.m_latency_us 		= m_muxer.m_latency_us;
+	signals.m_framesFailed 		= m_muxer.m_framesFailed;
+	signals.m_framesDropped 	= m_muxer.m_droppedFrames;
+	
+	// Only what outputs lost to backed up queues. Media passed over while a viewer waits for its first IDR isn't congestion.
+	signals.m_deliveryDrops 	= m_fragmentRouter.m_fragmentsDropped + m_tsOutput.m_framesDropped;
+	
+	if( m_pBitrateController->Update( signals, now ) )
+	{
+		ApplyBitrateControl();
+	}
+}
+
+void CVideoChannel::SetSegmentClosedCallback( TSegmentClosedCallback callbackIn )
+{
+	m_segmentClosedCallback = callbackIn;
+}
+
+void CVideoChannel::AddFragmentSink( CFragmentSink *sinkIn )
+{
+	m_externalSinks.push_back( sinkIn );
+	m_muxer.AddSink( sinkIn );
+}
+
+void CVideoChannel::SetRtspInput( CRtspServer::CStreamInput *inputIn )
+{
+	m_pRtspInput = inputIn;
+}
+
+void CVideoChannel::SetWebRtcInput( CWebRtcServer::CStreamInput *inputIn )
+{
+	// Only flagged here: the server thread mustn't wait on the camera
+	std::shared_ptr<std::atomic<bool>> keyframeRequested = m_pKeyframeRequested;
+	inputIn->SetKeyframeRequestHandler( [keyframeRequested](){ *keyframeRequested = true; } );
+	
+	m_pWebRtcInput = inputIn;
+}
+
+void CVideoChannel::SetJpegInput( CHttpServer::CJpegInput *inputIn )
+{
+	m_pJpegInput = inputIn;
+}
+
+bool CVideoChannel::IsMjpeg() const
+{
+	return m_settings.at( "format" ).at( "value" ) == "mjpeg";
+}
+
+bool CVideoChannel::IsUnderPressure()
+{
+	uint64_t droppedFrames 		= m_muxer.m_droppedFrames;
+	uint64_t droppedFragments 	= m_recorder.m_fragmentsDropped;
+	
+	bool isDropping = ( droppedFrames > m_lastDroppedFrames ) || ( droppedFragments > m_lastDroppedFragments );
+	
+	m_lastDroppedFrames 	= droppedFrames;
+	m_lastDroppedFragments 	= droppedFragments;
+	
+	return isDropping || ( m_muxer.m_latency_us > k_pressureLatency_us );
+}
+
 ///////////////////////////////////////
 // Private Channel API
 ///////////////////////////////////////
@@ -106,8 +247,69 @@ void CVideoChannel::VideoCallback( unsigned char *dataBufferOut, unsigned int bu
 	
 	CVideoChannel* channel = (CVideoChannel*) userDataIn;
 	
-	// Write the video data to the channel's muxer input buffer
-	channel->m_muxer.m_inputBuffer.Write( dataBufferOut, bufferSizeIn );
+	// Write the video data to the channel's muxer input buffer. H264 frames can have their SPS rewritten and be tagged with SEI metadata on the way.
+	if( infoIn.format == VID_FORMAT_H264_RAW )
+	{
+		const uint8_t *data = dataBufferOut;
+		size_t size 		= bufferSizeIn;
+		
+		if( channel->m_pKeyframeRequested->exchange( false ) && mxuvc_video_force_iframe( channel->m_channel ) )
+		{
+			cerr << "Failed to request keyframe for WebRTC viewer" << endl;
+		}
+		
+		if( channel->m_bitstreamAnalyzer.Analyze( data, size ) )
+		{
+			// Ask for an IDR now instead of showing smeared video until the next one
+			if( mxuvc_video_force_iframe( channel->m_channel ) )
+			{
+				cerr << "Failed to request keyframe after bitstream corruption" << endl;
+			}
+		}
+		
+		// With maxnal set a frame arrives over several callbacks. Only count a frame and wake the muxer once per access unit.
+		bool isFrameStart = channel->m_accessUnitAssembler.StartsAccessUnit( data, size );
+		
+		channel->m_spsRewriter.Process( data, size );
+		
+		TBufferSegment segments[ 3 ];
+		size_t segmentCount = channel->m_seiInjector.Process( data, size, infoIn.ts, segments );
+		
+		channel->m_muxer.m_inputBuffer.Write( segments, segmentCount, isFrameStart, isFrameStart );
+		
+		CRtspServer::CStreamInput *rtspInput = channel->m_pRtspInput;
+		
+		if( rtspInput != nullptr )
+		{
+			rtspInput->Write( segments, segmentCount, isFrameStart );
+		}
+		
+		CWebRtcServer::CStreamInput *webRtcInput = channel->m_pWebRtcInput;
+		
+		if( webRtcInput != nullptr )
+		{
+			webRtcInput->Write( segments, segmentCount, isFrameStart );
+		}
+		
+		channel->m_tsOutput.Write( segments, segmentCount, isFrameStart );
+		
+		// Lower temporal layers also go to the reduced framerate output
+		if( channel->m_baseLayerEnabled && channel->m_decimator.ShouldKeep( data, size ) )
+		{
+			channel->m_pBaseLayerMuxer->m_inputBuffer.Write( segments, segmentCount, isFrameStart, isFrameStart );
+		}
+	}
+	else
+	{
+		channel->m_muxer.m_inputBuffer.Write( dataBufferOut, bufferSizeIn );
+		
+		CHttpServer::CJpegInput *jpegInput = channel->m_pJpegInput;
+		
+		if( jpegInput != nullptr )
+		{
+			jpegInput->Write( dataBufferOut, bufferSizeIn );
+		}
+	}
 	
 	// Releases the buffer back to the MXUVC
 	mxuvc_video_cb_buf_done( channel->m_channel, infoIn.buf_index );
@@ -180,6 +382,26 @@ void CVideoChannel::RegisterAPIFunctions()
 	m_publicApiMap.insert( std::make_pair( std::string("report_health"), 			[this]( const nlohmann::json &paramsIn ){ this->ReportHealth( paramsIn ); } ) );
 	m_publicApiMap.insert( std::make_pair( std::string("report_api"), 				[this]( const nlohmann::json &paramsIn ){ this->ReportAPI( paramsIn ); } ) );
 	m_publicApiMap.insert( std::make_pair( std::string("apply_settings"),			[this]( const nlohmann::json &paramsIn ){ this->ApplySettings( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("record_start"),				[this]( const nlohmann::json &paramsIn ){ this->StartRecording( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("record_stop"),				[this]( const nlohmann::json &paramsIn ){ this->StopRecording( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("dump_buffer"),				[this]( const nlohmann::json &paramsIn ){ this->DumpBuffer( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("export_clip"),				[this]( const nlohmann::json &paramsIn ){ this->ExportClip( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("playback_start"),			[this]( const nlohmann::json &paramsIn ){ this->StartPlayback( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("playback_seek"),			[this]( const nlohmann::json &paramsIn ){ this->SeekPlayback( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("playback_speed"),			[this]( const nlohmann::json &paramsIn ){ this->SetPlaybackSpeed( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("playback_stop"),			[this]( const nlohmann::json &paramsIn ){ this->StopPlayback( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("telemetry_start"),			[this]( const nlohmann::json &paramsIn ){ this->StartTelemetry( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("telemetry_stop"),			[this]( const nlohmann::json &paramsIn ){ this->StopTelemetry( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("sei_config"),				[this]( const nlohmann::json &paramsIn ){ this->ConfigureSei( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("sps_rewrite"),				[this]( const nlohmann::json &paramsIn ){ this->ConfigureSpsRewrite( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("base_layer_start"),			[this]( const nlohmann::json &paramsIn ){ this->StartBaseLayer( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("base_layer_stop"),			[this]( const nlohmann::json &paramsIn ){ this->StopBaseLayer( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("hls_start"),				[this]( const nlohmann::json &paramsIn ){ this->StartHls( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("hls_stop"),					[this]( const nlohmann::json &paramsIn ){ this->StopHls( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("ts_multicast_start"),		[this]( const nlohmann::json &paramsIn ){ this->StartTsMulticast( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("ts_multicast_stop"),		[this]( const nlohmann::json &paramsIn ){ this->StopTsMulticast( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("bitrate_control_start"),	[this]( const nlohmann::json &paramsIn ){ this->StartBitrateControl( paramsIn ); } ) );
+	m_publicApiMap.insert( std::make_pair( std::string("bitrate_control_stop"),		[this]( const nlohmann::json &paramsIn ){ this->StopBitrateControl( paramsIn ); } ) );
 	
 	// Settings API
 	m_settingsApiMap.insert( std::make_pair( std::string("framerate"), 				[this]( const nlohmann::json &paramsIn ){ this->SetFramerate( paramsIn ); } ) );
@@ -450,7 +672,7 @@ void CVideoChannel::ValidateParameterType( const nlohmann::json &paramApiIn, con
 	}
 	else if( type == "string" )
 	{
-		if( paramIn.is_object() == false )
+		if( paramIn.is_string() == false )
 		{
 			throw std::runtime_error( type );
 		}
@@ -517,9 +739,106 @@ void CVideoChannel::ReportHealth( const nlohmann::json &paramsIn )
 	{
 		{ "fps", (float)m_muxer.m_fps },
 		{ "droppedFrames", (int)m_muxer.m_droppedFrames },
-		{ "latency_us", (int)m_muxer.m_latency_us }
+		{ "latency_us", (int)m_muxer.m_latency_us },
+		{ "callbacksPerFrame", ( m_accessUnitAssembler.m_accessUnits == 0 ) ? 0.0f : (float)m_accessUnitAssembler.m_callbacks / (float)m_accessUnitAssembler.m_accessUnits },
+		{ "seiInserted", (uint64_t)m_seiInjector.m_seiInserted },
+		{ "spsRewritten", (uint64_t)m_spsRewriter.m_spsRewritten },
+		{ "spsRewriteFailures", (uint64_t)m_spsRewriter.m_spsFailed },
+		{ "recording", 
+			{
+				{ "active", (bool)m_recorder.m_isRecording },
+				{ "bytesWritten", (uint64_t)m_recorder.m_bytesWritten },
+				{ "droppedFragments", (uint64_t)m_recorder.m_fragmentsDropped },
+				{ "segmentsClosed", (uint64_t)m_recorder.m_segmentsClosed },
+				{ "writeRate_Bps", (float)m_recorder.m_writeRate_Bps },
+				{ "telemetryWritten", (uint64_t)m_recorder.m_telemetryWritten }
+			}
+		},
+		{ "telemetry",
+			{
+				{ "active", (bool)m_telemetry.m_isRunning },
+				{ "samplesReceived", (uint64_t)m_telemetry.m_samplesReceived },
+				{ "samplesDropped", (uint64_t)m_telemetry.m_samplesDropped }
+			}
+		},
+		{ "preEventBuffer",
+			{
+				{ "bytes", (uint64_t)m_preEventBuffer.m_bufferedBytes },
+				{ "duration_s", (float)m_preEventBuffer.m_bufferedDuration_s }
+			}
+		},
+		{ "playback",
+			{
+				{ "active", (bool)m_playback.m_isPlaying },
+				{ "position_s", (float)m_playback.m_position_s }
+			}
+		},
+		{ "bitstream",
+			{
+				{ "nalsChecked", (uint64_t)m_bitstreamAnalyzer.m_nalsChecked },
+				{ "framingErrors", (uint64_t)m_bitstreamAnalyzer.m_framingErrors },
+				{ "forbiddenBitErrors", (uint64_t)m_bitstreamAnalyzer.m_forbiddenBitErrors },
+				{ "sliceHeaderErrors", (uint64_t)m_bitstreamAnalyzer.m_sliceHeaderErrors },
+				{ "frameNumGaps", (uint64_t)m_bitstreamAnalyzer.m_frameNumGaps },
+				{ "keyframesRequested", (uint64_t)m_bitstreamAnalyzer.m_keyframesRequested }
+			}
+		},
+		{ "baseLayer",
+			{
+				{ "active", (bool)m_baseLayerEnabled },
+				{ "framesKept", (uint64_t)m_decimator.m_framesKept },
+				{ "framesDropped", (uint64_t)m_decimator.m_framesDropped }
+			}
+		},
+		{ "hls",
+			{
+				{ "active", (bool)m_hlsWriter.m_isRunning },
+				{ "partsWritten", (uint64_t)m_hlsWriter.m_partsWritten },
+				{ "segmentsWritten", (uint64_t)m_hlsWriter.m_segmentsWritten },
+				{ "droppedFragments", (uint64_t)m_hlsWriter.m_fragmentsDropped }
+			}
+		},
+		{ "bitrateControl",
+			{
+				{ "active", (bool)m_pBitrateController },
+				{ "state", m_pBitrateController ? CBitrateController::ToString( m_pBitrateController->GetState() ) : "off" },
+				{ "decreases", m_pBitrateController ? m_pBitrateController->m_decreases : 0 },
+				{ "increases", m_pBitrateController ? m_pBitrateController->m_increases : 0 }
+			}
+		},
+		{ "tsMulticast",
+			{
+				{ "active", (bool)m_tsOutput.m_isRunning },
+				{ "datagramsSent", (uint64_t)m_tsOutput.m_datagramsSent },
+				{ "bytesSent", (uint64_t)m_tsOutput.m_bytesSent },
+				{ "droppedFrames", (uint64_t)m_tsOutput.m_framesDropped },
+				{ "skippedFrames", (uint64_t)m_tsOutput.m_framesSkipped },
+				{ "fecPacketsSent", (uint64_t)m_tsOutput.m_fecPacketsSent },
+				{ "pacedDatagrams", (uint64_t)m_tsOutput.m_pacingStats.m_packetsPaced },
+				{ "delayedDatagrams", (uint64_t)m_tsOutput.m_pacingStats.m_packetsDelayed },
+				{ "meanPacingDelay_us", ( m_tsOutput.m_pacingStats.m_packetsPaced != 0 ) ? ( m_tsOutput.m_pacingStats.m_totalDelay_us / m_tsOutput.m_pacingStats.m_packetsPaced ) : 0 },
+				{ "maxPacingDelay_us", (uint64_t)m_tsOutput.m_pacingStats.m_maxDelay_us }
+			}
+		}
 	};
 	
+	json subscribers = json::array();
+	
+	for( const TSubscriberStats &stats : m_fragmentRouter.GetSubscriberStats() )
+	{
+		subscribers.push_back(
+		{
+			{ "name", stats.m_name },
+			{ "fragmentsSent", stats.m_fragmentsSent },
+			{ "droppedFragments", stats.m_fragmentsDropped },
+			{ "passedOverFragments", stats.m_fragmentsPassedOver },
+			{ "skips", stats.m_skips },
+			{ "queuedBytes", stats.m_queuedBytes }
+		} );
+	}
+	
+	health[ "subscribers" ] = subscribers;
+	
 	m_eventEmitter.Emit( "health", health );
 }
 
@@ -546,6 +865,7 @@ void CVideoChannel::StopVideo( const nlohmann::json &paramsIn )
 {
 	// Clear the video buffer so it is fresh when video is started again
 	m_muxer.m_inputBuffer.Clear();
+	m_accessUnitAssembler.Reset();
 	
 	if( mxuvc_video_stop( m_channel ) )
 	{
@@ -563,6 +883,493 @@ void CVideoChannel::ForceIFrame( const nlohmann::json &paramsIn )
 	}
 }
 
+void CVideoChannel::StartRecording( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		TRecorderConfig config;
+		
+		config.m_directory 	= paramsIn.at( "path" ).get<std::string>();
+		config.m_filePrefix = "geomux" + m_cameraString + "_" + m_channelString;
+		
+		if( paramsIn.find( "segment_duration" ) != paramsIn.end() )
+		{
+			config.m_segmentDuration_s = paramsIn.at( "segment_duration" ).get<uint32_t>();
+		}
+		
+		if( paramsIn.find( "segment_size" ) != paramsIn.end() )
+		{
+			config.m_segmentSize_bytes = (uint64_t)paramsIn.at( "segment_size" ).get<uint32_t>() * 1024 * 1024;
+		}
+		
+		if( paramsIn.find( "fsync_interval" ) != paramsIn.end() )
+		{
+			config.m_fsyncInterval_s = paramsIn.at( "fsync_interval" ).get<uint32_t>();
+		}
+		
+		m_faststartRecording = ( paramsIn.find( "faststart" ) != paramsIn.end() ) && paramsIn.at( "faststart" ).get<bool>();
+		
+		m_recorder.Start( config );
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: StartRecording[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+	
+	m_eventEmitter.Emit( "status", "recording_started" );
+}
+
+void CVideoChannel::StopRecording( const nlohmann::json &paramsIn )
+{
+	m_recorder.Stop();
+	
+	m_eventEmitter.Emit( "status", "recording_stopped" );
+}
+
+void CVideoChannel::DumpBuffer( const nlohmann::json &paramsIn )
+{
+	const std::string path( paramsIn.at( "path" ).get<std::string>() );
+	
+	// Grab references to the buffered fragments now. The file is written on the task thread.
+	auto snapshot = m_preEventBuffer.Snapshot();
+	
+	if( snapshot.empty() )
+	{
+		throw std::runtime_error( "Command failed: DumpBuffer[" + m_channelString + "]: Nothing buffered yet" );
+	}
+	
+	m_taskQueue.Post( [ snapshot, path ]()
+	{
+		CPreEventBuffer::WriteToFile( snapshot, path );
+		
+		cout << "Wrote pre-event buffer to: " << path << endl;
+	} );
+	
+	m_eventEmitter.Emit( "status", "buffer_dump_started" );
+}
+
+void CVideoChannel::ExportClip( const nlohmann::json &paramsIn )
+{
+	const std::string segment( paramsIn.at( "segment" ).get<std::string>() );
+	const std::string path( paramsIn.at( "path" ).get<std::string>() );
+	const double start 	= paramsIn.at( "start" ).get<double>();
+	const double end 	= paramsIn.at( "end" ).get<double>();
+	
+	if( end <= start )
+	{
+		throw std::runtime_error( "Command failed: ExportClip[" + m_channelString + "]: End must be after start" );
+	}
+	
+	// Copying the fragments is disk-bound, so keep it off the command thread
+	m_taskQueue.Post( [ segment, start, end, path ]()
+	{
+		CClipExtractor::Extract( segment, start, end, path );
+		
+		cout << "Exported clip to: " << path << endl;
+	} );
+	
+	m_eventEmitter.Emit( "status", "clip_export_started" );
+}
+
+void CVideoChannel::StartPlayback( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		float speed = 1.0f;
+		double start = 0.0;
+		
+		if( paramsIn.find( "speed" ) != paramsIn.end() )
+		{
+			speed = paramsIn.at( "speed" ).get<float>();
+		}
+		
+		if( paramsIn.find( "start" ) != paramsIn.end() )
+		{
+			start = paramsIn.at( "start" ).get<double>();
+		}
+		
+		m_playback.Start( paramsIn.at( "path" ).get<std::string>(), speed, start );
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: StartPlayback[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+	
+	m_eventEmitter.Emit( "status", "playback_started" );
+}
+
+void CVideoChannel::SeekPlayback( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		m_playback.Seek( paramsIn.at( "position" ).get<double>() );
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: SeekPlayback[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+}
+
+void CVideoChannel::SetPlaybackSpeed( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		m_playback.SetSpeed( paramsIn.at( "speed" ).get<float>() );
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: SetPlaybackSpeed[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+}
+
+void CVideoChannel::StopPlayback( const nlohmann::json &paramsIn )
+{
+	m_playback.Stop();
+	
+	m_eventEmitter.Emit( "status", "playback_stopped" );
+}
+
+void CVideoChannel::StartTelemetry( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		std::vector<std::string> topics;
+		
+		if( paramsIn.find( "topics" ) != paramsIn.end() )
+		{
+			// Comma separated list of topic prefixes
+			std::stringstream topicList( paramsIn.at( "topics" ).get<std::string>() );
+			std::string topic;
+			
+			while( std::getline( topicList, topic, ',' ) )
+			{
+				if( !topic.empty() )
+				{
+					topics.push_back( topic );
+				}
+			}
+		}
+		
+		m_telemetry.Start( paramsIn.at( "endpoint" ).get<std::string>(), topics );
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: StartTelemetry[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+	
+	m_eventEmitter.Emit( "status", "telemetry_started" );
+}
+
+void CVideoChannel::StopTelemetry( const nlohmann::json &paramsIn )
+{
+	m_telemetry.Stop();
+	
+	m_eventEmitter.Emit( "status", "telemetry_stopped" );
+}
+
+void CVideoChannel::ConfigureSei( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		uint32_t interval 	= 1;
+		bool keyframesOnly 	= false;
+		std::string userData;
+		
+		if( paramsIn.find( "interval" ) != paramsIn.end() )
+		{
+			interval = paramsIn.at( "interval" ).get<uint32_t>();
+		}
+		
+		if( paramsIn.find( "keyframes_only" ) != paramsIn.end() )
+		{
+			keyframesOnly = paramsIn.at( "keyframes_only" ).get<bool>();
+		}
+		
+		if( paramsIn.find( "user_data" ) != paramsIn.end() )
+		{
+			userData = paramsIn.at( "user_data" ).get<std::string>();
+		}
+		
+		m_seiInjector.Configure( paramsIn.at( "enabled" ).get<bool>(), interval, keyframesOnly, userData );
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: ConfigureSei[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+	
+	m_eventEmitter.Emit( "status", "sei_configured" );
+}
+
+void CVideoChannel::ConfigureSpsRewrite( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		uint32_t framerate = 0;
+		
+		// Only used if the camera's SPS has no timing info of its own
+		if( m_settings.find( "framerate" ) != m_settings.end() )
+		{
+			framerate = m_settings.at( "framerate" ).at( "value" ).get<uint32_t>();
+		}
+		
+		m_spsRewriter.Configure( paramsIn.at( "enabled" ).get<bool>(), framerate );
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: ConfigureSpsRewrite[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+	
+	m_eventEmitter.Emit( "status", "sps_rewrite_configured" );
+}
+
+void CVideoChannel::StartBaseLayer( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		uint32_t hierarchyLevels = 0;
+		
+		if( m_settings.find( "gop_hierarchy_level" ) != m_settings.end() )
+		{
+			hierarchyLevels = m_settings.at( "gop_hierarchy_level" ).at( "value" ).get<uint32_t>();
+		}
+		
+		m_decimator.Configure( hierarchyLevels, paramsIn.at( "divisor" ).get<uint32_t>() );
+		
+		if( !m_pBaseLayerMuxer )
+		{
+			m_pBaseLayerMuxer = util::make_unique<CMuxer>( m_pContext, m_baseLayerEndpoint, EVideoFormat::UNKNOWN );
+		}
+		
+		m_baseLayerEnabled = true;
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: StartBaseLayer[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+	
+	m_eventEmitter.Emit( "status", "base_layer_started" );
+}
+
+void CVideoChannel::StopBaseLayer( const nlohmann::json &paramsIn )
+{
+	m_baseLayerEnabled = false;
+	
+	m_eventEmitter.Emit( "status", "base_layer_stopped" );
+}
+
+void CVideoChannel::StartHls( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		THlsConfig config;
+		
+		config.m_directory = paramsIn.at( "path" ).get<std::string>();
+		
+		if( paramsIn.find( "part_duration" ) != paramsIn.end() )
+		{
+			config.m_partTarget_ms = paramsIn.at( "part_duration" ).get<uint32_t>();
+		}
+		
+		if( paramsIn.find( "playlist_segments" ) != paramsIn.end() )
+		{
+			config.m_playlistSegments = paramsIn.at( "playlist_segments" ).get<uint32_t>();
+		}
+		
+		m_hlsWriter.Start( config );
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: StartHls[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+	
+	m_eventEmitter.Emit( "status", "hls_started" );
+}
+
+void CVideoChannel::StopHls( const nlohmann::json &paramsIn )
+{
+	m_hlsWriter.Stop();
+	
+	m_eventEmitter.Emit( "status", "hls_stopped" );
+}
+
+void CVideoChannel::StartTsMulticast( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		TTsMulticastConfig config;
+		
+		config.m_address = paramsIn.at( "address" ).get<std::string>();
+		
+		if( paramsIn.find( "port" ) != paramsIn.end() )
+		{
+			config.m_port = paramsIn.at( "port" ).get<uint16_t>();
+		}
+		
+		if( paramsIn.find( "ttl" ) != paramsIn.end() )
+		{
+			config.m_ttl = paramsIn.at( "ttl" ).get<uint8_t>();
+		}
+		
+		if( paramsIn.find( "interface" ) != paramsIn.end() )
+		{
+			config.m_interface = paramsIn.at( "interface" ).get<std::string>();
+		}
+		
+		if( paramsIn.find( "max_rate" ) != paramsIn.end() )
+		{
+			config.m_maxRate_bps = paramsIn.at( "max_rate" ).get<uint32_t>();
+		}
+		
+		if( paramsIn.find( "max_burst" ) != paramsIn.end() )
+		{
+			config.m_maxBurstBytes = paramsIn.at( "max_burst" ).get<size_t>();
+		}
+		
+		if( paramsIn.find( "fec_columns" ) != paramsIn.end() )
+		{
+			config.m_fecColumns = paramsIn.at( "fec_columns" ).get<uint8_t>();
+		}
+		
+		if( paramsIn.find( "fec_rows" ) != paramsIn.end() )
+		{
+			config.m_fecRows = paramsIn.at( "fec_rows" ).get<uint8_t>();
+		}
+		
+		if( paramsIn.find( "fec_2d" ) != paramsIn.end() )
+		{
+			config.m_fecRowPackets = paramsIn.at( "fec_2d" ).get<bool>();
+		}
+		
+		m_tsOutput.Start( config );
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: StartTsMulticast[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+	
+	m_eventEmitter.Emit( "status", "ts_multicast_started" );
+}
+
+void CVideoChannel::StopTsMulticast( const nlohmann::json &paramsIn )
+{
+	m_tsOutput.Stop();
+	
+	m_eventEmitter.Emit( "status", "ts_multicast_stopped" );
+}
+
+void CVideoChannel::StartBitrateControl( const nlohmann::json &paramsIn )
+{
+	try
+	{
+		TBitrateControlConfig config;
+		
+		if( paramsIn.find( "min_bitrate" ) != paramsIn.end() )
+		{
+			config.m_minBitrate_bps = paramsIn.at( "min_bitrate" ).get<uint32_t>();
+		}
+		
+		if( paramsIn.find( "max_bitrate" ) != paramsIn.end() )
+		{
+			config.m_maxBitrate_bps = paramsIn.at( "max_bitrate" ).get<uint32_t>();
+		}
+		
+		if( paramsIn.find( "min_framerate" ) != paramsIn.end() )
+		{
+			config.m_minFramerate = paramsIn.at( "min_framerate" ).get<uint32_t>();
+		}
+		
+		if( paramsIn.find( "max_latency" ) != paramsIn.end() )
+		{
+			config.m_highLatency_us = paramsIn.at( "max_latency" ).get<uint32_t>();
+			config.m_lowLatency_us 	= config.m_highLatency_us / 3;
+		}
+		
+		// Restarting keeps the settings from before the first start, not whatever the controller had got to
+		if( !m_pBitrateController )
+		{
+			GetBitrate();
+			GetFramerate();
+			
+			m_manualBitrate_bps = m_settings.at( "bitrate" ).at( "value" ).get<uint32_t>();
+			m_manualFramerate 	= m_settings.at( "framerate" ).at( "value" ).get<uint32_t>();
+		}
+		
+		m_pBitrateController 	= util::make_unique<CBitrateController>( config, m_manualBitrate_bps, m_manualFramerate );
+		m_nextBitrateUpdate 	= std::chrono::steady_clock::now();
+		
+		// The starting bitrate may have been clamped into the new bounds
+		ApplyBitrateControl();
+	}
+	catch( const std::exception &e )
+	{
+		throw std::runtime_error( "Command failed: StartBitrateControl[" + m_channelString + "]: " + std::string( e.what() ) );
+	}
+	
+	m_eventEmitter.Emit( "status", "bitrate_control_started" );
+}
+
+void CVideoChannel::StopBitrateControl( const nlohmann::json &paramsIn )
+{
+	if( !m_pBitrateController )
+	{
+		return;
+	}
+	
+	m_pBitrateController.reset();
+	
+	json update;
+	
+	try
+	{
+		SetBitrate( { { "value", m_manualBitrate_bps } } );
+		SetFramerate( { { "value", m_manualFramerate } } );
+		
+		update[ "bitrate" ] 	= m_settings[ "bitrate" ];
+		update[ "framerate" ] 	= m_settings[ "framerate" ];
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Failed to restore settings after bitrate control: " << e.what() << endl;
+	}
+	
+	m_eventEmitter.Emit( "settings", update );
+	m_eventEmitter.Emit( "status", "bitrate_control_stopped" );
+}
+
+void CVideoChannel::ApplyBitrateControl()
+{
+	json update;
+	uint32_t bitrate 	= m_pBitrateController->GetBitrate();
+	uint32_t framerate 	= m_pBitrateController->GetFramerate();
+	
+	try
+	{
+		if( m_settings.at( "bitrate" ).at( "value" ).get<uint32_t>() != bitrate )
+		{
+			SetBitrate( { { "value", bitrate } } );
+			update[ "bitrate" ] = m_settings[ "bitrate" ];
+		}
+		
+		if( m_settings.at( "framerate" ).at( "value" ).get<uint32_t>() != framerate )
+		{
+			SetFramerate( { { "value", framerate } } );
+			update[ "framerate" ] = m_settings[ "framerate" ];
+		}
+	}
+	catch( const std::exception &e )
+	{
+		cerr << "Bitrate control: " << e.what() << endl;
+	}
+	
+	if( !update.empty() )
+	{
+		cout << "Bitrate control[" << m_channelString << "]: " << CBitrateController::ToString( m_pBitrateController->GetState() )
+			<< ", " << bitrate << " bps at " << framerate << " fps" << endl;
+		
+		m_eventEmitter.Emit( "settings", update );
+	}
+}
+
 void CVideoChannel::ApplySettings( const nlohmann::json &paramsIn )
 {	
 	// paramsIn format:
@@ -9,6 +9,23 @@
 
 #include "CEventEmitter.h"
 #include "CMuxer.h"
+#include "CRecorder.h"
+#include "CPreEventBuffer.h"
+#include "CHlsWriter.h"
+#include "CTaskQueue.h"
+#include "CPlayback.h"
+#include "CTelemetrySubscriber.h"
+#include "CSeiInjector.h"
+#include "CSpsRewriter.h"
+#include "CTemporalDecimator.h"
+#include "CBitstreamAnalyzer.h"
+#include "CAccessUnitAssembler.h"
+#include "CHttpServer.h"
+#include "CRtspServer.h"
+#include "CWebRtcServer.h"
+#include "CTsMulticastOutput.h"
+#include "CFragmentRouter.h"
+#include "CBitrateController.h"
 
 // Defines
 #define VIDEO_BACKEND "\"v4l2\""
@@ -27,15 +44,42 @@ public:
 
 	bool IsAlive();
 	void Initialize();
+	video_channel_t GetChannel() const { return m_channel; }
 	void HandleMessage( const nlohmann::json &commandIn );
+	
+	// Periodic work on the command thread: runs the bitrate controller when it's enabled
+	void Update();
+	
+	// Closed segments are handed on for faststart conversion when the recording asked for it
+	void SetSegmentClosedCallback( TSegmentClosedCallback callbackIn );
+	
+	// True if live video has fallen behind since the last call. Only called from the faststart worker.
+	bool IsUnderPressure();
+	
+	// Extra consumers of the channel's fragments (e.g. the HTTP server). Detached again when the channel is destroyed.
+	void AddFragmentSink( CFragmentSink *sinkIn );
+	
+	// H264 NAL units also go to this RTSP stream, bypassing the muxer. The input must outlive the channel.
+	void SetRtspInput( CRtspServer::CStreamInput *inputIn );
+	
+	// Same for WebRTC. The viewers' keyframe requests are passed on to the camera from the video callback.
+	void SetWebRtcInput( CWebRtcServer::CStreamInput *inputIn );
+	
+	// MJPEG channels only: complete JPEGs from the capture buffer go to this HTTP stream. The input must outlive the channel.
+	void SetJpegInput( CHttpServer::CJpegInput *inputIn );
+	bool IsMjpeg() const;
 
 private:
 	
 	video_channel_t 				m_channel;
+	CpperoMQ::Context 				*m_pContext;
 	std::string						m_cameraString;
 	std::string						m_channelString;
 	std::string 					m_eventEndpoint;
 	std::string 					m_videoEndpoint;
+	std::string 					m_playbackEndpoint;
+	std::string 					m_baseLayerEndpoint;
+	std::string 					m_routerEndpoint;
 	
 	CEventEmitter 					m_eventEmitter;
 	
@@ -46,7 +90,47 @@ private:
 	TApiFunctionMap 				m_settingsApiMap;
 	TGetAPIMap 						m_privateApiMap;
 	
+	CBitstreamAnalyzer				m_bitstreamAnalyzer;
+	CAccessUnitAssembler			m_accessUnitAssembler;
+	CSpsRewriter					m_spsRewriter;
+	CSeiInjector					m_seiInjector;
 	CMuxer							m_muxer;
+	CTelemetrySubscriber			m_telemetry;
+	CRecorder						m_recorder;
+	CPreEventBuffer					m_preEventBuffer;
+	CHlsWriter						m_hlsWriter;
+	CTsMulticastOutput				m_tsOutput;
+	CFragmentRouter					m_fragmentRouter;
+	
+	CTaskQueue						m_taskQueue;
+	CPlayback						m_playback;
+	
+	// Reduced framerate output built from the lower temporal layers. The muxer is created on first use and kept.
+	CTemporalDecimator				m_decimator;
+	std::unique_ptr<CMuxer>			m_pBaseLayerMuxer;
+	std::atomic<bool>				m_baseLayerEnabled;
+	
+	TSegmentClosedCallback			m_segmentClosedCallback;
+	std::vector<CFragmentSink*>		m_externalSinks;
+	std::atomic<CRtspServer::CStreamInput*>	m_pRtspInput;
+	std::atomic<CWebRtcServer::CStreamInput*>	m_pWebRtcInput;
+	std::atomic<CHttpServer::CJpegInput*>	m_pJpegInput;
+	// Shared with the server's keyframe request handler, which can outlive the channel
+	std::shared_ptr<std::atomic<bool>>	m_pKeyframeRequested;
+	std::atomic<bool>				m_faststartRecording;
+	
+	uint64_t						m_lastDroppedFrames			= 0;
+	uint64_t						m_lastDroppedFragments		= 0;
+	
+	// Null unless adaptive bitrate is on. Set to the operator's settings again when it's turned off.
+	std::unique_ptr<CBitrateController>	m_pBitrateController;
+	uint32_t						m_manualBitrate_bps			= 0;
+	uint32_t						m_manualFramerate			= 0;
+	uint64_t						m_lastBitrateCallbacks		= 0;
+	std::chrono::steady_clock::time_point m_nextBitrateUpdate;
+	
+	const uint32_t					k_pressureLatency_us		= 100000;
+	const std::chrono::milliseconds	k_bitrateUpdateInterval		= std::chrono::milliseconds( 500 );
 	
 	static void VideoCallback( unsigned char *dataBufferOut, unsigned int bufferSizeIn, video_info_t infoIn, void *userDataIn );
 	
@@ -80,6 +164,37 @@ private:
 	
 	// H264
 	void ForceIFrame( const nlohmann::json &paramsIn );
+	void ConfigureSei( const nlohmann::json &paramsIn );
+	void ConfigureSpsRewrite( const nlohmann::json &paramsIn );
+	void StartBaseLayer( const nlohmann::json &paramsIn );
+	void StopBaseLayer( const nlohmann::json &paramsIn );
+	
+	// Live output
+	void StartHls( const nlohmann::json &paramsIn );
+	void StopHls( const nlohmann::json &paramsIn );
+	void StartTsMulticast( const nlohmann::json &paramsIn );
+	void StopTsMulticast( const nlohmann::json &paramsIn );
+	
+	// Adaptive bitrate
+	void StartBitrateControl( const nlohmann::json &paramsIn );
+	void StopBitrateControl( const nlohmann::json &paramsIn );
+	void ApplyBitrateControl();
+	
+	// Recording
+	void StartRecording( const nlohmann::json &paramsIn );
+	void StopRecording( const nlohmann::json &paramsIn );
+	void DumpBuffer( const nlohmann::json &paramsIn );
+	void ExportClip( const nlohmann::json &paramsIn );
+	
+	// Playback
+	void StartPlayback( const nlohmann::json &paramsIn );
+	void SeekPlayback( const nlohmann::json &paramsIn );
+	void SetPlaybackSpeed( const nlohmann::json &paramsIn );
+	void StopPlayback( const nlohmann::json &paramsIn );
+	
+	// Telemetry
+	void StartTelemetry( const nlohmann::json &paramsIn );
+	void StopTelemetry( const nlohmann::json &paramsIn );
 	
 	//--------------------
 	// Settings API
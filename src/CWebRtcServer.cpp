@@ -0,0 +1,1218 @@
+// Includes
+#include "CWebRtcServer.h"
+#include "Stun.h"
+#include "H264.h"
+#include "Utility.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <openssl/rand.h>
+
+extern "C"
+{
+	// FFmpeg
+	#include <libavutil/time.h>
+}
+
+using namespace std;
+
+namespace
+{
+	// RTCP payload-specific feedback (RFC 4585) and the two messages in it that ask for a keyframe
+	const uint8_t 	k_rtcpPayloadFeedback 	= 206;
+	const uint8_t 	k_feedbackPli 			= 1;
+	const uint8_t 	k_feedbackFir 			= 4;
+	
+	bool SetNonBlocking( int socketIn )
+	{
+		int flags = fcntl( socketIn, F_GETFL, 0 );
+		return ( flags != -1 ) && ( fcntl( socketIn, F_SETFL, flags | O_NONBLOCK ) != -1 );
+	}
+	
+	// profile_idc of the first SPS in the segments, or 0
+	uint8_t FindProfileIdc( const TBufferSegment *segmentsIn, size_t segmentCountIn )
+	{
+		for( size_t i = 0; i < segmentCountIn; ++i )
+		{
+			const uint8_t *cursor 	= segmentsIn[ i ].m_pData;
+			const uint8_t *end 		= cursor + segmentsIn[ i ].m_size;
+			h264::TNalUnit nal;
+			
+			while( h264::NextNalUnit( cursor, end, nal ) )
+			{
+				if( nal.m_size > 1 && nal.GetType() == h264::NAL_SPS )
+				{
+					return nal.m_pData[ 1 ];
+				}
+				
+				if( nal.IsVCL() )
+				{
+					// Parameter sets come first
+					return 0;
+				}
+			}
+		}
+		
+		return 0;
+	}
+	
+	bool StartsWith( const std::string &stringIn, const std::string &prefixIn )
+	{
+		return stringIn.compare( 0, prefixIn.size(), prefixIn ) == 0;
+	}
+	
+	bool EqualsIgnoreCase( const std::string &aIn, const std::string &bIn )
+	{
+		return aIn.size() == bIn.size() && std::equal( aIn.begin(), aIn.end(), bIn.begin(), []( char left, char right ){ return ::tolower( left ) == ::tolower( right ); } );
+	}
+}
+
+// ----------------------------------------------------
+// CStreamInput
+
+CWebRtcServer::CStreamInput::CStreamInput( CWebRtcServer *serverIn, int indexIn )
+	: m_pServer( serverIn )
+	, m_index( indexIn )
+	, m_packetizer( (uint32_t)std::rand(), serverIn->k_defaultPayloadType )
+	, m_profileIdc( 0 )
+{
+}
+
+void CWebRtcServer::CStreamInput::Write( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool isFrameStartIn )
+{
+	if( isFrameStartIn )
+	{
+		// 90kHz capture clock, shared by every callback of the access unit
+		m_timestamp = (uint32_t)( (uint64_t)av_gettime() * 9 / 100 );
+	}
+	
+	if( m_pServer->m_playingCount == 0 )
+	{
+		// Nobody to send to. Only keep track of the profile, for answering offers.
+		uint8_t profileIdc = isFrameStartIn ? FindProfileIdc( segmentsIn, segmentCountIn ) : 0;
+		
+		if( profileIdc != 0 )
+		{
+			m_profileIdc = profileIdc;
+		}
+		
+		return;
+	}
+	
+	TRtpBurstPtr burst = m_packetizer.Packetize( segmentsIn, segmentCountIn, m_timestamp, isFrameStartIn );
+	
+	if( burst->m_sps.size() > 1 )
+	{
+		m_profileIdc = burst->m_sps[ 1 ];
+	}
+	
+	if( !burst->m_packets.empty() )
+	{
+		m_pServer->QueueBurst( m_index, burst );
+	}
+}
+
+void CWebRtcServer::CStreamInput::SetKeyframeRequestHandler( std::function<void()> handlerIn )
+{
+	m_keyframeRequestHandler = handlerIn;
+}
+
+// ----------------------------------------------------
+// CWebRtcServer
+
+CWebRtcServer::CWebRtcServer( uint16_t portIn, std::shared_ptr<CTokenBucket> pacingBucketIn )
+	: m_sessionCount( 0 )
+	, m_playingCount( 0 )
+	, m_packetsSent( 0 )
+	, m_packetsDropped( 0 )
+	, m_keyframeRequests( 0 )
+	, m_port( portIn )
+	, m_pPacer( pacingBucketIn ? util::make_unique<CPacedSender>( pacingBucketIn ) : nullptr )
+	, m_killThread( false )
+{
+}
+
+CWebRtcServer::~CWebRtcServer()
+{
+	Stop();
+}
+
+CWebRtcServer::CStreamInput* CWebRtcServer::AddStream( const std::string &nameIn )
+{
+	if( m_thread.joinable() )
+	{
+		throw std::runtime_error( "Streams must be added before the WebRTC server starts" );
+	}
+	
+	TStream stream;
+	stream.m_name 	= nameIn;
+	stream.m_pInput = std::unique_ptr<CStreamInput>( new CStreamInput( this, (int)m_streams.size() ) );
+	
+	m_streams.push_back( std::move( stream ) );
+	
+	return m_streams.back().m_pInput.get();
+}
+
+void CWebRtcServer::Start()
+{
+	if( !m_pDtlsContext )
+	{
+		m_pDtlsContext = util::make_unique<CDtlsContext>();
+	}
+	
+	OpenSockets();
+	
+	m_killThread 	= false;
+	m_thread 		= std::thread( &CWebRtcServer::ThreadLoop, this );
+	
+	cout << "WebRTC server listening on port " << m_port << " (HTTP signaling on TCP, media on UDP)" << endl;
+}
+
+void CWebRtcServer::Stop()
+{
+	if( m_thread.joinable() )
+	{
+		m_killThread = true;
+		
+		uint64_t wake = 1;
+		if( write( m_wakeFd, &wake, sizeof( wake ) ) < 0 )
+		{
+			cerr << "Failed to wake WebRTC server thread" << endl;
+		}
+		
+		m_thread.join();
+	}
+	
+	// Say goodbye while the socket is still open
+	for( std::unique_ptr<TSession> &session : m_sessions )
+	{
+		CloseSession( *session );
+	}
+	
+	for( TSignalingClient &client : m_clients )
+	{
+		close( client.m_socket );
+	}
+	
+	m_sessions.clear();
+	m_clients.clear();
+	m_sessionCount 	= 0;
+	m_playingCount 	= 0;
+	
+	CloseSockets();
+}
+
+void CWebRtcServer::OpenSockets()
+{
+	sockaddr_in address;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family 		= AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_ANY );
+	address.sin_port 		= htons( m_port );
+	
+	m_listenSocket 	= socket( AF_INET, SOCK_STREAM, 0 );
+	m_udpSocket 	= socket( AF_INET, SOCK_DGRAM, 0 );
+	
+	if( m_listenSocket < 0 || m_udpSocket < 0 )
+	{
+		std::string error( strerror( errno ) );
+		CloseSockets();
+		
+		throw std::runtime_error( "Failed to create WebRTC sockets: " + error );
+	}
+	
+	int reuse = 1;
+	setsockopt( m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+	
+	if( bind( m_listenSocket, (sockaddr*)&address, sizeof( address ) ) < 0 || listen( m_listenSocket, 16 ) < 0 || !SetNonBlocking( m_listenSocket )
+		|| bind( m_udpSocket, (sockaddr*)&address, sizeof( address ) ) < 0 || !SetNonBlocking( m_udpSocket ) )
+	{
+		std::string error( strerror( errno ) );
+		CloseSockets();
+		
+		throw std::runtime_error( "Failed to listen on WebRTC port " + std::to_string( m_port ) + ": " + error );
+	}
+	
+	// A whole IDR goes out in one go, to every viewer, give it room
+	int sendBufferSize = 2 * 1024 * 1024;
+	setsockopt( m_udpSocket, SOL_SOCKET, SO_SNDBUF, &sendBufferSize, sizeof( sendBufferSize ) );
+	
+	m_wakeFd = eventfd( 0, EFD_NONBLOCK );
+	
+	if( m_wakeFd < 0 )
+	{
+		CloseSockets();
+		throw std::runtime_error( "Failed to create WebRTC server eventfd" );
+	}
+}
+
+void CWebRtcServer::CloseSockets()
+{
+	for( int *fd : { &m_listenSocket, &m_udpSocket, &m_wakeFd } )
+	{
+		if( *fd >= 0 )
+		{
+			close( *fd );
+			*fd = -1;
+		}
+	}
+}
+
+void CWebRtcServer::QueueBurst( int streamIn, const TRtpBurstPtr &burstIn )
+{
+	// Called from the video callback: only a pointer is queued, the server thread does the encryption and sending
+	{
+		std::lock_guard<std::mutex> lock( m_pendingMutex );
+		m_pending.push_back( { streamIn, burstIn } );
+	}
+	
+	if( m_wakeFd >= 0 )
+	{
+		uint64_t wake = 1;
+		if( write( m_wakeFd, &wake, sizeof( wake ) ) < 0 )
+		{
+			// Counter is saturated, the server thread is already due to wake up
+		}
+	}
+}
+
+void CWebRtcServer::RequestKeyframe( int streamIn )
+{
+	CStreamInput &input = *m_streams[ streamIn ].m_pInput;
+	auto now = std::chrono::steady_clock::now();
+	
+	if( now - input.m_lastKeyframeRequest < k_keyframeRequestInterval )
+	{
+		return;
+	}
+	
+	input.m_lastKeyframeRequest = now;
+	m_keyframeRequests++;
+	
+	if( input.m_keyframeRequestHandler )
+	{
+		input.m_keyframeRequestHandler();
+	}
+}
+
+void CWebRtcServer::ThreadLoop()
+{
+	std::vector<pollfd> pollFds;
+	
+	while( !m_killThread )
+	{
+		pollFds.clear();
+		pollFds.push_back( { m_listenSocket, POLLIN, 0 } );
+		pollFds.push_back( { m_wakeFd, POLLIN, 0 } );
+		pollFds.push_back( { m_udpSocket, POLLIN, 0 } );
+		
+		const size_t k_clientOffset = pollFds.size();
+		
+		for( TSignalingClient &client : m_clients )
+		{
+			pollFds.push_back( { client.m_socket, (short)( POLLIN | ( client.m_sent < client.m_output.size() ? POLLOUT : 0 ) ), 0 } );
+		}
+		
+		// DTLS retransmission timers need servicing while a handshake is under way
+		bool isHandshaking = std::any_of( m_sessions.begin(), m_sessions.end(), []( const std::unique_ptr<TSession> &sessionIn ){ return sessionIn->m_state == ESessionState::HANDSHAKING; } );
+		int timeout 		= isHandshaking ? k_handshakePollTimeout_ms : k_pollTimeout_ms;
+		
+		// And in time for the next paced packet
+		if( m_pacingTimeout_ms >= 0 )
+		{
+			timeout = std::min( timeout, m_pacingTimeout_ms );
+		}
+		
+		if( poll( pollFds.data(), pollFds.size(), timeout ) < 0 )
+		{
+			if( errno != EINTR )
+			{
+				cerr << "WebRTC server poll failed: " << strerror( errno ) << endl;
+			}
+			
+			continue;
+		}
+		
+		if( pollFds[ 1 ].revents & POLLIN )
+		{
+			uint64_t wake;
+			if( read( m_wakeFd, &wake, sizeof( wake ) ) < 0 )
+			{
+				// Already drained
+			}
+		}
+		
+		if( pollFds[ 2 ].revents & POLLIN )
+		{
+			ReadDatagrams();
+		}
+		
+		DistributePending();
+		
+		if( m_pPacer )
+		{
+			m_pacingTimeout_ms = m_pPacer->Flush( m_udpSocket );
+		}
+		
+		for( size_t i = 0; i < m_clients.size(); ++i )
+		{
+			TSignalingClient &client 	= m_clients[ i ];
+			short events 				= pollFds[ i + k_clientOffset ].revents;
+			bool keep 					= !( events & ( POLLERR | POLLHUP | POLLNVAL ) );
+			
+			if( keep && ( events & POLLIN ) )
+			{
+				keep = ReadFromClient( client );
+			}
+			
+			if( keep && client.m_sent < client.m_output.size() )
+			{
+				keep = WriteToClient( client );
+			}
+			
+			// One request per connection
+			if( !keep || ( client.m_responded && client.m_sent == client.m_output.size() ) )
+			{
+				close( client.m_socket );
+				client.m_socket = -1;
+			}
+		}
+		
+		m_clients.erase( std::remove_if( m_clients.begin(), m_clients.end(), []( const TSignalingClient &clientIn ){ return clientIn.m_socket < 0; } ), m_clients.end() );
+		
+		if( pollFds[ 0 ].revents & POLLIN )
+		{
+			AcceptClients();
+		}
+		
+		ServiceSessions();
+	}
+}
+
+void CWebRtcServer::DistributePending()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_pendingMutex );
+		m_draining.swap( m_pending );
+	}
+	
+	for( TPendingBurst &pending : m_draining )
+	{
+		for( std::unique_ptr<TSession> &session : m_sessions )
+		{
+			if( session->m_state == ESessionState::PLAYING && session->m_stream == pending.m_stream )
+			{
+				SendBurst( *session, pending.m_pBurst );
+			}
+		}
+	}
+	
+	m_draining.clear();
+}
+
+void CWebRtcServer::SendBurst( TSession &sessionIn, const TRtpBurstPtr &burstIn )
+{
+	if( sessionIn.m_waitingForKeyframe )
+	{
+		if( !burstIn->m_isKeyframe )
+		{
+			return;
+		}
+		
+		sessionIn.m_waitingForKeyframe = false;
+	}
+	
+	// The whole frame or none of it. A frame that doesn't fit means the link is too slow: resume at the next IDR.
+	if( m_pPacer && !m_pPacer->HasRoom( burstIn->m_data.size() + burstIn->m_packets.size() * CSrtpContext::k_authTagSize ) )
+	{
+		m_packetsDropped 				+= burstIn->m_packets.size();
+		sessionIn.m_waitingForKeyframe 	= true;
+		return;
+	}
+	
+	// Every session has its own keys, so each gets its own encrypted copy of the burst
+	size_t packetCount = burstIn->m_packets.size();
+	
+	m_sendBuffer.resize( packetCount * k_maxPacketSize );
+	m_messages.resize( packetCount );
+	m_iovecs.resize( packetCount );
+	
+	size_t messageCount = 0;
+	
+	for( size_t i = 0; i < packetCount; ++i )
+	{
+		const TRtpBurst::TPacket &packet = burstIn->m_packets[ i ];
+		uint8_t *data = &m_sendBuffer[ i * k_maxPacketSize ];
+		
+		if( packet.m_size + CSrtpContext::k_authTagSize > k_maxPacketSize )
+		{
+			m_packetsDropped++;
+			continue;
+		}
+		
+		memcpy( data, burstIn->m_data.data() + packet.m_offset + CRtpPacketizer::k_interleaveHeaderSize, packet.m_size );
+		
+		// The payload type this browser picked, keeping the marker bit
+		data[ 1 ] = ( data[ 1 ] & 0x80 ) | sessionIn.m_payloadType;
+		
+		size_t protectedSize = 0;
+		
+		if( !sessionIn.m_pSrtpOut->ProtectRtp( data, packet.m_size, protectedSize ) )
+		{
+			m_packetsDropped++;
+			continue;
+		}
+		
+		if( m_pPacer )
+		{
+			m_pPacer->Queue( data, protectedSize, sessionIn.m_address );
+			m_packetsSent++;
+			continue;
+		}
+		
+		m_iovecs[ messageCount ].iov_base 	= data;
+		m_iovecs[ messageCount ].iov_len 	= protectedSize;
+		
+		mmsghdr &message = m_messages[ messageCount ];
+		memset( &message, 0, sizeof( message ) );
+		message.msg_hdr.msg_name 		= &sessionIn.m_address;
+		message.msg_hdr.msg_namelen 	= sizeof( sessionIn.m_address );
+		message.msg_hdr.msg_iov 		= &m_iovecs[ messageCount ];
+		message.msg_hdr.msg_iovlen 		= 1;
+		
+		messageCount++;
+	}
+	
+	size_t sentCount = 0;
+	
+	while( sentCount < messageCount )
+	{
+		// UDP is allowed to lose packets. Never wait on it: the browser asks for a keyframe if it matters.
+		int sent = sendmmsg( m_udpSocket, &m_messages[ sentCount ], messageCount - sentCount, MSG_DONTWAIT );
+		
+		if( sent <= 0 )
+		{
+			if( sent < 0 && errno == EINTR )
+			{
+				continue;
+			}
+			
+			break;
+		}
+		
+		sentCount += sent;
+	}
+	
+	m_packetsSent 		+= sentCount;
+	m_packetsDropped 	+= messageCount - sentCount;
+}
+
+void CWebRtcServer::ReadDatagrams()
+{
+	uint8_t buffer[ 2048 ];
+	
+	while( true )
+	{
+		sockaddr_in address;
+		socklen_t addressSize = sizeof( address );
+		
+		ssize_t size = recvfrom( m_udpSocket, buffer, sizeof( buffer ), MSG_DONTWAIT, (sockaddr*)&address, &addressSize );
+		
+		if( size <= 0 )
+		{
+			return;
+		}
+		
+		if( stun::IsStun( buffer, size ) )
+		{
+			HandleStun( buffer, size, address );
+			continue;
+		}
+		
+		TSession *session = FindSession( address );
+		
+		if( session == nullptr )
+		{
+			continue;
+		}
+		
+		if( buffer[ 0 ] >= 20 && buffer[ 0 ] <= 63 && session->m_pDtls )
+		{
+			HandleDtls( *session, buffer, size );
+		}
+		else if( buffer[ 0 ] >= 128 && buffer[ 0 ] <= 191 )
+		{
+			HandleRtcp( *session, buffer, size );
+		}
+	}
+}
+
+void CWebRtcServer::HandleStun( const uint8_t *dataIn, size_t sizeIn, const sockaddr_in &addressIn )
+{
+	stun::TBindingRequest request;
+	
+	if( !stun::ParseBindingRequest( dataIn, sizeIn, request ) )
+	{
+		return;
+	}
+	
+	// USERNAME is "<our ufrag>:<their ufrag>"
+	size_t separator = request.m_username.find( ':' );
+	
+	if( separator == std::string::npos )
+	{
+		return;
+	}
+	
+	const std::string localUfrag 	= request.m_username.substr( 0, separator );
+	const std::string remoteUfrag 	= request.m_username.substr( separator + 1 );
+	
+	auto it = std::find_if( m_sessions.begin(), m_sessions.end(), [&]( const std::unique_ptr<TSession> &sessionIn )
+	{
+		return sessionIn->m_state != ESessionState::CLOSED && sessionIn->m_localUfrag == localUfrag && sessionIn->m_remoteUfrag == remoteUfrag;
+	} );
+	
+	if( it == m_sessions.end() || !stun::CheckIntegrity( dataIn, sizeIn, ( *it )->m_localPassword ) )
+	{
+		return;
+	}
+	
+	TSession &session = **it;
+	
+	std::vector<uint8_t> response = stun::BuildBindingResponse( request, addressIn, session.m_localPassword );
+	sendto( m_udpSocket, response.data(), response.size(), MSG_DONTWAIT, (const sockaddr*)&addressIn, sizeof( addressIn ) );
+	
+	session.m_lastConsent = std::chrono::steady_clock::now();
+	
+	// We're ICE-lite, so the browser picks the pair. Send to wherever its nominated check came from.
+	if( !session.m_hasAddress || request.m_useCandidate )
+	{
+		session.m_address 		= addressIn;
+		session.m_hasAddress 	= true;
+	}
+	
+	if( session.m_state == ESessionState::CONNECTING )
+	{
+		// We're DTLS passive, so this only gets ready for the browser's ClientHello
+		session.m_pDtls = util::make_unique<CDtlsTransport>( *m_pDtlsContext );
+		session.m_state = ESessionState::HANDSHAKING;
+	}
+}
+
+void CWebRtcServer::HandleDtls( TSession &sessionIn, const uint8_t *dataIn, size_t sizeIn )
+{
+	sessionIn.m_pDtls->HandleDatagram( dataIn, sizeIn );
+	FlushDtls( sessionIn );
+	
+	CDtlsTransport::EState state = sessionIn.m_pDtls->GetState();
+	
+	if( state == CDtlsTransport::EState::CLOSED || state == CDtlsTransport::EState::FAILED )
+	{
+		CloseSession( sessionIn );
+		return;
+	}
+	
+	if( state != CDtlsTransport::EState::CONNECTED || sessionIn.m_state != ESessionState::HANDSHAKING )
+	{
+		return;
+	}
+	
+	// The certificate is only trusted because it's the one the browser put in its offer
+	if( !EqualsIgnoreCase( sessionIn.m_pDtls->GetPeerFingerprint(), sessionIn.m_remoteFingerprint ) )
+	{
+		cerr << "WebRTC session " << sessionIn.m_id << ": DTLS certificate does not match the offer's fingerprint" << endl;
+		CloseSession( sessionIn );
+		return;
+	}
+	
+	TSrtpKeys keys;
+	
+	if( !sessionIn.m_pDtls->ExportSrtpKeys( keys ) )
+	{
+		cerr << "WebRTC session " << sessionIn.m_id << ": no SRTP profile negotiated" << endl;
+		CloseSession( sessionIn );
+		return;
+	}
+	
+	sessionIn.m_pSrtpOut 	= util::make_unique<CSrtpContext>( keys.m_localKey, keys.m_localSalt );
+	sessionIn.m_pSrtcpIn 	= util::make_unique<CSrtpContext>( keys.m_remoteKey, keys.m_remoteSalt );
+	OPENSSL_cleanse( &keys, sizeof( keys ) );
+	
+	sessionIn.m_state 				= ESessionState::PLAYING;
+	sessionIn.m_waitingForKeyframe 	= true;
+	m_playingCount++;
+	
+	cout << "WebRTC session " << sessionIn.m_id << " playing " << m_streams[ sessionIn.m_stream ].m_name << endl;
+	
+	// Don't make a new viewer wait out the GOP
+	RequestKeyframe( sessionIn.m_stream );
+}
+
+void CWebRtcServer::HandleRtcp( TSession &sessionIn, uint8_t *dataIn, size_t sizeIn )
+{
+	// We only send, so anything in the RTP range is RTCP (RFC 5761 payload types 192-223)
+	if( sessionIn.m_state != ESessionState::PLAYING || sizeIn < 2 || dataIn[ 1 ] < 192 || dataIn[ 1 ] > 223 )
+	{
+		return;
+	}
+	
+	size_t size = 0;
+	
+	if( !sessionIn.m_pSrtcpIn->UnprotectRtcp( dataIn, sizeIn, size ) )
+	{
+		return;
+	}
+	
+	// Compound packet. Receiver reports and NACKs are ignored.
+	bool wantsKeyframe = false;
+	
+	for( size_t offset = 0; offset + 4 <= size; )
+	{
+		uint8_t format 	= dataIn[ offset ] & 0x1F;
+		uint8_t type 	= dataIn[ offset + 1 ];
+		size_t length 	= 4 * ( ( ( dataIn[ offset + 2 ] << 8 ) | dataIn[ offset + 3 ] ) + 1 );
+		
+		if( type == k_rtcpPayloadFeedback && ( format == k_feedbackPli || format == k_feedbackFir ) )
+		{
+			wantsKeyframe = true;
+		}
+		
+		offset += length;
+	}
+	
+	if( wantsKeyframe )
+	{
+		RequestKeyframe( sessionIn.m_stream );
+	}
+}
+
+void CWebRtcServer::FlushDtls( TSession &sessionIn )
+{
+	std::vector<std::vector<uint8_t>> &outgoing = sessionIn.m_pDtls->GetOutgoing();
+	
+	for( const std::vector<uint8_t> &datagram : outgoing )
+	{
+		sendto( m_udpSocket, datagram.data(), datagram.size(), MSG_DONTWAIT, (const sockaddr*)&sessionIn.m_address, sizeof( sessionIn.m_address ) );
+	}
+	
+	outgoing.clear();
+}
+
+void CWebRtcServer::ServiceSessions()
+{
+	auto now = std::chrono::steady_clock::now();
+	
+	for( std::unique_ptr<TSession> &session : m_sessions )
+	{
+		if( session->m_state == ESessionState::HANDSHAKING )
+		{
+			session->m_pDtls->HandleTimeout();
+			FlushDtls( *session );
+			
+			if( session->m_pDtls->GetState() == CDtlsTransport::EState::FAILED )
+			{
+				CloseSession( *session );
+			}
+		}
+		
+		// Also covers answers the browser never connected to
+		if( session->m_state != ESessionState::CLOSED && now - session->m_lastConsent > k_consentTimeout )
+		{
+			cout << "WebRTC session " << session->m_id << " timed out" << endl;
+			CloseSession( *session );
+		}
+	}
+	
+	m_sessions.erase( std::remove_if( m_sessions.begin(), m_sessions.end(), []( const std::unique_ptr<TSession> &sessionIn ){ return sessionIn->m_state == ESessionState::CLOSED; } ), m_sessions.end() );
+	
+	m_sessionCount = (uint32_t)m_sessions.size();
+}
+
+void CWebRtcServer::CloseSession( TSession &sessionIn )
+{
+	if( sessionIn.m_state == ESessionState::PLAYING )
+	{
+		m_playingCount--;
+	}
+	
+	if( sessionIn.m_pDtls )
+	{
+		sessionIn.m_pDtls->Close();
+		FlushDtls( sessionIn );
+	}
+	
+	sessionIn.m_state = ESessionState::CLOSED;
+}
+
+CWebRtcServer::TSession* CWebRtcServer::FindSession( const sockaddr_in &addressIn )
+{
+	for( std::unique_ptr<TSession> &session : m_sessions )
+	{
+		if( session->m_hasAddress && session->m_state != ESessionState::CLOSED
+			&& session->m_address.sin_addr.s_addr == addressIn.sin_addr.s_addr && session->m_address.sin_port == addressIn.sin_port )
+		{
+			return session.get();
+		}
+	}
+	
+	return nullptr;
+}
+
+void CWebRtcServer::AcceptClients()
+{
+	while( true )
+	{
+		int clientSocket = accept( m_listenSocket, nullptr, nullptr );
+		
+		if( clientSocket < 0 )
+		{
+			return;
+		}
+		
+		if( m_clients.size() >= k_maxClients || !SetNonBlocking( clientSocket ) )
+		{
+			close( clientSocket );
+			continue;
+		}
+		
+		int noDelay = 1;
+		setsockopt( clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+		
+		TSignalingClient client;
+		client.m_socket = clientSocket;
+		
+		m_clients.push_back( std::move( client ) );
+	}
+}
+
+bool CWebRtcServer::ReadFromClient( TSignalingClient &clientIn )
+{
+	char buffer[ 4096 ];
+	
+	while( true )
+	{
+		ssize_t bytesRead = recv( clientIn.m_socket, buffer, sizeof( buffer ), 0 );
+		
+		if( bytesRead == 0 )
+		{
+			return false;
+		}
+		
+		if( bytesRead < 0 )
+		{
+			if( errno == EAGAIN || errno == EWOULDBLOCK )
+			{
+				break;
+			}
+			
+			return ( errno == EINTR );
+		}
+		
+		clientIn.m_input.append( buffer, bytesRead );
+		
+		if( clientIn.m_input.size() > k_maxRequestSize )
+		{
+			return false;
+		}
+	}
+	
+	if( clientIn.m_responded )
+	{
+		clientIn.m_input.clear();
+		return true;
+	}
+	
+	size_t headerEnd = clientIn.m_input.find( "\r\n\r\n" );
+	
+	if( headerEnd == std::string::npos )
+	{
+		return true;
+	}
+	
+	const std::string headers = clientIn.m_input.substr( 0, headerEnd + 2 );
+	size_t bodySize = std::strtoul( GetHeader( headers, "content-length" ).c_str(), nullptr, 10 );
+	
+	if( clientIn.m_input.size() < headerEnd + 4 + bodySize )
+	{
+		return true;
+	}
+	
+	HandleRequest( clientIn, headers, clientIn.m_input.substr( headerEnd + 4, bodySize ) );
+	
+	clientIn.m_input.clear();
+	clientIn.m_responded = true;
+	
+	return WriteToClient( clientIn );
+}
+
+bool CWebRtcServer::WriteToClient( TSignalingClient &clientIn )
+{
+	while( clientIn.m_sent < clientIn.m_output.size() )
+	{
+		ssize_t bytesSent = send( clientIn.m_socket, clientIn.m_output.data() + clientIn.m_sent, clientIn.m_output.size() - clientIn.m_sent, MSG_NOSIGNAL );
+		
+		if( bytesSent < 0 )
+		{
+			return ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR );
+		}
+		
+		clientIn.m_sent += bytesSent;
+	}
+	
+	return true;
+}
+
+void CWebRtcServer::HandleRequest( TSignalingClient &clientIn, const std::string &headersIn, const std::string &bodyIn )
+{
+	// Request line: <method> <path> HTTP/1.1
+	size_t methodEnd 	= headersIn.find( ' ' );
+	size_t pathEnd 		= ( methodEnd == std::string::npos ) ? std::string::npos : headersIn.find_first_of( " ?", methodEnd + 1 );
+	
+	if( pathEnd == std::string::npos )
+	{
+		clientIn.m_output = BuildResponse( "400 Bad Request" );
+		return;
+	}
+	
+	const std::string method 	= headersIn.substr( 0, methodEnd );
+	const std::string path 		= headersIn.substr( methodEnd + 1, pathEnd - methodEnd - 1 );
+	
+	// /<stream> or /<stream>/<session>
+	size_t nameEnd 				= path.find( '/', 1 );
+	const std::string name 		= path.substr( 1, ( nameEnd == std::string::npos ) ? std::string::npos : nameEnd - 1 );
+	const std::string sessionId = ( nameEnd == std::string::npos ) ? "" : path.substr( nameEnd + 1 );
+	int stream 					= FindStream( name );
+	
+	if( method == "OPTIONS" )
+	{
+		// CORS preflight, so a page served from anywhere can play
+		clientIn.m_output = BuildResponse( "204 No Content", "Access-Control-Allow-Methods: POST, DELETE, OPTIONS\r\nAccess-Control-Allow-Headers: Content-Type\r\n" );
+	}
+	else if( stream < 0 )
+	{
+		clientIn.m_output = BuildResponse( "404 Not Found" );
+	}
+	else if( method == "POST" && sessionId.empty() )
+	{
+		clientIn.m_output = HandleOffer( clientIn, stream, bodyIn );
+	}
+	else if( method == "DELETE" && !sessionId.empty() )
+	{
+		auto it = std::find_if( m_sessions.begin(), m_sessions.end(), [&]( const std::unique_ptr<TSession> &sessionIn )
+		{
+			return sessionIn->m_id == sessionId && sessionIn->m_stream == stream && sessionIn->m_state != ESessionState::CLOSED;
+		} );
+		
+		if( it == m_sessions.end() )
+		{
+			clientIn.m_output = BuildResponse( "404 Not Found" );
+			return;
+		}
+		
+		cout << "WebRTC session " << sessionId << " ended" << endl;
+		CloseSession( **it );
+		
+		clientIn.m_output = BuildResponse( "200 OK" );
+	}
+	else
+	{
+		clientIn.m_output = BuildResponse( "405 Method Not Allowed", "Allow: POST, DELETE, OPTIONS\r\n" );
+	}
+}
+
+std::string CWebRtcServer::HandleOffer( TSignalingClient &clientIn, int streamIn, const std::string &offerIn )
+{
+	if( m_sessions.size() >= k_maxSessions )
+	{
+		return BuildResponse( "503 Service Unavailable" );
+	}
+	
+	TOffer offer;
+	
+	if( !ParseOffer( offerIn, m_streams[ streamIn ].m_pInput->m_profileIdc, offer ) )
+	{
+		return BuildResponse( "400 Bad Request", "Content-Type: text/plain\r\n", "Expected an H264 video offer with ICE credentials, a SHA-256 fingerprint and packetization-mode=1\n" );
+	}
+	
+	std::unique_ptr<TSession> session = util::make_unique<TSession>();
+	session->m_id 					= RandomString( 16 );
+	session->m_stream 				= streamIn;
+	session->m_localUfrag 			= RandomString( 8 );
+	session->m_localPassword 		= RandomString( 24 );
+	session->m_remoteUfrag 			= offer.m_remoteUfrag;
+	session->m_remoteFingerprint 	= offer.m_fingerprint;
+	session->m_payloadType 			= (uint8_t)offer.m_payloadType;
+	session->m_lastConsent 			= std::chrono::steady_clock::now();
+	
+	// Our one candidate is the address the browser reached us on
+	sockaddr_in localAddress;
+	socklen_t addressSize = sizeof( localAddress );
+	char host[ INET_ADDRSTRLEN ] = "127.0.0.1";
+	
+	if( getsockname( clientIn.m_socket, (sockaddr*)&localAddress, &addressSize ) == 0 && localAddress.sin_addr.s_addr != htonl( INADDR_ANY ) )
+	{
+		inet_ntop( AF_INET, &localAddress.sin_addr, host, sizeof( host ) );
+	}
+	
+	const std::string answer = BuildAnswer( *session, offer, host );
+	const std::string location = "/" + m_streams[ streamIn ].m_name + "/" + session->m_id;
+	
+	cout << "WebRTC session " << session->m_id << " offered " << m_streams[ streamIn ].m_name << endl;
+	
+	m_sessions.push_back( std::move( session ) );
+	m_sessionCount = (uint32_t)m_sessions.size();
+	
+	return BuildResponse( "201 Created", "Content-Type: application/sdp\r\nLocation: " + location + "\r\n", answer );
+}
+
+bool CWebRtcServer::ParseOffer( const std::string &offerIn, uint8_t profileIdcIn, TOffer &offerOut )
+{
+	std::istringstream lines( offerIn );
+	std::string line;
+	
+	int videoSection 	= -1;
+	int section 		= -1;
+	
+	// H264 payload types in the video section that use packetization mode 1, and their fmtp
+	std::vector<int> payloadTypes;
+	std::vector<std::pair<int, std::string>> fmtps;
+	
+	while( std::getline( lines, line ) )
+	{
+		if( !line.empty() && line.back() == '\r' )
+		{
+			line.pop_back();
+		}
+		
+		if( StartsWith( line, "m=" ) )
+		{
+			// m=<media> <port> <proto> <format> ...
+			std::istringstream fields( line.substr( 2 ) );
+			TOfferedMedia media;
+			std::string port;
+			
+			fields >> media.m_media >> port >> media.m_protocol >> media.m_format;
+			
+			section = (int)offerOut.m_media.size();
+			offerOut.m_media.push_back( media );
+			
+			if( videoSection < 0 && media.m_media == "video" )
+			{
+				videoSection = section;
+			}
+		}
+		else if( StartsWith( line, "a=ice-ufrag:" ) && offerOut.m_remoteUfrag.empty() )
+		{
+			// Session level, or the same in every bundled section
+			offerOut.m_remoteUfrag = line.substr( 12 );
+		}
+		else if( StartsWith( line, "a=ice-pwd:" ) && offerOut.m_remotePassword.empty() )
+		{
+			offerOut.m_remotePassword = line.substr( 10 );
+		}
+		else if( StartsWith( line, "a=fingerprint:" ) && offerOut.m_fingerprint.empty() && EqualsIgnoreCase( line.substr( 14, 8 ), "sha-256 " ) )
+		{
+			offerOut.m_fingerprint = line.substr( 22 );
+		}
+		else if( StartsWith( line, "a=mid:" ) && section >= 0 )
+		{
+			offerOut.m_media[ section ].m_mid = line.substr( 6 );
+		}
+		else if( section >= 0 && section == videoSection )
+		{
+			if( line == "a=setup:passive" )
+			{
+				offerOut.m_isPassive = true;
+			}
+			else if( StartsWith( line, "a=rtpmap:" ) && line.find( " H264/90000" ) != std::string::npos )
+			{
+				payloadTypes.push_back( std::atoi( line.c_str() + 9 ) );
+			}
+			else if( StartsWith( line, "a=fmtp:" ) && line.find( ' ' ) != std::string::npos )
+			{
+				fmtps.push_back( { std::atoi( line.c_str() + 7 ), line.substr( line.find( ' ' ) + 1 ) } );
+			}
+		}
+	}
+	
+	if( videoSection < 0 || offerOut.m_isPassive || offerOut.m_remoteUfrag.empty() || offerOut.m_remotePassword.empty() || offerOut.m_fingerprint.empty() )
+	{
+		return false;
+	}
+	
+	// Prefer the browser's H264 flavour with the camera's profile, so the decoder is set up for what it gets
+	char profile[ 4 ];
+	snprintf( profile, sizeof( profile ), "%02x", profileIdcIn );
+	
+	for( int payloadType : payloadTypes )
+	{
+		auto fmtp = std::find_if( fmtps.begin(), fmtps.end(), [payloadType]( const std::pair<int, std::string> &fmtpIn ){ return fmtpIn.first == payloadType; } );
+		
+		if( fmtp == fmtps.end() || fmtp->second.find( "packetization-mode=1" ) == std::string::npos )
+		{
+			continue;
+		}
+		
+		size_t profileLevelId = fmtp->second.find( "profile-level-id=" );
+		bool isMatch = ( profileIdcIn != 0 && profileLevelId != std::string::npos && EqualsIgnoreCase( fmtp->second.substr( profileLevelId + 17, 2 ), profile ) );
+		
+		if( offerOut.m_payloadType < 0 || isMatch )
+		{
+			offerOut.m_payloadType 	= payloadType;
+			offerOut.m_fmtp 		= fmtp->second;
+		}
+		
+		if( isMatch )
+		{
+			break;
+		}
+	}
+	
+	if( offerOut.m_payloadType < 0 || offerOut.m_payloadType > 127 )
+	{
+		return false;
+	}
+	
+	offerOut.m_media[ videoSection ].m_isAccepted = true;
+	return true;
+}
+
+std::string CWebRtcServer::BuildAnswer( const TSession &sessionIn, const TOffer &offerIn, const std::string &hostIn )
+{
+	const CStreamInput &input 	= *m_streams[ sessionIn.m_stream ].m_pInput;
+	const std::string &name 	= m_streams[ sessionIn.m_stream ].m_name;
+	const std::string pt 		= std::to_string( sessionIn.m_payloadType );
+	const uint32_t ssrc 		= input.m_packetizer.GetSsrc();
+	
+	std::string answer = "v=0\r\n"
+						"o=- " + std::to_string( ssrc ) + " 2 IN IP4 " + hostIn + "\r\n"
+						"s=" + name + "\r\n"
+						"t=0 0\r\n"
+						"a=ice-lite\r\n";
+	
+	for( const TOfferedMedia &media : offerIn.m_media )
+	{
+		if( media.m_isAccepted && !media.m_mid.empty() )
+		{
+			// Everything we send rides on the video section's transport
+			answer += "a=group:BUNDLE " + media.m_mid + "\r\n";
+		}
+	}
+	
+	answer += "a=msid-semantic: WMS " + name + "\r\n";
+	
+	for( const TOfferedMedia &media : offerIn.m_media )
+	{
+		if( !media.m_isAccepted )
+		{
+			answer += "m=" + media.m_media + " 0 " + media.m_protocol + " " + media.m_format + "\r\n"
+						"c=IN IP4 0.0.0.0\r\n"
+						+ ( media.m_mid.empty() ? "" : "a=mid:" + media.m_mid + "\r\n" ) +
+						"a=inactive\r\n";
+			continue;
+		}
+		
+		answer += "m=video " + std::to_string( m_port ) + " UDP/TLS/RTP/SAVPF " + pt + "\r\n"
+					"c=IN IP4 " + hostIn + "\r\n"
+					+ ( media.m_mid.empty() ? "" : "a=mid:" + media.m_mid + "\r\n" ) +
+					"a=ice-ufrag:" + sessionIn.m_localUfrag + "\r\n"
+					"a=ice-pwd:" + sessionIn.m_localPassword + "\r\n"
+					"a=fingerprint:sha-256 " + m_pDtlsContext->GetFingerprint() + "\r\n"
+					"a=setup:passive\r\n"
+					"a=sendonly\r\n"
+					"a=rtcp-mux\r\n"
+					"a=rtpmap:" + pt + " H264/90000\r\n"
+					"a=fmtp:" + pt + " " + offerIn.m_fmtp + "\r\n"
+					"a=rtcp-fb:" + pt + " nack pli\r\n"
+					"a=rtcp-fb:" + pt + " ccm fir\r\n"
+					"a=msid:" + name + " " + name + "-video\r\n"
+					"a=ssrc:" + std::to_string( ssrc ) + " cname:geomuxpp\r\n"
+					"a=candidate:1 1 udp 2130706431 " + hostIn + " " + std::to_string( m_port ) + " typ host\r\n"
+					"a=end-of-candidates\r\n";
+	}
+	
+	return answer;
+}
+
+std::string CWebRtcServer::BuildResponse( const std::string &statusIn, const std::string &headersIn, const std::string &bodyIn )
+{
+	return "HTTP/1.1 " + statusIn + "\r\n"
+			"Access-Control-Allow-Origin: *\r\n"
+			"Access-Control-Expose-Headers: Location\r\n"
+			"Connection: close\r\n"
+			+ headersIn +
+			"Content-Length: " + std::to_string( bodyIn.size() ) + "\r\n"
+			"\r\n" + bodyIn;
+}
+
+int CWebRtcServer::FindStream( const std::string &nameIn )
+{
+	for( size_t i = 0; i < m_streams.size(); ++i )
+	{
+		if( m_streams[ i ].m_name == nameIn )
+		{
+			return (int)i;
+		}
+	}
+	
+	return -1;
+}
+
+std::string CWebRtcServer::RandomString( size_t lengthIn )
+{
+	// ICE credentials are what keeps other hosts off a session, so they come from the CSPRNG
+	static const char k_characters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+	
+	std::vector<uint8_t> random( lengthIn );
+	
+	if( RAND_bytes( random.data(), (int)random.size() ) != 1 )
+	{
+		throw std::runtime_error( "Failed to generate WebRTC credentials" );
+	}
+	
+	std::string result;
+	
+	for( uint8_t byte : random )
+	{
+		result += k_characters[ byte % ( sizeof( k_characters ) - 1 ) ];
+	}
+	
+	return result;
+}
+
+std::string CWebRtcServer::GetHeader( const std::string &headersIn, const std::string &nameIn )
+{
+	// Header names are case insensitive
+	std::string lowerHeaders( headersIn );
+	std::transform( lowerHeaders.begin(), lowerHeaders.end(), lowerHeaders.begin(), ::tolower );
+	
+	size_t position = lowerHeaders.find( "\r\n" + nameIn + ":" );
+	
+	if( position == std::string::npos )
+	{
+		return "";
+	}
+	
+	size_t valueStart 	= headersIn.find_first_not_of( " \t", position + 3 + nameIn.size() );
+	size_t valueEnd 	= headersIn.find( "\r\n", position + 2 );
+	
+	if( valueStart == std::string::npos || valueEnd == std::string::npos || valueStart >= valueEnd )
+	{
+		return "";
+	}
+	
+	return headersIn.substr( valueStart, valueEnd - valueStart );
+}
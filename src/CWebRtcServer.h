@@ -0,0 +1,235 @@
+#pragma once
+
+// Includes
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "CVideoBuffer.h"
+#include "CRtpPacketizer.h"
+#include "CDtlsContext.h"
+#include "CDtlsTransport.h"
+#include "CSrtpContext.h"
+#include "CPacedSender.h"
+
+// Sub-second browser viewing over WebRTC, WHEP style: the browser POSTs an SDP offer to http://<host>:<port>/<stream>
+// and gets the answer back in the response, then media flows over UDP on the same port number: ICE-lite, DTLS-SRTP and
+// the same H264 RTP packetization as CRtspServer, straight from the video callback. PLI/FIR feedback from the browser
+// asks the camera for an IDR. No retransmissions (NACK) and no audio. Single threaded and non-blocking (poll), like
+// the other servers.
+//
+// DELETE /<stream>/<session> (the Location of the answer) ends a session. Sessions that stop sending consent
+// checks are dropped after k_consentTimeout. With a pacing rate, media leaves at that peak rate instead of in one burst
+// per frame.
+class CWebRtcServer
+{
+public:
+	// Feeds one stream from the video callback
+	class CStreamInput
+	{
+	public:
+		// Called with the same segments written to the muxer
+		void Write( const TBufferSegment *segmentsIn, size_t segmentCountIn, bool isFrameStartIn );
+		
+		// Called on the server thread when a viewer needs a keyframe, so it must not block. Set before the server starts.
+		void SetKeyframeRequestHandler( std::function<void()> handlerIn );
+	
+	private:
+		friend class CWebRtcServer;
+		
+		CStreamInput( CWebRtcServer *serverIn, int indexIn );
+		
+		// Attributes
+		CWebRtcServer 			*m_pServer;
+		int 					m_index;
+		CRtpPacketizer 			m_packetizer;
+		uint32_t 				m_timestamp			= 0;
+		std::atomic<uint8_t> 	m_profileIdc;				// From the latest SPS, to pick the browser's matching H264 payload type. 0 until seen.
+		
+		std::function<void()> 					m_keyframeRequestHandler;
+		std::chrono::steady_clock::time_point 	m_lastKeyframeRequest;
+	};
+	
+	// Attributes
+	std::atomic<uint32_t> 		m_sessionCount;
+	std::atomic<uint32_t> 		m_playingCount;
+	std::atomic<uint64_t> 		m_packetsSent;
+	std::atomic<uint64_t> 		m_packetsDropped;
+	std::atomic<uint64_t> 		m_keyframeRequests;
+	
+	// Methods
+	// Without a pacing bucket, each frame's packets are sent as soon as they are protected. The bucket may be shared with other servers.
+	CWebRtcServer( uint16_t portIn, std::shared_ptr<CTokenBucket> pacingBucketIn );
+	virtual ~CWebRtcServer();
+	
+	// Streams must all be added before Start(). The returned input belongs to the server.
+	CStreamInput* AddStream( const std::string &nameIn );
+	
+	void Start();
+	void Stop();
+	
+	// Null without pacing
+	const TPacingStats* GetPacingStats() const { return m_pPacer ? &m_pPacer->m_stats : nullptr; }
+
+private:
+	enum class ESessionState
+	{
+		CONNECTING,			// Answer sent, waiting for the browser's first connectivity check
+		HANDSHAKING,		// ICE done, DTLS under way
+		PLAYING,
+		CLOSED
+	};
+	
+	struct TSession
+	{
+		std::string 						m_id;
+		int 								m_stream				= -1;
+		ESessionState 						m_state					= ESessionState::CONNECTING;
+		
+		// Negotiated in the offer/answer
+		std::string 						m_localUfrag;
+		std::string 						m_localPassword;
+		std::string 						m_remoteUfrag;
+		std::string 						m_remoteFingerprint;
+		uint8_t 							m_payloadType			= 0;
+		
+		// Where the browser's nominated candidate pair ends on its side
+		bool 								m_hasAddress			= false;
+		sockaddr_in 						m_address;
+		
+		std::unique_ptr<CDtlsTransport> 	m_pDtls;
+		std::unique_ptr<CSrtpContext> 		m_pSrtpOut;
+		std::unique_ptr<CSrtpContext> 		m_pSrtcpIn;
+		
+		bool 								m_waitingForKeyframe	= true;
+		std::chrono::steady_clock::time_point m_lastConsent;
+	};
+	
+	struct TSignalingClient
+	{
+		int 			m_socket		= -1;
+		std::string 	m_input;
+		std::string 	m_output;
+		size_t 			m_sent			= 0;
+		bool 			m_responded		= false;
+	};
+	
+	struct TStream
+	{
+		std::string 					m_name;
+		std::unique_ptr<CStreamInput> 	m_pInput;
+	};
+	
+	struct TPendingBurst
+	{
+		int 			m_stream;
+		TRtpBurstPtr 	m_pBurst;
+	};
+	
+	struct TOfferedMedia
+	{
+		std::string 	m_media;
+		std::string 	m_protocol;
+		std::string 	m_format;			// First one offered, echoed back when the section is rejected
+		std::string 	m_mid;
+		bool 			m_isAccepted	= false;
+	};
+	
+	struct TOffer
+	{
+		std::string 				m_remoteUfrag;
+		std::string 				m_remotePassword;
+		std::string 				m_fingerprint;		// SHA-256 only, which is all browsers send
+		bool 						m_isPassive			= false;
+		
+		std::vector<TOfferedMedia> 	m_media;			// In offer order, which the answer has to keep
+		int 						m_payloadType		= -1;
+		std::string 				m_fmtp;
+	};
+	
+	// Attributes
+	uint16_t 						m_port;
+	int 							m_listenSocket		= -1;
+	int 							m_udpSocket			= -1;
+	int 							m_wakeFd			= -1;
+	
+	std::unique_ptr<CDtlsContext> 	m_pDtlsContext;
+	
+	std::vector<TStream> 					m_streams;
+	std::vector<std::unique_ptr<TSession>> 	m_sessions;
+	std::vector<TSignalingClient> 			m_clients;
+	
+	// Filled by the video callbacks, drained by the server thread
+	std::mutex 						m_pendingMutex;
+	std::vector<TPendingBurst> 		m_pending;
+	std::vector<TPendingBurst> 		m_draining;
+	
+	// Reused to protect and send a burst
+	std::vector<uint8_t> 			m_sendBuffer;
+	std::vector<mmsghdr> 			m_messages;
+	std::vector<iovec> 				m_iovecs;
+	
+	std::unique_ptr<CPacedSender> 	m_pPacer;
+	int 							m_pacingTimeout_ms	= -1;
+	
+	std::thread 					m_thread;
+	std::atomic<bool> 				m_killThread;
+	
+	const size_t 					k_maxSessions			= 8;
+	const size_t 					k_maxClients			= 16;
+	const size_t 					k_maxRequestSize		= 65536;
+	const size_t 					k_maxPacketSize			= 1500;
+	const int 						k_pollTimeout_ms		= 1000;
+	const int 						k_handshakePollTimeout_ms	= 100;
+	const uint8_t 					k_defaultPayloadType	= 96;
+	
+	// Browsers refresh consent every 5s or so (RFC 7675)
+	const std::chrono::seconds 		k_consentTimeout		= std::chrono::seconds( 30 );
+	
+	// A viewer joining, or a burst of PLIs after loss, costs one IDR, not one per request
+	const std::chrono::milliseconds k_keyframeRequestInterval	= std::chrono::milliseconds( 500 );
+	
+	// Methods
+	void QueueBurst( int streamIn, const TRtpBurstPtr &burstIn );
+	void RequestKeyframe( int streamIn );
+	
+	void OpenSockets();
+	void CloseSockets();
+	
+	void ThreadLoop();
+	void DistributePending();
+	void SendBurst( TSession &sessionIn, const TRtpBurstPtr &burstIn );
+	
+	// UDP: STUN, DTLS and SRTCP share the socket and are told apart by their first byte (RFC 7983)
+	void ReadDatagrams();
+	void HandleStun( const uint8_t *dataIn, size_t sizeIn, const sockaddr_in &addressIn );
+	void HandleDtls( TSession &sessionIn, const uint8_t *dataIn, size_t sizeIn );
+	void HandleRtcp( TSession &sessionIn, uint8_t *dataIn, size_t sizeIn );
+	void FlushDtls( TSession &sessionIn );
+	void ServiceSessions();
+	void CloseSession( TSession &sessionIn );
+	TSession* FindSession( const sockaddr_in &addressIn );
+	
+	// Signaling over HTTP
+	void AcceptClients();
+	bool ReadFromClient( TSignalingClient &clientIn );
+	bool WriteToClient( TSignalingClient &clientIn );
+	void HandleRequest( TSignalingClient &clientIn, const std::string &headersIn, const std::string &bodyIn );
+	std::string HandleOffer( TSignalingClient &clientIn, int streamIn, const std::string &offerIn );
+	bool ParseOffer( const std::string &offerIn, uint8_t profileIdcIn, TOffer &offerOut );
+	std::string BuildAnswer( const TSession &sessionIn, const TOffer &offerIn, const std::string &hostIn );
+	std::string BuildResponse( const std::string &statusIn, const std::string &headersIn = "", const std::string &bodyIn = "" );
+	
+	int FindStream( const std::string &nameIn );
+	static std::string RandomString( size_t lengthIn );
+	static std::string GetHeader( const std::string &headersIn, const std::string &nameIn );
+};
@@ -0,0 +1,200 @@
+// Includes
+#include "Fec.h"
+#include "FecXor.h"
+#include "Utility.h"
+
+#include <cstring>
+
+#if defined( __SSE2__ )
+	#include <immintrin.h>
+	#define FEC_XOR_X86 1
+#endif
+
+// Every FEC packet is built from, and every recovery runs through, these XOR kernels. At 20% overhead
+// that is two passes over every byte sent, so there are vector versions for the CPUs we run on. The NEON one is in
+// FecXorNeon.cpp, the only file built with NEON enabled on 32-bit ARM.
+namespace fec
+{
+	namespace kernel
+	{
+		// Reference implementation
+		void XorByteLoop( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn )
+		{
+			for( size_t i = 0; i < sizeIn; ++i )
+			{
+				destinationIn[ i ] ^= sourceIn[ i ];
+			}
+		}
+	}
+	
+	namespace
+	{
+		// Portable fallback, a machine word at a time. memcpy keeps unaligned access legal and compiles to plain loads.
+		void XorWordLoop( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn )
+		{
+			size_t i = 0;
+			
+			for( ; i + sizeof( uint64_t ) <= sizeIn; i += sizeof( uint64_t ) )
+			{
+				uint64_t destination;
+				uint64_t source;
+				
+				memcpy( &destination, destinationIn + i, sizeof( destination ) );
+				memcpy( &source, sourceIn + i, sizeof( source ) );
+				
+				destination ^= source;
+				memcpy( destinationIn + i, &destination, sizeof( destination ) );
+			}
+			
+			kernel::XorByteLoop( destinationIn + i, sourceIn + i, sizeIn - i );
+		}
+		
+		#if defined( FEC_XOR_X86 )
+		void XorSSE2( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn )
+		{
+			size_t i = 0;
+			
+			for( ; i + 64 <= sizeIn; i += 64 )
+			{
+				__m128i d0 = _mm_loadu_si128( (const __m128i*)( destinationIn + i ) );
+				__m128i d1 = _mm_loadu_si128( (const __m128i*)( destinationIn + i + 16 ) );
+				__m128i d2 = _mm_loadu_si128( (const __m128i*)( destinationIn + i + 32 ) );
+				__m128i d3 = _mm_loadu_si128( (const __m128i*)( destinationIn + i + 48 ) );
+				
+				d0 = _mm_xor_si128( d0, _mm_loadu_si128( (const __m128i*)( sourceIn + i ) ) );
+				d1 = _mm_xor_si128( d1, _mm_loadu_si128( (const __m128i*)( sourceIn + i + 16 ) ) );
+				d2 = _mm_xor_si128( d2, _mm_loadu_si128( (const __m128i*)( sourceIn + i + 32 ) ) );
+				d3 = _mm_xor_si128( d3, _mm_loadu_si128( (const __m128i*)( sourceIn + i + 48 ) ) );
+				
+				_mm_storeu_si128( (__m128i*)( destinationIn + i ), d0 );
+				_mm_storeu_si128( (__m128i*)( destinationIn + i + 16 ), d1 );
+				_mm_storeu_si128( (__m128i*)( destinationIn + i + 32 ), d2 );
+				_mm_storeu_si128( (__m128i*)( destinationIn + i + 48 ), d3 );
+			}
+			
+			for( ; i + 16 <= sizeIn; i += 16 )
+			{
+				__m128i d = _mm_loadu_si128( (const __m128i*)( destinationIn + i ) );
+				d = _mm_xor_si128( d, _mm_loadu_si128( (const __m128i*)( sourceIn + i ) ) );
+				_mm_storeu_si128( (__m128i*)( destinationIn + i ), d );
+			}
+			
+			kernel::XorByteLoop( destinationIn + i, sourceIn + i, sizeIn - i );
+		}
+		
+		__attribute__(( target( "avx2" ) ))
+		void XorAVX2( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn )
+		{
+			size_t i = 0;
+			
+			for( ; i + 64 <= sizeIn; i += 64 )
+			{
+				__m256i d0 = _mm256_loadu_si256( (const __m256i*)( destinationIn + i ) );
+				__m256i d1 = _mm256_loadu_si256( (const __m256i*)( destinationIn + i + 32 ) );
+				
+				d0 = _mm256_xor_si256( d0, _mm256_loadu_si256( (const __m256i*)( sourceIn + i ) ) );
+				d1 = _mm256_xor_si256( d1, _mm256_loadu_si256( (const __m256i*)( sourceIn + i + 32 ) ) );
+				
+				_mm256_storeu_si256( (__m256i*)( destinationIn + i ), d0 );
+				_mm256_storeu_si256( (__m256i*)( destinationIn + i + 32 ), d1 );
+			}
+			
+			XorWordLoop( destinationIn + i, sourceIn + i, sizeIn - i );
+		}
+		#endif
+		
+		std::vector<TKernel> DetectKernels()
+		{
+			std::vector<TKernel> kernels =
+			{
+				{ "byte loop", kernel::XorByteLoop },
+				{ "word loop", XorWordLoop }
+			};
+			
+			#if defined( FEC_XOR_X86 )
+			kernels.push_back( { "sse2", XorSSE2 } );
+			
+			if( __builtin_cpu_supports( "avx2" ) )
+			{
+				kernels.push_back( { "avx2", XorAVX2 } );
+			}
+			#endif
+			
+			#if defined( FEC_XOR_NEON )
+			if( util::CpuHasNeon() )
+			{
+				kernels.push_back( { "neon", kernel::XorNEON } );
+			}
+			#endif
+			
+			return kernels;
+		}
+	}
+	
+	const std::vector<TKernel>& GetKernels()
+	{
+		static const std::vector<TKernel> kernels = DetectKernels();
+		return kernels;
+	}
+	
+	void XorInto( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn )
+	{
+		static const TXorKernel best = GetKernels().back().m_xor;
+		best( destinationIn, sourceIn, sizeIn );
+	}
+	
+	void WriteRtpHeader( uint8_t *dataOut, uint8_t payloadTypeIn, uint16_t sequenceIn, uint32_t timestampIn, uint32_t ssrcIn )
+	{
+		dataOut[ 0 ] 	= 0x80;
+		dataOut[ 1 ] 	= payloadTypeIn & 0x7F;
+		dataOut[ 2 ] 	= (uint8_t)( sequenceIn >> 8 );
+		dataOut[ 3 ] 	= (uint8_t)sequenceIn;
+		dataOut[ 4 ] 	= (uint8_t)( timestampIn >> 24 );
+		dataOut[ 5 ] 	= (uint8_t)( timestampIn >> 16 );
+		dataOut[ 6 ] 	= (uint8_t)( timestampIn >> 8 );
+		dataOut[ 7 ] 	= (uint8_t)timestampIn;
+		dataOut[ 8 ] 	= (uint8_t)( ssrcIn >> 24 );
+		dataOut[ 9 ] 	= (uint8_t)( ssrcIn >> 16 );
+		dataOut[ 10 ] 	= (uint8_t)( ssrcIn >> 8 );
+		dataOut[ 11 ] 	= (uint8_t)ssrcIn;
+	}
+	
+	void WriteFecHeader( uint8_t *dataOut, const TFecHeader &headerIn )
+	{
+		dataOut[ 0 ] 	= (uint8_t)( headerIn.m_snBase >> 8 );
+		dataOut[ 1 ] 	= (uint8_t)headerIn.m_snBase;
+		dataOut[ 2 ] 	= (uint8_t)( headerIn.m_lengthRecovery >> 8 );
+		dataOut[ 3 ] 	= (uint8_t)headerIn.m_lengthRecovery;
+		dataOut[ 4 ] 	= 0x80 | ( headerIn.m_ptRecovery & 0x7F );		// E bit set, as 2022-1 requires
+		dataOut[ 5 ] 	= 0x00;											// Mask, unused
+		dataOut[ 6 ] 	= 0x00;
+		dataOut[ 7 ] 	= 0x00;
+		dataOut[ 8 ] 	= (uint8_t)( headerIn.m_tsRecovery >> 24 );
+		dataOut[ 9 ] 	= (uint8_t)( headerIn.m_tsRecovery >> 16 );
+		dataOut[ 10 ] 	= (uint8_t)( headerIn.m_tsRecovery >> 8 );
+		dataOut[ 11 ] 	= (uint8_t)headerIn.m_tsRecovery;
+		dataOut[ 12 ] 	= headerIn.m_isRow ? 0x40 : 0x00;				// N = 0, D, type = XOR, index = 0
+		dataOut[ 13 ] 	= headerIn.m_offset;
+		dataOut[ 14 ] 	= headerIn.m_count;
+		dataOut[ 15 ] 	= 0x00;											// SNBase extension, unused
+	}
+	
+	bool ReadFecHeader( const uint8_t *dataIn, size_t sizeIn, TFecHeader &headerOut )
+	{
+		// Only XOR FEC without the extension fields is supported
+		if( sizeIn < k_fecHeaderSize || ( dataIn[ 12 ] & 0xBF ) != 0 || dataIn[ 13 ] == 0 || dataIn[ 14 ] == 0 )
+		{
+			return false;
+		}
+		
+		headerOut.m_snBase 			= ( dataIn[ 0 ] << 8 ) | dataIn[ 1 ];
+		headerOut.m_lengthRecovery 	= ( dataIn[ 2 ] << 8 ) | dataIn[ 3 ];
+		headerOut.m_ptRecovery 		= dataIn[ 4 ] & 0x7F;
+		headerOut.m_tsRecovery 		= ( (uint32_t)dataIn[ 8 ] << 24 ) | ( dataIn[ 9 ] << 16 ) | ( dataIn[ 10 ] << 8 ) | dataIn[ 11 ];
+		headerOut.m_isRow 			= ( dataIn[ 12 ] & 0x40 ) != 0;
+		headerOut.m_offset 			= dataIn[ 13 ];
+		headerOut.m_count 			= dataIn[ 14 ];
+		
+		return true;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// SMPTE 2022-1 style forward error correction: packets are laid out in a matrix of L columns by D rows, and
+// each column (and optionally each row) gets an XOR parity packet. One loss per column or row can be rebuilt
+// without a retransmission. A burst of up to L consecutive packets only costs one packet per column.
+namespace fec
+{
+	// RTP payload types. Media is MPEG-TS (RFC 2250), FEC is dynamic.
+	const uint8_t 	k_mediaPayloadType 	= 33;
+	const uint8_t 	k_fecPayloadType 	= 96;
+	
+	const size_t 	k_rtpHeaderSize 	= 12;
+	const size_t 	k_fecHeaderSize 	= 16;
+	const size_t 	k_maxPayloadSize 	= 1472 - k_rtpHeaderSize - k_fecHeaderSize;
+	
+	// Matrix limits from SMPTE 2022-1
+	const uint8_t 	k_maxColumns 		= 20;
+	const uint8_t 	k_maxRows 			= 20;
+	const size_t 	k_maxMatrixSize 	= 100;
+	
+	// The FEC header that follows the RTP header of every FEC packet
+	struct TFecHeader
+	{
+		uint16_t 	m_snBase			= 0;		// First media sequence number protected
+		uint16_t 	m_lengthRecovery	= 0;		// XOR of the protected payload lengths
+		uint8_t 	m_ptRecovery		= 0;
+		uint32_t 	m_tsRecovery		= 0;
+		bool 		m_isRow				= false;	// D bit: row FEC, sent on port + 4. Otherwise column FEC, on port + 2.
+		uint8_t 	m_offset			= 0;		// Sequence number step between protected packets (L for columns, 1 for rows)
+		uint8_t 	m_count				= 0;		// Number of protected packets (D for columns, L for rows)
+	};
+	
+	void WriteRtpHeader( uint8_t *dataOut, uint8_t payloadTypeIn, uint16_t sequenceIn, uint32_t timestampIn, uint32_t ssrcIn );
+	void WriteFecHeader( uint8_t *dataOut, const TFecHeader &headerIn );
+	bool ReadFecHeader( const uint8_t *dataIn, size_t sizeIn, TFecHeader &headerOut );
+	
+	// destinationIn ^= sourceIn over sizeIn bytes. Uses the fastest kernel the CPU supports.
+	void XorInto( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn );
+	
+	typedef void ( *TXorKernel )( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn );
+	
+	struct TKernel
+	{
+		const char 		*m_name;
+		TXorKernel 		m_xor;
+	};
+	
+	// Every kernel this build and CPU can run, slowest first. The last one is used by XorInto.
+	const std::vector<TKernel>& GetKernels();
+}
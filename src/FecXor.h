@@ -0,0 +1,23 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+
+#if defined( __arm__ ) || defined( __aarch64__ )
+	#define FEC_XOR_NEON 1
+#endif
+
+// XOR kernels shared between Fec.cpp and FecXorNeon.cpp. Use fec::XorInto instead.
+namespace fec
+{
+	namespace kernel
+	{
+		// Reference implementation, and the tail of the vector versions
+		void XorByteLoop( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn );
+		
+		#if defined( FEC_XOR_NEON )
+		void XorNEON( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn );
+		#endif
+	}
+}
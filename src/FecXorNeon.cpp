@@ -0,0 +1,40 @@
+// Includes
+#include "FecXor.h"
+
+#if defined( FEC_XOR_NEON )
+
+#include <arm_neon.h>
+
+// Built with NEON enabled (see the Makefile), so nothing here may run before Fec.cpp has checked the CPU has it
+namespace fec
+{
+	namespace kernel
+	{
+		void XorNEON( uint8_t *destinationIn, const uint8_t *sourceIn, size_t sizeIn )
+		{
+			size_t i = 0;
+			
+			for( ; i + 64 <= sizeIn; i += 64 )
+			{
+				uint8x16_t d0 = vld1q_u8( destinationIn + i );
+				uint8x16_t d1 = vld1q_u8( destinationIn + i + 16 );
+				uint8x16_t d2 = vld1q_u8( destinationIn + i + 32 );
+				uint8x16_t d3 = vld1q_u8( destinationIn + i + 48 );
+				
+				vst1q_u8( destinationIn + i, veorq_u8( d0, vld1q_u8( sourceIn + i ) ) );
+				vst1q_u8( destinationIn + i + 16, veorq_u8( d1, vld1q_u8( sourceIn + i + 16 ) ) );
+				vst1q_u8( destinationIn + i + 32, veorq_u8( d2, vld1q_u8( sourceIn + i + 32 ) ) );
+				vst1q_u8( destinationIn + i + 48, veorq_u8( d3, vld1q_u8( sourceIn + i + 48 ) ) );
+			}
+			
+			for( ; i + 16 <= sizeIn; i += 16 )
+			{
+				vst1q_u8( destinationIn + i, veorq_u8( vld1q_u8( destinationIn + i ), vld1q_u8( sourceIn + i ) ) );
+			}
+			
+			XorByteLoop( destinationIn + i, sourceIn + i, sizeIn - i );
+		}
+	}
+}
+
+#endif
@@ -73,6 +73,489 @@ namespace gc6500
 				},
 				"alias": "Apply Settings",
 				"description": "Allows the user to set multiple settings at once."
+			},
+			
+			"record_start":
+			{
+				"formats": [ "all" ],
+				"params": 
+				{
+					"path":
+					{
+						"type": "string",
+						"alias": "Directory",
+						"description": "Existing directory that recording segments are written to."
+					},
+					
+					"segment_duration":
+					{
+						"type": "uint32",
+						"unit": "s",
+						"min": 10,
+						"max": 86400,
+						"alias": "Segment Duration",
+						"description": "Starts a new segment at the next keyframe after this much time. Default: 300."
+					},
+					
+					"segment_size":
+					{
+						"type": "uint32",
+						"unit": "MB",
+						"min": 1,
+						"max": 4096,
+						"alias": "Segment Size",
+						"description": "Starts a new segment at the next keyframe before exceeding this size. Default: 512."
+					},
+					
+					"fsync_interval":
+					{
+						"type": "uint32",
+						"unit": "s",
+						"min": 1,
+						"max": 60,
+						"alias": "Sync Interval",
+						"description": "Maximum amount of recorded video that can be lost to a power failure. Default: 2."
+					},
+					"faststart":
+					{
+						"type": "bool",
+						"alias": "Faststart Copies",
+						"description": "Also write a progressive (moov first) copy of each closed segment in the background. The original is kept."
+					}
+				},
+				"alias": "Start Recording",
+				"description": "Records the channel's muxed output to segmented MP4 files."
+			},
+			
+			"record_stop":
+			{
+				"formats": [ "all" ],
+				"params": {},
+				"alias": "Stop Recording",
+				"description": "Stops recording and closes the current segment."
+			},
+			
+			"dump_buffer":
+			{
+				"formats": [ "all" ],
+				"params": 
+				{
+					"path":
+					{
+						"type": "string",
+						"alias": "File",
+						"description": "MP4 file to write the buffered video to."
+					}
+				},
+				"alias": "Save Pre-Event Buffer",
+				"description": "Writes the last 30 seconds of video, starting at a keyframe, to a file without interrupting the stream."
+			},
+			
+			"export_clip":
+			{
+				"formats": [ "all" ],
+				"params": 
+				{
+					"segment":
+					{
+						"type": "string",
+						"alias": "Recording",
+						"description": "Recorded segment file to cut the clip from. Must have its keyframe index next to it."
+					},
+					"start":
+					{
+						"type": "float",
+						"alias": "Start",
+						"description": "Clip start in seconds from the first keyframe of the segment. Rounded down to a keyframe."
+					},
+					"end":
+					{
+						"type": "float",
+						"alias": "End",
+						"description": "Clip end in seconds from the first keyframe of the segment. Rounded up to the next keyframe."
+					},
+					"path":
+					{
+						"type": "string",
+						"alias": "File",
+						"description": "MP4 file to write the clip to."
+					}
+				},
+				"alias": "Export Clip",
+				"description": "Copies the fragments covering a time range of a recording into a standalone MP4 without re-encoding."
+			},
+			
+			"playback_start":
+			{
+				"formats": [ "all" ],
+				"params": 
+				{
+					"path":
+					{
+						"type": "string",
+						"alias": "Recording",
+						"description": "Recorded segment to play back on the channel's playback endpoint."
+					},
+					"speed":
+					{
+						"type": "float",
+						"alias": "Speed",
+						"description": "Multiple of real time. 0 plays as fast as possible. Defaults to 1."
+					},
+					"start":
+					{
+						"type": "float",
+						"alias": "Start",
+						"description": "Seconds from the start of the segment. Playback begins at the keyframe at or before it."
+					}
+				},
+				"alias": "Start Playback",
+				"description": "Plays a recording back with the same init and video topics as the live stream."
+			},
+			
+			"playback_seek":
+			{
+				"formats": [ "all" ],
+				"params": 
+				{
+					"position":
+					{
+						"type": "float",
+						"alias": "Position",
+						"description": "Seconds from the start of the segment. Snaps back to the nearest keyframe."
+					}
+				},
+				"alias": "Seek Playback",
+				"description": "Jumps playback to a keyframe. Requires the segment's keyframe index."
+			},
+			
+			"playback_speed":
+			{
+				"formats": [ "all" ],
+				"params": 
+				{
+					"speed":
+					{
+						"type": "float",
+						"alias": "Speed",
+						"description": "Multiple of real time. 0 plays as fast as possible."
+					}
+				},
+				"alias": "Playback Speed",
+				"description": "Changes the playback speed."
+			},
+			
+			"playback_stop":
+			{
+				"formats": [ "all" ],
+				"params": {},
+				"alias": "Stop Playback",
+				"description": "Stops playback."
+			},
+			
+			"telemetry_start":
+			{
+				"formats": [ "all" ],
+				"params": 
+				{
+					"endpoint":
+					{
+						"type": "string",
+						"alias": "Endpoint",
+						"description": "ZMQ publisher to take telemetry from, e.g. ipc:///tmp/telemetry.ipc"
+					},
+					"topics":
+					{
+						"type": "string",
+						"alias": "Topics",
+						"description": "Comma separated topic prefixes to subscribe to. All topics if omitted."
+					}
+				},
+				"alias": "Start Telemetry",
+				"description": "Records telemetry samples into recordings as emsg boxes, timed on the video's media timeline."
+			},
+			
+			"telemetry_stop":
+			{
+				"formats": [ "all" ],
+				"params": {},
+				"alias": "Stop Telemetry",
+				"description": "Stops taking telemetry."
+			},
+			
+			"sei_config":
+			{
+				"formats": [ "h264" ],
+				"params": 
+				{
+					"enabled":
+					{
+						"type": "bool",
+						"alias": "Enabled",
+						"description": "Insert SEI user_data_unregistered NALs carrying capture time and a sequence number."
+					},
+					
+					"interval":
+					{
+						"type": "uint32",
+						"unit": "frames",
+						"min": 1,
+						"max": 3600,
+						"alias": "Interval",
+						"description": "Tag every Nth selected frame. Default: 1."
+					},
+					
+					"keyframes_only":
+					{
+						"type": "bool",
+						"alias": "Keyframes Only",
+						"description": "Only consider IDR frames for tagging. Default: false."
+					},
+					
+					"user_data":
+					{
+						"type": "string",
+						"alias": "User Data",
+						"description": "Appended verbatim to every SEI payload, e.g. an overlay string."
+					}
+				},
+				"alias": "Configure SEI Metadata",
+				"description": "Configures in-band per-frame metadata. Payload after the 16 byte UUID: version(1), capture time us(8), sequence(4), camera timestamp(8), user data. Big endian."
+			},
+			
+			"sps_rewrite":
+			{
+				"formats": [ "h264" ],
+				"params": 
+				{
+					"enabled":
+					{
+						"type": "bool",
+						"alias": "Enabled",
+						"description": "Rewrite the camera's SPS with a bitstream_restriction allowing no frame reordering, plus VUI timing if missing."
+					}
+				},
+				"alias": "Low Latency SPS",
+				"description": "Lets decoders output each frame as soon as it is decoded. Enable before starting video so the init segment's avcC carries the rewritten SPS."
+			},
+			
+			"base_layer_start":
+			{
+				"formats": [ "h264" ],
+				"params": 
+				{
+					"divisor":
+					{
+						"type": "uint32",
+						"unit": "",
+						"min": 1,
+						"max": 16,
+						"alias": "Framerate Divisor",
+						"description": "Power of two to divide the framerate by, e.g. 2 for 30->15 fps. Needs a gop_hierarchy_level of at least log2(divisor)."
+					}
+				},
+				"alias": "Start Base Layer Stream",
+				"description": "Publishes the lower temporal layers of the stream, without re-encoding, on ipc:///tmp/geomux_video<camera>_<channel>_base.ipc."
+			},
+			
+			"base_layer_stop":
+			{
+				"formats": [ "h264" ],
+				"params": {},
+				"alias": "Stop Base Layer Stream",
+				"description": "Stops feeding the reduced framerate stream."
+			},
+			
+			"hls_start":
+			{
+				"formats": [ "h264" ],
+				"params": 
+				{
+					"path":
+					{
+						"type": "string",
+						"alias": "Directory",
+						"description": "Existing directory, ideally on tmpfs, that the playlist (live.m3u8), init segments, segments and parts are written to."
+					},
+					
+					"part_duration":
+					{
+						"type": "uint32",
+						"unit": "ms",
+						"min": 50,
+						"max": 2000,
+						"alias": "Part Duration",
+						"description": "Target duration of each low-latency part. Default: 200."
+					},
+					
+					"playlist_segments":
+					{
+						"type": "uint32",
+						"min": 2,
+						"max": 30,
+						"alias": "Playlist Segments",
+						"description": "Number of complete segments (one per GOP) listed in the playlist. Older files are deleted. Default: 6."
+					}
+				},
+				"alias": "Start LL-HLS Output",
+				"description": "Writes the live fragments as Low-Latency HLS for any HTTP server to serve, without remuxing."
+			},
+			
+			"hls_stop":
+			{
+				"formats": [ "h264" ],
+				"params": {},
+				"alias": "Stop LL-HLS Output",
+				"description": "Stops the LL-HLS output and removes its files."
+			},
+			
+			"ts_multicast_start":
+			{
+				"formats": [ "h264" ],
+				"params": 
+				{
+					"address":
+					{
+						"type": "string",
+						"alias": "Multicast Group",
+						"description": "IPv4 multicast group to send to, e.g. 239.255.0.1."
+					},
+					
+					"port":
+					{
+						"type": "uint16",
+						"alias": "Port",
+						"description": "Destination UDP port. Default: 5004."
+					},
+					
+					"ttl":
+					{
+						"type": "uint8",
+						"min": 1,
+						"max": 255,
+						"alias": "TTL",
+						"description": "Multicast TTL. Default: 1, which keeps the stream on the local network."
+					},
+					
+					"interface":
+					{
+						"type": "string",
+						"alias": "Interface Address",
+						"description": "Local IPv4 address of the interface to send from. Default: the multicast route."
+					},
+					
+					"max_rate":
+					{
+						"type": "uint32",
+						"unit": "bps",
+						"min": 1000000,
+						"max": 100000000,
+						"alias": "Max Rate",
+						"description": "Pacing ceiling for the sender, so keyframes are spread out instead of sent as one burst. Default: 20000000."
+					},
+					
+					"max_burst":
+					{
+						"type": "uint32",
+						"unit": "bytes",
+						"min": 1500,
+						"max": 1048576,
+						"alias": "Max Burst",
+						"description": "Most the sender puts on the wire back to back at full link speed before pacing kicks in. Default: 32768."
+					},
+					
+					"fec_columns":
+					{
+						"type": "uint8",
+						"min": 0,
+						"max": 20,
+						"alias": "FEC Columns",
+						"description": "SMPTE 2022-1 FEC matrix columns (L). Column FEC goes to port + 2, row FEC to port + 4, and the TS is sent as RTP. A burst of up to L lost packets can be rebuilt. Default: 0 (no FEC)."
+					},
+					
+					"fec_rows":
+					{
+						"type": "uint8",
+						"min": 1,
+						"max": 20,
+						"alias": "FEC Rows",
+						"description": "FEC matrix rows (D). Column FEC costs 1/D extra bandwidth. Columns x rows must be at most 100. Default: 10."
+					},
+					
+					"fec_2d":
+					{
+						"type": "bool",
+						"alias": "Row FEC",
+						"description": "Send row FEC as well (a further 1/L), so some losses a column can't fix alone are still recovered. Default: true."
+					}
+				},
+				"alias": "Start MPEG-TS Multicast",
+				"description": "Sends the stream as MPEG-TS over UDP multicast (7 TS packets per datagram), so any number of viewers can share it."
+			},
+			
+			"ts_multicast_stop":
+			{
+				"formats": [ "h264" ],
+				"params": {},
+				"alias": "Stop MPEG-TS Multicast",
+				"description": "Stops the MPEG-TS multicast output."
+			},
+			
+			"bitrate_control_start":
+			{
+				"formats": [ "h264" ],
+				"params": 
+				{
+					"min_bitrate":
+					{
+						"type": "uint32",
+						"unit": "bps",
+						"min": 1000,
+						"max": 10000000,
+						"alias": "Min Bitrate",
+						"description": "Lowest bitrate the controller backs off to. Default: 500000."
+					},
+					
+					"max_bitrate":
+					{
+						"type": "uint32",
+						"unit": "bps",
+						"min": 1000,
+						"max": 10000000,
+						"alias": "Max Bitrate",
+						"description": "Highest bitrate the controller recovers to. Default: 8000000."
+					},
+					
+					"min_framerate":
+					{
+						"type": "uint32",
+						"unit": "fps",
+						"min": 0,
+						"max": 60,
+						"alias": "Min Framerate",
+						"description": "Once at the minimum bitrate, keep lowering the framerate down to this. Default: 0 (framerate is left alone)."
+					},
+					
+					"max_latency":
+					{
+						"type": "uint32",
+						"unit": "us",
+						"min": 10000,
+						"max": 5000000,
+						"alias": "Max Latency",
+						"description": "Capture to muxer latency treated as congestion. Recovery waits for it to fall below a third of this. Default: 150000."
+					}
+				},
+				"alias": "Start Adaptive Bitrate",
+				"description": "Lowers the bitrate (then the framerate) when frames back up or are dropped on the way out, and raises it again slowly once delivery has been clean for a while. Manual bitrate and framerate changes are overridden while it runs."
+			},
+			
+			"bitrate_control_stop":
+			{
+				"formats": [ "h264" ],
+				"params": {},
+				"alias": "Stop Adaptive Bitrate",
+				"description": "Stops adaptive bitrate and restores the bitrate and framerate from before it started."
 			}
 		},
 		
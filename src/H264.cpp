@@ -0,0 +1,292 @@
+// Includes
+#include "H264.h"
+#include "CBitstream.h"
+
+#include <exception>
+
+namespace
+{
+	// Reads exp-Golomb and fixed fields, and writes each one straight back out if there is a writer
+	class CSpsFieldReader
+	{
+	public:
+		// Methods
+		CSpsFieldReader( CBitReader &readerIn, CBitWriter *writerIn )
+			: m_reader( readerIn )
+			, m_pWriter( writerIn )
+		{
+		}
+		
+		uint32_t ReadBits( uint32_t countIn )
+		{
+			uint32_t value = m_reader.ReadBits( countIn );
+			
+			if( m_pWriter )
+			{
+				m_pWriter->WriteBits( value, countIn );
+			}
+			
+			return value;
+		}
+		
+		uint32_t ReadUE()
+		{
+			uint32_t value = m_reader.ReadUE();
+			
+			if( m_pWriter )
+			{
+				m_pWriter->WriteUE( value );
+			}
+			
+			return value;
+		}
+		
+		int32_t ReadSE()
+		{
+			int32_t value = m_reader.ReadSE();
+			
+			if( m_pWriter )
+			{
+				m_pWriter->WriteSE( value );
+			}
+			
+			return value;
+		}
+	
+	private:
+		// Attributes
+		CBitReader 		&m_reader;
+		CBitWriter 		*m_pWriter;
+	};
+}
+
+namespace h264
+{
+	bool NextNalUnit( const uint8_t *&cursorIn, const uint8_t *endIn, TNalUnit &nalOut )
+	{
+		const uint8_t *startCode = FindStartCode( cursorIn, endIn );
+		
+		if( startCode + 3 >= endIn )
+		{
+			cursorIn = endIn;
+			return false;
+		}
+		
+		const uint8_t *data = startCode + 3;
+		const uint8_t *next = FindStartCode( data, endIn );
+		
+		// A zero before the next start code belongs to its 4 byte prefix
+		const uint8_t *dataEnd = next;
+		
+		if( next != endIn && next > data && next[ -1 ] == 0 )
+		{
+			dataEnd--;
+		}
+		
+		nalOut.m_pStartCode = ( startCode > cursorIn && startCode[ -1 ] == 0 ) ? startCode - 1 : startCode;
+		nalOut.m_pData 		= data;
+		nalOut.m_size 		= dataEnd - data;
+		
+		cursorIn = dataEnd;
+		return true;
+	}
+	
+	bool IsFirstSliceOfPicture( const TNalUnit &nalIn )
+	{
+		return nalIn.IsVCL() && nalIn.m_size > 1 && ( nalIn.m_pData[ 1 ] & 0x80 );
+	}
+	
+	bool ParseSps( const uint8_t *nalIn, size_t sizeIn, TSpsInfo &spsOut )
+	{
+		// Nothing carries over from a previous SPS, fields an SPS doesn't have keep their defaults
+		spsOut = TSpsInfo();
+		
+		if( sizeIn < 4 )
+		{
+			return false;
+		}
+		
+		std::vector<uint8_t> rbsp;
+		RemoveEmulationPrevention( nalIn + 1, sizeIn - 1, rbsp );
+		
+		try
+		{
+			CBitReader reader( rbsp.data(), rbsp.size() );
+			
+			ReadSpsFields( reader, spsOut );
+			
+			return ( spsOut.m_log2MaxFrameNum <= 16 );
+		}
+		catch( const std::exception &e )
+		{
+			return false;
+		}
+	}
+	
+	void ReadSpsFields( CBitReader &readerIn, TSpsInfo &spsOut, CBitWriter *writerIn )
+	{
+		CSpsFieldReader fields( readerIn, writerIn );
+		
+		// profile_idc, constraint flags, level_idc, seq_parameter_set_id
+		spsOut.m_profileIdc = fields.ReadBits( 8 );
+		fields.ReadBits( 8 );
+		spsOut.m_levelIdc 	= fields.ReadBits( 8 );
+		spsOut.m_spsId 		= fields.ReadUE();
+		
+		switch( spsOut.m_profileIdc )
+		{
+			case 100: case 110: case 122: case 244: case 44:
+			case 83: case 86: case 118: case 128: case 138:
+			case 139: case 134: case 135:
+			{
+				uint32_t chromaFormatIdc = fields.ReadUE();
+				
+				if( chromaFormatIdc == 3 )
+				{
+					spsOut.m_separateColourPlane = fields.ReadBits( 1 );
+				}
+				
+				// Bit depths and qpprime_y_zero_transform_bypass_flag
+				fields.ReadUE();
+				fields.ReadUE();
+				fields.ReadBits( 1 );
+				
+				// seq_scaling_matrix_present_flag
+				if( fields.ReadBits( 1 ) )
+				{
+					int lists = ( chromaFormatIdc != 3 ) ? 8 : 12;
+					
+					for( int i = 0; i < lists; ++i )
+					{
+						if( !fields.ReadBits( 1 ) )
+						{
+							continue;
+						}
+						
+						// The scaling list's delta_scale values
+						int lastScale = 8;
+						int nextScale = 8;
+						
+						for( int j = 0; j < ( ( i < 6 ) ? 16 : 64 ); ++j )
+						{
+							if( nextScale != 0 )
+							{
+								nextScale = ( lastScale + fields.ReadSE() + 256 ) % 256;
+							}
+							
+							lastScale = ( nextScale == 0 ) ? lastScale : nextScale;
+						}
+					}
+				}
+				
+				break;
+			}
+			default:
+				break;
+		}
+		
+		spsOut.m_log2MaxFrameNum = fields.ReadUE() + 4;
+		
+		uint32_t pocType = fields.ReadUE();
+		
+		if( pocType == 0 )
+		{
+			// log2_max_pic_order_cnt_lsb_minus4
+			fields.ReadUE();
+		}
+		else if( pocType == 1 )
+		{
+			// delta_pic_order_always_zero_flag, offset_for_non_ref_pic, offset_for_top_to_bottom_field
+			fields.ReadBits( 1 );
+			fields.ReadSE();
+			fields.ReadSE();
+			
+			uint32_t cycleLength = fields.ReadUE();
+			
+			for( uint32_t i = 0; i < cycleLength; ++i )
+			{
+				fields.ReadSE();
+			}
+		}
+		
+		spsOut.m_maxRefFrames 			= fields.ReadUE();
+		spsOut.m_gapsInFrameNumAllowed 	= fields.ReadBits( 1 );
+		spsOut.m_widthInMbs 			= fields.ReadUE() + 1;
+		spsOut.m_heightInMapUnits 		= fields.ReadUE() + 1;
+		spsOut.m_frameMbsOnly 			= fields.ReadBits( 1 );
+	}
+	
+	void AppendEscaped( const uint8_t *rbspIn, size_t sizeIn, std::vector<uint8_t> &nalOut )
+	{
+		int zeros = 0;
+		
+		for( size_t i = 0; i < sizeIn; ++i )
+		{
+			// Two zeros followed by 0-3 would look like a start code (or break one), so split them with 0x03
+			if( zeros == 2 && rbspIn[ i ] <= 3 )
+			{
+				nalOut.push_back( 0x03 );
+				zeros = 0;
+			}
+			
+			nalOut.push_back( rbspIn[ i ] );
+			zeros = ( rbspIn[ i ] == 0 ) ? zeros + 1 : 0;
+		}
+	}
+	
+	void RemoveEmulationPrevention( const uint8_t *nalIn, size_t sizeIn, std::vector<uint8_t> &rbspOut )
+	{
+		const uint8_t *end 		= nalIn + sizeIn;
+		const uint8_t *cursor 	= nalIn;
+		
+		rbspOut.clear();
+		rbspOut.reserve( sizeIn );
+		
+		// Copy everything up to each 00 00 03, dropping the 03. The zero count restarts after it.
+		while( cursor < end )
+		{
+			const uint8_t *escape = FindEmulationPrevention( cursor, end );
+			
+			if( escape == end )
+			{
+				rbspOut.insert( rbspOut.end(), cursor, end );
+				break;
+			}
+			
+			rbspOut.insert( rbspOut.end(), cursor, escape + 2 );
+			cursor = escape + 3;
+		}
+	}
+	
+	void BuildUserDataUnregisteredSei( const uint8_t uuidIn[ 16 ], const uint8_t *payloadIn, size_t sizeIn, std::vector<uint8_t> &seiOut )
+	{
+		const size_t payloadSize = 16 + sizeIn;
+		
+		seiOut.clear();
+		
+		// Start code and NAL header
+		seiOut.insert( seiOut.end(), { 0x00, 0x00, 0x00, 0x01, NAL_SEI } );
+		
+		// sei_message header: payloadType 5, then payloadSize, each as a run of 0xFF plus a final byte
+		std::vector<uint8_t> rbsp;
+		rbsp.reserve( payloadSize + 8 );
+		rbsp.push_back( 5 );
+		
+		size_t remaining = payloadSize;
+		
+		while( remaining >= 255 )
+		{
+			rbsp.push_back( 0xFF );
+			remaining -= 255;
+		}
+		
+		rbsp.push_back( (uint8_t)remaining );
+		rbsp.insert( rbsp.end(), uuidIn, uuidIn + 16 );
+		rbsp.insert( rbsp.end(), payloadIn, payloadIn + sizeIn );
+		
+		// rbsp_trailing_bits
+		rbsp.push_back( 0x80 );
+		
+		AppendEscaped( rbsp.data(), rbsp.size(), seiOut );
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class CBitReader;
+class CBitWriter;
+
+// Annex-B H.264 bitstream helpers. Nothing here decodes slice data.
+namespace h264
+{
+	enum ENalType : uint8_t
+	{
+		NAL_SLICE 		= 1,
+		NAL_IDR_SLICE 	= 5,
+		NAL_SEI 		= 6,
+		NAL_SPS 		= 7,
+		NAL_PPS 		= 8,
+		NAL_AUD 		= 9
+	};
+	
+	// The SPS fields needed to check slice headers
+	struct TSpsInfo
+	{
+		uint32_t 	m_profileIdc			= 0;
+		uint32_t 	m_levelIdc				= 0;
+		uint32_t 	m_spsId					= 0;
+		uint32_t 	m_log2MaxFrameNum		= 4;
+		bool 		m_separateColourPlane	= false;
+		uint32_t 	m_maxRefFrames			= 0;
+		bool 		m_gapsInFrameNumAllowed	= false;
+		uint32_t 	m_widthInMbs			= 0;
+		uint32_t 	m_heightInMapUnits		= 0;
+		bool 		m_frameMbsOnly			= true;
+		
+		uint32_t GetPicSizeInMbs() const { return m_widthInMbs * m_heightInMapUnits * ( m_frameMbsOnly ? 1 : 2 ); }
+	};
+	
+	struct TNalUnit
+	{
+		const uint8_t 	*m_pStartCode	= nullptr;		// Start of the 00 00 01 (or 00 00 00 01) prefix
+		const uint8_t 	*m_pData		= nullptr;		// NAL header byte
+		size_t 			m_size			= 0;			// From the header byte to the next start code
+		
+		uint8_t GetType() const { return m_pData[ 0 ] & 0x1F; }
+		uint8_t GetRefIdc() const { return ( m_pData[ 0 ] >> 5 ) & 0x03; }
+		bool IsVCL() const { return GetType() >= NAL_SLICE && GetType() <= NAL_IDR_SLICE; }
+	};
+	
+	// Returns a pointer to the next 00 00 01 at or after beginIn, or endIn if there isn't one.
+	// Uses the fastest scanner the CPU supports, see H264Scan.cpp.
+	const uint8_t* FindStartCode( const uint8_t *beginIn, const uint8_t *endIn );
+	
+	// Same, for the next 00 00 03 emulation prevention sequence
+	const uint8_t* FindEmulationPrevention( const uint8_t *beginIn, const uint8_t *endIn );
+	
+	// Finds the next 00 00 <thirdByteIn> in [beginIn, endIn), or returns endIn
+	typedef const uint8_t* ( *TPatternScanner )( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn );
+	
+	struct TScanner
+	{
+		const char 			*m_name;
+		TPatternScanner 	m_scan;
+	};
+	
+	// Every scanner this build and CPU can run, slowest first. The last one is used by FindStartCode.
+	const std::vector<TScanner>& GetScanners();
+	
+	// Steps through the NAL units of a buffer. cursorIn must start at the buffer's first start code.
+	bool NextNalUnit( const uint8_t *&cursorIn, const uint8_t *endIn, TNalUnit &nalOut );
+	
+	// First slice of a picture: first_mb_in_slice is ue(v) 0, which is a single 1 bit right after the NAL header
+	bool IsFirstSliceOfPicture( const TNalUnit &nalIn );
+	
+	// Parses the start of an SPS NAL (header byte included). Returns false if it is truncated or malformed.
+	bool ParseSps( const uint8_t *nalIn, size_t sizeIn, TSpsInfo &spsOut );
+	
+	// Reads an SPS RBSP from profile_idc through frame_mbs_only_flag. With a writer, every field is also copied to it
+	// unchanged, so a rewriter can carry on from there. Throws if the data runs out.
+	void ReadSpsFields( CBitReader &readerIn, TSpsInfo &spsOut, CBitWriter *writerIn = nullptr );
+	
+	// Appends RBSP data with emulation prevention bytes inserted
+	void AppendEscaped( const uint8_t *rbspIn, size_t sizeIn, std::vector<uint8_t> &nalOut );
+	
+	// Replaces the contents of rbspOut with the NAL payload minus its emulation prevention bytes
+	void RemoveEmulationPrevention( const uint8_t *nalIn, size_t sizeIn, std::vector<uint8_t> &rbspOut );
+	
+	// Builds a complete SEI NAL (with 4 byte start code) holding one user_data_unregistered message
+	void BuildUserDataUnregisteredSei( const uint8_t uuidIn[ 16 ], const uint8_t *payloadIn, size_t sizeIn, std::vector<uint8_t> &seiOut );
+}
@@ -0,0 +1,188 @@
+// Includes
+#include "H264.h"
+#include "H264Scan.h"
+#include "Utility.h"
+
+#include <cstring>
+
+#if defined( __SSE2__ )
+	#include <immintrin.h>
+	#define H264_SCAN_X86 1
+#endif
+
+// Start code and emulation prevention scanning. Every byte we capture goes through this at least once,
+// so there are vector versions for the CPUs we run on, picked at runtime where the build can't assume them. The NEON one is
+// in H264ScanNeon.cpp, the only file built with NEON enabled on 32-bit ARM.
+namespace h264
+{
+	namespace scan
+	{
+		// Reference implementation, checks every position
+		const uint8_t* ScanByteLoop( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn )
+		{
+			for( const uint8_t *p = beginIn; p + 3 <= endIn; ++p )
+			{
+				if( p[ 0 ] == 0 && p[ 1 ] == 0 && p[ 2 ] == thirdByteIn )
+				{
+					return p;
+				}
+			}
+			
+			return endIn;
+		}
+		
+		// Portable fallback. A non-zero third byte that doesn't complete a match rules out the next two positions as well.
+		const uint8_t* ScanSkipping( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn )
+		{
+			for( const uint8_t *p = beginIn; p + 3 <= endIn; ++p )
+			{
+				if( p[ 2 ] != 0 )
+				{
+					if( p[ 2 ] == thirdByteIn && p[ 0 ] == 0 && p[ 1 ] == 0 )
+					{
+						return p;
+					}
+					
+					p += 2;
+				}
+			}
+			
+			return endIn;
+		}
+	}
+	
+	namespace
+	{
+		// Lets libc find the rare third byte, then checks the two zeros ahead of it
+		const uint8_t* ScanMemchr( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn )
+		{
+			if( endIn - beginIn < 3 )
+			{
+				return endIn;
+			}
+			
+			const uint8_t *p = beginIn + 2;
+			
+			while( p < endIn )
+			{
+				p = (const uint8_t*)memchr( p, thirdByteIn, endIn - p );
+				
+				if( p == nullptr )
+				{
+					return endIn;
+				}
+				
+				if( p[ -1 ] == 0 && p[ -2 ] == 0 )
+				{
+					return p - 2;
+				}
+				
+				++p;
+			}
+			
+			return endIn;
+		}
+		
+		#if defined( H264_SCAN_X86 )
+		const uint8_t* ScanSSE2( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn )
+		{
+			const __m128i zero 	= _mm_setzero_si128();
+			const __m128i third = _mm_set1_epi8( (char)thirdByteIn );
+			const uint8_t *p 	= beginIn;
+			
+			// Compare 16 candidate positions at once: bytes p+i, p+i+1 and p+i+2 for i in [0, 16)
+			for( ; p + 18 <= endIn; p += 16 )
+			{
+				__m128i b0 = _mm_loadu_si128( (const __m128i*)p );
+				__m128i b1 = _mm_loadu_si128( (const __m128i*)( p + 1 ) );
+				__m128i b2 = _mm_loadu_si128( (const __m128i*)( p + 2 ) );
+				
+				__m128i match = _mm_and_si128( _mm_and_si128( _mm_cmpeq_epi8( b0, zero ), _mm_cmpeq_epi8( b1, zero ) ), _mm_cmpeq_epi8( b2, third ) );
+				int mask = _mm_movemask_epi8( match );
+				
+				if( mask != 0 )
+				{
+					return p + __builtin_ctz( (unsigned)mask );
+				}
+			}
+			
+			return scan::ScanSkipping( p, endIn, thirdByteIn );
+		}
+		
+		__attribute__(( target( "avx2" ) ))
+		const uint8_t* ScanAVX2( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn )
+		{
+			const __m256i zero 	= _mm256_setzero_si256();
+			const __m256i third = _mm256_set1_epi8( (char)thirdByteIn );
+			const uint8_t *p 	= beginIn;
+			
+			for( ; p + 34 <= endIn; p += 32 )
+			{
+				__m256i b0 = _mm256_loadu_si256( (const __m256i*)p );
+				__m256i b1 = _mm256_loadu_si256( (const __m256i*)( p + 1 ) );
+				__m256i b2 = _mm256_loadu_si256( (const __m256i*)( p + 2 ) );
+				
+				__m256i match = _mm256_and_si256( _mm256_and_si256( _mm256_cmpeq_epi8( b0, zero ), _mm256_cmpeq_epi8( b1, zero ) ), _mm256_cmpeq_epi8( b2, third ) );
+				unsigned mask = (unsigned)_mm256_movemask_epi8( match );
+				
+				if( mask != 0 )
+				{
+					return p + __builtin_ctz( mask );
+				}
+			}
+			
+			return scan::ScanSkipping( p, endIn, thirdByteIn );
+		}
+		#endif
+		
+		std::vector<TScanner> DetectScanners()
+		{
+			std::vector<TScanner> scanners = 
+			{
+				{ "byte loop", scan::ScanByteLoop },
+				{ "memchr", ScanMemchr },
+				{ "skipping", scan::ScanSkipping }
+			};
+			
+			#if defined( H264_SCAN_X86 )
+			scanners.push_back( { "sse2", ScanSSE2 } );
+			
+			if( __builtin_cpu_supports( "avx2" ) )
+			{
+				scanners.push_back( { "avx2", ScanAVX2 } );
+			}
+			#endif
+			
+			#if defined( H264_SCAN_NEON )
+			if( util::CpuHasNeon() )
+			{
+				scanners.push_back( { "neon", scan::ScanNEON } );
+			}
+			#endif
+			
+			return scanners;
+		}
+		
+		TPatternScanner GetBestScanner()
+		{
+			static const TPatternScanner best = GetScanners().back().m_scan;
+			return best;
+		}
+	}
+	
+	const std::vector<TScanner>& GetScanners()
+	{
+		static const std::vector<TScanner> scanners = DetectScanners();
+		return scanners;
+	}
+	
+	const uint8_t* FindStartCode( const uint8_t *beginIn, const uint8_t *endIn )
+	{
+		return GetBestScanner()( beginIn, endIn, 0x01 );
+	}
+	
+	const uint8_t* FindEmulationPrevention( const uint8_t *beginIn, const uint8_t *endIn )
+	{
+		return GetBestScanner()( beginIn, endIn, 0x03 );
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+
+#if defined( __arm__ ) || defined( __aarch64__ )
+	#define H264_SCAN_NEON 1
+#endif
+
+// Scanner kernels shared between H264Scan.cpp and H264ScanNeon.cpp. Use h264::FindStartCode and friends instead.
+namespace h264
+{
+	namespace scan
+	{
+		// Reference implementation, checks every position
+		const uint8_t* ScanByteLoop( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn );
+		
+		// Portable fallback, and the tail of the vector versions
+		const uint8_t* ScanSkipping( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn );
+		
+		#if defined( H264_SCAN_NEON )
+		const uint8_t* ScanNEON( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn );
+		#endif
+	}
+}
@@ -0,0 +1,46 @@
+// Includes
+#include "H264Scan.h"
+
+#if defined( H264_SCAN_NEON )
+
+#include <arm_neon.h>
+
+// Built with NEON enabled (see the Makefile), so nothing here may run before H264Scan.cpp has checked the CPU has it
+namespace h264
+{
+	namespace scan
+	{
+		const uint8_t* ScanNEON( const uint8_t *beginIn, const uint8_t *endIn, uint8_t thirdByteIn )
+		{
+			const uint8x16_t zero 	= vdupq_n_u8( 0 );
+			const uint8x16_t third 	= vdupq_n_u8( thirdByteIn );
+			const uint8_t *p 		= beginIn;
+			
+			for( ; p + 18 <= endIn; p += 16 )
+			{
+				uint8x16_t b0 = vld1q_u8( p );
+				uint8x16_t b1 = vld1q_u8( p + 1 );
+				uint8x16_t b2 = vld1q_u8( p + 2 );
+				
+				uint8x16_t match = vandq_u8( vandq_u8( vceqq_u8( b0, zero ), vceqq_u8( b1, zero ) ), vceqq_u8( b2, third ) );
+				
+				// NEON has no movemask, so only test for any match and let the scalar loop find it within the block
+				#if defined( __aarch64__ )
+				bool anyMatch = ( vmaxvq_u8( match ) != 0 );
+				#else
+				uint8x8_t folded = vorr_u8( vget_low_u8( match ), vget_high_u8( match ) );
+				bool anyMatch = ( vget_lane_u64( vreinterpret_u64_u8( folded ), 0 ) != 0 );
+				#endif
+				
+				if( anyMatch )
+				{
+					return ScanByteLoop( p, p + 18, thirdByteIn );
+				}
+			}
+			
+			return ScanSkipping( p, endIn, thirdByteIn );
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,295 @@
+// Includes
+#include "Mp4Box.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace mp4
+{
+	uint32_t ReadU32( const uint8_t *dataIn )
+	{
+		return ( (uint32_t)dataIn[ 0 ] << 24 ) | ( (uint32_t)dataIn[ 1 ] << 16 ) | ( (uint32_t)dataIn[ 2 ] << 8 ) | (uint32_t)dataIn[ 3 ];
+	}
+	
+	uint64_t ReadU64( const uint8_t *dataIn )
+	{
+		return ( (uint64_t)ReadU32( dataIn ) << 32 ) | (uint64_t)ReadU32( dataIn + 4 );
+	}
+	
+	void WriteU32( uint8_t *dataOut, uint32_t valueIn )
+	{
+		dataOut[ 0 ] = (uint8_t)( valueIn >> 24 );
+		dataOut[ 1 ] = (uint8_t)( valueIn >> 16 );
+		dataOut[ 2 ] = (uint8_t)( valueIn >> 8 );
+		dataOut[ 3 ] = (uint8_t)( valueIn );
+	}
+	
+	void WriteU64( uint8_t *dataOut, uint64_t valueIn )
+	{
+		WriteU32( dataOut, (uint32_t)( valueIn >> 32 ) );
+		WriteU32( dataOut + 4, (uint32_t)valueIn );
+	}
+	
+	bool ParseBox( const uint8_t *dataIn, size_t sizeIn, uint64_t offsetIn, TBox &boxOut )
+	{
+		if( offsetIn + 8 > sizeIn )
+		{
+			return false;
+		}
+		
+		uint64_t size 		= ReadU32( dataIn + offsetIn );
+		uint32_t headerSize = 8;
+		
+		if( size == 1 )
+		{
+			// 64-bit largesize follows the type
+			if( offsetIn + 16 > sizeIn )
+			{
+				return false;
+			}
+			
+			size 		= ReadU64( dataIn + offsetIn + 8 );
+			headerSize 	= 16;
+		}
+		else if( size == 0 )
+		{
+			// Box extends to the end of the data
+			size = sizeIn - offsetIn;
+		}
+		
+		if( size < headerSize || offsetIn + size > sizeIn )
+		{
+			return false;
+		}
+		
+		boxOut.m_type 		= ReadU32( dataIn + offsetIn + 4 );
+		boxOut.m_offset 	= offsetIn;
+		boxOut.m_size 		= size;
+		boxOut.m_headerSize = headerSize;
+		
+		return true;
+	}
+	
+	bool FindBox( const uint8_t *dataIn, size_t sizeIn, uint64_t beginIn, uint64_t endIn, uint32_t typeIn, TBox &boxOut )
+	{
+		uint64_t offset = beginIn;
+		
+		while( offset < endIn )
+		{
+			TBox box;
+			
+			if( !ParseBox( dataIn, endIn, offset, box ) )
+			{
+				return false;
+			}
+			
+			if( box.m_type == typeIn )
+			{
+				boxOut = box;
+				return true;
+			}
+			
+			offset = box.GetEnd();
+		}
+		
+		return false;
+	}
+	
+	bool GetBaseMediaDecodeTime( const uint8_t *moofIn, size_t sizeIn, uint64_t &timeOut )
+	{
+		TBox moof, traf, tfdt;
+		
+		if( !ParseBox( moofIn, sizeIn, 0, moof ) || moof.m_type != FourCC( 'm', 'o', 'o', 'f' ) )
+		{
+			return false;
+		}
+		
+		if( !FindBox( moofIn, sizeIn, moof.GetPayloadOffset(), moof.GetEnd(), FourCC( 't', 'r', 'a', 'f' ), traf )
+			|| !FindBox( moofIn, sizeIn, traf.GetPayloadOffset(), traf.GetEnd(), FourCC( 't', 'f', 'd', 't' ), tfdt ) )
+		{
+			return false;
+		}
+		
+		const uint8_t *payload 	= moofIn + tfdt.GetPayloadOffset();
+		const uint64_t size 	= tfdt.m_size - tfdt.m_headerSize;
+		
+		// Full box: version(1) + flags(3), then a 32 or 64-bit time depending on version
+		if( size < 4 || size < 4 + ( ( payload[ 0 ] == 1 ) ? 8u : 4u ) )
+		{
+			return false;
+		}
+		
+		timeOut = ( payload[ 0 ] == 1 ) ? ReadU64( payload + 4 ) : ReadU32( payload + 4 );
+		return true;
+	}
+	
+	bool GetTrackTimescale( const uint8_t *initIn, size_t sizeIn, uint32_t &timescaleOut )
+	{
+		TBox moov, trak, mdia, mdhd;
+		
+		if( !FindBox( initIn, sizeIn, 0, sizeIn, FourCC( 'm', 'o', 'o', 'v' ), moov )
+			|| !FindBox( initIn, sizeIn, moov.GetPayloadOffset(), moov.GetEnd(), FourCC( 't', 'r', 'a', 'k' ), trak )
+			|| !FindBox( initIn, sizeIn, trak.GetPayloadOffset(), trak.GetEnd(), FourCC( 'm', 'd', 'i', 'a' ), mdia )
+			|| !FindBox( initIn, sizeIn, mdia.GetPayloadOffset(), mdia.GetEnd(), FourCC( 'm', 'd', 'h', 'd' ), mdhd ) )
+		{
+			return false;
+		}
+		
+		const uint8_t *payload = initIn + mdhd.GetPayloadOffset();
+		
+		// Skip version/flags and the creation/modification times (64-bit in version 1)
+		timescaleOut = ReadU32( payload + 4 + ( ( payload[ 0 ] == 1 ) ? 16 : 8 ) );
+		return true;
+	}
+	
+	bool GetAvcCodecString( const uint8_t *initIn, size_t sizeIn, std::string &codecOut )
+	{
+		TBox moov, trak, mdia, minf, stbl, stsd, avc1, avcC;
+		
+		if( !FindBox( initIn, sizeIn, 0, sizeIn, FourCC( 'm', 'o', 'o', 'v' ), moov )
+			|| !FindBox( initIn, sizeIn, moov.GetPayloadOffset(), moov.GetEnd(), FourCC( 't', 'r', 'a', 'k' ), trak )
+			|| !FindBox( initIn, sizeIn, trak.GetPayloadOffset(), trak.GetEnd(), FourCC( 'm', 'd', 'i', 'a' ), mdia )
+			|| !FindBox( initIn, sizeIn, mdia.GetPayloadOffset(), mdia.GetEnd(), FourCC( 'm', 'i', 'n', 'f' ), minf )
+			|| !FindBox( initIn, sizeIn, minf.GetPayloadOffset(), minf.GetEnd(), FourCC( 's', 't', 'b', 'l' ), stbl )
+			|| !FindBox( initIn, sizeIn, stbl.GetPayloadOffset(), stbl.GetEnd(), FourCC( 's', 't', 's', 'd' ), stsd ) )
+		{
+			return false;
+		}
+		
+		// stsd is a full box with an entry count, avc1 has 78 bytes of visual sample entry fields ahead of its children
+		if( !FindBox( initIn, sizeIn, stsd.GetPayloadOffset() + 8, stsd.GetEnd(), FourCC( 'a', 'v', 'c', '1' ), avc1 )
+			|| !FindBox( initIn, sizeIn, avc1.GetPayloadOffset() + 78, avc1.GetEnd(), FourCC( 'a', 'v', 'c', 'C' ), avcC )
+			|| avcC.m_size - avcC.m_headerSize < 4 )
+		{
+			return false;
+		}
+		
+		// configurationVersion, then profile, constraint flags and level
+		const uint8_t *config = initIn + avcC.GetPayloadOffset();
+		char codec[ 16 ];
+		
+		snprintf( codec, sizeof( codec ), "avc1.%02x%02x%02x", config[ 1 ], config[ 2 ], config[ 3 ] );
+		codecOut = codec;
+		
+		return true;
+	}
+	
+	std::vector<uint8_t> RebuildInitWithEditList( const uint8_t *initIn, size_t sizeIn, uint64_t mediaTimeIn )
+	{
+		TBox moov, trak;
+		
+		if( !FindBox( initIn, sizeIn, 0, sizeIn, FourCC( 'm', 'o', 'o', 'v' ), moov )
+			|| !FindBox( initIn, sizeIn, moov.GetPayloadOffset(), moov.GetEnd(), FourCC( 't', 'r', 'a', 'k' ), trak ) )
+		{
+			// Nothing we know how to edit, use it as is
+			return std::vector<uint8_t>( initIn, initIn + sizeIn );
+		}
+		
+		// edts containing a version 1 elst with a single entry: unknown duration, starting at mediaTimeIn, rate 1
+		uint8_t edts[ 44 ] = { 0 };
+		
+		WriteU32( edts, sizeof( edts ) );
+		WriteU32( edts + 4, FourCC( 'e', 'd', 't', 's' ) );
+		WriteU32( edts + 8, sizeof( edts ) - 8 );
+		WriteU32( edts + 12, FourCC( 'e', 'l', 's', 't' ) );
+		edts[ 16 ] = 1;
+		WriteU32( edts + 20, 1 );
+		WriteU64( edts + 24, 0 );
+		WriteU64( edts + 32, mediaTimeIn );
+		edts[ 40 ] = 0;
+		edts[ 41 ] = 1;
+		
+		// Rebuild the trak without any existing edit list, inserting ours ahead of mdia
+		std::vector<uint8_t> trakPayload;
+		uint64_t offset = trak.GetPayloadOffset();
+		bool inserted = false;
+		
+		while( offset < trak.GetEnd() )
+		{
+			TBox child;
+			
+			if( !ParseBox( initIn, trak.GetEnd(), offset, child ) )
+			{
+				return std::vector<uint8_t>( initIn, initIn + sizeIn );
+			}
+			
+			if( child.m_type == FourCC( 'm', 'd', 'i', 'a' ) && !inserted )
+			{
+				trakPayload.insert( trakPayload.end(), edts, edts + sizeof( edts ) );
+				inserted = true;
+			}
+			
+			if( child.m_type != FourCC( 'e', 'd', 't', 's' ) )
+			{
+				trakPayload.insert( trakPayload.end(), initIn + child.m_offset, initIn + child.GetEnd() );
+			}
+			
+			offset = child.GetEnd();
+		}
+		
+		if( !inserted )
+		{
+			trakPayload.insert( trakPayload.end(), edts, edts + sizeof( edts ) );
+		}
+		
+		uint64_t trakSize = 8 + trakPayload.size();
+		uint64_t moovSize = moov.m_size - moov.m_headerSize + 8 - trak.m_size + trakSize;
+		
+		std::vector<uint8_t> result;
+		result.reserve( sizeIn + sizeof( edts ) );
+		
+		// Everything before moov (ftyp)
+		result.insert( result.end(), initIn, initIn + moov.m_offset );
+		
+		// moov header, then its children with the trak replaced
+		uint8_t header[ 8 ];
+		
+		WriteU32( header, (uint32_t)moovSize );
+		WriteU32( header + 4, FourCC( 'm', 'o', 'o', 'v' ) );
+		result.insert( result.end(), header, header + 8 );
+		
+		result.insert( result.end(), initIn + moov.GetPayloadOffset(), initIn + trak.m_offset );
+		
+		WriteU32( header, (uint32_t)trakSize );
+		WriteU32( header + 4, FourCC( 't', 'r', 'a', 'k' ) );
+		result.insert( result.end(), header, header + 8 );
+		result.insert( result.end(), trakPayload.begin(), trakPayload.end() );
+		
+		result.insert( result.end(), initIn + trak.GetEnd(), initIn + moov.GetEnd() );
+		
+		// Everything after moov
+		result.insert( result.end(), initIn + moov.GetEnd(), initIn + sizeIn );
+		
+		return result;
+	}
+
+	std::vector<uint8_t> BuildEventMessage( const std::string &schemeIdUriIn, const std::string &valueIn, uint32_t timescaleIn,
+											uint64_t presentationTimeIn, uint32_t durationIn, uint32_t idIn,
+											const uint8_t *dataIn, size_t sizeIn )
+	{
+		// Header, version/flags, timescale, presentation_time, event_duration, id, then the two strings with terminators
+		const size_t size = 8 + 4 + 4 + 8 + 4 + 4 + schemeIdUriIn.size() + 1 + valueIn.size() + 1 + sizeIn;
+		
+		std::vector<uint8_t> box( size, 0 );
+		uint8_t *out = box.data();
+		
+		WriteU32( out, (uint32_t)size );
+		WriteU32( out + 4, FourCC( 'e', 'm', 's', 'g' ) );
+		out[ 8 ] = 1;
+		WriteU32( out + 12, timescaleIn );
+		WriteU64( out + 16, presentationTimeIn );
+		WriteU32( out + 24, durationIn );
+		WriteU32( out + 28, idIn );
+		out += 32;
+		
+		std::copy( schemeIdUriIn.begin(), schemeIdUriIn.end(), out );
+		out += schemeIdUriIn.size() + 1;
+		
+		std::copy( valueIn.begin(), valueIn.end(), out );
+		out += valueIn.size() + 1;
+		
+		std::copy( dataIn, dataIn + sizeIn, out );
+		
+		return box;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+
+// Minimal ISO BMFF box helpers for working with our own fragmented MP4 output without libavformat
+namespace mp4
+{
+	struct TBox
+	{
+		uint32_t 	m_type			= 0;
+		uint64_t 	m_offset		= 0;	// Offset of the box header
+		uint64_t 	m_size			= 0;	// Total size including the header
+		uint32_t 	m_headerSize	= 0;
+		
+		uint64_t GetPayloadOffset() const { return m_offset + m_headerSize; }
+		uint64_t GetEnd() const { return m_offset + m_size; }
+	};
+	
+	constexpr uint32_t FourCC( char a, char b, char c, char d )
+	{
+		return ( (uint32_t)a << 24 ) | ( (uint32_t)b << 16 ) | ( (uint32_t)c << 8 ) | (uint32_t)d;
+	}
+	
+	uint32_t ReadU32( const uint8_t *dataIn );
+	uint64_t ReadU64( const uint8_t *dataIn );
+	void WriteU32( uint8_t *dataOut, uint32_t valueIn );
+	void WriteU64( uint8_t *dataOut, uint64_t valueIn );
+	
+	// Parses the box header at offsetIn. Returns false if the header or box is truncated.
+	bool ParseBox( const uint8_t *dataIn, size_t sizeIn, uint64_t offsetIn, TBox &boxOut );
+	
+	// Finds the first box of the given type in [beginIn, endIn)
+	bool FindBox( const uint8_t *dataIn, size_t sizeIn, uint64_t beginIn, uint64_t endIn, uint32_t typeIn, TBox &boxOut );
+	
+	// moof/traf/tfdt baseMediaDecodeTime of a fragment. False if any of them is missing or truncated.
+	bool GetBaseMediaDecodeTime( const uint8_t *moofIn, size_t sizeIn, uint64_t &timeOut );
+	
+	// moov/trak/mdia/mdhd timescale of the (only) track in an init segment
+	bool GetTrackTimescale( const uint8_t *initIn, size_t sizeIn, uint32_t &timescaleOut );
+	
+	// RFC 6381 codecs parameter (e.g. avc1.42c01e) from the avcC of an H264 init segment, for MSE clients
+	bool GetAvcCodecString( const uint8_t *initIn, size_t sizeIn, std::string &codecOut );
+	
+	// Copy of an init segment whose track carries an edit list starting presentation at mediaTimeIn,
+	// so a file cut from the middle of a recording plays from zero
+	std::vector<uint8_t> RebuildInitWithEditList( const uint8_t *initIn, size_t sizeIn, uint64_t mediaTimeIn );
+	
+	// Version 1 event message box (emsg), with an absolute presentation time on the track's timeline
+	std::vector<uint8_t> BuildEventMessage( const std::string &schemeIdUriIn, const std::string &valueIn, uint32_t timescaleIn,
+											uint64_t presentationTimeIn, uint32_t durationIn, uint32_t idIn,
+											const uint8_t *dataIn, size_t sizeIn );
+}
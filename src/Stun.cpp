@@ -0,0 +1,175 @@
+// Includes
+#include "Stun.h"
+
+#include <cstring>
+
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+
+extern "C"
+{
+	// FFmpeg
+	#include <libavutil/crc.h>
+}
+
+namespace stun
+{
+	namespace
+	{
+		const uint16_t 	k_bindingRequest 		= 0x0001;
+		const uint16_t 	k_bindingSuccess 		= 0x0101;
+		
+		const uint16_t 	k_attrUsername 			= 0x0006;
+		const uint16_t 	k_attrMessageIntegrity 	= 0x0008;
+		const uint16_t 	k_attrXorMappedAddress 	= 0x0020;
+		const uint16_t 	k_attrUseCandidate 		= 0x0025;
+		const uint16_t 	k_attrFingerprint 		= 0x8028;
+		
+		const size_t 	k_integritySize 		= 20;
+		const uint32_t 	k_fingerprintXor 		= 0x5354554E;
+		
+		uint16_t Read16( const uint8_t *dataIn )
+		{
+			return (uint16_t)( ( dataIn[ 0 ] << 8 ) | dataIn[ 1 ] );
+		}
+		
+		uint32_t Read32( const uint8_t *dataIn )
+		{
+			return ( (uint32_t)dataIn[ 0 ] << 24 ) | ( dataIn[ 1 ] << 16 ) | ( dataIn[ 2 ] << 8 ) | dataIn[ 3 ];
+		}
+		
+		void Write16( uint8_t *dataOut, uint16_t valueIn )
+		{
+			dataOut[ 0 ] = (uint8_t)( valueIn >> 8 );
+			dataOut[ 1 ] = (uint8_t)valueIn;
+		}
+		
+		void Write32( uint8_t *dataOut, uint32_t valueIn )
+		{
+			Write16( dataOut, (uint16_t)( valueIn >> 16 ) );
+			Write16( dataOut + 2, (uint16_t)valueIn );
+		}
+		
+		// Appends an attribute header and reserves its value, padded to 4 bytes. Returns the offset of the value.
+		size_t AddAttribute( std::vector<uint8_t> &messageIn, uint16_t typeIn, size_t sizeIn )
+		{
+			size_t offset = messageIn.size();
+			
+			messageIn.resize( offset + 4 + ( ( sizeIn + 3 ) & ~(size_t)3 ), 0 );
+			Write16( &messageIn[ offset ], typeIn );
+			Write16( &messageIn[ offset + 2 ], (uint16_t)sizeIn );
+			
+			return offset + 4;
+		}
+		
+		// Offset of the first attribute of the given type, or 0
+		size_t FindAttribute( const uint8_t *dataIn, size_t sizeIn, uint16_t typeIn )
+		{
+			size_t offset = k_headerSize;
+			
+			while( offset + 4 <= sizeIn )
+			{
+				uint16_t type 	= Read16( dataIn + offset );
+				size_t length 	= Read16( dataIn + offset + 2 );
+				
+				if( offset + 4 + length > sizeIn )
+				{
+					return 0;
+				}
+				
+				if( type == typeIn )
+				{
+					return offset;
+				}
+				
+				offset += 4 + ( ( length + 3 ) & ~(size_t)3 );
+			}
+			
+			return 0;
+		}
+		
+		void ComputeIntegrity( const uint8_t *dataIn, size_t sizeIn, const std::string &passwordIn, uint8_t *integrityOut )
+		{
+			unsigned int integritySize = k_integritySize;
+			
+			HMAC( EVP_sha1(), passwordIn.data(), (int)passwordIn.size(), dataIn, sizeIn, integrityOut, &integritySize );
+		}
+	}
+	
+	bool IsStun( const uint8_t *dataIn, size_t sizeIn )
+	{
+		return sizeIn >= k_headerSize && dataIn[ 0 ] < 4 && Read32( dataIn + 4 ) == k_magicCookie;
+	}
+	
+	bool ParseBindingRequest( const uint8_t *dataIn, size_t sizeIn, TBindingRequest &requestOut )
+	{
+		if( !IsStun( dataIn, sizeIn ) || Read16( dataIn ) != k_bindingRequest || k_headerSize + Read16( dataIn + 2 ) != sizeIn )
+		{
+			return false;
+		}
+		
+		memcpy( requestOut.m_transactionId, dataIn + 8, sizeof( requestOut.m_transactionId ) );
+		
+		size_t username = FindAttribute( dataIn, sizeIn, k_attrUsername );
+		
+		if( username == 0 )
+		{
+			return false;
+		}
+		
+		requestOut.m_username.assign( (const char*)dataIn + username + 4, Read16( dataIn + username + 2 ) );
+		requestOut.m_useCandidate = ( FindAttribute( dataIn, sizeIn, k_attrUseCandidate ) != 0 );
+		
+		return true;
+	}
+	
+	bool CheckIntegrity( const uint8_t *dataIn, size_t sizeIn, const std::string &passwordIn )
+	{
+		size_t integrity = FindAttribute( dataIn, sizeIn, k_attrMessageIntegrity );
+		
+		if( integrity == 0 || Read16( dataIn + integrity + 2 ) != k_integritySize )
+		{
+			return false;
+		}
+		
+		// The HMAC covers everything before the attribute, with the length field as if the message ended after it
+		std::vector<uint8_t> signedPart( dataIn, dataIn + integrity );
+		Write16( &signedPart[ 2 ], (uint16_t)( integrity + 4 + k_integritySize - k_headerSize ) );
+		
+		uint8_t expected[ k_integritySize ];
+		ComputeIntegrity( signedPart.data(), signedPart.size(), passwordIn, expected );
+		
+		return CRYPTO_memcmp( expected, dataIn + integrity + 4, k_integritySize ) == 0;
+	}
+	
+	std::vector<uint8_t> BuildBindingResponse( const TBindingRequest &requestIn, const sockaddr_in &addressIn, const std::string &passwordIn )
+	{
+		std::vector<uint8_t> message( k_headerSize, 0 );
+		
+		Write16( &message[ 0 ], k_bindingSuccess );
+		Write32( &message[ 4 ], k_magicCookie );
+		memcpy( &message[ 8 ], requestIn.m_transactionId, sizeof( requestIn.m_transactionId ) );
+		
+		// Port and address are XORed with the magic cookie. Both are already in network order.
+		size_t mapped = AddAttribute( message, k_attrXorMappedAddress, 8 );
+		uint32_t address = ntohl( addressIn.sin_addr.s_addr );
+		
+		message[ mapped + 1 ] = 0x01;		// IPv4
+		Write16( &message[ mapped + 2 ], (uint16_t)( ntohs( addressIn.sin_port ) ^ ( k_magicCookie >> 16 ) ) );
+		Write32( &message[ mapped + 4 ], address ^ k_magicCookie );
+		
+		// Each trailer covers the message up to itself, with the length already counting it
+		size_t integrity = AddAttribute( message, k_attrMessageIntegrity, k_integritySize );
+		Write16( &message[ 2 ], (uint16_t)( message.size() - k_headerSize ) );
+		ComputeIntegrity( message.data(), integrity - 4, passwordIn, &message[ integrity ] );
+		
+		size_t fingerprint = AddAttribute( message, k_attrFingerprint, 4 );
+		Write16( &message[ 2 ], (uint16_t)( message.size() - k_headerSize ) );
+		
+		uint32_t crc = av_crc( av_crc_get_table( AV_CRC_32_IEEE_LE ), 0xFFFFFFFF, message.data(), fingerprint - 4 ) ^ 0xFFFFFFFF;
+		Write32( &message[ fingerprint ], crc ^ k_fingerprintXor );
+		
+		return message;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Includes
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+// The small part of STUN (RFC 5389) an ICE-lite agent needs: answering the browser's Binding requests, which are
+// both its connectivity checks and, once media flows, its consent refreshes (RFC 7675).
+namespace stun
+{
+	const size_t 	k_headerSize 		= 20;
+	const uint32_t 	k_magicCookie 		= 0x2112A442;
+	
+	struct TBindingRequest
+	{
+		uint8_t 		m_transactionId[ 12 ];
+		std::string 	m_username;					// "<our ufrag>:<their ufrag>"
+		bool 			m_useCandidate		= false;	// The browser nominated this pair
+	};
+	
+	// First byte 0-3 and the magic cookie in place. Enough to tell STUN from DTLS and SRTP on a shared port (RFC 7983).
+	bool IsStun( const uint8_t *dataIn, size_t sizeIn );
+	
+	// False for anything that isn't a well formed Binding request
+	bool ParseBindingRequest( const uint8_t *dataIn, size_t sizeIn, TBindingRequest &requestOut );
+	
+	// Checks MESSAGE-INTEGRITY with the short term password (our ice-pwd)
+	bool CheckIntegrity( const uint8_t *dataIn, size_t sizeIn, const std::string &passwordIn );
+	
+	// Binding success response carrying the address the request came from, signed with our ice-pwd
+	std::vector<uint8_t> BuildBindingResponse( const TBindingRequest &requestIn, const sockaddr_in &addressIn, const std::string &passwordIn );
+}
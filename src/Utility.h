@@ -3,6 +3,11 @@
 // Includes
 #include <memory>
 
+#if defined( __arm__ )
+	#include <sys/auxv.h>
+	#include <asm/hwcap.h>
+#endif
+
 namespace util
 {
 	// Correlary to make_shared
@@ -11,4 +16,17 @@ namespace util
 	{
 		return std::unique_ptr<T>( new T( std::forward<Args>(args)... ) );
 	}
+	
+	#if defined( __arm__ ) || defined( __aarch64__ )
+	// NEON is optional on 32-bit ARM, so the kernels built for it are only used if the kernel reports it. It is part of the
+	// base architecture on 64-bit ARM.
+	inline bool CpuHasNeon()
+	{
+		#if defined( __aarch64__ )
+		return true;
+		#else
+		return ( getauxval( AT_HWCAP ) & HWCAP_NEON ) != 0;
+		#endif
+	}
+	#endif
 }
\ No newline at end of file
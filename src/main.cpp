@@ -1,11 +1,240 @@
 // Includes
 #include "Utility.h"
 #include "CGeomux.h"
+#include "CRemuxApp.h"
+#include "CScanBenchmarkApp.h"
+#include "CFecBenchmarkApp.h"
+#include "CRecordBenchmarkApp.h"
+#include "CSubscriberSimApp.h"
 
 #include "OptionParser.h"
 
+namespace
+{
+	enum EOptionIndex
+	{
+		UNKNOWN,
+		HELP,
+		REMUX,
+		OUTPUT,
+		FRAMERATE,
+		BENCHMARK_SCAN,
+		BENCHMARK_FEC,
+		BENCHMARK_RECORD,
+		SIMULATE_SUBSCRIBERS,
+		HTTP_PORT,
+		RTSP_PORT,
+		WEBRTC_PORT,
+		PACE_RATE
+	};
+	
+	option::ArgStatus RequiredArg( const option::Option &optionIn, bool printErrorIn )
+	{
+		if( optionIn.arg != nullptr && optionIn.arg[ 0 ] != 0 )
+		{
+			return option::ARG_OK;
+		}
+		
+		if( printErrorIn )
+		{
+			std::cerr << "Option '" << std::string( optionIn.name, optionIn.namelen ) << "' requires an argument" << std::endl;
+		}
+		
+		return option::ARG_ILLEGAL;
+	}
+	
+	// Leaves portOut alone if the option wasn't given
+	bool ParsePort( const option::Option &optionIn, uint16_t &portOut )
+	{
+		if( !optionIn )
+		{
+			return true;
+		}
+		
+		try
+		{
+			int port = std::stoi( optionIn.arg );
+			
+			if( port > 0 && port <= 65535 )
+			{
+				portOut = (uint16_t)port;
+				return true;
+			}
+		}
+		catch( const std::exception & )
+		{
+		}
+		
+		std::cerr << "Invalid port for '" << std::string( optionIn.name, optionIn.namelen ) << "': " << optionIn.arg << std::endl;
+		return false;
+	}
+	
+	// Given in kbit/s. Leaves rate_bpsOut alone if the option wasn't given.
+	bool ParseRate( const option::Option &optionIn, uint64_t &rate_bpsOut )
+	{
+		if( !optionIn )
+		{
+			return true;
+		}
+		
+		try
+		{
+			long long rate = std::stoll( optionIn.arg );
+			
+			if( rate > 0 && rate <= 10000000 )
+			{
+				rate_bpsOut = (uint64_t)rate * 1000;
+				return true;
+			}
+		}
+		catch( const std::exception & )
+		{
+		}
+		
+		std::cerr << "Invalid rate for '" << std::string( optionIn.name, optionIn.namelen ) << "': " << optionIn.arg << std::endl;
+		return false;
+	}
+	
+	const option::Descriptor k_usage[] =
+	{
+		{ UNKNOWN, 		0, "", 	"", 			option::Arg::None, 	"Usage: geomuxpp [options] [cameraOffset]\n\nOptions:" },
+		{ HELP, 		0, "h", "help", 		option::Arg::None, 	"  --help, -h \tPrint usage and exit." },
+		{ REMUX, 		0, "", 	"remux", 		RequiredArg, 		"  --remux=<file> \tMux a raw H264 (Annex-B) or MJPEG capture as fast as possible, then exit." },
+		{ OUTPUT, 		0, "", 	"output", 		RequiredArg, 		"  --output=<file|endpoint> \tRemux output. A ZMQ endpoint (e.g. ipc:///tmp/remux.ipc) publishes instead of writing a file. Defaults to <input>.mp4." },
+		{ FRAMERATE, 	0, "", 	"framerate", 	RequiredArg, 		"  --framerate=<fps> \tFramerate used to timestamp remuxed frames. Defaults to 30." },
+		{ BENCHMARK_SCAN, 	0, "", 	"benchmark-scan", RequiredArg, 		"  --benchmark-scan=<file> \tTime the H264 start code scanners over a raw H264 capture, then exit." },
+		{ BENCHMARK_FEC, 	0, "", 	"benchmark-fec", RequiredArg, 		"  --benchmark-fec=<file> \tTime the FEC encoder and simulate bursty packet loss on a raw H264 capture, then exit." },
+		{ BENCHMARK_RECORD, 	0, "", 	"benchmark-record", RequiredArg, 	"  --benchmark-record=<dir> \tMeasure sustained recording throughput into a directory for 1, 2 and 4 channels at once, then exit." },
+		{ SIMULATE_SUBSCRIBERS, 0, "", "simulate-subscribers", option::Arg::None, "  --simulate-subscribers \tFeed a synthetic stream to fast, slow and stalling subscribers over the queued ZMQ delivery path and check none see a broken GOP, then exit." },
+		{ HTTP_PORT, 	0, "", 	"http-port", 	RequiredArg, 		"  --http-port=<port> \tServe live fMP4 to browsers over HTTP/WebSocket on this port. Disabled by default." },
+		{ RTSP_PORT, 	0, "", 	"rtsp-port", 	RequiredArg, 		"  --rtsp-port=<port> \tServe H264 channels over RTSP (RTP over UDP or interleaved TCP) on this port. Disabled by default." },
+		{ WEBRTC_PORT, 	0, "", 	"webrtc-port", 	RequiredArg, 		"  --webrtc-port=<port> \tServe H264 channels to browsers over WebRTC: SDP offer/answer over HTTP on this TCP port, media on the same UDP port. Disabled by default." },
+		{ PACE_RATE, 	0, "", 	"pace-rate", 	RequiredArg, 		"  --pace-rate=<kbit/s> \tSpread each frame's RTSP and WebRTC UDP packets out at this peak rate, shared by both, instead of sending them in one burst. Off by default." },
+		{ 0, 0, 0, 0, 0, 0 }
+	};
+}
+
 int main( int argc, char* argv[] )
 {	
+	// Skip the program name
+	option::Stats stats( k_usage, argc - 1, (const char**)( argv + 1 ) );
+	std::vector<option::Option> options( stats.options_max );
+	std::vector<option::Option> buffer( stats.buffer_max );
+	option::Parser parse( k_usage, argc - 1, (const char**)( argv + 1 ), options.data(), buffer.data() );
+	
+	if( parse.error() || options[ UNKNOWN ] )
+	{
+		option::printUsage( std::cerr, k_usage );
+		return 1;
+	}
+	
+	if( options[ HELP ] )
+	{
+		option::printUsage( std::cout, k_usage );
+		return 0;
+	}
+	
+	if( options[ BENCHMARK_SCAN ] )
+	{
+		try
+		{
+			std::unique_ptr<CApp> app = util::make_unique<CScanBenchmarkApp>( argc, argv, std::string( options[ BENCHMARK_SCAN ].arg ) );
+			
+			app->Run();
+		}
+		catch( const std::exception &e )
+		{
+			std::cerr << "Exception in main: " << e.what() << std::endl;
+			return 1;
+		}
+		
+		return 0;
+	}
+	
+	if( options[ BENCHMARK_FEC ] )
+	{
+		try
+		{
+			std::unique_ptr<CApp> app = util::make_unique<CFecBenchmarkApp>( argc, argv, std::string( options[ BENCHMARK_FEC ].arg ) );
+			
+			app->Run();
+		}
+		catch( const std::exception &e )
+		{
+			std::cerr << "Exception in main: " << e.what() << std::endl;
+			return 1;
+		}
+		
+		return 0;
+	}
+	
+	if( options[ BENCHMARK_RECORD ] )
+	{
+		try
+		{
+			std::unique_ptr<CApp> app = util::make_unique<CRecordBenchmarkApp>( argc, argv, std::string( options[ BENCHMARK_RECORD ].arg ) );
+			
+			app->Run();
+		}
+		catch( const std::exception &e )
+		{
+			std::cerr << "Exception in main: " << e.what() << std::endl;
+			return 1;
+		}
+		
+		return 0;
+	}
+	
+	if( options[ SIMULATE_SUBSCRIBERS ] )
+	{
+		try
+		{
+			std::unique_ptr<CApp> app = util::make_unique<CSubscriberSimApp>( argc, argv );
+			
+			app->Run();
+		}
+		catch( const std::exception &e )
+		{
+			std::cerr << "Exception in main: " << e.what() << std::endl;
+			return 1;
+		}
+		
+		return 0;
+	}
+	
+	if( options[ REMUX ] )
+	{
+		try
+		{
+			const std::string input( options[ REMUX ].arg );
+			const std::string output( options[ OUTPUT ] ? options[ OUTPUT ].arg : input + ".mp4" );
+			float framerate = ( options[ FRAMERATE ] ? std::stof( options[ FRAMERATE ].arg ) : 30.0f );
+			
+			std::unique_ptr<CApp> app = util::make_unique<CRemuxApp>( argc, argv, input, output, framerate );
+			
+			app->Run();
+		}
+		catch( const std::exception &e )
+		{
+			std::cerr << "Exception in main: " << e.what() << std::endl;
+			return 1;
+		}
+		
+		return 0;
+	}
+	
+	const std::string cameraOffset( ( parse.nonOptionsCount() > 0 ) ? parse.nonOption( 0 ) : "0" );
+	uint16_t httpPort = 0;
+	uint16_t rtspPort = 0;
+	uint16_t webRtcPort = 0;
+	uint64_t paceRate_bps = 0;
+	
+	if( !ParsePort( options[ HTTP_PORT ], httpPort ) || !ParsePort( options[ RTSP_PORT ], rtspPort ) || !ParsePort( options[ WEBRTC_PORT ], webRtcPort )
+		|| !ParseRate( options[ PACE_RATE ], paceRate_bps ) )
+	{
+		return 1;
+	}
+	
 	bool restart = false;
 	
 	do
@@ -16,7 +245,7 @@ int main( int argc, char* argv[] )
 		try
 		{
 			// Create the application
-			std::unique_ptr<CApp> app = util::make_unique<CGeomux>( argc, argv );
+			std::unique_ptr<CApp> app = util::make_unique<CGeomux>( argc, argv, cameraOffset, httpPort, rtspPort, webRtcPort, paceRate_bps );
 		
 			// Run the application
 			app->Run();